@@ -314,6 +314,101 @@ esl_dst_XJukesCantor(const ESL_ALPHABET *abc, const ESL_DSQ *ax, const ESL_DSQ *
   return status;
 }
 
+/* Function:  esl_dst_XMask()
+ * Synopsis:  Prepare an aligned digital seq for fast identity counting.
+ *
+ * Purpose:   Copy the <alen> residues of aligned digital sequence
+ *            <ax> (indexed <1..alen>) into <mx> (indexed <0..alen-1>),
+ *            replacing every residue that is not canonical in
+ *            alphabet <abc> (gaps, degeneracies, missing data) by
+ *            <eslDSQ_SENTINEL>. The number of canonical residues is
+ *            returned in <opt_n>.
+ *
+ *            Masked sequences are compared by
+ *            <esl_dst_XMaskedIdents()>, which does in a tight
+ *            alphabet-free loop what <esl_dst_XPairId()> does with
+ *            per-residue alphabet lookups. Masking each sequence
+ *            once and comparing the masks pays off whenever a
+ *            sequence takes part in more than a few comparisons, as
+ *            in distance matrices and clustering.
+ *
+ * Args:      abc   - digital alphabet in use
+ *            ax    - aligned digital seq, 1..alen
+ *            alen  - length of <ax>
+ *            mx    - RETURN: masked seq; caller provides <alen> bytes
+ *            opt_n - optRETURN: number of canonical residues in <ax>
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <ax> is not <alen> residues long.
+ */
+int
+esl_dst_XMask(const ESL_ALPHABET *abc, const ESL_DSQ *ax, int alen, ESL_DSQ *mx, int *opt_n)
+{
+  int n = 0;
+  int i;
+
+  for (i = 0; i < alen; i++)
+    {
+      if (ax[i+1] == eslDSQ_SENTINEL) ESL_EXCEPTION(eslEINVAL, "strings not same length, not aligned");
+      if (esl_abc_XIsCanonical(abc, ax[i+1])) { mx[i] = ax[i+1]; n++; }
+      else                                      mx[i] = eslDSQ_SENTINEL;
+    }
+  if (ax[alen+1] != eslDSQ_SENTINEL) ESL_EXCEPTION(eslEINVAL, "strings not same length, not aligned");
+
+  if (opt_n != NULL) *opt_n = n;
+  return eslOK;
+}
+
+/* Function:  esl_dst_XMaskedIdents()
+ * Synopsis:  Count identities between two masked aligned seqs.
+ *
+ * Purpose:   Count the aligned positions at which masked sequences
+ *            <mx1> and <mx2> (both of length <alen>, as made by
+ *            <esl_dst_XMask()>) have the same canonical residue, and
+ *            return that count. This is the <nid> of
+ *            <esl_dst_XPairId()>.
+ *
+ *            If <need> is greater than zero, the caller only wants
+ *            to know whether there are at least <need> identities,
+ *            and the count may stop early: as soon as <need>
+ *            identities have been seen, or as soon as the remaining
+ *            columns can no longer supply them. The value returned
+ *            is then only guaranteed to be <>= need> exactly when
+ *            the full count is. With <need> of 0, the full count is
+ *            always returned.
+ *
+ *            The count is done in fixed-size blocks of columns, with
+ *            a branch-free inner loop that the compiler can
+ *            vectorize; the early-stop test is made only between
+ *            blocks.
+ *
+ * Args:      mx1   - masked aligned seq 1, 0..alen-1
+ *            mx2   - masked aligned seq 2, 0..alen-1
+ *            alen  - length of both seqs
+ *            need  - stop once it is decided whether >= <need> identities; 0 to count all
+ *
+ * Returns:   the (possibly partial) number of identities.
+ */
+int
+esl_dst_XMaskedIdents(const ESL_DSQ *mx1, const ESL_DSQ *mx2, int alen, int need)
+{
+  int idents = 0;
+  int n;
+  int i, j, end;
+
+  for (i = 0; i < alen; i = end)
+    {
+      end = ESL_MIN(alen, i + eslDST_MASKBLOCK);
+      for (n = 0, j = i; j < end; j++)
+	n += (mx1[j] == mx2[j]) & (mx1[j] != eslDSQ_SENTINEL);
+      idents += n;
+
+      if (need > 0 && (idents >= need || idents + (alen - end) < need)) break;
+    }
+  return idents;
+}
+
 #endif /*eslAUGMENT_ALPHABET*/
 /*---------- end pairwise distances, digital seqs --------------*/
 
@@ -518,7 +613,10 @@ esl_dst_CJukesCantorMx(int K, char **aseq, int nseq,
  * Purpose:   Given a digitized multiple sequence alignment <ax>, consisting
  *            of <N> aligned digital sequences in alphabet <abc>; calculate
  *            a symmetric pairwise fractional identity matrix by $N(N-1)/2$
- *            calls to <esl_dst_XPairId()>, and return it in <ret_S>.
+ *            pairwise comparisons, and return it in <ret_S>. Identities
+ *            are the same as <esl_dst_XPairId()>'s; each seq is masked
+ *            once with <esl_dst_XMask()> and pairs are compared with
+ *            <esl_dst_XMaskedIdents()>.
  *            
  * Args:      abc   - digital alphabet in use
  *            ax    - aligned dsq's, [0..N-1][1..alen]                  
@@ -537,26 +635,45 @@ int
 esl_dst_XPairIdMx(const ESL_ALPHABET *abc,  ESL_DSQ **ax, int N, ESL_DMATRIX **ret_S)
 {
   int status;
-  ESL_DMATRIX *S = NULL;
+  ESL_DMATRIX *S   = NULL;
+  ESL_DSQ     *mx  = NULL;	/* masked seqs, [0..N-1][0..alen-1], one block */
+  int         *len = NULL;	/* canonical residue counts, [0..N-1]          */
+  int64_t      alen;
   int i,j;
 
   if (( S = esl_dmatrix_Create(N,N) ) == NULL) goto ERROR;
+  if (N == 0) goto DONE;
+
+  /* Mask each seq once, so the N(N-1)/2 comparisons don't repeat the
+   * alphabet lookups; identities come out as in esl_dst_XPairId().
+   */
+  alen = esl_abc_dsqlen(ax[0]);
+  ESL_ALLOC(mx,  sizeof(ESL_DSQ) * N * ESL_MAX(alen, 1));
+  ESL_ALLOC(len, sizeof(int)     * N);
+  for (i = 0; i < N; i++)
+    if ((status = esl_dst_XMask(abc, ax[i], alen, mx + (int64_t) i * alen, &(len[i]))) != eslOK)
+      ESL_XEXCEPTION(status, "Pairwise identity calculation failed at seq %d\n", i);
   
   for (i = 0; i < N; i++)
     {
       S->mx[i][i] = 1.;
       for (j = i+1; j < N; j++)
 	{
-	  status = esl_dst_XPairId(abc, ax[i], ax[j], &(S->mx[i][j]), NULL, NULL);
-	  if (status != eslOK)
-	    ESL_XEXCEPTION(status, "Pairwise identity calculation failed at seqs %d,%d\n", i,j);
+	  S->mx[i][j] = esl_dst_XMaskedIdents(mx + (int64_t) i * alen, mx + (int64_t) j * alen, alen, 0);
+	  S->mx[i][j] = (ESL_MIN(len[i], len[j]) == 0 ? 0. : S->mx[i][j] / (double) ESL_MIN(len[i], len[j]));
 	  S->mx[j][i] =  S->mx[i][j];
 	}
     }
+
+ DONE:
+  free(mx);
+  free(len);
   if (ret_S != NULL) *ret_S = S; else esl_dmatrix_Destroy(S);
   return eslOK;
 
  ERROR:
+  if (mx    != NULL)  free(mx);
+  if (len   != NULL)  free(len);
   if (S     != NULL)  esl_dmatrix_Destroy(S);
   if (ret_S != NULL) *ret_S = NULL;
   return status;
@@ -1040,6 +1157,44 @@ utest_XJukesCantor(ESL_ALPHABET *abc, char **as, ESL_DSQ **ax, int N)
   return eslOK;
 
 }
+
+/* Masked identity counts agree with esl_dst_XPairId(), and an early-stopping
+ * count with threshold <need> agrees with the full count about reaching it.
+ * Rows are laid end to end in a long pair of masked seqs, so the count
+ * runs over several blocks.
+ */
+static int
+utest_XMaskedIdents(ESL_ALPHABET *abc, ESL_DSQ **ax, int N)
+{
+  ESL_DSQ *mx1 = NULL;
+  ESL_DSQ *mx2 = NULL;
+  int      L   = esl_abc_dsqlen(ax[0]);
+  int      nid, nres, n1, n2;
+  int      total, need;
+  int      i;
+
+  if ((mx1 = malloc(sizeof(ESL_DSQ) * N * L)) == NULL) abort();
+  if ((mx2 = malloc(sizeof(ESL_DSQ) * N * L)) == NULL) abort();
+
+  total = 0;
+  for (i = 0; i < N; i++)
+    {
+      if (esl_dst_XMask(abc, ax[i],       L, mx1 + i*L, &n1) != eslOK) abort();
+      if (esl_dst_XMask(abc, ax[(i+1)%N], L, mx2 + i*L, &n2) != eslOK) abort();
+      if (esl_dst_XPairId(abc, ax[i], ax[(i+1)%N], NULL, &nid, &nres) != eslOK) abort();
+      if (ESL_MIN(n1, n2) != nres)                                abort();
+      if (esl_dst_XMaskedIdents(mx1 + i*L, mx2 + i*L, L, 0) != nid) abort();
+      total += nid;
+    }
+  if (esl_dst_XMaskedIdents(mx1, mx2, N*L, 0) != total) abort();
+
+  for (need = 1; need <= N*L; need++)
+    if ((esl_dst_XMaskedIdents(mx1, mx2, N*L, need) >= need) != (total >= need)) abort();
+
+  free(mx1);
+  free(mx2);
+  return eslOK;
+}
 #endif /*eslAUGMENT_ALPHABET*/
 
 
@@ -1288,6 +1443,7 @@ main(int argc, char **argv)
 #ifdef eslAUGMENT_ALPHABET
   if (utest_XPairId(abc, as, ax, N)      != eslOK) return eslFAIL;
   if (utest_XJukesCantor(abc, as, ax, N) != eslOK) return eslFAIL;
+  if (utest_XMaskedIdents(abc, ax, N)    != eslOK) return eslFAIL;
 #endif /*eslAUGMENT_ALPHABET*/
 
 #ifdef eslAUGMENT_DMATRIX
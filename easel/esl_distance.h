@@ -19,6 +19,11 @@
 #include "esl_random.h"  
 #endif
 
+/* esl_dst_XMaskedIdents() counts identities in blocks of this many
+ * columns, deciding between blocks whether it can stop early.
+ */
+#define eslDST_MASKBLOCK 256
+
 /* 1. Pairwise distances for aligned text sequences.
  */
 extern int esl_dst_CPairId(const char *asq1, const char *asq2, 
@@ -33,6 +38,8 @@ extern int esl_dst_XPairId(const ESL_ALPHABET *abc, const ESL_DSQ *ax1, const ES
 			   double *opt_pid, int *opt_nid, int *opt_n);
 extern int esl_dst_XJukesCantor(const ESL_ALPHABET *abc, const ESL_DSQ *ax, const ESL_DSQ *ay, 
 				double *opt_distance, double *opt_variance);
+extern int esl_dst_XMask(const ESL_ALPHABET *abc, const ESL_DSQ *ax, int alen, ESL_DSQ *mx, int *opt_n);
+extern int esl_dst_XMaskedIdents(const ESL_DSQ *mx1, const ESL_DSQ *mx2, int alen, int need);
 #endif
 
 
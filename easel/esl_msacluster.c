@@ -20,6 +20,8 @@
  */
 #include "esl_config.h"
 
+#include <math.h>
+
 #include "easel.h"
 #include "esl_cluster.h"
 #include "esl_distance.h"
@@ -45,16 +47,32 @@ static double squid_xdistance(ESL_ALPHABET *a, ESL_DSQ *x1, ESL_DSQ *x2);
  */
 static int msacluster_clinkage(const void *v1, const void *v2, const void *p, int *ret_link);
 #ifdef eslAUGMENT_ALPHABET
+#if defined(eslMSACLUSTER_REGRESSION) || defined(eslMSAWEIGHT_REGRESSION)
 static int msacluster_xlinkage(const void *v1, const void *v2, const void *p, int *ret_link);
+#else
+static int msacluster_mlinkage(const void *v1, const void *v2, const void *p, int *ret_link);
+static int msacluster_mneed(double maxid, int minlen);
+#endif
 #endif
 
 /* In digital mode, we'll need to pass the clustering routine two parameters -
  * %id threshold and alphabet ptr - so make a structure that bundles them.
+ * The alignment length is needed too when the seqs are masked (below).
  */
 #ifdef eslAUGMENT_ALPHABET
 struct msa_param_s {
   double        maxid;
   ESL_ALPHABET *abc;
+  int64_t       alen;
+};
+
+/* In digital mode, each aligned seq is masked once with
+ * esl_dst_XMask(), and the clustering routine is handed these 
+ * instead of the raw ax[] rows.
+ */
+struct msa_mseq_s {
+  ESL_DSQ *mx;			/* masked aligned seq, 0..alen-1 */
+  int      n;			/* number of canonical residues  */
 };
 #endif
 
@@ -92,6 +110,13 @@ struct msa_param_s {
  *            scales as about $LN \log N$. The best case scales as
  *            $LN$, when there is just one cluster in a completely
  *            connected graph.
+ *
+ *            For a digital <msa>, each sequence is masked once (see
+ *            <esl_dst_XMask()>), and each pairwise comparison stops
+ *            as soon as it is decided whether the pair reaches
+ *            <maxid>. The clustering is the same as comparing every
+ *            pair in full with <esl_dst_XPairId()>, but costs
+ *            $O(LN)$ more memory for the masked copy.
  *            
  * Args:      msa     - multiple alignment to cluster
  *            maxid   - pairwise identity threshold: cluster if $\geq$ <maxid>
@@ -129,6 +154,8 @@ esl_msacluster_SingleLinkage(const ESL_MSA *msa, double maxid,
   int   i;
 #ifdef eslAUGMENT_ALPHABET
   struct msa_param_s param;
+  struct msa_mseq_s *mseq = NULL;
+  ESL_DSQ           *mx   = NULL;
 #endif
 
   /* Allocations */
@@ -144,11 +171,28 @@ esl_msacluster_SingleLinkage(const ESL_MSA *msa, double maxid,
   else {
     param.maxid = maxid;
     param.abc   = msa->abc;
+    param.alen  = msa->alen;
+#if defined(eslMSACLUSTER_REGRESSION) || defined(eslMSAWEIGHT_REGRESSION)
     status = esl_cluster_SingleLinkage((void *) msa->ax, (size_t) msa->nseq, sizeof(ESL_DSQ *),
 				       msacluster_xlinkage, (void *) &param, 
 				       workspace, assignment, &nc);
+#else
+    ESL_ALLOC(mseq, sizeof(struct msa_mseq_s) * ESL_MAX(msa->nseq, 1));
+    ESL_ALLOC(mx,   sizeof(ESL_DSQ) * ESL_MAX(msa->nseq * msa->alen, 1));
+    for (i = 0; i < msa->nseq; i++)
+      {
+	mseq[i].mx = mx + (int64_t) i * msa->alen;
+	if ((status = esl_dst_XMask(msa->abc, msa->ax[i], msa->alen, mseq[i].mx, &(mseq[i].n))) != eslOK) goto ERROR;
+      }
+    status = esl_cluster_SingleLinkage((void *) mseq, (size_t) msa->nseq, sizeof(struct msa_mseq_s),
+				       msacluster_mlinkage, (void *) &param, 
+				       workspace, assignment, &nc);
+    free(mseq); mseq = NULL;
+    free(mx);   mx   = NULL;
+#endif
   }
 #endif
+  if (status != eslOK) goto ERROR;
 
   if (opt_nin != NULL) 
     {
@@ -169,6 +213,10 @@ esl_msacluster_SingleLinkage(const ESL_MSA *msa, double maxid,
   if (workspace  != NULL) free(workspace);
   if (assignment != NULL) free(assignment);
   if (nin        != NULL) free(nin);
+#ifdef eslAUGMENT_ALPHABET
+  if (mseq       != NULL) free(mseq);
+  if (mx         != NULL) free(mx);
+#endif
   if (opt_c  != NULL) *opt_c  = NULL;
   if (opt_nc != NULL) *opt_nc = 0;
   return status;
@@ -204,6 +252,7 @@ msacluster_clinkage(const void *v1, const void *v2, const void *p, int *ret_link
   
 /* Definition of % id linkage in digital aligned seqs (>= maxid) */
 #ifdef eslAUGMENT_ALPHABET
+#if defined(eslMSACLUSTER_REGRESSION) || defined(eslMSAWEIGHT_REGRESSION)
 static int
 msacluster_xlinkage(const void *v1, const void *v2, const void *p, int *ret_link)
 {
@@ -211,17 +260,55 @@ msacluster_xlinkage(const void *v1, const void *v2, const void *p, int *ret_link
   ESL_DSQ *ax2              = *(ESL_DSQ **) v2;
   struct msa_param_s *param = (struct msa_param_s *) p;
   double   pid;
-  int      status = eslOK;
 
-#if defined(eslMSACLUSTER_REGRESSION) || defined(eslMSAWEIGHT_REGRESSION)
   pid = 1. - squid_xdistance(param->abc, ax1, ax2);
-#else  
-  if ( (status = esl_dst_XPairId(param->abc, ax1, ax2, &pid, NULL, NULL)) != eslOK) return status;
-#endif
 
   *ret_link = (pid >= param->maxid ? TRUE : FALSE); 
-  return status;
+  return eslOK;
+}
+#else
+/* Same linkage, on masked seqs. Rather than computing pid = nid/minlen
+ * and comparing to maxid, find the smallest identity count that
+ * reaches maxid, and let the identity count stop as soon as it's
+ * decided whether the pair gets there.
+ */
+static int
+msacluster_mlinkage(const void *v1, const void *v2, const void *p, int *ret_link)
+{
+  struct msa_mseq_s  *s1    = (struct msa_mseq_s *) v1;
+  struct msa_mseq_s  *s2    = (struct msa_mseq_s *) v2;
+  struct msa_param_s *param = (struct msa_param_s *) p;
+  int    minlen = ESL_MIN(s1->n, s2->n);
+  int    need;
+
+  if (minlen == 0) { *ret_link = (0. >= param->maxid ? TRUE : FALSE); return eslOK; } /* esl_dst_XPairId() calls pid 0 */
+
+  need = msacluster_mneed(param->maxid, minlen);
+  if      (need > minlen) *ret_link = FALSE;
+  else if (need == 0)     *ret_link = TRUE;
+  else                    *ret_link = (esl_dst_XMaskedIdents(s1->mx, s2->mx, param->alen, need) >= need ? TRUE : FALSE);
+  return eslOK;
 }
+
+/* Smallest nid in 0..minlen for which (double) nid / (double) minlen >= maxid,
+ * computed with the same floating point comparison esl_dst_XPairId()'s
+ * callers use; or minlen+1 if there is none. <minlen> > 0.
+ */
+static int
+msacluster_mneed(double maxid, int minlen)
+{
+  int need;
+
+  if      (maxid <= 0.) return 0;
+  else if (maxid >  1.) return minlen+1;
+
+  need = (int) ceil(maxid * (double) minlen);
+  if (need > minlen) need = minlen;
+  while (need > 0       && (double) (need-1) / (double) minlen >= maxid) need--;
+  while (need <= minlen && (double)  need    / (double) minlen <  maxid) need++;
+  return need;
+}
+#endif
 #endif
 
 
@@ -35,6 +35,11 @@
 #include "esl_msacluster.h"
 #include "esl_msaweight.h"
 
+/* Digital PB weighting works on blocks of this many columns at a time,
+ * so each pass over the seqs reads a contiguous run of each row.
+ */
+#define eslMSAWEIGHT_PBBLOCK 128
+
 
 /*****************************************************************
  * 1. Implementations of weighting algorithms
@@ -233,9 +238,13 @@ esl_msaweight_GSC(ESL_MSA *msa)
  *            that effect), then normalized to sum to nseq.
  *            
  *            An advantage of the PB method is efficiency.
- *            It is $O(1)$ in memory and $O(NL)$ time, for an alignment of
+ *            It is $O(N)$ in memory and $O(NL)$ time, for an alignment of
  *            N sequences and L columns. This makes it a good method 
- *            for ad hoc weighting of very deep alignments.
+ *            for ad hoc weighting of very deep alignments. Digital
+ *            alignments are processed in blocks of columns, reading
+ *            each row in contiguous runs rather than one column at a
+ *            time across all rows; the weights are the same as
+ *            column-at-a-time, down to the last bit.
  *            
  *            When the alignment is in simple text mode, IUPAC
  *            degenerate symbols are not dealt with correctly; instead,
@@ -260,6 +269,13 @@ esl_msaweight_PB(ESL_MSA *msa)
   int     idx, pos, i;
   int     K;			/* alphabet size */
   int     status;
+#ifdef eslAUGMENT_ALPHABET
+  double *inc    = NULL;	/* digital: weight increment for each residue code in each column of a block, [j*Kp+x] */
+  int    *seqlen = NULL;	/* digital: number of canonical residues in each seq, [0..nseq-1] */
+  ESL_DSQ *ax;
+  double  w;
+  int     n, j, x;
+#endif
 
   /* Contract checks
    */
@@ -273,7 +289,12 @@ esl_msaweight_PB(ESL_MSA *msa)
     { ESL_ALLOC(nres, sizeof(int) * 26);          K = 26;          }
 #ifdef eslAUGMENT_ALPHABET
   else 
-    { ESL_ALLOC(nres, sizeof(int) * msa->abc->K); K = msa->abc->K; }
+    { 
+      K = msa->abc->K;
+      ESL_ALLOC(nres,   sizeof(int)    * eslMSAWEIGHT_PBBLOCK * K);
+      ESL_ALLOC(inc,    sizeof(double) * eslMSAWEIGHT_PBBLOCK * msa->abc->Kp);
+      ESL_ALLOC(seqlen, sizeof(int)    * msa->nseq);
+    }
 #endif
 
   esl_vec_DSet(msa->wgt, msa->nseq, 0.);
@@ -309,36 +330,47 @@ esl_msaweight_PB(ESL_MSA *msa)
       }
     }
 
-  /* This section handles digital alignments. */
+  /* This section handles digital alignments. A block of columns at a
+   * time: count residues in each column of the block, turn counts into
+   * per-residue weight increments (zero for gaps and degeneracies),
+   * then bump each seq's weight column by column, in the same order
+   * as a column-at-a-time loop would.
+   */
 #ifdef eslAUGMENT_ALPHABET
   else
     {
-      for (pos = 1; pos <= msa->alen; pos++)
+      esl_vec_ISet(seqlen, msa->nseq, 0);
+      for (pos = 1; pos <= msa->alen; pos += eslMSAWEIGHT_PBBLOCK)
 	{
-	  /* Collect # of residues 0..K-1 in this column, and total # */
-	  esl_vec_ISet(nres, K, 0.);
+	  n = ESL_MIN(eslMSAWEIGHT_PBBLOCK, msa->alen - pos + 1);
+
+	  /* Collect # of residues 0..K-1 in each column of the block */
+	  esl_vec_ISet(nres, n*K, 0);
 	  for (idx = 0; idx < msa->nseq; idx++)
-	    if (esl_abc_XIsCanonical(msa->abc, msa->ax[idx][pos]))
-	      nres[(int) msa->ax[idx][pos]] ++;
-	  for (ntotal = 0, i = 0; i < K; i++) if (nres[i] > 0) ntotal++;
+	    for (ax = msa->ax[idx] + pos, j = 0; j < n; j++)
+	      if (esl_abc_XIsCanonical(msa->abc, ax[j])) { nres[j*K + ax[j]]++; seqlen[idx]++; }
+
+	  /* PB rule: residue x, in a column with ntotal different residues, gets 1/(ntotal*nres[x]) */
+	  for (j = 0; j < n; j++)
+	    {
+	      for (ntotal = 0, i = 0; i < K; i++) if (nres[j*K+i] > 0) ntotal++;
+	      for (x = 0; x < msa->abc->Kp; x++)
+		inc[j*msa->abc->Kp + x] = ((x < K && nres[j*K+x] > 0) ? 1. / (double) (ntotal * nres[j*K+x]) : 0.);
+	    }
 
-	  /* Bump weight on each sequence by PB rule */
-	  if (ntotal > 0) {
-	    for (idx = 0; idx < msa->nseq; idx++) {
-	      if (esl_abc_XIsCanonical(msa->abc, msa->ax[idx][pos]))
-		msa->wgt[idx] += 1. / (double) (ntotal * nres[msa->ax[idx][pos]]);
+	  /* Bump weight on each sequence */
+	  for (idx = 0; idx < msa->nseq; idx++)
+	    {
+	      for (w = msa->wgt[idx], ax = msa->ax[idx] + pos, j = 0; j < n; j++)
+		w += inc[j*msa->abc->Kp + ax[j]];
+	      msa->wgt[idx] = w;
 	    }
-	  }
 	}
 
       /* first normalization by # of residues counted in each seq */
       for (idx = 0; idx < msa->nseq; idx++)
-	{
-	  for (rlen = 0, pos = 1; pos <= msa->alen; pos++) 
-	    if (esl_abc_XIsCanonical(msa->abc, msa->ax[idx][pos])) rlen++;
-	  if (rlen > 0) msa->wgt[idx] /= (double) rlen;
-	  /* if rlen == 0 for this seq, its weight is still 0.0, as initialized. */
-	}
+	if (seqlen[idx] > 0) msa->wgt[idx] /= (double) seqlen[idx];
+      /* if seqlen == 0 for this seq, its weight is still 0.0, as initialized. */
     }
 #endif
 
@@ -351,10 +383,18 @@ esl_msaweight_PB(ESL_MSA *msa)
   msa->flags |= eslMSA_HASWGTS;
 
   free(nres);
+#ifdef eslAUGMENT_ALPHABET
+  if (inc    != NULL) free(inc);
+  if (seqlen != NULL) free(seqlen);
+#endif
   return eslOK;
 
  ERROR:
   if (nres != NULL) free(nres);
+#ifdef eslAUGMENT_ALPHABET
+  if (inc    != NULL) free(inc);
+  if (seqlen != NULL) free(seqlen);
+#endif
   return status;
 }
 
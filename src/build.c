@@ -3,6 +3,9 @@
  * Two versions: 
  *    p7_Handmodelmaker() -- use #=RF annotation to indicate match columns
  *    p7_Fastmodelmaker() -- Krogh/Haussler heuristic
+ *
+ * p7_Streammodelmaker() does either one on an alignment that's read
+ * in passes from a P7_MSASTREAM, instead of held in memory.
  * 
  * The maximum likelihood model construction algorithm that was in previous
  * HMMER versions has been deprecated, at least for the moment.
@@ -30,10 +33,14 @@
 #include "esl_alphabet.h"
 #include "esl_msa.h"
 #include "esl_msafile.h"
+#include "esl_vectorops.h"
 
 #include "hmmer.h"
 
-static int do_modelmask( ESL_MSA *msa);
+/* p7_Fastmodelmaker() collects column counts this many columns at a time. */
+#define p7_FASTMM_BLOCK 128
+
+static int do_modelmask( ESL_MSA *msa, const char *mm);
 static int matassign2hmm(ESL_MSA *msa, int *matassign, P7_HMM **ret_hmm, P7_TRACE ***opt_tr);
 static int annotate_model(P7_HMM *hmm, int *matassign, ESL_MSA *msa);
 
@@ -160,8 +167,10 @@ p7_Fastmodelmaker(ESL_MSA *msa, float symfrac, P7_BUILDER *bld, P7_HMM **ret_hmm
   int     *matassign = NULL; /* MAT state assignments if 1; 1..alen */
   int      idx;              /* counter over sequences              */
   int      apos;             /* counter for aligned columns         */
-  float    r;		         /* weighted residue count              */
-  float    totwgt;	     /* weighted residue+gap count          */
+  float    r[p7_FASTMM_BLOCK];      /* weighted residue count, per column in block    */
+  float    totwgt[p7_FASTMM_BLOCK]; /* weighted residue+gap count, per column in block */
+  ESL_DSQ *ax;
+  int      n, j;
 
   if (! (msa->flags & eslMSA_DIGITAL)) ESL_XEXCEPTION(eslEINVAL, "need digital MSA");
 
@@ -170,18 +179,26 @@ p7_Fastmodelmaker(ESL_MSA *msa, float symfrac, P7_BUILDER *bld, P7_HMM **ret_hmm
   ESL_ALLOC(matassign, sizeof(int)     * (msa->alen+1));
 
   /* Determine weighted sym freq in each column, set matassign[] accordingly.
+   * Columns are done a block at a time, so each row is read in contiguous 
+   * runs; each column still sums its weights in sequence order.
    */
-  for (apos = 1; apos <= msa->alen; apos++) 
+  for (apos = 1; apos <= msa->alen; apos += p7_FASTMM_BLOCK) 
     {  
-      r = totwgt = 0.;
+      n = ESL_MIN(p7_FASTMM_BLOCK, msa->alen - apos + 1);
+      for (j = 0; j < n; j++) r[j] = totwgt[j] = 0.;
+
       for (idx = 0; idx < msa->nseq; idx++) 
-      {
-        if       (esl_abc_XIsResidue(msa->abc, msa->ax[idx][apos])) { r += msa->wgt[idx]; totwgt += msa->wgt[idx]; }
-        else if  (esl_abc_XIsGap(msa->abc,     msa->ax[idx][apos])) {                     totwgt += msa->wgt[idx]; }
-        else if  (esl_abc_XIsMissing(msa->abc, msa->ax[idx][apos])) continue;
-      }
-      if (r > 0. && r / totwgt >= symfrac) matassign[apos] = TRUE;
-      else                                 matassign[apos] = FALSE;
+	for (ax = msa->ax[idx] + apos, j = 0; j < n; j++)
+	  {
+	    if       (esl_abc_XIsResidue(msa->abc, ax[j])) { r[j] += msa->wgt[idx]; totwgt[j] += msa->wgt[idx]; }
+	    else if  (esl_abc_XIsGap(msa->abc,     ax[j])) {                        totwgt[j] += msa->wgt[idx]; }
+	  }
+
+      for (j = 0; j < n; j++)
+	{
+	  if (r[j] > 0. && r[j] / totwgt[j] >= symfrac) matassign[apos+j] = TRUE;
+	  else                                          matassign[apos+j] = FALSE;
+	}
     }
 
 
@@ -202,6 +219,149 @@ p7_Fastmodelmaker(ESL_MSA *msa, float symfrac, P7_BUILDER *bld, P7_HMM **ret_hmm
   return status;
 }
 
+/* Function: p7_Streammodelmaker()
+ * 
+ * Purpose:  Model construction from a streamed alignment.
+ *           Construct a counts-form HMM from the current alignment in
+ *           the stream <ms>, the same as <p7_Handmodelmaker()> or
+ *           <p7_Fastmodelmaker()> (according to <bld->arch_strategy>)
+ *           would from the same alignment in memory, after
+ *           <p7_Builder()> set its relative weights (according to
+ *           <bld->wgt_strategy>) and marked its fragments (according
+ *           to <bld->fragthresh>).
+ *
+ *           Sequences are read a chunk at a time: one pass for PB
+ *           weights, one to assign match columns by <bld->symfrac>
+ *           (fast architecture only), and one to collect counts from
+ *           fake tracebacks, which are freed as each chunk is counted.
+ *
+ *           Only the <p7_WGT_NONE> and <p7_WGT_PB> weighting
+ *           strategies can be used on a stream.
+ *
+ *           The model's <nseq> and <eff_nseq> are set to the number of
+ *           sequences, and its rf, mm, cs, ca, and map annotation is
+ *           set from the stream's <ms->hdr>.
+ *
+ * Args:     ms      - alignment stream, just after <p7_msastream_Next()>
+ *           bld     - build parameters
+ *           ret_hmm - RETURN: counts-form HMM
+ *
+ * Return:   <eslOK> on success; <*ret_hmm> is allocated here, and
+ *           must be free'd by caller.
+ *
+ *           Returns <eslENORESULT> if no consensus columns were
+ *           annotated; <eslEFORMAT> if hand architecture was requested
+ *           and the alignment has no reference annotation line, or if
+ *           the file changed while it was being read; in these cases,
+ *           <*ret_hmm> is returned <NULL>.
+ *
+ * Throws:   <eslEMEM> on allocation failure; <eslEINVAL> if
+ *           <bld->wgt_strategy> can't be used on a stream.
+ */
+int
+p7_Streammodelmaker(P7_MSASTREAM *ms, P7_BUILDER *bld, P7_HMM **ret_hmm)
+{
+  P7_HMM    *hmm       = NULL;
+  double    *wgt       = NULL;	/* relative weights, 0..nseq-1         */
+  int       *matassign = NULL;	/* MAT state assignments if 1; 1..alen */
+  float     *r         = NULL;	/* weighted residue count, 1..alen     */
+  float     *totwgt    = NULL;	/* weighted residue+gap count, 1..alen */
+  P7_TRACE **tr        = NULL;	/* fake traces for one chunk           */
+  ESL_MSA   *chunk     = NULL;
+  int        M;
+  int        idx, i;
+  int64_t    apos;
+  char       errbuf[eslERRBUFSIZE];
+  int        status;
+
+  ESL_ALLOC(wgt,       sizeof(double) * ms->nseq);
+  ESL_ALLOC(matassign, sizeof(int)    * (ms->alen+1));
+  ESL_ALLOC(tr,        sizeof(P7_TRACE *) * ms->nchunk);
+  for (i = 0; i < ms->nchunk; i++) tr[i] = NULL;
+
+  /* Relative weights, as relative_weights() in p7_builder.c */
+  if      (bld->wgt_strategy == p7_WGT_NONE) esl_vec_DSet(wgt, ms->nseq, 1.);
+  else if (bld->wgt_strategy == p7_WGT_PB)   { if ((status = p7_msastream_PBWeights(ms, wgt)) != eslOK) goto ERROR; }
+  else ESL_XEXCEPTION(eslEINVAL, "weighting strategy can't be used on an alignment stream");
+
+  /* Match column assignment */
+  if (bld->arch_strategy == p7_ARCH_HAND)
+    {
+      if (ms->hdr->rf == NULL) { status = eslEFORMAT; goto ERROR; }
+      for (apos = 1; apos <= ms->alen; apos++)
+	matassign[apos] = (esl_abc_CIsGap(ms->abc, ms->hdr->rf[apos-1])? FALSE : TRUE);
+    }
+  else
+    {
+      ESL_ALLOC(r,      sizeof(float) * (ms->alen+1));
+      ESL_ALLOC(totwgt, sizeof(float) * (ms->alen+1));
+      for (apos = 1; apos <= ms->alen; apos++) r[apos] = totwgt[apos] = 0.;
+
+      for (idx = 0; (status = p7_msastream_ReadChunk(ms, &chunk)) == eslOK; idx += chunk->nseq)
+	{
+	  if ((status = esl_msa_MarkFragments(chunk, bld->fragthresh)) != eslOK) goto ERROR;
+	  for (i = 0; i < chunk->nseq; i++)
+	    for (apos = 1; apos <= ms->alen; apos++)
+	      {
+		if      (esl_abc_XIsResidue(ms->abc, chunk->ax[i][apos])) { r[apos] += wgt[idx+i]; totwgt[apos] += wgt[idx+i]; }
+		else if (esl_abc_XIsGap(ms->abc,     chunk->ax[i][apos])) {                        totwgt[apos] += wgt[idx+i]; }
+	      }
+	}
+      if (status != eslEOF) goto ERROR;
+
+      for (apos = 1; apos <= ms->alen; apos++)
+	matassign[apos] = (r[apos] > 0. && r[apos] / totwgt[apos] >= bld->symfrac) ? TRUE : FALSE;
+    }
+
+  for (M = 0, apos = 1; apos <= ms->alen; apos++)
+    if (matassign[apos]) M++;
+  if (M == 0) { status = eslENORESULT; goto ERROR; }
+
+  /* Build count model from fake tracebacks, a chunk at a time */
+  if ((hmm    = p7_hmm_Create(M, ms->abc)) == NULL)  { status = eslEMEM; goto ERROR; }
+  if ((status = p7_hmm_Zero(hmm))          != eslOK) goto ERROR;
+  if ((status = p7_msastream_Rewind(ms))   != eslOK) goto ERROR;
+
+  for (idx = 0; (status = p7_msastream_ReadChunk(ms, &chunk)) == eslOK; idx += chunk->nseq)
+    {
+      if ((status = esl_msa_MarkFragments(chunk, bld->fragthresh))              != eslOK) goto ERROR;
+      do_modelmask(chunk, ms->hdr->mm);
+
+      if ((status = p7_trace_FauxFromMSA(chunk, matassign, p7_MSA_COORDS, tr)) != eslOK) goto ERROR;
+      for (i = 0; i < chunk->nseq; i++)
+	{
+	  if ((status = p7_trace_Doctor(tr[i], NULL, NULL))                          != eslOK) goto ERROR;
+	  if ((status = p7_trace_Validate(tr[i], ms->abc, chunk->ax[i], errbuf))     != eslOK) 
+	    ESL_XEXCEPTION(eslFAIL, "validation failed: %s", errbuf);
+	  if ((status = p7_trace_Count(hmm, chunk->ax[i], wgt[idx+i], tr[i]))       != eslOK) goto ERROR;
+	}
+      for (i = 0; i < chunk->nseq; i++) { p7_trace_Destroy(tr[i]); tr[i] = NULL; }
+    }
+  if (status != eslEOF) goto ERROR;
+
+  hmm->nseq     = ms->nseq;
+  hmm->eff_nseq = ms->nseq;
+  if ((status = annotate_model(hmm, matassign, ms->hdr)) != eslOK) goto ERROR;
+
+  p7_trace_DestroyArray(tr, ms->nchunk);
+  if (totwgt != NULL) free(totwgt);
+  if (r      != NULL) free(r);
+  free(matassign);
+  free(wgt);
+  *ret_hmm = hmm;
+  return eslOK;
+
+ ERROR:
+  if (tr        != NULL) p7_trace_DestroyArray(tr, ms->nchunk);
+  if (totwgt    != NULL) free(totwgt);
+  if (r         != NULL) free(r);
+  if (matassign != NULL) free(matassign);
+  if (wgt       != NULL) free(wgt);
+  if (hmm       != NULL) p7_hmm_Destroy(hmm);
+  *ret_hmm = NULL;
+  return status;
+}
+
 /*-------------------- end, exported API -------------------------*/
 
 
@@ -214,23 +374,24 @@ p7_Fastmodelmaker(ESL_MSA *msa, float symfrac, P7_BUILDER *bld, P7_HMM **ret_hmm
 
 /* Function: do_modelmask()
  *
- * Purpose:  If the given <msa> has a MM CS line, mask (turn to
- *           degenerate) residues in the msa positions associated
- *           with the marked position in the MM (marked with 'm')
+ * Purpose:  If there's a MM CS line <mm> (usually the <msa>'s own),
+ *           mask (turn to degenerate) residues in the msa positions
+ *           associated with the marked position in the MM (marked
+ *           with 'm')
  *
  * Return:   <eslOK> on success.
  *           <eslENORESULT> if error.
  */
 static int
-do_modelmask( ESL_MSA *msa)
+do_modelmask( ESL_MSA *msa, const char *mm)
 {
   int i,j;
 
-  if (msa->mm == NULL)  return eslOK;  //nothing to do
+  if (mm == NULL)  return eslOK;  //nothing to do
 
   for (i = 1; i <= msa->alen; i++) {
     for (j = 0; j < msa->nseq; j++) {
-      if (msa->mm[i-1] == 'm') {
+      if (mm[i-1] == 'm') {
 #ifdef eslAUGMENT_ALPHABET
         if (msa->ax[j][i] != msa->abc->K && msa->ax[j][i] != msa->abc->Kp-1) // if not gap
           msa->ax[j][i] = msa->abc->Kp-3; //that's the degenerate "any character" (N for DNA, X for protein)
@@ -273,7 +434,7 @@ matassign2hmm(ESL_MSA *msa, int *matassign, P7_HMM **ret_hmm, P7_TRACE ***opt_tr
   char errbuf[eslERRBUFSIZE];
 
   /* apply the model mask in the 'GC MM' row */
-  do_modelmask(msa);
+  do_modelmask(msa, msa->mm);
 
   /* How many match states in the HMM? */
   for (M = 0, apos = 1; apos <= msa->alen; apos++) 
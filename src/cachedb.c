@@ -2,6 +2,7 @@
  * 
  * Contents:
  *   2. P7_CACHEDB_SEQS: a daemon's cached sequence database
+ *   3. Caching an ordinary sequence file
  *   x. Benchmark driver
  *   x. Unit tests
  *   x. License and copyright information.
@@ -189,6 +190,7 @@ p7_seqcache_Open(char *seqfile, P7_SEQCACHE **ret_cache, char *errbuf)
     cache->list[inx].n      = sq->n;
     cache->list[inx].idx    = inx;
     cache->list[inx].db_key = db_key;
+    cache->list[inx].acc    = NULL;
     if(desc_ptr != NULL) esl_strdup(desc_ptr, -1, &(cache->list[inx].desc));
 
     /* copy the digitized sequence */
@@ -300,6 +302,133 @@ p7_seqcache_Close(P7_SEQCACHE *cache)
 }
 
 
+/* Function:  p7_seqcache_Read()
+ * Synopsis:  Read the rest of an ordinary sequence file into a cache.
+ *
+ * Purpose:   Read every remaining sequence from the open digital
+ *            sequence file <sqfp> into a new cache, so that a caller
+ *            that searches the same database many times (jackhmmer,
+ *            over its iterations and queries) parses and digitizes
+ *            it only once. Residues are packed into one arena, each
+ *            sequence as a complete <dsq> with sentinels at 0 and
+ *            n+1; names, accessions and descriptions are packed
+ *            into another.
+ *
+ *            Unlike p7_seqcache_Open(), any format Easel reads is
+ *            accepted, there is no header line, and the order of
+ *            the file is kept: the cache has one database, listing
+ *            the sequences as they were read, with <idx> 0..count-1.
+ *            <cache->abc> is left <NULL>; the sequences are in the
+ *            alphabet of <sqfp>.
+ *
+ * Returns:   <eslOK> on success; <*ret_cache> is the new cache.
+ *            <eslEFORMAT> on a parse error, with the message in
+ *            <sqfp>'s error buffer.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_seqcache_Read(ESL_SQFILE *sqfp, P7_SEQCACHE **ret_cache)
+{
+  P7_SEQCACHE *cache    = NULL;
+  ESL_SQ      *sq       = NULL;
+  uint64_t    *res_off  = NULL;     /* offset of each seq's dsq in residue_mem, while it may move */
+  uint64_t    *hdr_off  = NULL;     /* ... and of its name in header_mem                          */
+  uint64_t     res_used = 0;
+  uint64_t     hdr_used = 0;
+  uint64_t     need;
+  uint32_t     nalloc   = 1024;
+  uint32_t     i;
+  int          nlen, alen, dlen;
+  int          status;
+
+  ESL_ALLOC(cache, sizeof(P7_SEQCACHE));
+  memset(cache, 0, sizeof(P7_SEQCACHE));
+  if ((status = esl_strdup(sqfp->filename, -1, &cache->name)) != eslOK) goto ERROR;
+
+  cache->res_size = 1024 * 1024;
+  cache->hdr_size = 64 * 1024;
+  ESL_ALLOC(cache->residue_mem, cache->res_size);
+  ESL_ALLOC(cache->header_mem,  cache->hdr_size);
+  ESL_ALLOC(cache->list, sizeof(HMMER_SEQ) * nalloc);
+  ESL_ALLOC(res_off,     sizeof(uint64_t)  * nalloc);
+  ESL_ALLOC(hdr_off,     sizeof(uint64_t)  * nalloc);
+
+  if ((sq = esl_sq_CreateDigital(sqfp->abc)) == NULL) { status = eslEMEM; goto ERROR; }
+
+  while ((status = esl_sqio_Read(sqfp, sq)) == eslOK)
+    {
+      if (cache->count == nalloc) {
+        nalloc *= 2;
+        ESL_REALLOC(cache->list, sizeof(HMMER_SEQ) * nalloc);
+        ESL_REALLOC(res_off,     sizeof(uint64_t)  * nalloc);
+        ESL_REALLOC(hdr_off,     sizeof(uint64_t)  * nalloc);
+      }
+
+      need = sq->n + 2;
+      if (res_used + need > cache->res_size) {
+        while (res_used + need > cache->res_size) cache->res_size *= 2;
+        ESL_REALLOC(cache->residue_mem, cache->res_size);
+      }
+      nlen = strlen(sq->name);
+      alen = strlen(sq->acc);
+      dlen = strlen(sq->desc);
+      need = nlen + alen + dlen + 3;
+      if (hdr_used + need > cache->hdr_size) {
+        while (hdr_used + need > cache->hdr_size) cache->hdr_size *= 2;
+        ESL_REALLOC(cache->header_mem, cache->hdr_size);
+      }
+
+      res_off[cache->count] = res_used;
+      hdr_off[cache->count] = hdr_used;
+      memcpy((char *) cache->residue_mem + res_used, sq->dsq, sq->n + 2);
+      res_used += sq->n + 2;
+      memcpy(cache->header_mem + hdr_used, sq->name, nlen + 1);
+      memcpy(cache->header_mem + hdr_used + nlen + 1, sq->acc, alen + 1);
+      memcpy(cache->header_mem + hdr_used + nlen + alen + 2, sq->desc, dlen + 1);
+      hdr_used += need;
+
+      cache->list[cache->count].n      = sq->n;
+      cache->list[cache->count].idx    = cache->count;
+      cache->list[cache->count].db_key = 1;
+      cache->count++;
+
+      esl_sq_Reuse(sq);
+    }
+  if (status != eslEOF) goto ERROR;
+
+  /* the arenas won't move again; point the list into them */
+  for (i = 0; i < cache->count; i++)
+    {
+      cache->list[i].dsq  = (ESL_DSQ *) cache->residue_mem + res_off[i];
+      cache->list[i].name = cache->header_mem + hdr_off[i];
+      cache->list[i].acc  = cache->list[i].name + strlen(cache->list[i].name) + 1;
+      cache->list[i].desc = cache->list[i].acc  + strlen(cache->list[i].acc)  + 1;
+    }
+
+  cache->db_cnt = 1;
+  ESL_ALLOC(cache->db, sizeof(SEQ_DB));
+  cache->db[0].list  = NULL;
+  cache->db[0].count = cache->db[0].K = cache->count;
+  ESL_ALLOC(cache->db[0].list, sizeof(HMMER_SEQ *) * ESL_MAX(1, cache->count));
+  for (i = 0; i < cache->count; i++) cache->db[0].list[i] = cache->list + i;
+
+  free(res_off);
+  free(hdr_off);
+  esl_sq_Destroy(sq);
+  *ret_cache = cache;
+  return eslOK;
+
+ ERROR:
+  if (res_off) free(res_off);
+  if (hdr_off) free(hdr_off);
+  if (sq)      esl_sq_Destroy(sq);
+  if (cache)   p7_seqcache_Close(cache);
+  *ret_cache = NULL;
+  return status;
+}
+
+
 
 
 /*****************************************************************
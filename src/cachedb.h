@@ -8,6 +8,7 @@ typedef struct {
   int64_t  idx;	                   /* ctr for this seq                      */
   uint64_t db_key;                 /* flag for included databases           */
   char    *desc;                   /* description                           */
+  char    *acc;                    /* accession, or NULL                    */
 } HMMER_SEQ;
 
 typedef struct {
@@ -36,6 +37,7 @@ typedef struct {
 
 
 extern int    p7_seqcache_Open(char *seqfile, P7_SEQCACHE **ret_cache, char *errbuf);
+extern int    p7_seqcache_Read(ESL_SQFILE *sqfp, P7_SEQCACHE **ret_cache);
 extern void   p7_seqcache_Close(P7_SEQCACHE *cache);
 
 #endif /*P7_CACHEDB_INCLUDED*/
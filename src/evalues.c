@@ -18,8 +18,40 @@
 #include "esl_randomseq.h"
 #include "esl_vectorops.h"
 
+#ifdef HMMER_THREADS
+#include "esl_threads.h"
+#endif
+
 #include "hmmer.h"
 
+/* Each calibration simulation scores N random sequences with one of
+ * the three filters. The sequences are all drawn from the caller's RNG
+ * first, in the same order a one-at-a-time loop would draw them, and
+ * only then scored; so scoring can be split across threads without
+ * changing a single score, and the fitted parameters don't depend on
+ * the number of threads.
+ */
+enum calib_filter_e { CALIB_MSV = 0, CALIB_VITERBI = 1, CALIB_FORWARD = 2 };
+
+typedef struct {
+  enum calib_filter_e which;  /* which filter to score with                        */
+  P7_OPROFILE        *om;     /* shared, read-only while scoring                   */
+  P7_BG              *bg;     /* shared, read-only while scoring                   */
+  ESL_DSQ            *dsq;    /* N sequences of length L, each with its sentinels  */
+  int                 L;
+  int                 N;
+  double             *xv;     /* RETURN: xv[i] = score of seq i, in bits           */
+  int                 w;      /* this worker scores seqs w, w+nw, w+2nw...         */
+  int                 nw;     /* total # of workers                                */
+  int                 status; /* RETURN: eslOK, or error status                    */
+} CALIB_WORK;
+
+static int  simulate_scores(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, enum calib_filter_e which, int ncpus, double *xv);
+static int  score_seqs(CALIB_WORK *work);
+#ifdef HMMER_THREADS
+static void calib_thread(void *arg);
+#endif
+
 /*****************************************************************
  * 1. p7_Calibrate():  model calibration wrapper 
  *****************************************************************/ 
@@ -49,6 +81,11 @@
  *                      pass <*byp_om == NULL> if <om> return desired;
  *                      pass <NULL> to use and discard internal default.          
  *
+ *            If <cfg_b->ncpus> is nonzero (and HMMER is built with
+ *            threads), the simulations are scored by that many
+ *            threads. The results are identical for any number of
+ *            threads.
+ *
  * Returns:   <eslOK> on success.
  *
  * Throws:    <eslEMEM> on allocation failure.
@@ -71,6 +108,7 @@ p7_Calibrate(P7_HMM *hmm, P7_BUILDER *cfg_b, ESL_RANDOMNESS **byp_rng, P7_BG **b
   int             EfL    = ((cfg_b != NULL) ? cfg_b->EfL    : 100);
   int             EfN    = ((cfg_b != NULL) ? cfg_b->EfN    : 200);
   double          Eft    = ((cfg_b != NULL) ? cfg_b->Eft    : 0.04);
+  int             ncpus  = ((cfg_b != NULL) ? cfg_b->ncpus  : 0);
   double          lambda, mmu, vmu, tau;
   int             status;
   
@@ -104,9 +142,9 @@ p7_Calibrate(P7_HMM *hmm, P7_BUILDER *cfg_b, ESL_RANDOMNESS **byp_rng, P7_BG **b
 
   /* The calibration steps themselves */
   if ((status = p7_Lambda(hmm, bg, &lambda))                          != eslOK) ESL_XFAIL(status,  errbuf, "failed to determine lambda");
-  if ((status = p7_MSVMu    (r, om, bg, EmL, EmN, lambda, &mmu))      != eslOK) ESL_XFAIL(status,  errbuf, "failed to determine msv mu");
-  if ((status = p7_ViterbiMu(r, om, bg, EvL, EvN, lambda, &vmu))      != eslOK) ESL_XFAIL(status,  errbuf, "failed to determine vit mu");
-  if ((status = p7_Tau      (r, om, bg, EfL, EfN, lambda, Eft, &tau)) != eslOK) ESL_XFAIL(status,  errbuf, "failed to determine fwd tau");
+  if ((status = p7_MSVMu_threaded    (r, om, bg, EmL, EmN, lambda,      ncpus, &mmu)) != eslOK) ESL_XFAIL(status,  errbuf, "failed to determine msv mu");
+  if ((status = p7_ViterbiMu_threaded(r, om, bg, EvL, EvN, lambda,      ncpus, &vmu)) != eslOK) ESL_XFAIL(status,  errbuf, "failed to determine vit mu");
+  if ((status = p7_Tau_threaded      (r, om, bg, EfL, EfN, lambda, Eft, ncpus, &tau)) != eslOK) ESL_XFAIL(status,  errbuf, "failed to determine fwd tau");
 
   /* Store results */
   hmm->evparam[p7_MLAMBDA] = om->evparam[p7_MLAMBDA] = lambda;
@@ -239,50 +277,37 @@ p7_Lambda(P7_HMM *hmm, P7_BG *bg, double *ret_lambda)
 int
 p7_MSVMu(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambda, double *ret_mmu)
 {
-  P7_OMX  *ox      = p7_omx_Create(om->M, 0, 0); /* DP matrix: 1 row version */
-  ESL_DSQ *dsq     = NULL;
+  return p7_MSVMu_threaded(r, om, bg, L, N, lambda, 0, ret_mmu);
+}
+
+/* Function:  p7_MSVMu_threaded()
+ * Synopsis:  Determines MSV Gumbel mu, scoring with <ncpus> threads.
+ *
+ * Purpose:   Same as p7_MSVMu(), but if <ncpus> is nonzero and HMMER
+ *            was built with threads, the <N> simulated sequences are
+ *            scored by <ncpus> threads. The estimate is identical to
+ *            p7_MSVMu()'s for any <ncpus>.
+ */
+int
+p7_MSVMu_threaded(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambda, int ncpus, double *ret_mmu)
+{
   double  *xv      = NULL;
-  int      i;
-  float    sc, nullsc;
-#ifndef p7_IMPL_DUMMY
-  float    maxsc   = (255 - om->base_b) / om->scale_b; /* if score overflows, use this */
-#endif
   int      status;
 
-  if (ox == NULL) { status = eslEMEM; goto ERROR; }
   ESL_ALLOC(xv,  sizeof(double)  * N);
-  ESL_ALLOC(dsq, sizeof(ESL_DSQ) * (L+2));
 
   p7_oprofile_ReconfigLength(om, L);
   p7_bg_SetLength(bg, L);
 
-  for (i = 0; i < N; i++)
-    {
-      if ((status = esl_rsq_xfIID(r, bg->f, om->abc->K, L, dsq)) != eslOK) goto ERROR;
-      if ((status = p7_bg_NullOne(bg, dsq, L, &nullsc))          != eslOK) goto ERROR;   
-
-      status = p7_MSVFilter(dsq, L, om, ox, &sc); 
-#ifndef p7_IMPL_DUMMY
-      if (status == eslERANGE) { sc = maxsc; status = eslOK; }
-#endif
-      if (status != eslOK)     goto ERROR;
-
-      xv[i] = (sc - nullsc) / eslCONST_LOG2;
-    }
-
-  if ((status = esl_gumbel_FitCompleteLoc(xv, N, lambda, ret_mmu))  != eslOK) goto ERROR;
-  p7_omx_Destroy(ox);
+  if ((status = simulate_scores(r, om, bg, L, N, CALIB_MSV, ncpus, xv)) != eslOK) goto ERROR;
+  if ((status = esl_gumbel_FitCompleteLoc(xv, N, lambda, ret_mmu))      != eslOK) goto ERROR;
   free(xv);
-  free(dsq);
   return eslOK;
 
  ERROR:
   *ret_mmu = 0.0;
-  if (ox  != NULL) p7_omx_Destroy(ox);
   if (xv  != NULL) free(xv);
-  if (dsq != NULL) free(dsq);
   return status;
-
 }
 
 /* Function:  p7_ViterbiMu()
@@ -312,50 +337,35 @@ p7_MSVMu(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lam
 int
 p7_ViterbiMu(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambda, double *ret_vmu)
 {
-  P7_OMX  *ox      = p7_omx_Create(om->M, 0, 0); /* DP matrix: 1 row version */
-  ESL_DSQ *dsq     = NULL;
+  return p7_ViterbiMu_threaded(r, om, bg, L, N, lambda, 0, ret_vmu);
+}
+
+/* Function:  p7_ViterbiMu_threaded()
+ * Synopsis:  Determines Viterbi Gumbel mu, scoring with <ncpus> threads.
+ *
+ * Purpose:   Same as p7_ViterbiMu(), with the scoring optionally split
+ *            across <ncpus> threads, as in p7_MSVMu_threaded().
+ */
+int
+p7_ViterbiMu_threaded(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambda, int ncpus, double *ret_vmu)
+{
   double  *xv      = NULL;
-  int      i;
-  float    sc, nullsc;
-#ifndef p7_IMPL_DUMMY
-  float    maxsc   = (32767.0 - om->base_w) / om->scale_w; /* if score overflows, use this [J4/139] */
-#endif
   int      status;
 
-  if (ox == NULL) { status = eslEMEM; goto ERROR; }
   ESL_ALLOC(xv,  sizeof(double)  * N);
-  ESL_ALLOC(dsq, sizeof(ESL_DSQ) * (L+2));
 
   p7_oprofile_ReconfigLength(om, L);
   p7_bg_SetLength(bg, L);
 
-  for (i = 0; i < N; i++)
-    {
-      if ((status = esl_rsq_xfIID(r, bg->f, om->abc->K, L, dsq)) != eslOK) goto ERROR;
-      if ((status = p7_bg_NullOne(bg, dsq, L, &nullsc))          != eslOK) goto ERROR;   
-
-      status = p7_ViterbiFilter(dsq, L, om, ox, &sc); 
-#ifndef p7_IMPL_DUMMY
-      if (status == eslERANGE) { sc = maxsc; status = eslOK; }
-#endif
-      if (status != eslOK)     goto ERROR;
-
-      xv[i] = (sc - nullsc) / eslCONST_LOG2;
-    }
-
-  if ((status = esl_gumbel_FitCompleteLoc(xv, N, lambda, ret_vmu))  != eslOK) goto ERROR;
-  p7_omx_Destroy(ox);
+  if ((status = simulate_scores(r, om, bg, L, N, CALIB_VITERBI, ncpus, xv)) != eslOK) goto ERROR;
+  if ((status = esl_gumbel_FitCompleteLoc(xv, N, lambda, ret_vmu))          != eslOK) goto ERROR;
   free(xv);
-  free(dsq);
   return eslOK;
 
  ERROR:
   *ret_vmu = 0.0;
-  if (ox  != NULL) p7_omx_Destroy(ox);
   if (xv  != NULL) free(xv);
-  if (dsq != NULL) free(dsq);
   return status;
-
 }
 
 
@@ -421,29 +431,29 @@ p7_ViterbiMu(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double
 int
 p7_Tau(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambda, double tailp, double *ret_tau)
 {
-  P7_OMX  *ox      = p7_omx_Create(om->M, 0, L);     /* DP matrix: for ForwardParser,  L rows */
-  ESL_DSQ *dsq     = NULL;
+  return p7_Tau_threaded(r, om, bg, L, N, lambda, tailp, 0, ret_tau);
+}
+
+/* Function:  p7_Tau_threaded()
+ * Synopsis:  Determine Forward tau, scoring with <ncpus> threads.
+ *
+ * Purpose:   Same as p7_Tau(), with the scoring optionally split
+ *            across <ncpus> threads, as in p7_MSVMu_threaded().
+ */
+int
+p7_Tau_threaded(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambda, double tailp, int ncpus, double *ret_tau)
+{
   double  *xv      = NULL;
-  float    fsc, nullsc;		                  
   double   gmu, glam;
   int      status;
-  int      i;
 
   ESL_ALLOC(xv,  sizeof(double)  * N);
-  ESL_ALLOC(dsq, sizeof(ESL_DSQ) * (L+2));
-  if (ox == NULL) { status = eslEMEM; goto ERROR; }
 
   p7_oprofile_ReconfigLength(om, L);
   p7_bg_SetLength(bg, L);
 
-  for (i = 0; i < N; i++)
-    {
-      if ((status = esl_rsq_xfIID(r, bg->f, om->abc->K, L, dsq)) != eslOK) goto ERROR;
-      if ((status = p7_ForwardParser(dsq, L, om, ox, &fsc))      != eslOK) goto ERROR;
-      if ((status = p7_bg_NullOne(bg, dsq, L, &nullsc))          != eslOK) goto ERROR;   
-      xv[i] = (fsc - nullsc) / eslCONST_LOG2;
-    }
-  if ((status = esl_gumbel_FitComplete(xv, N, &gmu, &glam)) != eslOK) goto ERROR;
+  if ((status = simulate_scores(r, om, bg, L, N, CALIB_FORWARD, ncpus, xv)) != eslOK) goto ERROR;
+  if ((status = esl_gumbel_FitComplete(xv, N, &gmu, &glam))                  != eslOK) goto ERROR;
 
   /* Explanation of the eqn below: first find the x at which the Gumbel tail
    * mass is predicted to be equal to tailp. Then back up from that x
@@ -453,17 +463,153 @@ p7_Tau(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambd
   *ret_tau =  esl_gumbel_invcdf(1.0-tailp, gmu, glam) + (log(tailp) / lambda);
   
   free(xv);
-  free(dsq);
-  p7_omx_Destroy(ox);
   return eslOK;
 
  ERROR:
   *ret_tau = 0.;
   if (xv  != NULL) free(xv);
-  if (dsq != NULL) free(dsq);
-  if (ox  != NULL) p7_omx_Destroy(ox);
   return status;
 }
+
+
+/* simulate_scores()
+ * 
+ * Draw <N> iid sequences of length <L> from <bg> using <r>, then
+ * score each with the filter <which>, putting the bit scores in
+ * <xv[0..N-1]>. <om> and <bg> must already be configured for length
+ * <L>. If <ncpus> > 0 (threaded builds only) the scoring is split
+ * across that many threads.
+ */
+static int
+simulate_scores(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, enum calib_filter_e which, int ncpus, double *xv)
+{
+  ESL_DSQ    *dsq  = NULL;
+  CALIB_WORK *work = NULL;
+#ifdef HMMER_THREADS
+  ESL_THREADS *obj = NULL;
+#endif
+  int         nw   = 1;
+  int         i, w;
+  int         status;
+
+  ESL_ALLOC(dsq, sizeof(ESL_DSQ) * (L+2) * ESL_MAX(1, N));
+  for (i = 0; i < N; i++)
+    if ((status = esl_rsq_xfIID(r, bg->f, om->abc->K, L, dsq + (size_t) i * (L+2))) != eslOK) goto ERROR;
+
+#ifdef HMMER_THREADS
+  nw = ESL_MAX(1, ESL_MIN(ncpus, N));
+#endif
+  ESL_ALLOC(work, sizeof(CALIB_WORK) * nw);
+  for (w = 0; w < nw; w++)
+    {
+      work[w].which  = which;
+      work[w].om     = om;
+      work[w].bg     = bg;
+      work[w].dsq    = dsq;
+      work[w].L      = L;
+      work[w].N      = N;
+      work[w].xv     = xv;
+      work[w].w      = w;
+      work[w].nw     = nw;
+      work[w].status = eslOK;
+    }
+
+#ifdef HMMER_THREADS
+  if (nw > 1)
+    {
+      if ((obj = esl_threads_Create(&calib_thread)) == NULL) { status = eslEMEM; goto ERROR; }
+      for (w = 0; w < nw; w++)
+	esl_threads_AddThread(obj, &work[w]);
+      esl_threads_WaitForStart(obj);
+      esl_threads_WaitForFinish(obj);
+      esl_threads_Destroy(obj);
+      obj = NULL;
+    }
+  else
+#endif
+    score_seqs(&work[0]);
+
+  for (w = 0; w < nw; w++)
+    if ((status = work[w].status) != eslOK) goto ERROR;
+
+  free(work);
+  free(dsq);
+  return eslOK;
+
+ ERROR:
+#ifdef HMMER_THREADS
+  if (obj  != NULL) esl_threads_Destroy(obj);
+#endif
+  if (work != NULL) free(work);
+  if (dsq  != NULL) free(dsq);
+  return status;
+}
+
+/* score_seqs()
+ *
+ * Score this worker's share of a calibration simulation:
+ * sequences <w>, <w+nw>, <w+2nw>... Sets <work->status>.
+ */
+static int
+score_seqs(CALIB_WORK *work)
+{
+  P7_OPROFILE *om  = work->om;
+  P7_OMX      *ox  = p7_omx_Create(om->M, 0, (work->which == CALIB_FORWARD ? work->L : 0)); /* 1 row for MSV, Viterbi; L rows for ForwardParser */
+  ESL_DSQ     *dsq;
+  float        sc, nullsc;
+#ifndef p7_IMPL_DUMMY
+  float        maxsc = (work->which == CALIB_MSV ? (255 - om->base_b) / om->scale_b : (32767.0 - om->base_w) / om->scale_w); /* if score overflows, use this [J4/139] */
+#endif
+  int          i;
+  int          status;
+
+  if (ox == NULL) { status = eslEMEM; goto ERROR; }
+
+  for (i = work->w; i < work->N; i += work->nw)
+    {
+      dsq = work->dsq + (size_t) i * (work->L+2);
+
+      if (work->which == CALIB_FORWARD) {
+	if ((status = p7_ForwardParser(dsq, work->L, om, ox, &sc))          != eslOK) goto ERROR;
+	if ((status = p7_bg_NullOne(work->bg, dsq, work->L, &nullsc))       != eslOK) goto ERROR;   
+      } else {
+	if ((status = p7_bg_NullOne(work->bg, dsq, work->L, &nullsc))       != eslOK) goto ERROR;   
+
+	if (work->which == CALIB_MSV) status = p7_MSVFilter    (dsq, work->L, om, ox, &sc); 
+	else                          status = p7_ViterbiFilter(dsq, work->L, om, ox, &sc); 
+#ifndef p7_IMPL_DUMMY
+	if (status == eslERANGE) { sc = maxsc; status = eslOK; }
+#endif
+	if (status != eslOK)     goto ERROR;
+      }
+
+      work->xv[i] = (sc - nullsc) / eslCONST_LOG2;
+    }
+
+  p7_omx_Destroy(ox);
+  work->status = eslOK;
+  return eslOK;
+
+ ERROR:
+  if (ox != NULL) p7_omx_Destroy(ox);
+  work->status = status;
+  return status;
+}
+
+#ifdef HMMER_THREADS
+static void
+calib_thread(void *arg)
+{
+  ESL_THREADS *obj = (ESL_THREADS *) arg;
+  int          workeridx;
+
+  impl_Init();
+
+  esl_threads_Started(obj, &workeridx);
+  score_seqs((CALIB_WORK *) esl_threads_GetData(obj, workeridx));
+  esl_threads_Finished(obj, workeridx);
+}
+#endif /*HMMER_THREADS*/
 /*-------------- end, determining individual parameters ---------*/
 
 
@@ -482,6 +482,7 @@ fm_FM_destroy ( FM_DATA *fm, int isMainFM)
   if (fm->C)            free (fm->C);
   if (fm->occCnts_b)    free (fm->occCnts_b);
   if (fm->occCnts_sb)   free (fm->occCnts_sb);
+  if (fm->rb_mem)       free (fm->rb_mem);
 
   if (isMainFM && fm->T)  free (fm->T);
   if (isMainFM && fm->SA) free (fm->SA);
@@ -513,6 +514,7 @@ fm_FM_read( FM_DATA *fm, FM_METADATA *meta, int getAll )
   int cnt;
   int chars_per_byte = 8/meta->charBits;
 
+  fm->rb_mem = fm->rb = NULL;
 
   if(fread(&(fm->N), sizeof(uint64_t), 1, meta->fp) !=  1)
     esl_fatal( "%s: Error reading block_length in FM index.\n", __FILE__);
@@ -583,6 +585,9 @@ fm_FM_read( FM_DATA *fm, FM_METADATA *meta, int getAll )
   C[meta->alph_size] *= -1;
   C[0] = 1;
 
+  if (meta->rank_layout == fm_RANK_BLOCKS && fm_buildRankBlocks(fm, meta) != eslOK)
+    goto ERROR;
+
   return eslOK;
 
 ERROR:
@@ -621,6 +626,8 @@ fm_readFMmeta( FM_METADATA *meta)
   )
     esl_fatal( "%s: Error reading meta data for FM index.\n", __FILE__);
 
+  meta->rank_layout = (meta->fwd_only & FM_META_RANKBLOCKS_FLAG) ? fm_RANK_BLOCKS : fm_RANK_SAMPLED;
+  meta->fwd_only   &= ~FM_META_RANKBLOCKS_FLAG;
 
   ESL_ALLOC (meta->seq_data,  meta->seq_count   * sizeof(FM_SEQDATA));
   if (meta->seq_data == NULL  )
@@ -55,6 +55,27 @@ fm_print_m128_rev (__m128i in)
 #endif //#if   defined (p7_IMPL_SSE)
 
 
+/* Function:  fm_popcount64()
+ * Synopsis:  Count the set bits in a 64-bit word.
+ *
+ * Purpose:   Uses the compiler builtin where available, which becomes a
+ *            single popcnt instruction when the target supports it; otherwise
+ *            falls back on the usual SWAR reduction.
+ */
+static inline int
+fm_popcount64(uint64_t x)
+{
+#if defined (__GNUC__)
+  return __builtin_popcountll(x);
+#else
+  x = x - ((x >> 1) & 0x5555555555555555ULL);
+  x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+  x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  return (int) ((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+
 /* Function:  fm_initConfig()
  * Purpose:   Initialize vector masks used in SSE FMindex implementation
  */
@@ -206,6 +227,8 @@ fm_getOccCount (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c) {
   int up_b           = 2*b_rel_pos/meta->freq_cnt_b; //1 if pos is expected to be closer to the boundary of b_pos+1, 0 otherwise
   int landmark       = ((b_pos+up_b)*meta->freq_cnt_b) - 1 ;
 
+  if (fm->rb != NULL) return fm_getOccCountRB(fm, pos, c);
+
   if (landmark >= fm->N) { // special case: for a count in the final block, just count from the bottom
     up_b      = 0;
     landmark  = (b_pos*(meta->freq_cnt_b)) - 1 ;
@@ -390,6 +413,8 @@ fm_getOccCountLT (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c, uint
   int landmark             = ((b_pos+up_b)*(meta->freq_cnt_b)) - 1 ;
 
 
+  if (fm->rb != NULL) return fm_getOccCountLTRB(fm, pos, c, cnteq, cntlt);
+
   if (landmark >= fm->N) { // special case: for a count in the final block, just count from the bottom
     up_b      = 0;
     landmark  = (b_pos*(meta->freq_cnt_b)) - 1 ;
@@ -413,7 +438,7 @@ fm_getOccCountLT (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c, uint
 
 #if   defined (p7_IMPL_SSE)
 
-  if ( landmark < fm->N - 1 || landmark == -1 ) {
+  { // after the final-block adjustment above, landmark < fm->N always: there's a scan to do
 
     const uint8_t * BWT = fm->BWT;
 
@@ -624,6 +649,360 @@ fm_getOccCountLT (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c, uint
 }
 
 
+/* Function:  fm_buildRankBlocks()
+ * Synopsis:  Build the interleaved rank-block layout for an FM index
+ * Purpose:   Given an FM index whose packed BWT has been read, compute
+ *            the array of FM_RANKBLOCKs used by fm_getOccCountRB() and
+ *            fm_getOccCountLTRB(). Each block stores the cumulative
+ *            character counts up to its first position together with
+ *            the next FM_RB_CHARS characters as two bit planes. The
+ *            sampled occCnts_b/occCnts_sb tables are left in place.
+ *
+ *            Only the 2-bit DNA alphabet is supported; for any other
+ *            alphabet this is a no-op and fm->rb stays NULL, so rank
+ *            queries fall back to the sampled layout.
+ *
+ * Returns:   eslOK on success.
+ *
+ * Throws:    eslEMEM on allocation failure.
+ */
+int
+fm_buildRankBlocks( FM_DATA *fm, const FM_METADATA *meta)
+{
+  int           status;
+  uint64_t      nblocks = 1 + fm->N / FM_RB_CHARS;
+  uint32_t      cnt[4]  = { 0, 0, 0, 0 };
+  uint8_t       hinib[256], lonib[256]; // for a packed byte, the high (low) bits of its 4 chars; char k at bit k
+  FM_RANKBLOCK *blk;
+  uint64_t      b, first, nchars;
+  uint64_t      hi, lo, mask;
+  int           n3, nh, nl;
+  int           i, k, w, c;
+
+  if (meta->alph_type != fm_DNA) return eslOK;
+
+  for (i=0; i<256; i++) {
+    hinib[i] = lonib[i] = 0;
+    for (k=0; k<4; k++) {
+      c = (i >> (6 - 2*k)) & 0x3;  // same unpacking as fm_getChar()
+      hinib[i] |= (c>>1)  << k;
+      lonib[i] |= (c&0x1) << k;
+    }
+  }
+
+  ESL_ALLOC (fm->rb_mem, nblocks * sizeof(FM_RANKBLOCK) + 63); // +63 for manual 64-byte (cache line) alignment
+     fm->rb =   (FM_RANKBLOCK *) (((unsigned long int)fm->rb_mem + 63) & (~0x3f));
+
+  for (b=0; b<nblocks; b++) {
+    blk = fm->rb + b;
+    for (c=0; c<4; c++) blk->cnt[c] = cnt[c];
+
+    for (w=0; w<FM_RB_WORDS; w++) {
+      hi = lo = 0;
+      first = b*FM_RB_CHARS + 64*w;
+      if (first < fm->N) {
+        nchars = ESL_MIN(64, fm->N - first);
+        for (k=0; k<(nchars+3)/4; k++) {
+          hi |= (uint64_t) hinib[fm->BWT[first/4 + k]] << (4*k);
+          lo |= (uint64_t) lonib[fm->BWT[first/4 + k]] << (4*k);
+        }
+        mask = (nchars < 64 ? (((uint64_t) 1) << nchars) - 1 : ~((uint64_t) 0));
+        hi  &= mask;
+        lo  &= mask;
+
+        n3 = fm_popcount64(hi & lo);
+        nh = fm_popcount64(hi);
+        nl = fm_popcount64(lo);
+        cnt[3] += n3;
+        cnt[2] += nh - n3;
+        cnt[1] += nl - n3;
+        cnt[0] += nchars - nh - nl + n3;
+      }
+      blk->hi[w] = hi;
+      blk->lo[w] = lo;
+    }
+  }
+
+  return eslOK;
+
+ERROR:
+  fm->rb_mem = fm->rb = NULL;
+  return status;
+}
+
+
+/* Function:  fm_prefetchOcc()
+ * Synopsis:  Issue prefetches for the data a later rank query at <pos> will touch
+ *
+ * Purpose:   Rank queries against a multi-GB BWT are dominated by cache
+ *            misses, and each step of a backward search depends on the
+ *            previous one. Callers that have several independent queries
+ *            in flight (e.g. backtracking many suffix array positions at
+ *            once) can call this for the next query of each chain before
+ *            doing the current work, so that the misses overlap.
+ *
+ *            Covers fm_getOccCount(fm, cfg, pos, c), fm_getOccCountLT() at
+ *            the same position, and fm_getChar() at pos+1. It is a hint
+ *            only; it never changes results.
+ */
+void
+fm_prefetchOcc (const FM_DATA *fm, const FM_CFG *cfg, int pos)
+{
+#if   defined (p7_IMPL_SSE)
+  const FM_METADATA *meta = cfg->meta;
+  const uint64_t     p    = (uint64_t) (pos+1);
+
+  if (fm->rb != NULL) {
+    _mm_prefetch((const char *) (fm->rb + p / FM_RB_CHARS), _MM_HINT_T0);
+  } else {
+    _mm_prefetch((const char *) (fm->occCnts_b  + (p / meta->freq_cnt_b)  * meta->alph_size), _MM_HINT_T0);
+    _mm_prefetch((const char *) (fm->occCnts_sb + (p / meta->freq_cnt_sb) * meta->alph_size), _MM_HINT_T0);
+    _mm_prefetch((const char *) (fm->BWT + p / (8/meta->charBits)),                           _MM_HINT_T0);
+  }
+#endif
+}
+
+
+/* Function:  fm_getOccCountRB()
+ * Synopsis:  Compute number of occurrences of c in BWT[0..pos], using rank blocks
+ *
+ * Purpose:   Same contract as fm_getOccCount(), for an index whose rank
+ *            blocks have been built by fm_buildRankBlocks(). The block
+ *            holding position pos+1 carries the cumulative count for all
+ *            preceding blocks, and the characters inside the block are
+ *            counted by matching both bit planes against c and taking
+ *            the popcount of at most FM_RB_WORDS words. All of this lives
+ *            in one cache line, so there is no second dependent load
+ *            into a separate checkpoint table.
+ */
+int
+fm_getOccCountRB (const FM_DATA *fm, int pos, uint8_t c)
+{
+  const uint64_t      p   = (uint64_t) (pos+1);      // number of characters to count
+  const FM_RANKBLOCK *blk = fm->rb + p / FM_RB_CHARS;
+  int                 r   = p % FM_RB_CHARS;          // characters to count inside blk
+  int                 cnt = blk->cnt[c];
+  uint64_t            m;
+  int                 w;
+
+  for (w = 0; r > 0; w++, r -= 64) {
+    m  = (c & 0x2 ? blk->hi[w] : ~blk->hi[w]) & (c & 0x1 ? blk->lo[w] : ~blk->lo[w]);
+    if (r < 64) m &= (((uint64_t) 1) << r) - 1;
+    cnt += fm_popcount64(m);
+  }
+
+  if (c==0 && pos >= fm->term_loc) // I overcounted 'A' by one, because '$' was replaced with an 'A'
+    cnt--;
+
+  return cnt;
+}
+
+
+/* Function:  fm_getOccCountLTRB()
+ * Synopsis:  Compute number of occurrences of c, and of characters <c, in BWT[0..pos], using rank blocks
+ *
+ * Purpose:   Same contract as fm_getOccCountLT(). Within the block, the
+ *            counts of all four characters fall out of three popcounts
+ *            per word (hi&lo, hi, lo), so the less-than count costs no
+ *            more than the equal count.
+ */
+int
+fm_getOccCountLTRB (const FM_DATA *fm, int pos, uint8_t c, uint32_t *cnteq, uint32_t *cntlt)
+{
+  const uint64_t      p   = (uint64_t) (pos+1);
+  const FM_RANKBLOCK *blk = fm->rb + p / FM_RB_CHARS;
+  int                 r   = p % FM_RB_CHARS;
+  uint32_t            n[4];
+  uint64_t            mask, h, l;
+  int                 n3, nh, nl;
+  int                 i, w;
+
+  for (i=0; i<4; i++) n[i] = blk->cnt[i];
+
+  for (w = 0; r > 0; w++, r -= 64) {
+    mask = (r < 64 ? (((uint64_t) 1) << r) - 1 : ~((uint64_t) 0));
+    h    = blk->hi[w] & mask;
+    l    = blk->lo[w] & mask;
+    n3   = fm_popcount64(h & l);
+    nh   = fm_popcount64(h);
+    nl   = fm_popcount64(l);
+    n[3] += n3;
+    n[2] += nh - n3;
+    n[1] += nl - n3;
+    n[0] += ESL_MIN(r, 64) - nh - nl + n3;
+  }
+
+  *cnteq = n[c];
+  *cntlt = 0;
+  for (i=0; i<c; i++)
+    *cntlt += n[i];
+
+  if ( pos >= fm->term_loc) {
+    if (c == 0) { // deal with the fact that '$' was replaced with an 'A'
+      (*cnteq)--; // I overcounted 'A' by one
+      (*cntlt) = 1; // '$' is lexicographically lower than 'A', but I didn't count it in the method above
+    }
+  }
+
+  return eslOK;
+}
+
+
+/*****************************************************************
+ * Unit tests
+ *****************************************************************/
+#ifdef p7FM_SSE_TESTDRIVE
+#include "esl_random.h"
+
+/* utest_rankblocks()
+ *
+ * Build a random 2-bit "BWT" (rank queries don't care whether the
+ * string really is a BWT) with its sampled occurrence tables laid
+ * out as makehmmerdb writes them, then check that the sampled SSE
+ * counts, the rank-block counts, and a brute-force prefix count all
+ * agree at every position, for every character.
+ */
+static void
+utest_rankblocks(ESL_RANDOMNESS *r, int N)
+{
+  char         msg[]      = "fm_sse rank-block unit test failed";
+  FM_CFG      *cfg        = NULL;
+  FM_METADATA *meta       = NULL;
+  FM_DATA      fm;
+  FM_RANKBLOCK *rb;
+  uint8_t     *txt        = NULL;
+  uint32_t    *prefix     = NULL;  /* prefix[4*i+c] = occurrences of c in txt[0..i] */
+  uint16_t    *occCnts_b  = NULL;
+  uint32_t    *occCnts_sb = NULL;
+  uint32_t     cnts_b[4]  = { 0, 0, 0, 0 };
+  uint32_t     cnts_sb[4] = { 0, 0, 0, 0 };
+  uint32_t     eq1, lt1, eq2, lt2, expect_eq, expect_lt;
+  int          num_freq_cnts_b, num_freq_cnts_sb;
+  int          i, j, c, status;
+
+  if (fm_configAlloc(&cfg) != eslOK) esl_fatal(msg);
+  meta = cfg->meta;
+  meta->alph = meta->inv_alph = NULL;
+  meta->compl_alph            = NULL;
+  meta->seq_data              = NULL;
+  meta->seq_count             = 0;
+  meta->ambig_list->ranges    = NULL;
+  meta->alph_type             = fm_DNA;
+  meta->alph_size             = 4;
+  meta->charBits              = 2;
+  meta->freq_cnt_b            = 256;
+  meta->freq_cnt_sb           = 65536;
+  if (fm_configInit(cfg, NULL) != eslOK) esl_fatal(msg);
+
+  num_freq_cnts_b  = 1+ceil((double)N/meta->freq_cnt_b);
+  num_freq_cnts_sb = 1+ceil((double)N/meta->freq_cnt_sb);
+
+  fm.N        = N;
+  fm.term_loc = esl_rnd_Roll(r, N);
+  ESL_ALLOC(txt,        sizeof(uint8_t)  * N);
+  ESL_ALLOC(prefix,     sizeof(uint32_t) * N * 4);
+  ESL_ALLOC(fm.BWT_mem, sizeof(uint8_t)  * ((N+3)/4 + 31));
+  fm.BWT = (uint8_t *) (((unsigned long int)fm.BWT_mem + 15) & (~0xf));
+  ESL_ALLOC(occCnts_b,  sizeof(uint16_t) * num_freq_cnts_b  * 4);
+  ESL_ALLOC(occCnts_sb, sizeof(uint32_t) * num_freq_cnts_sb * 4);
+  fm.occCnts_b  = occCnts_b;
+  fm.occCnts_sb = occCnts_sb;
+  fm.rb_mem     = fm.rb = NULL;
+  fm.T = NULL; fm.SA = NULL; fm.C = NULL;
+
+  for (i=0; i<N; i++) txt[i] = esl_rnd_Roll(r, 4);
+  txt[fm.term_loc] = 0;  /* '$' is stored as an 'A' */
+  for (i=0; i<(N+3)/4+16; i++) fm.BWT[i] = 0;
+  for (i=0; i<N; i++) fm.BWT[i/4] |= txt[i] << (6 - 2*(i%4));
+
+  /* sampled occurrence counts, exactly as makehmmerdb builds them */
+  for (c=0; c<4; c++) { FM_OCC_CNT(b, 0, c) = 0; FM_OCC_CNT(sb, 0, c) = 0; }
+  for (j=0; j<N; j++) {
+    cnts_sb[txt[j]]++;
+    cnts_b[txt[j]]++;
+    if ( !((j+1) % meta->freq_cnt_b) ) {
+      for (c=0; c<4; c++) FM_OCC_CNT(b, (j+1)/meta->freq_cnt_b, c) = cnts_b[c];
+      if ( !((j+1) % meta->freq_cnt_sb) )
+        for (c=0; c<4; c++) { FM_OCC_CNT(sb, (j+1)/meta->freq_cnt_sb, c) = cnts_sb[c]; cnts_b[c] = 0; }
+    }
+  }
+  for (c=0; c<4; c++) {
+    if (N % meta->freq_cnt_b) FM_OCC_CNT(b,  num_freq_cnts_b-1,  c) = cnts_b[c];
+    FM_OCC_CNT(sb, num_freq_cnts_sb-1, c) = cnts_sb[c];
+  }
+
+  for (i=0; i<N; i++)
+    for (c=0; c<4; c++)
+      prefix[4*i+c] = (i ? prefix[4*(i-1)+c] : 0) + (txt[i] == c ? 1 : 0);
+
+  if (fm_buildRankBlocks(&fm, meta) != eslOK) esl_fatal(msg);
+  if ((rb = fm.rb) == NULL)                    esl_fatal(msg);
+
+  for (i=0; i<N; i++)
+    for (c=0; c<4; c++) {
+      expect_eq = prefix[4*i+c] - ((c==0 && i >= fm.term_loc) ? 1 : 0);
+      for (expect_lt=0, j=0; j<c; j++) expect_lt += prefix[4*i+j];
+      if (c==0 && i >= fm.term_loc) expect_lt = 1;
+
+      if (fm_getOccCountRB(&fm, i, c) != expect_eq) esl_fatal(msg);
+      fm_getOccCountLTRB(&fm, i, c, &eq2, &lt2);
+      if (eq2 != expect_eq || lt2 != expect_lt)     esl_fatal(msg);
+
+      /* the sampled path, with rank blocks temporarily hidden */
+      fm.rb = NULL;
+      if (fm_getOccCount(&fm, cfg, i, c) != expect_eq) esl_fatal(msg);
+      fm_getOccCountLT(&fm, cfg, i, c, &eq1, &lt1);
+      if (eq1 != expect_eq || lt1 != expect_lt)        esl_fatal(msg);
+      fm.rb = rb;
+    }
+
+  free(txt);
+  free(prefix);
+  fm_FM_destroy(&fm, FALSE);
+  fm_configDestroy(cfg);
+  return;
+
+ ERROR:
+  esl_fatal(msg);
+}
+#endif /*p7FM_SSE_TESTDRIVE*/
+
+
+/*****************************************************************
+ * Test driver
+ *****************************************************************/
+#ifdef p7FM_SSE_TESTDRIVE
+#include "esl_getopts.h"
+#include "esl_random.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                  0 },
+  { "-N",        eslARG_INT, "140000", NULL, "n>0", NULL,  NULL, NULL, "length of random BWT to test",                   0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "unit test driver for FM-index occurrence counting";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r  = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+
+#if defined (p7_IMPL_SSE)
+  utest_rankblocks(r, esl_opt_GetInteger(go, "-N"));
+#endif
+
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return eslOK;
+}
+#endif /*p7FM_SSE_TESTDRIVE*/
+
+
+
 /*****************************************************************
  * HMMER - Biological sequence analysis with profile HMMs
  * Version 3.1b2; February 2015
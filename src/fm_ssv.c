@@ -110,34 +110,66 @@ FM_mergeSeeds(FM_DIAGLIST *seeds, int N, int ssv_length) {
 }
 
 
- /* Function:  FM_backtrackSeed()
+ /* Function:  FM_backtrackSeeds()
   *
-  * Synopsis:  Find position(s) in the FM index for a diagonal that meets score threshold
+  * Synopsis:  Find positions in the FM index for a batch of BWT entries
   *
-  * Details:   Follows the BWT/FM-index until finding an entry of the implicit
-  *            suffix array that is found in the sampled SA.
-
+  * Details:   For each of the <cnt> consecutive BWT positions starting
+  *            at <first>, follow the BWT/FM-index backward until finding
+  *            an entry of the implicit suffix array that is found in the
+  *            sampled SA.
+  *
+  *            Each backtrack is a chain of dependent rank queries, and so
+  *            is bound by memory latency. The chains are independent of
+  *            each other, though, so they are advanced round-robin: one
+  *            step of every unfinished chain per pass, with a prefetch
+  *            issued for each chain's next step as soon as it is known.
+  *            By the time a chain comes around again its data is usually
+  *            in cache. Results are identical to backtracking one at a
+  *            time.
   *
   * Args:      fmf             - FM index for finding matches to the input sequence
   *            fm_cfg          - FM-index meta data
-  *            i               - Single position in the BWT
-  *
-  * Returns:   <eslOK> on success.
+  *            first           - first position in the BWT
+  *            cnt             - number of positions, at most FM_BACKTRACK_BATCH
+  *            ret_pos         - RETURN: ret_pos[b] is the text position of BWT entry first+b
   */
-static uint32_t
-FM_backtrackSeed(const FM_DATA *fmf, const FM_CFG *fm_cfg, int i) {
-  int j = i;
-  int len = 0;
-  int c;
-
-  while ( j != fmf->term_loc && (j % fm_cfg->meta->freq_SA)) { //go until we hit a position in the full SA that was sampled during FM index construction
-    c = fm_getChar( fm_cfg->meta->alph_type, j, fmf->BWT);
-    j = fm_getOccCount (fmf, fm_cfg, j-1, c);
-    j += abs(fmf->C[c]);
-    len++;
+#define FM_BACKTRACK_BATCH 16
+
+static void
+FM_backtrackSeeds(const FM_DATA *fmf, const FM_CFG *fm_cfg, int first, int cnt, uint32_t *ret_pos) {
+  int      j[FM_BACKTRACK_BATCH];
+  uint32_t len[FM_BACKTRACK_BATCH];
+  int      done[FM_BACKTRACK_BATCH];
+  int      remaining = cnt;
+  int      b, c;
+
+  for (b=0; b<cnt; b++) {
+    j[b]    = first + b;
+    len[b]  = 0;
+    done[b] = FALSE;
+    fm_prefetchOcc(fmf, fm_cfg, j[b]-1);
   }
 
-  return len + (j==fmf->term_loc ? 0 : fmf->SA[ j / fm_cfg->meta->freq_SA ]) ; // len is how many backward steps we had to take to find a sampled SA position
+  while (remaining > 0) {
+    for (b=0; b<cnt; b++) {
+      if (done[b]) continue;
+
+      if ( j[b] == fmf->term_loc || !(j[b] % fm_cfg->meta->freq_SA)) { //hit a position in the full SA that was sampled during FM index construction
+        ret_pos[b] = len[b] + (j[b]==fmf->term_loc ? 0 : fmf->SA[ j[b] / fm_cfg->meta->freq_SA ]) ; // len is how many backward steps we had to take to find a sampled SA position
+        done[b]    = TRUE;
+        remaining--;
+        continue;
+      }
+
+      c     = fm_getChar( fm_cfg->meta->alph_type, j[b], fmf->BWT);
+      j[b]  = fm_getOccCount (fmf, fm_cfg, j[b]-1, c);
+      j[b] += abs(fmf->C[c]);
+      len[b]++;
+
+      fm_prefetchOcc(fmf, fm_cfg, j[b]-1);
+    }
+  }
 }
 
 /* Function:  FM_getPassingDiags()
@@ -169,20 +201,28 @@ FM_getPassingDiags(const FM_DATA *fmf, const FM_CFG *fm_cfg,
             FM_DIAGLIST *seeds
             )
 {
-  int i;
+  int i, b;
+  int cnt = 0;
+  uint32_t pos[FM_BACKTRACK_BATCH];
   FM_DIAG *seed;
 
   //iterate over the forward interval, for each entry backtrack until hitting a sampled suffix array entry
   for (i = interval->lower;  i<= interval->upper; i++) {
 
+    b = (i - interval->lower) % FM_BACKTRACK_BATCH;
+    if (b == 0) {
+      cnt = ESL_MIN(FM_BACKTRACK_BATCH, interval->upper - i + 1);
+      FM_backtrackSeeds(fmf, fm_cfg, i, cnt, pos);
+    }
+
     seed = fm_newSeed(seeds);
     seed->k      = k;
     seed->length = depth;
 
     if (complementarity == p7_NOCOMPLEMENT )
-      seed->n    =  fmf->N - FM_backtrackSeed(fmf, fm_cfg, i) - depth - 1;
+      seed->n    =  fmf->N - pos[b] - depth - 1;
     else
-      seed->n    =  FM_backtrackSeed(fmf, fm_cfg, i) ;
+      seed->n    =  pos[b] ;
 
     seed->complementarity = complementarity;
 
@@ -255,6 +295,11 @@ FM_Recurse( int depth, int Kp, int fm_direction,
   uint8_t positive_run = 0;
   uint8_t consec_consensus = 0;
 
+  /* every child of this node in the trie extends the interval with a rank query
+   * at the same two positions; get those cache misses started now */
+  fm_prefetchOcc( (fm_direction == fm_forward ? fmf : fmb), fm_cfg, interval_1->lower-1);
+  fm_prefetchOcc( (fm_direction == fm_forward ? fmf : fmb), fm_cfg, interval_1->upper);
+
   for (c=0; c< fm_cfg->meta->alph_size; c++) {//acgt
     int dppos = last;
     seq[depth-1] = fm_cfg->meta->alph[c];
@@ -807,6 +852,10 @@ p7_SSVFM_longlarget( P7_OPROFILE *om, float nu, P7_BG *bg, double F1,
     FM_extendSeed( seeds.diags+i, fmf, ssvdata, fm_cfg, tmp_sq);
   }
 
+  // at most one window per seed; reserve room for them up front
+  if (p7_hmmwindow_grow(windowlist, windowlist->count + seeds.count) != eslOK)
+    ESL_EXCEPTION(eslEMEM, "Error allocating memory for SSVFM windows\n");
+
   for(i=0; i<seeds.count; i++) {
     diag = seeds.diags+i;
     if (diag->score >= sc_thresh)
@@ -827,6 +876,306 @@ ERROR:
 /*------------------ end, FM_MSV() ------------------------*/
 
 
+
+/*****************************************************************
+ * Benchmark and unit test drivers
+ *****************************************************************/
+#if defined(p7FM_SSV_BENCHMARK) || defined(p7FM_SSV_TESTDRIVE)
+
+/* backtrack_one()
+ *
+ * The original, one-entry-at-a-time backtrack that FM_backtrackSeeds()
+ * replaces: the reference for the unit test, and the baseline for the
+ * benchmark.
+ */
+static uint32_t
+backtrack_one(const FM_DATA *fmf, const FM_CFG *fm_cfg, int i) {
+  int j = i;
+  int len = 0;
+  int c;
+
+  while ( j != fmf->term_loc && (j % fm_cfg->meta->freq_SA)) {
+    c = fm_getChar( fm_cfg->meta->alph_type, j, fmf->BWT);
+    j = fm_getOccCount (fmf, fm_cfg, j-1, c);
+    j += abs(fmf->C[c]);
+    len++;
+  }
+
+  return len + (j==fmf->term_loc ? 0 : fmf->SA[ j / fm_cfg->meta->freq_SA ]) ;
+}
+#endif /*p7FM_SSV_BENCHMARK || p7FM_SSV_TESTDRIVE*/
+
+
+#ifdef p7FM_SSV_BENCHMARK
+/* ./fm_ssv_benchmark <fmindex>
+ *
+ * Times suffix array backtracking over random intervals of BWT
+ * entries in the first block of an FM index (built with makehmmerdb),
+ * one entry at a time vs. in batches as FM_getPassingDiags() does it.
+ * The effect of batching grows with the size of the index: it hides
+ * cache misses, and a small index stays in cache anyway.
+ */
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_stopwatch.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                  0 },
+  { "-N",        eslARG_INT, "100000", NULL, "n>0", NULL,  NULL, NULL, "number of intervals to backtrack",               0 },
+  { "-L",        eslARG_INT,     "16", NULL, "n>0", NULL,  NULL, NULL, "number of BWT entries in each interval",         0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options] <fmindex>";
+static char banner[] = "benchmark driver for FM-index suffix array backtracking";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go     = p7_CreateDefaultApp(options, 1, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r      = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_STOPWATCH  *w      = esl_stopwatch_Create();
+  char           *fmfile = esl_opt_GetArg(go, 1);
+  int             N      = esl_opt_GetInteger(go, "-N");
+  int             L      = esl_opt_GetInteger(go, "-L");
+  FM_CFG         *cfg    = NULL;
+  FM_DATA         fmf;
+  uint32_t        pos[FM_BACKTRACK_BATCH];
+  uint64_t        sum1   = 0;
+  uint64_t        sum2   = 0;
+  int            *first  = NULL;
+  int             i, j, b, cnt;
+  int             status;
+
+  if (fm_configAlloc(&cfg) != eslOK)                          p7_Fail("allocation failed");
+  if ((cfg->meta->fp = fopen(fmfile, "rb")) == NULL)          p7_Fail("failed to open %s", fmfile);
+  if (fm_readFMmeta(cfg->meta)              != eslOK)         p7_Fail("failed to read FM meta data from %s", fmfile);
+  if (fm_configInit(cfg, NULL)              != eslOK)         p7_Fail("failed to initialize FM configuration");
+  if (fm_FM_read(&fmf, cfg->meta, TRUE)     != eslOK)         p7_Fail("failed to read FM index from %s", fmfile);
+
+  ESL_ALLOC(first, sizeof(int) * N);
+  for (i = 0; i < N; i++) first[i] = 1 + esl_rnd_Roll(r, fmf.N - L - 1);
+
+  esl_stopwatch_Start(w);
+  for (i = 0; i < N; i++)
+    for (j = 0; j < L; j++)
+      sum1 += backtrack_one(&fmf, cfg, first[i] + j);
+  esl_stopwatch_Stop(w);
+  esl_stopwatch_Display(stdout, w, "# one at a time: ");
+
+  esl_stopwatch_Start(w);
+  for (i = 0; i < N; i++)
+    for (j = 0; j < L; j += FM_BACKTRACK_BATCH) {
+      cnt = ESL_MIN(FM_BACKTRACK_BATCH, L - j);
+      FM_backtrackSeeds(&fmf, cfg, first[i] + j, cnt, pos);
+      for (b = 0; b < cnt; b++) sum2 += pos[b];
+    }
+  esl_stopwatch_Stop(w);
+  esl_stopwatch_Display(stdout, w, "# batched:       ");
+
+  printf("# BWT length %" PRIu64 ", %s; %d intervals of %d entries\n",
+         fmf.N, (fmf.rb != NULL ? "rank blocks" : "sampled counts"), N, L);
+  if (sum1 != sum2) p7_Fail("batched and one-at-a-time positions differ");
+
+  free(first);
+  fm_FM_destroy(&fmf, TRUE);
+  fclose(cfg->meta->fp);
+  fm_configDestroy(cfg);
+  esl_stopwatch_Destroy(w);
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return 0;
+
+ ERROR:
+  p7_Fail("allocation failed");
+  return status;
+}
+#endif /*p7FM_SSV_BENCHMARK*/
+
+
+#ifdef p7FM_SSV_TESTDRIVE
+#include "esl_getopts.h"
+#include "esl_random.h"
+
+static const uint8_t *sfx_txt;  /* text whose suffixes sfx_sorter() compares */
+
+/* sfx_sorter(): qsort's pawn for a naive suffix sort; the last
+ * character of the text is the unique, lowest-sorting terminator */
+static int
+sfx_sorter(const void *a, const void *b)
+{
+  const uint8_t *s = sfx_txt + *(const int *) a;
+  const uint8_t *t = sfx_txt + *(const int *) b;
+
+  while (*s == *t) { s++; t++; }
+  return (*s < *t ? -1 : 1);
+}
+
+/* utest_backtrack()
+ *
+ * Build a real FM index of a random DNA text of length <N>-1 plus
+ * '$', with the suffix array sampled every <freq_SA> entries, laid
+ * out as makehmmerdb writes it. Then backtrack every BWT entry in
+ * batches of 1..FM_BACKTRACK_BATCH, and check that each position
+ * matches both the one-at-a-time backtrack and the full suffix
+ * array; with and without rank blocks.
+ */
+static void
+utest_backtrack(ESL_RANDOMNESS *r, int N, int freq_SA)
+{
+  char         msg[]      = "fm_ssv backtrack unit test failed";
+  FM_CFG      *cfg        = NULL;
+  FM_METADATA *meta       = NULL;
+  FM_DATA      fm;
+  FM_RANKBLOCK *rb;
+  uint8_t     *T          = NULL;   /* text: 1..4 for a..t, 0 for '$' */
+  uint8_t     *bwt        = NULL;   /* unpacked BWT, 0..3             */
+  int         *SA         = NULL;
+  uint16_t    *occCnts_b  = NULL;
+  uint32_t    *occCnts_sb = NULL;
+  uint32_t     cnts_b[4]  = { 0, 0, 0, 0 };
+  uint32_t     cnts_sb[4] = { 0, 0, 0, 0 };
+  uint32_t     pos[FM_BACKTRACK_BATCH];
+  int64_t      prevC, cnt;
+  int          num_freq_cnts_b, num_freq_cnts_sb;
+  int          i, j, c, b, batch, n, layout;
+  int          status;
+
+  if (fm_configAlloc(&cfg) != eslOK) esl_fatal(msg);
+  meta = cfg->meta;
+  meta->alph = meta->inv_alph = NULL;
+  meta->compl_alph            = NULL;
+  meta->seq_data              = NULL;
+  meta->seq_count             = 0;
+  meta->ambig_list->ranges    = NULL;
+  meta->alph_type             = fm_DNA;
+  meta->alph_size             = 4;
+  meta->charBits              = 2;
+  meta->freq_SA               = freq_SA;
+  meta->freq_cnt_b            = 256;
+  meta->freq_cnt_sb           = 65536;
+  if (fm_configInit(cfg, NULL) != eslOK) esl_fatal(msg);
+
+  num_freq_cnts_b  = 1+ceil((double)N/meta->freq_cnt_b);
+  num_freq_cnts_sb = 1+ceil((double)N/meta->freq_cnt_sb);
+
+  ESL_ALLOC(T,          sizeof(uint8_t)  * N);
+  ESL_ALLOC(bwt,        sizeof(uint8_t)  * N);
+  ESL_ALLOC(SA,         sizeof(int)      * N);
+  ESL_ALLOC(fm.BWT_mem, sizeof(uint8_t)  * ((N+3)/4 + 31));
+  fm.BWT = (uint8_t *) (((unsigned long int)fm.BWT_mem + 15) & (~0xf));
+  ESL_ALLOC(fm.SA,      sizeof(uint32_t) * (1 + N/freq_SA));
+  ESL_ALLOC(fm.C,       sizeof(int64_t)  * 5);
+  ESL_ALLOC(occCnts_b,  sizeof(uint16_t) * num_freq_cnts_b  * 4);
+  ESL_ALLOC(occCnts_sb, sizeof(uint32_t) * num_freq_cnts_sb * 4);
+  fm.N          = N;
+  fm.occCnts_b  = occCnts_b;
+  fm.occCnts_sb = occCnts_sb;
+  fm.rb_mem     = fm.rb = NULL;
+  fm.T          = NULL;
+
+  for (i=0; i<N-1; i++) T[i] = 1 + esl_rnd_Roll(r, 4);
+  T[N-1] = 0;
+  for (i=0; i<N; i++) SA[i] = i;
+  sfx_txt = T;
+  qsort(SA, N, sizeof(int), sfx_sorter);
+
+  /* BWT and sampled SA, as makehmmerdb builds them */
+  for (j=0; j<N; j++) {
+    if (SA[j] == 0) { fm.term_loc = j; bwt[j] = 0; }
+    else            bwt[j] = T[SA[j]-1] - 1;
+    if ( !(j % freq_SA) ) fm.SA[j/freq_SA] = (SA[j] == N-1 ? -1 : SA[j]);
+  }
+  for (i=0; i<(N+3)/4+16; i++) fm.BWT[i] = 0;
+  for (i=0; i<N; i++) fm.BWT[i/4] |= bwt[i] << (6 - 2*(i%4));
+
+  for (c=0; c<4; c++) { FM_OCC_CNT(b, 0, c) = 0; FM_OCC_CNT(sb, 0, c) = 0; }
+  for (j=0; j<N; j++) {
+    cnts_sb[bwt[j]]++;
+    cnts_b[bwt[j]]++;
+    if ( !((j+1) % meta->freq_cnt_b) ) {
+      for (c=0; c<4; c++) FM_OCC_CNT(b, (j+1)/meta->freq_cnt_b, c) = cnts_b[c];
+      if ( !((j+1) % meta->freq_cnt_sb) )
+        for (c=0; c<4; c++) { FM_OCC_CNT(sb, (j+1)/meta->freq_cnt_sb, c) = cnts_sb[c]; cnts_b[c] = 0; }
+    }
+  }
+  for (c=0; c<4; c++) {
+    if (N % meta->freq_cnt_b) FM_OCC_CNT(b, num_freq_cnts_b-1, c) = cnts_b[c];
+    FM_OCC_CNT(sb, num_freq_cnts_sb-1, c) = cnts_sb[c];
+  }
+
+  /* C, as fm_FM_read() computes it */
+  fm.C[0] = 0;
+  for (c=0; c<4; c++) {
+    prevC = abs(fm.C[c]);
+    cnt   = FM_OCC_CNT(sb, num_freq_cnts_sb-1, c);
+    if (cnt == 0) { fm.C[c+1] = prevC; fm.C[c] *= -1; }
+    else            fm.C[c+1] = prevC + cnt;
+  }
+  fm.C[4] *= -1;
+  fm.C[0]  = 1;
+
+  if (fm_buildRankBlocks(&fm, meta) != eslOK) esl_fatal(msg);
+  rb = fm.rb;
+
+  for (layout = 0; layout < 2; layout++)
+    {
+      fm.rb = (layout ? rb : NULL);
+      for (batch = 1; batch <= FM_BACKTRACK_BATCH; batch++)
+        for (i = 1; i < N; i += batch)  /* row 0 is the '$' suffix; FM_getPassingDiags never asks for it */
+          {
+            n = ESL_MIN(batch, N - i);
+            FM_backtrackSeeds(&fm, cfg, i, n, pos);
+            for (b = 0; b < n; b++) {
+              if (pos[b] != (uint32_t) SA[i+b])               esl_fatal(msg);
+              if (pos[b] != backtrack_one(&fm, cfg, i+b))     esl_fatal(msg);
+            }
+          }
+    }
+  fm.rb = rb;
+
+  free(T);
+  free(bwt);
+  free(SA);
+  fm_FM_destroy(&fm, TRUE);
+  fm_configDestroy(cfg);
+  return;
+
+ ERROR:
+  esl_fatal(msg);
+}
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                  0 },
+  { "-N",        eslARG_INT,  "20000", NULL, "n>1", NULL,  NULL, NULL, "length of random text to index",                 0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "unit test driver for FM-index seed backtracking";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r  = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  int             N  = esl_opt_GetInteger(go, "-N");
+
+#if defined (p7_IMPL_SSE)
+  utest_backtrack(r, N,   8);
+  utest_backtrack(r, N,  32);
+  utest_backtrack(r, N+1, 1);
+#endif
+
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return eslOK;
+}
+#endif /*p7FM_SSV_TESTDRIVE*/
+
+
 /*****************************************************************
  * HMMER - Biological sequence analysis with profile HMMs
  * Version 3.1b2; February 2015
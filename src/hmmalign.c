@@ -16,8 +16,33 @@
 #include "esl_sqio.h"
 #include "esl_vectorops.h"
 
+#ifdef HMMER_THREADS
+#include <unistd.h>
+#include "esl_threads.h"
+#include "esl_workqueue.h"
+#endif /*HMMER_THREADS*/
+
 #include "hmmer.h"
 
+#define BLOCK_SIZE 100   /* max # of sequences a worker aligns per work item */
+
+#ifdef HMMER_THREADS
+typedef struct {
+  int          start;		/* index of first sequence in the block */
+  int          n;		/* # of sequences in block; 0 tells the worker to stop */
+} WORK_ITEM;
+
+typedef struct {
+  ESL_WORK_QUEUE  *queue;
+  P7_HMM          *hmm;
+  ESL_SQ         **sq;
+  P7_TRACE       **tr;
+} WORKER_INFO;
+
+static void thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, int offset, int N, int blocksize);
+static void pipeline_thread(void *arg);
+#endif /*HMMER_THREADS*/
+
 static int map_alignment(const char *msafile, const P7_HMM *hmm, ESL_SQ ***ret_sq, P7_TRACE ***ret_tr, int *ret_ntot);
 
 
@@ -35,6 +60,9 @@ static ESL_OPTIONS options[] = {
   { "--rna",       eslARG_NONE,     FALSE,     NULL, NULL, ALPHOPTS,  NULL,  NULL, "assert <seqfile>, <hmmfile> both RNA: no autodetection",      2 },
   { "--informat",  eslARG_STRING,    NULL,     NULL, NULL,   NULL,    NULL,  NULL, "assert <seqfile> is in format <s>: no autodetection",            2 },
   { "--outformat", eslARG_STRING, "Stockholm", NULL, NULL,   NULL,    NULL,  NULL, "output alignment in format <s>",                                    2 },
+#ifdef HMMER_THREADS 
+  { "--cpu",       eslARG_INT,       NULL,"HMMER_NCPU","n>=0",NULL,   NULL,  NULL, "number of parallel CPU workers to use for multithreads",            2 },
+#endif
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
 
@@ -97,9 +125,19 @@ main(int argc, char **argv)
   ESL_MSA      *msa     = NULL;	/* resulting multiple alignment    */
   int           msaopts = 0;	/* flags to p7_tracealign_Seqs()   */
   int           idx;		/* counter over seqs, traces       */
+  int           ncpus   = 0;	/* # of worker threads             */
+#ifdef HMMER_THREADS
+  ESL_THREADS    *threadObj = NULL;
+  ESL_WORK_QUEUE *queue     = NULL;
+  WORKER_INFO    *info      = NULL;
+  WORK_ITEM      *item      = NULL;
+#endif
   int           status;		/* easel/hmmer return code         */
   char          errbuf[eslERRBUFSIZE];
 
+  impl_Init();                  /* processor specific initialization; worker threads do the same */
+  p7_FLogsumInit();		/* the generic failover uses table-driven Logsum(); fill the table before any threads start */
+
   /* Parse the command line
    */
   go = esl_getopts_Create(options);
@@ -198,7 +236,55 @@ main(int argc, char **argv)
   for (idx = mapseq; idx < totseq; idx++)
     tr[idx] = p7_trace_CreateWithPP();
 
-  p7_tracealign_computeTraces(hmm, sq, mapseq, totseq - mapseq, tr);
+#ifdef HMMER_THREADS
+  if (esl_opt_IsOn(go, "--cpu")) ncpus = esl_opt_GetInteger(go, "--cpu");
+  else                                   esl_threads_CPUCount(&ncpus);
+  if (nseq < 2) ncpus = 0;
+  p7_tracealign_SetThreads(ncpus);
+#endif
+
+  if (ncpus == 0) 
+    p7_tracealign_computeTraces(hmm, sq, mapseq, nseq, tr);
+#ifdef HMMER_THREADS
+  else
+    {
+      /* Each worker aligns blocks of consecutive sequences with its own
+       * profile and DP matrices, writing the traces in place in <tr>; so
+       * the result doesn't depend on which worker took which block.
+       * Blocks are small enough to go around all workers a few times.
+       */
+      threadObj = esl_threads_Create(&pipeline_thread);
+      queue     = esl_workqueue_Create(ncpus * 2);
+
+      ESL_ALLOC(info, sizeof(*info) * ncpus);
+      for (idx = 0; idx < ncpus; idx++)
+	{
+	  info[idx].queue = queue;
+	  info[idx].hmm   = hmm;
+	  info[idx].sq    = sq;
+	  info[idx].tr    = tr;
+	  esl_threads_AddThread(threadObj, &info[idx]);
+	}
+
+      for (idx = 0; idx < ncpus * 2; idx++)
+	{
+	  ESL_ALLOC(item, sizeof(*item));
+	  item->start = 0;
+	  item->n     = 0;
+	  status = esl_workqueue_Init(queue, item);
+	  if (status != eslOK) esl_fatal("Failed to add block to work queue");
+	}
+
+      thread_loop(threadObj, queue, mapseq, nseq, ESL_MAX(1, ESL_MIN(BLOCK_SIZE, nseq / (ncpus * 4))));
+
+      esl_workqueue_Reset(queue);
+      while (esl_workqueue_Remove(queue, (void **) &item) == eslOK)
+	free(item);
+      esl_workqueue_Destroy(queue);
+      esl_threads_Destroy(threadObj);
+      free(info);
+    }
+#endif
 
   p7_tracealign_Seqs(sq, tr, totseq, hmm->M, msaopts, hmm, &msa);
 
@@ -225,6 +311,88 @@ main(int argc, char **argv)
  * Internal functions used by main and API
  *****************************************************************/
 
+#ifdef HMMER_THREADS
+/* thread_loop()
+ * Hand out the <N> sequences starting at <offset> to the workers,
+ * in blocks of up to <blocksize>; then one empty block per worker
+ * to stop it.
+ */
+static void
+thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, int offset, int N, int blocksize)
+{
+  int        status;
+  int        next     = offset;
+  int        eofCount = 0;
+  WORK_ITEM *item;
+  void      *newItem;
+
+  esl_workqueue_Reset(queue);
+  esl_threads_WaitForStart(obj);
+
+  status = esl_workqueue_ReaderUpdate(queue, NULL, &newItem);
+  if (status != eslOK) esl_fatal("Work queue reader failed");
+
+  while (eofCount < esl_threads_GetWorkerCount(obj))
+    {
+      item        = (WORK_ITEM *) newItem;
+      item->start = next;
+      item->n     = ESL_MIN(blocksize, offset + N - next);
+      next       += item->n;
+      if (item->n == 0) eofCount++;
+
+      status = esl_workqueue_ReaderUpdate(queue, item, &newItem);
+      if (status != eslOK) esl_fatal("Work queue reader failed");
+    }
+
+  status = esl_workqueue_ReaderUpdate(queue, newItem, NULL);
+  if (status != eslOK) esl_fatal("Work queue reader failed");
+
+  /* wait for all the threads to complete */
+  esl_threads_WaitForFinish(obj);
+  esl_workqueue_Complete(queue);  
+}
+
+static void 
+pipeline_thread(void *arg)
+{
+  int          status;
+  int          workeridx;
+  WORKER_INFO *info;
+  ESL_THREADS *obj;
+  WORK_ITEM   *item;
+  void        *newItem;
+  
+  impl_Init();
+
+  obj = (ESL_THREADS *) arg;
+  esl_threads_Started(obj, &workeridx);
+
+  info = (WORKER_INFO *) esl_threads_GetData(obj, workeridx);
+
+  status = esl_workqueue_WorkerUpdate(info->queue, NULL, &newItem);
+  if (status != eslOK) esl_fatal("Work queue worker failed");
+
+  /* loop until all blocks have been processed */
+  item = (WORK_ITEM *) newItem;
+  while (item->n > 0)
+    {
+      p7_tracealign_computeTraces(info->hmm, info->sq, item->start, item->n, info->tr);
+
+      status = esl_workqueue_WorkerUpdate(info->queue, item, &newItem);
+      if (status != eslOK) esl_fatal("Work queue worker failed");
+
+      item = (WORK_ITEM *) newItem;
+    }
+
+  status = esl_workqueue_WorkerUpdate(info->queue, item, NULL);
+  if (status != eslOK) esl_fatal("Work queue worker failed");
+
+  esl_threads_Finished(obj, workeridx);
+  return;
+}
+#endif /*HMMER_THREADS*/
+
+
 static int
 map_alignment(const char *msafile, const P7_HMM *hmm, ESL_SQ ***ret_sq, P7_TRACE ***ret_tr, int *ret_ntot)
 {
@@ -64,6 +64,7 @@ typedef struct _pending_s {
 #define CONOPTS "--fast,--hand"                                /* Exclusive options for model construction                    */
 #define EFFOPTS "--eent,--eclust,--eset,--enone"               /* Exclusive options for effective sequence number calculation */
 #define WGTOPTS "--wgsc,--wblosum,--wpb,--wnone,--wgiven"      /* Exclusive options for relative weighting                    */
+#define STREAMINCOMP "-O,--wgsc,--wblosum,--wgiven,--eclust,--singlemx" /* Options that need the whole MSA in memory       */
 
 static ESL_OPTIONS options[] = {
   /* name           type      default  env  range     toggles      reqs   incomp  help   docgroup*/
@@ -131,6 +132,7 @@ static ESL_OPTIONS options[] = {
   { "--w_beta",   eslARG_REAL,       NULL, NULL, NULL,    NULL,     NULL,    NULL, "tail mass at which window length is determined",        8 },
   { "--w_length", eslARG_INT,        NULL, NULL, NULL,    NULL,     NULL,    NULL, "window length ",                                        8 },
   { "--maxinsertlen",  eslARG_INT,   NULL, NULL, "n>=5",  NULL,     NULL,    NULL, "pretend all inserts are length <= <n>",   8 },
+  { "--stream",   eslARG_NONE,      FALSE, NULL, NULL,    NULL,     NULL, STREAMINCOMP, "read Pfam-format <msafile> in passes, not into memory", 8 },
 
 
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
@@ -148,6 +150,7 @@ struct cfg_s {
   char         *alifile;	/* name of the alignment file we're building HMMs from  */
   int           fmt;		/* format code for alifile */
   ESLX_MSAFILE *afp;            /* open alifile  */
+  P7_MSASTREAM *ms;             /* open alifile, if streaming it (--stream) instead */
   ESL_ALPHABET *abc;		/* digital alphabet */
 
   char         *hmmName;        /* hmm file name supplied from -n          */
@@ -172,6 +175,7 @@ static char banner[] = "profile HMM construction from multiple sequence alignmen
 
 static int  usual_master(const ESL_GETOPTS *go, struct cfg_s *cfg);
 static void serial_loop  (WORKER_INFO *info, struct cfg_s *cfg, const ESL_GETOPTS *go);
+static void stream_loop  (WORKER_INFO *info, struct cfg_s *cfg);
 #ifdef HMMER_THREADS
 static void thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, struct cfg_s *cfg, const ESL_GETOPTS *go);
 static void pipeline_thread(void *arg);
@@ -245,6 +249,8 @@ process_commandline(int argc, char **argv, ESL_GETOPTS **ret_go, char **ret_hmmf
     { if (puts("Must specify --informat to read <alifile> from stdin ('-')") < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed"); goto FAILURE; }
 
 #ifdef HAVE_MPI
+  if (esl_opt_IsOn(go, "--mpi") && esl_opt_IsOn(go, "--stream"))
+    { if (puts("Options --stream and --mpi are incompatible. A stream is read serially, one alignment at a time.") < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed"); goto FAILURE; }
   if (esl_opt_IsOn(go, "--mpi") && esl_opt_IsOn(go, "--cpu")) 
     {
       int mpisetby = esl_opt_GetSetter(go, "--mpi");
@@ -319,6 +325,7 @@ output_header(const ESL_GETOPTS *go, const struct cfg_s *cfg)
   if (esl_opt_IsUsed(go, "--pextend")    && fprintf(cfg->ofp, "# gap extend probability:           %f\n",         esl_opt_GetReal   (go, "--pextend")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--mx")         && fprintf(cfg->ofp, "# subst score matrix (built-in):    %s\n",         esl_opt_GetString (go, "--mx"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--mxfile")     && fprintf(cfg->ofp, "# subst score matrix (file):        %s\n",         esl_opt_GetString (go, "--mxfile"))  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--stream")     && fprintf(cfg->ofp, "# streaming input alignment:        on\n")                                             < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--maxinsertlen")  && fprintf(cfg->ofp, "# max insert length:                %d\n",         esl_opt_GetInteger (go, "--maxinsertlen"))  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 
 
@@ -394,6 +401,7 @@ main(int argc, char **argv)
   cfg.ofp         = NULL;	           
   cfg.fmt         = eslMSAFILE_UNKNOWN;    /* autodetect alignment format by default. */ 
   cfg.afp         = NULL;	           
+  cfg.ms          = NULL;
   cfg.abc         = NULL;	           
   cfg.hmmfp       = NULL;	           
   cfg.postmsafile = esl_opt_GetString(go, "-O"); /* NULL by default */
@@ -457,6 +465,7 @@ main(int argc, char **argv)
   if (cfg.my_rank == 0) {
     if (esl_opt_IsOn(go, "-o")) { fclose(cfg.ofp); }
     if (cfg.afp)   eslx_msafile_Close(cfg.afp);
+    if (cfg.ms)    p7_msastream_Close(cfg.ms);
     if (cfg.abc)   esl_alphabet_Destroy(cfg.abc);
     if (cfg.hmmfp) fclose(cfg.hmmfp);
   }
@@ -501,8 +510,20 @@ usual_master(const ESL_GETOPTS *go, struct cfg_s *cfg)
   else if (esl_opt_GetBoolean(go, "--rna"))     cfg->abc = esl_alphabet_Create(eslRNA);
   else                                          cfg->abc = NULL;
   
-  status = eslx_msafile_Open(&(cfg->abc), cfg->alifile, NULL, cfg->fmt, NULL, &(cfg->afp));
-  if (status != eslOK) eslx_msafile_OpenFailure(cfg->afp, status);
+  if (esl_opt_GetBoolean(go, "--stream"))
+    {
+      char errbuf[eslERRBUFSIZE];
+
+      if (strcmp(cfg->alifile, "-") == 0)                                            p7_Fail("Can't use --stream with <msafile> on stdin: the file is read in several passes\n");
+      if (cfg->fmt != eslMSAFILE_UNKNOWN && cfg->fmt != eslMSAFILE_STOCKHOLM && cfg->fmt != eslMSAFILE_PFAM) 
+	p7_Fail("--stream only reads Stockholm (Pfam) format alignments\n");
+      if (p7_msastream_Open(cfg->alifile, &(cfg->abc), &(cfg->ms), errbuf) != eslOK) p7_Fail("Alignment input open failed.\n   %s\n", errbuf);
+    }
+  else
+    {
+      status = eslx_msafile_Open(&(cfg->abc), cfg->alifile, NULL, cfg->fmt, NULL, &(cfg->afp));
+      if (status != eslOK) eslx_msafile_OpenFailure(cfg->afp, status);
+    }
 
   cfg->hmmfp = fopen(cfg->hmmfile, "w");
   if (cfg->hmmfp == NULL) p7_Fail("Failed to open HMM file %s for writing", cfg->hmmfile);
@@ -531,6 +552,7 @@ usual_master(const ESL_GETOPTS *go, struct cfg_s *cfg)
   /* initialize thread data */
   if (esl_opt_IsOn(go, "--cpu")) ncpus = esl_opt_GetInteger(go, "--cpu");
   else                                   esl_threads_CPUCount(&ncpus);
+  if (cfg->ms != NULL) ncpus = 0; /* a stream is read in passes, one alignment at a time */
 
   if (ncpus > 0)
     {
@@ -614,10 +636,12 @@ usual_master(const ESL_GETOPTS *go, struct cfg_s *cfg)
 #endif
 
 #ifdef HMMER_THREADS
-  if (ncpus > 0)  thread_loop(threadObj, queue, cfg, go);
-  else            serial_loop(info, cfg, go);
+  if      (cfg->ms != NULL) stream_loop(info, cfg);
+  else if (ncpus > 0)       thread_loop(threadObj, queue, cfg, go);
+  else                      serial_loop(info, cfg, go);
 #else
-  serial_loop(info, cfg, go);
+  if (cfg->ms != NULL) stream_loop(info, cfg);
+  else                 serial_loop(info, cfg, go);
 #endif
 
   for (i = 0; i < infocnt; ++i)
@@ -1045,6 +1069,42 @@ serial_loop(WORKER_INFO *info, struct cfg_s *cfg, const ESL_GETOPTS *go)
     }
 }
 
+/* stream_loop()
+ * Serial loop over the alignments of a --stream input; each one is
+ * read in passes by p7_BuilderStream(), instead of into memory.
+ */
+static void
+stream_loop(WORKER_INFO *info, struct cfg_s *cfg)
+{
+  P7_MSASTREAM *ms  = cfg->ms;
+  P7_HMM       *hmm = NULL;
+  char          errmsg[eslERRBUFSIZE];
+  double        entropy;
+  int           status;
+
+  cfg->nali = 0;
+  while ((status = p7_msastream_Next(ms)) != eslEOF)
+    {
+      if      (status == eslEFORMAT) p7_Fail("Alignment input parse error:\n   %s\n   while reading Stockholm file %s\n   at or near line %d\n", ms->errmsg, cfg->alifile, ms->linenumber);
+      else if (status != eslOK)      p7_Fail("Alignment input read failed with error code %d\n", status);
+      cfg->nali++;
+
+      if ((status = set_msa_name(cfg, errmsg, ms->hdr)) != eslOK) p7_Fail("%s\n", errmsg); /* cfg->nnamed gets incremented in this call */
+
+      if ((status = p7_BuilderStream(info->bld, ms, info->bg, &hmm, NULL, NULL)) != eslOK) p7_Fail("build failed: %s", info->bld->errbuf);
+
+      //if the user set the popen/pextend flags, override the computed gap params now:
+      if (info->bld->popen != -1 || info->bld->pextend != -1) {
+        apply_fixed_gap_params(hmm, info->bld->popen, info->bld->pextend);
+      }
+
+      entropy = p7_MeanMatchRelativeEntropy(hmm, info->bg);
+      if ((status = output_result(cfg, errmsg, cfg->nali, ms->hdr, hmm, NULL, entropy)) != eslOK) p7_Fail(errmsg);
+
+      p7_hmm_Destroy(hmm);
+    }
+}
+
 #ifdef HMMER_THREADS
 static void
 thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, struct cfg_s *cfg, const ESL_GETOPTS *go)
@@ -1278,7 +1338,7 @@ output_result(const struct cfg_s *cfg, char *errbuf, int msaidx, ESL_MSA *msa, P
     if (fprintf(cfg->ofp, "%-5d %-20s %5d %5" PRId64 " %5d %8.2f %6.3f %s\n",
           msaidx,
           (msa->name != NULL) ? msa->name : "",
-          msa->nseq,
+          hmm->nseq,
           msa->alen,
           hmm->M,
           hmm->eff_nseq,
@@ -1289,7 +1349,7 @@ output_result(const struct cfg_s *cfg, char *errbuf, int msaidx, ESL_MSA *msa, P
     if (fprintf(cfg->ofp, "%-5d %-20s %5d %5" PRId64 " %5d %5d %8.2f %6.3f %s\n",
           msaidx,
           (msa->name != NULL) ? msa->name : "",
-          msa->nseq,
+          hmm->nseq,
           msa->alen,
           hmm->M,
           hmm->max_length,
@@ -1351,9 +1411,9 @@ set_msa_name(struct cfg_s *cfg, char *errbuf, ESL_MSA *msa)
 	{
 	  cfg->nnamed++;
 	}
-      else if (cfg->afp->bf->filename)
+      else if (cfg->afp == NULL || cfg->afp->bf->filename)
 	{
-	  if ((status = esl_FileTail(cfg->afp->bf->filename, TRUE, &name)) != eslOK) return status; /* TRUE=nosuffix */	  
+	  if ((status = esl_FileTail(cfg->afp ? cfg->afp->bf->filename : cfg->alifile, TRUE, &name)) != eslOK) return status; /* TRUE=nosuffix */	  
 	  if ((status = esl_msa_SetName(msa, name, -1))                    != eslOK) return status;
 	  free(name);
 	}
@@ -647,6 +647,7 @@ typedef struct p7_domaindef_s {
 
   /* the ad hoc null2 model: 1..L nat scores for each residue, log f'(x_i) / f(x_i) */
   float *n2sc;
+  float *n2prv;			/* adaptive trace sampling: null2 scores at the last convergence check */
 
   /* rng and reusable memory for stochastic tracebacks */
   ESL_RANDOMNESS *r;		/* random number generator                                 */
@@ -654,6 +655,9 @@ typedef struct p7_domaindef_s {
   P7_SPENSEMBLE  *sp;		/* an ensemble of sampled segment pairs (domain endpoints) */
   P7_TRACE       *tr;		/* reusable space for a trace of a domain                  */
   P7_TRACE       *gtr;		/* reusable space for a traceback of the entire target seq */
+  struct p7_spcoord_s *sigc_prv;/* adaptive trace sampling: clusters at the last convergence check   */
+  int             nsigc_prv;
+  int             nsigc_prv_alloc;
 
   /* Heuristic thresholds that control the region definition process */
   /* "rt" = "region threshold", for lack of better term  */
@@ -663,6 +667,8 @@ typedef struct p7_domaindef_s {
   
   /* Heuristic thresholds that control the stochastic traceback/clustering process */
   int    nsamples;	/* collect ensemble of this many stochastic traces */
+  int    nsamples_check;/* >0: adaptive; test for convergence every this many traces, stop early if converged; 0: always <nsamples> */
+  float  n2tol;         /* adaptive: converged when null2 log ratios in region move < n2tol nats in total, and clusters stay put */
   float  min_overlap;	/* 0.8 means >= 80% overlap of (smaller/larger) segment to link, both in seq and hmm            */
   int    of_smaller;	/* see above; TRUE means overlap denom is calc'ed wrt smaller segment; FALSE means larger       */
   int    max_diagdiff;	/* 4 means either start or endpoints of two segments must be within <=4 diagonals of each other */
@@ -681,6 +687,11 @@ typedef struct p7_domaindef_s {
   int    noverlaps;	/* number of envelopes defined in ensemble clustering that overlap w/ prev envelope */
   int    nenvelopes;	/* number of envelopes handed over for domain definition, null2, alignment, and scoring. */
 
+  /* What to build for each domain's alignment */
+  int    do_alidisplay;	/* TRUE (default): full alignment display; FALSE: coordinates only (no alignment output wanted) */
+
+  /* Optional parallelism across the regions of one long sequence (threaded builds only) */
+  int    nthreads;	/* >1: up to this many threads share the regions of a big sequence; 0 or 1: serial */
 } P7_DOMAINDEF;
 
 
@@ -695,6 +706,16 @@ typedef struct p7_domaindef_s {
 #define p7_IS_DROPPED       (1<<3)
 #define p7_IS_DUPLICATE     (1<<4)
 
+/* binary per-domain tables, p7_tophits_BinaryDomains() */
+#define p7_DOMBIN_MAGIC     0x70374442  /* "p7DB" read as a big-endian uint32; "BD7p" if byte-swapped */
+#define p7_DOMBIN_VERSION   1
+#define p7_DOMBIN_ALI       (1<<0)      /* records carry alignment strings */
+#define p7_DOMBIN_SCAN      (1<<1)      /* targets are models (hmmscan)    */
+
+/* binary saved hit lists, p7_tophits_WriteBinary() */
+#define p7_HITBIN_MAGIC     0x70374842  /* "p7HB" read as a big-endian uint32 */
+#define p7_HITBIN_VERSION   1
+
 
 /* Structure: P7_HIT
  * 
@@ -753,6 +774,14 @@ typedef struct p7_tophits_s {
   uint64_t nincluded;	/* number of hits that are includable       */
   int      is_sorted_by_sortkey; /* TRUE when hits sorted by sortkey and th->hit valid for all N hits */
   int      is_sorted_by_seqidx; /* TRUE when hits sorted by seq_idx, position, and th->hit valid for all N hits */
+
+  /* Optional bound on the list: keep only the <maxhits> best hits by sortkey */
+  uint64_t maxhits;	/* 0 = unbounded (default)                                    */
+  double   minkey;	/* hits with sortkey < minkey can't enter a bounded list       */
+  float   *pruned_sc;	/* [0..npruned-1] scores of targets pruned from the list       */
+  double  *pruned_lnP;	/* [0..npruned-1] their log P-values; both kept for domZ       */
+  uint64_t npruned;	/* number of pruned targets                                   */
+  uint64_t npruned_alloc;	/* current allocation of pruned_sc, pruned_lnP         */
 } P7_TOPHITS;
 
 
@@ -855,6 +884,33 @@ enum fm_direction_e {
   fm_backward   = 1,
 };
 
+/* How occurrence (rank) queries are answered. The sampled layout is the
+ * original one: occCnts_sb/occCnts_b checkpoints plus an SSE scan of the
+ * BWT between them. The rank-block layout interleaves cumulative counts
+ * with the BWT bits they cover, one 64-byte cache line per block, so a
+ * query is a single cache line touch and a few popcounts. The choice is
+ * made by makehmmerdb (--rankblocks) and recorded in the high bit of the
+ * fwd_only byte of the metadata header, so older indexes read unchanged.
+ */
+enum fm_ranklayout_e {
+  fm_RANK_SAMPLED = 0,
+  fm_RANK_BLOCKS  = 1,
+};
+#define FM_META_RANKBLOCKS_FLAG 0x80
+
+#define FM_RB_WORDS 3                  /* 64-bit words per bit plane                  */
+#define FM_RB_CHARS (64*FM_RB_WORDS)   /* 192 2-bit characters per rank block         */
+
+/* One rank block: counts of each of the 4 DNA characters in BWT[0..b*FM_RB_CHARS-1],
+ * followed by the block's characters split into a high-bit plane and a low-bit plane.
+ * Character k of the block is bit (k%64) of word (k/64) in each plane.
+ */
+typedef struct fm_rankblock_s {
+  uint32_t cnt[4];
+  uint64_t hi[FM_RB_WORDS];
+  uint64_t lo[FM_RB_WORDS];
+} FM_RANKBLOCK;
+
 
 typedef struct fm_interval_s {
   int   lower;
@@ -900,6 +956,7 @@ typedef struct fm_seqdata_s {
 
 typedef struct fm_metadata_s {
   uint8_t  fwd_only;
+  uint8_t  rank_layout; //fm_RANK_SAMPLED or fm_RANK_BLOCKS; packed into the fwd_only byte on disk
   uint8_t  alph_type;
   uint8_t  alph_size;
   uint8_t  charBits;
@@ -933,6 +990,8 @@ typedef struct fm_data_s {
   int64_t  *C; //the first position of each letter of the alphabet if all of T is sorted.  (signed, as I use that to keep tract of presence/absence)
   uint32_t *occCnts_sb;
   uint16_t *occCnts_b;
+  FM_RANKBLOCK *rb_mem;
+  FM_RANKBLOCK *rb;  // NULL unless meta->rank_layout == fm_RANK_BLOCKS; 64-byte aligned
 } FM_DATA;
 
 typedef struct fm_dp_pair_s {
@@ -1185,6 +1244,9 @@ typedef struct p7_pipeline_s {
   int             do_alignment_score_calc;
   P7_DOMAINDEF   *ddef;		/* domain definition workflow               */
 
+  /* Window lists for long targets, kept between targets (nhmmer)           */
+  P7_HMM_WINDOWLIST msv_windowlist; /* SSV-passing windows                  */
+  P7_HMM_WINDOWLIST vit_windowlist; /* Viterbi-passing windows              */
 
   /* Reporting threshold settings                                           */
   int     by_E;		        /* TRUE to cut per-target report off by E   */
@@ -1235,6 +1297,7 @@ typedef struct p7_pipeline_s {
   uint64_t      pos_past_vit;	/* # positions that pass ViterbiFilter()  (used for nhmmer) */
   uint64_t      pos_past_fwd;	/* # positions that pass ForwardFilter()  (used for nhmmer) */
   uint64_t      pos_output;	    /* # positions that make it to the final output (used for nhmmer) */
+  double        msvP;           /* MSV filter P-value of the most recent target (used for jackhmmer --skipfar) */
 
   enum p7_pipemodes_e mode;    	/* p7_SCAN_MODELS | p7_SEARCH_SEQS          */
   int           long_targets;   /* TRUE if the target sequences are expected to be very long (e.g. dna chromosome search in nhmmer) */
@@ -1290,6 +1353,7 @@ typedef struct p7_builder_s {
   int                  EfL;	         /* length of sequences generated for Forward fitting      */
   int                  EfN;	         /* # of sequences generated for Forward fitting           */
   double               Eft;	         /* tail mass used for Forward fitting                     */
+  int                  ncpus;	         /* # of threads scoring calibration seqs; 0 = serial      */
 
   /* Choice of prior                                                                               */
   P7_PRIOR            *prior;	         /* choice of prior when parameterizing from counts        */
@@ -1309,6 +1373,46 @@ typedef struct p7_builder_s {
 } P7_BUILDER;
 
 
+/* P7_MSASTREAM: a Pfam-format (one block) Stockholm file, read in
+ * sequential passes so that deep alignments can be built into models
+ * without ever holding the whole ESL_MSA in memory.
+ */
+#define p7_MSASTREAM_CHUNK 256	/* number of aligned seqs delivered per chunk */
+
+typedef struct p7_msastream_s {
+  FILE               *fp;	   /* open alignment file; must be seekable                 */
+  char               *filename;    /* name of the alignment file                            */
+  const ESL_ALPHABET *abc;	   /* digital alphabet                                      */
+  ESL_DSQ             inmap[128];  /* input map: <abc->inmap>, w/ [0] = unknown residue     */
+  char               *buf;	   /* current line, for esl_fgets()                         */
+  int                 nalloc;	   /* allocated size of <buf>                               */
+  int                 linenumber;  /* line number of the line in <buf>                      */
+
+  off_t               datastart;   /* offset of first line after "# STOCKHOLM" header       */
+  int                 startline;   /* line number of the header                             */
+  off_t               dataend;	   /* offset of the line after "//", or -1 if not known yet */
+  int                 endline;	   /* line number of the "//"                               */
+
+  /* Information on the current alignment, collected by the scan pass                       */
+  ESL_MSA            *hdr;	   /* zero-seq MSA: name, acc, desc, cutoffs, rf, cs, mm    */
+  int                 nseq;	   /* number of aligned sequences                           */
+  int64_t             alen;	   /* alignment length                                      */
+  uint32_t            checksum;    /* same as esl_msa_Checksum() of the digital MSA         */
+  int                *nres;	   /* canonical residue counts per column: [apos*K + x]     */
+  char               *badseq;	   /* first seq w/ ~ other than at fragment edges, or NULL  */
+  ESL_DSQ            *ax;	   /* digitized row, 1..alen, for the scan                  */
+  ESL_KEYHASH        *names;	   /* seq names seen in the scan, to catch duplicates       */
+
+  /* Chunks of aligned sequences, delivered in order in each later pass                     */
+  ESL_MSA            *chunk;	   /* up to p7_MSASTREAM_CHUNK digital rows, 1..alen        */
+  int                 nchunk;	   /* number of rows allocated in <chunk>                   */
+  int                 seqi;	   /* index of next seq to be read in this pass             */
+  int                 at_end;	   /* TRUE when this pass has reached the "//"              */
+
+  char                errmsg[eslERRBUFSIZE]; /* informative message on parse failure        */
+} P7_MSASTREAM;
+
+
 
 /*****************************************************************
  * 18. Routines in HMMER's exposed API.
@@ -1317,6 +1421,7 @@ typedef struct p7_builder_s {
 /* build.c */
 extern int p7_Handmodelmaker(ESL_MSA *msa,                P7_BUILDER *bld, P7_HMM **ret_hmm, P7_TRACE ***ret_tr);
 extern int p7_Fastmodelmaker(ESL_MSA *msa, float symfrac, P7_BUILDER *bld, P7_HMM **ret_hmm, P7_TRACE ***ret_tr);
+extern int p7_Streammodelmaker(P7_MSASTREAM *ms,          P7_BUILDER *bld, P7_HMM **ret_hmm);
 
 /* emit.c */
 extern int p7_CoreEmit   (ESL_RANDOMNESS *r, const P7_HMM *hmm,                                        ESL_SQ *sq, P7_TRACE *tr);
@@ -1334,6 +1439,9 @@ extern int p7_Lambda(P7_HMM *hmm, P7_BG *bg, double *ret_lambda);
 extern int p7_MSVMu     (ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambda,               double *ret_mmu);
 extern int p7_ViterbiMu (ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambda,               double *ret_vmu);
 extern int p7_Tau       (ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambda, double tailp, double *ret_tau);
+extern int p7_MSVMu_threaded    (ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambda,               int ncpus, double *ret_mmu);
+extern int p7_ViterbiMu_threaded(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambda,               int ncpus, double *ret_vmu);
+extern int p7_Tau_threaded      (ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambda, double tailp, int ncpus, double *ret_tau);
 
 /* eweight.c */
 extern int p7_EntropyWeight(const P7_HMM *hmm, const P7_BG *bg, const P7_PRIOR *pri, double infotarget, double *ret_Neff);
@@ -1460,11 +1568,13 @@ extern int p7_oprofile_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, i
 /* tracealign.c */
 extern int p7_tracealign_Seqs(ESL_SQ **sq,           P7_TRACE **tr, int nseq, int M,  int optflags, P7_HMM *hmm, ESL_MSA **ret_msa);
 extern int p7_tracealign_MSA (const ESL_MSA *premsa, P7_TRACE **tr,           int M,  int optflags, ESL_MSA **ret_postmsa);
+extern int p7_tracealign_SetThreads(int ncpus);
 extern int p7_tracealign_computeTraces(P7_HMM *hmm, ESL_SQ  **sq, int offset, int N, P7_TRACE  **tr);
 extern int p7_tracealign_getMSAandStats(P7_HMM *hmm, ESL_SQ  **sq, int N, ESL_MSA **ret_msa, float **ret_pp, float **ret_relent, float **ret_scores );
 
 /* p7_alidisplay.c */
 extern P7_ALIDISPLAY *p7_alidisplay_Create(const P7_TRACE *tr, int which, const P7_OPROFILE *om, const ESL_SQ *sq);
+extern P7_ALIDISPLAY *p7_alidisplay_CreateCoords(const P7_TRACE *tr, int which, const P7_OPROFILE *om, const ESL_SQ *sq);
 extern P7_ALIDISPLAY *p7_alidisplay_Clone(const P7_ALIDISPLAY *ad);
 extern size_t         p7_alidisplay_Sizeof(const P7_ALIDISPLAY *ad);
 extern int            p7_alidisplay_Serialize(P7_ALIDISPLAY *ad);
@@ -1501,6 +1611,7 @@ extern void        p7_builder_Destroy(P7_BUILDER *bld);
 
 extern int p7_Builder      (P7_BUILDER *bld, ESL_MSA *msa, P7_BG *bg, P7_HMM **opt_hmm, P7_TRACE ***opt_trarr, P7_PROFILE **opt_gm, P7_OPROFILE **opt_om, ESL_MSA **opt_postmsa);
 extern int p7_SingleBuilder(P7_BUILDER *bld, ESL_SQ *sq,   P7_BG *bg, P7_HMM **opt_hmm, P7_TRACE  **opt_tr,    P7_PROFILE **opt_gm, P7_OPROFILE **opt_om); 
+extern int p7_BuilderStream(P7_BUILDER *bld, P7_MSASTREAM *ms, P7_BG *bg, P7_HMM **opt_hmm, P7_PROFILE **opt_gm, P7_OPROFILE **opt_om);
 extern int p7_Builder_MaxLength      (P7_HMM *hmm, double emit_thresh);
 
 /* p7_domaindef.c */
@@ -1515,6 +1626,10 @@ extern int p7_domaindef_ByViterbi            (P7_PROFILE *gm, const ESL_SQ *sq,
 extern int p7_domaindef_ByPosteriorHeuristics(const ESL_SQ *sq, P7_OPROFILE *om, P7_OMX *oxf, P7_OMX *oxb, P7_OMX *fwd, P7_OMX *bck,
 				                                  P7_DOMAINDEF *ddef, P7_BG *bg, int long_target,
 				                                  P7_BG *bg_tmp, float *scores_arr, float *fwd_emissions_arr);
+#ifdef HMMER_THREADS
+extern void p7_domaindef_LendThread(void);
+extern void p7_domaindef_ReclaimThreads(void);
+#endif
 
 
 /* p7_gmx.c */
@@ -1584,9 +1699,21 @@ extern int  p7_hmmfile_Position(P7_HMMFILE *hfp, const off_t offset);
 
 /* p7_hmmwindow.c */
 int p7_hmmwindow_init (P7_HMM_WINDOWLIST *list);
+int p7_hmmwindow_grow (P7_HMM_WINDOWLIST *list, int n);
+void p7_hmmwindow_reuse (P7_HMM_WINDOWLIST *list);
+void p7_hmmwindow_destroy (P7_HMM_WINDOWLIST *list);
 P7_HMM_WINDOW *p7_hmmwindow_new (P7_HMM_WINDOWLIST *list, uint32_t id, uint32_t pos, uint32_t fm_pos, uint16_t k, uint32_t length, float score, uint8_t complementarity, uint32_t target_len);
+int p7_hmmwindow_merge (P7_HMM_WINDOWLIST *list, float pct_overlap);
+
 
 
+/* p7_msastream.c */
+extern int  p7_msastream_Open     (const char *filename, ESL_ALPHABET **byp_abc, P7_MSASTREAM **ret_ms, char *errbuf);
+extern int  p7_msastream_Next     (P7_MSASTREAM *ms);
+extern int  p7_msastream_Rewind   (P7_MSASTREAM *ms);
+extern int  p7_msastream_ReadChunk(P7_MSASTREAM *ms, ESL_MSA **ret_chunk);
+extern int  p7_msastream_PBWeights(P7_MSASTREAM *ms, double *wgt);
+extern void p7_msastream_Close    (P7_MSASTREAM *ms);
 
 /* p7_msvdata.c */
 extern P7_SCOREDATA   *p7_hmm_ScoreDataCreate(P7_OPROFILE *om, P7_PROFILE *gm );
@@ -1627,6 +1754,8 @@ extern int p7_Pipeline_LongTarget   (P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCORE
                                      , ESL_STOPWATCH *watch_slave
 */
                                      );
+extern int p7_Pipeline_LongTargetRevComp(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
+                                     P7_BG *bg, P7_TOPHITS *hitlist, int64_t seqidx, const ESL_SQ *sq);
 
 
 
@@ -1672,6 +1801,8 @@ extern void    p7_spensemble_Destroy(P7_SPENSEMBLE *sp);
 extern P7_TOPHITS *p7_tophits_Create(void);
 extern int         p7_tophits_Grow(P7_TOPHITS *h);
 extern int         p7_tophits_CreateNextHit(P7_TOPHITS *h, P7_HIT **ret_hit);
+extern int         p7_tophits_Admits(const P7_TOPHITS *h, double sortkey);
+extern int         p7_tophits_Prune(P7_TOPHITS *h, float score, double lnP);
 extern int         p7_tophits_Add(P7_TOPHITS *h,
 				  char *name, char *acc, char *desc, 
 				  double sortkey, 
@@ -1686,10 +1817,12 @@ extern int         p7_tophits_SortBySeqidxAndAlipos(P7_TOPHITS *h);
 extern int         p7_tophits_SortByModelnameAndAlipos(P7_TOPHITS *h);
 
 extern int         p7_tophits_Merge(P7_TOPHITS *h1, P7_TOPHITS *h2);
+extern int         p7_tophits_MergeAll(P7_TOPHITS *h1, P7_TOPHITS **hv, int nh);
 extern int         p7_tophits_GetMaxPositionLength(P7_TOPHITS *h);
 extern int         p7_tophits_GetMaxNameLength(P7_TOPHITS *h);
 extern int         p7_tophits_GetMaxAccessionLength(P7_TOPHITS *h);
 extern int         p7_tophits_GetMaxShownLength(P7_TOPHITS *h);
+extern int         p7_tophits_Reuse(P7_TOPHITS *h);
 extern void        p7_tophits_Destroy(P7_TOPHITS *h);
 
 extern int p7_tophits_ComputeNhmmerEvalues(P7_TOPHITS *th, double N, int W);
@@ -1703,10 +1836,13 @@ extern int p7_tophits_Alignment(const P7_TOPHITS *th, const ESL_ALPHABET *abc,
 				ESL_MSA **ret_msa);
 extern int p7_tophits_TabularTargets(FILE *ofp, char *qname, char *qacc, P7_TOPHITS *th, P7_PIPELINE *pli, int show_header);
 extern int p7_tophits_TabularDomains(FILE *ofp, char *qname, char *qacc, P7_TOPHITS *th, P7_PIPELINE *pli, int show_header);
+extern int p7_tophits_BinaryDomains(FILE *ofp, char *qname, char *qacc, P7_TOPHITS *th, P7_PIPELINE *pli, int show_ali);
 extern int p7_tophits_TabularXfam(FILE *ofp, char *qname, char *qacc, P7_TOPHITS *th, P7_PIPELINE *pli);
 extern int p7_tophits_TabularTail(FILE *ofp, const char *progname, enum p7_pipemodes_e pipemode, 
 				  const char *qfile, const char *tfile, const ESL_GETOPTS *go);
 extern int p7_tophits_AliScores(FILE *ofp, char *qname, P7_TOPHITS *th );
+extern int p7_tophits_WriteBinary(FILE *fp, const P7_TOPHITS *th, uint64_t first);
+extern int p7_tophits_ReadBinary (FILE *fp, P7_TOPHITS *th);
 
 /* p7_trace.c */
 extern P7_TRACE *p7_trace_Create(void);
@@ -1775,6 +1911,7 @@ extern int fm_initAmbiguityList (FM_AMBIGLIST *list);
 extern int fm_addAmbiguityRange (FM_AMBIGLIST *list, uint32_t start, uint32_t stop);
 extern int fm_convertRange2DSQ(const FM_DATA *fm, const FM_METADATA *meta, uint64_t first, int length, int complementarity, ESL_SQ *sq, int fix_ambiguities );
 extern int fm_initConfigGeneric( FM_CFG *cfg, ESL_GETOPTS *go);
+extern int fm_buildRankBlocks( FM_DATA *fm, const FM_METADATA *meta);
 
 /* fm_ssv.c */
 extern int p7_SSVFM_longlarget( P7_OPROFILE *om, float nu, P7_BG *bg, double F1,
@@ -1786,6 +1923,9 @@ extern int p7_SSVFM_longlarget( P7_OPROFILE *om, float nu, P7_BG *bg, double F1,
 extern int fm_configInit      (FM_CFG *cfg, ESL_GETOPTS *go);
 extern int fm_getOccCount     (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c);
 extern int fm_getOccCountLT   (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c, uint32_t *cnteq, uint32_t *cntlt);
+extern void fm_prefetchOcc     (const FM_DATA *fm, const FM_CFG *cfg, int pos);
+extern int fm_getOccCountRB   (const FM_DATA *fm, int pos, uint8_t c);
+extern int fm_getOccCountLTRB (const FM_DATA *fm, int pos, uint8_t c, uint32_t *cnteq, uint32_t *cntlt);
 
 
 
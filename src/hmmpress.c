@@ -9,38 +9,109 @@
 #include "easel.h"
 #include "esl_alphabet.h"
 #include "esl_getopts.h"
+#include "esl_ssi.h"
+
+#ifdef HMMER_THREADS
+#include <unistd.h>
+#include "esl_threads.h"
+#include "esl_workqueue.h"
+#endif /*HMMER_THREADS*/
 
 #include "hmmer.h"
 
+typedef struct {
+#ifdef HMMER_THREADS
+  ESL_WORK_QUEUE   *queue;
+#endif /*HMMER_THREADS*/
+  P7_HMMFILE       *hfp;	/* worker's own handle on <hmmfile>, repositioned to each record */
+  ESL_ALPHABET     *abc;	/* shared with the master; only read */
+  P7_BG            *bg;
+} WORKER_INFO;
+
+#ifdef HMMER_THREADS
+typedef struct {
+  int          nhmm;		/* 1..n for the models we press, in file order; 0 for an empty item */
+  int          processed;
+  off_t        offset;		/* disk offset of the model's record in <hmmfile> */
+  int          status;		/* eslOK, or the error from p7_hmmfile_Read()  */
+  P7_HMM      *hmm;
+  P7_OPROFILE *om;
+} WORK_ITEM;
+
+typedef struct _pending_s {
+  int          nhmm;
+  int          status;
+  P7_HMM      *hmm;
+  P7_OPROFILE *om;
+  struct _pending_s *next;
+} PENDING_ITEM;
+#endif /*HMMER_THREADS*/
+
+struct cfg_s {
+  char         *hmmfile;
+  P7_HMMFILE   *hfp;		/* open <hmmfile>                                          */
+  ESL_ALPHABET *abc;
+  off_t        *offset;		/* disk offsets of all <nrec> records, or NULL if not scanned */
+  int           nrec;
+  int           nskip;		/* # of leading models that are already pressed (--append) */
+  char        **name;		/* names of those <nskip> models, from the scan...           */
+  char        **acc;		/*   ... and their accessions (NULL if none)                 */
+  off_t        *moff;		/*   ... and their .h3m offsets, from the old SSI index      */
+
+  FILE         *mfp;		/* .h3m, .h3f, .h3p output                                 */
+  FILE         *ffp;
+  FILE         *pfp;
+  ESL_NEWSSI   *nssi;		/* .h3i output                                             */
+  uint16_t      fh;
+  int           nmodel;		/* # of models pressed in this run                         */
+  uint64_t      totM;
+};
+
 static ESL_OPTIONS options[] = {
   /* name           type      default  env  range     toggles      reqs   incomp  help   docgroup*/
   { "-h",        eslARG_NONE,   FALSE, NULL, NULL,      NULL,      NULL,    NULL, "show brief help on version and usage",          0 },
-  { "-f",        eslARG_NONE,   FALSE, NULL, NULL,      NULL,      NULL,    NULL, "force: overwrite any previous pressed files",   0 },
+  { "-f",        eslARG_NONE,   FALSE, NULL, NULL,      NULL,      NULL,"--append","force: overwrite any previous pressed files",   0 },
+  { "--append",  eslARG_NONE,   FALSE, NULL, NULL,      NULL,      NULL,    "-f", "press only models added to end of <hmmfile>",   0 },
+#ifdef HMMER_THREADS 
+  { "--cpu",     eslARG_INT,    NULL,"HMMER_NCPU","n>=0",NULL,     NULL,    NULL, "number of parallel CPU workers for multithreads",0 },
+#endif
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
 static char usage[]  = "[-options] <hmmfile>";
 static char banner[] = "prepare an HMM database for faster hmmscan searches";
 
-static void open_db_files(ESL_GETOPTS *go, char *basename, FILE **ret_mfp,  FILE **ret_ffp,  FILE **ret_pfp, ESL_NEWSSI **ret_nssi);
+static void         open_db_files(ESL_GETOPTS *go, char *basename, FILE **ret_mfp,  FILE **ret_ffp,  FILE **ret_pfp, ESL_NEWSSI **ret_nssi);
+static int          scan_hmmfile(char *hmmfile, int nnamed, struct cfg_s *cfg, char *errbuf);
+static int          read_pressed(struct cfg_s *cfg, ESL_SSI *ssi);
+static P7_OPROFILE *convert_model(P7_HMM *hmm, P7_BG *bg);
+static void         press_model(struct cfg_s *cfg, P7_HMM *hmm, P7_OPROFILE *om);
+static void         read_failure(struct cfg_s *cfg, int status);
+static void         serial_loop(WORKER_INFO *info, struct cfg_s *cfg);
+#ifdef HMMER_THREADS
+static void         thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, struct cfg_s *cfg);
+static void         pipeline_thread(void *arg);
+#endif /*HMMER_THREADS*/
 
 int
 main(int argc, char **argv)
 {
   ESL_GETOPTS   *go      = p7_CreateDefaultApp(options, 1, argc, argv, banner, usage);
-  ESL_ALPHABET  *abc     = NULL;
+  struct cfg_s   cfg;
   char          *hmmfile = esl_opt_GetArg(go, 1);
   P7_HMMFILE    *hfp     = NULL;
   P7_HMM        *hmm     = NULL;
-  P7_BG         *bg      = NULL;
-  P7_PROFILE    *gm      = NULL;
-  P7_OPROFILE   *om      = NULL;
-  FILE          *mfp     = NULL; 
-  FILE          *ffp     = NULL; 
-  FILE          *pfp     = NULL; 
-  ESL_NEWSSI    *nssi    = NULL;
-  uint16_t       fh      = 0;
-  int            nmodel  = 0;
-  uint64_t       totM    = 0;
+  ESL_SSI       *ssi     = NULL;
+  int            do_append = esl_opt_GetBoolean(go, "--append");
+  int            ncpus   = 0;
+  int            infocnt = 0;
+  WORKER_INFO   *info    = NULL;
+#ifdef HMMER_THREADS
+  WORK_ITEM     *item    = NULL;
+  ESL_THREADS   *threadObj = NULL;
+  ESL_WORK_QUEUE *queue  = NULL;
+#endif
+  char          *ssifile = NULL;
+  int            i;
   int            status;
   char           errbuf[eslERRBUFSIZE];
 
@@ -53,74 +124,188 @@ main(int argc, char **argv)
 
   if (hfp->do_stdin || hfp->do_gzip) p7_Fail("HMM file %s must be a normal file, not gzipped or a stdin pipe", hmmfile);
 
-  open_db_files(go, hmmfile, &mfp, &ffp, &pfp, &nssi);
+  cfg.hmmfile = hmmfile;
+  cfg.hfp     = hfp;
+  cfg.abc     = NULL;
+  cfg.offset  = NULL;
+  cfg.nrec    = 0;
+  cfg.nskip   = 0;
+  cfg.name    = NULL;
+  cfg.acc     = NULL;
+  cfg.moff    = NULL;
+  cfg.nmodel  = 0;
+  cfg.totM    = 0;
 
-  if (esl_newssi_AddFile(nssi, hfp->fname, 0, &fh) != eslOK) /* 0 = format code (HMMs don't have any yet) */
-    p7_Die("Failed to add HMM file %s to new SSI index\n", hfp->fname);
+#ifdef HMMER_THREADS
+  if (esl_opt_IsOn(go, "--cpu")) ncpus = esl_opt_GetInteger(go, "--cpu");
+  else                                   esl_threads_CPUCount(&ncpus);
+  if (hfp->efp == NULL) ncpus = 0; /* workers seek into and parse an ASCII file; a binary one is fast enough to read serially */
+#endif
 
-  printf("Working...    "); 
-  fflush(stdout);
+  /* With --append, the models named in the existing SSI index must be
+   * the leading models of <hmmfile>; only the ones after them get pressed.
+   */
+  if (do_append)
+    {
+      if (hfp->efp == NULL) p7_Fail("--append requires an ASCII HMM file, and %s is binary", hmmfile);
+      if (esl_sprintf(&ssifile, "%s.h3i", hmmfile) != eslOK) p7_Die("esl_sprintf() failed");
+      status = esl_ssi_Open(ssifile, &ssi);
+      if      (status == eslENOTFOUND) p7_Fail("--append: no SSI index %s found; press %s without --append first", ssifile, hmmfile);
+      else if (status != eslOK)        p7_Fail("--append: failed to open SSI index %s; re-press %s with -f", ssifile, hmmfile);
+      cfg.nskip = (int) ssi->nprimary;
+    }
 
-  while ((status = p7_hmmfile_Read(hfp, &abc, &hmm)) == eslOK)
+  /* The scan gives the workers (and --append) the offset of each model record */
+  if (do_append || ncpus > 0)
     {
-     if (hmm->name == NULL) p7_Fail("Every HMM must have a name to be indexed. Failed to find name of HMM #%d\n", nmodel+1);
+      status = scan_hmmfile(hmmfile, cfg.nskip, &cfg, errbuf);
+      if      (status == eslEFORMAT) p7_Fail("bad file format in HMM file %s:\n%s\n", hmmfile, errbuf);
+      else if (status != eslOK)      p7_Fail("Failed to scan HMM file %s:\n%s\n",     hmmfile, errbuf);
 
-     if (nmodel == 0) { 	/* first time initialization, now that alphabet known */
-	bg = p7_bg_Create(abc);
-	p7_bg_SetLength(bg, 400);
+      /* Read the first model to learn the alphabet, before any worker needs it. */
+      if (cfg.nrec > 0) {
+	if ((status = p7_hmmfile_Read(hfp, &(cfg.abc), &hmm)) != eslOK) read_failure(&cfg, status);
+	p7_hmm_Destroy(hmm);
       }
+    }
 
-      nmodel++;
-      totM += hmm->M;
+  if (do_append)
+    {
+      read_pressed(&cfg, ssi);
+      esl_ssi_Close(ssi);
+    }
 
-      gm = p7_profile_Create(hmm->M, abc);
-      p7_ProfileConfig(hmm, bg, gm, 400, p7_LOCAL);
-      om = p7_oprofile_Create(gm->M, abc);
-      p7_oprofile_Convert(gm, om);
-      
-      if ((om->offs[p7_MOFFSET] = ftello(mfp)) == -1) p7_Fail("Failed to ftello() current disk position of HMM db file");
-      if ((om->offs[p7_FOFFSET] = ftello(ffp)) == -1) p7_Fail("Failed to ftello() current disk position of MSV db file");
-      if ((om->offs[p7_POFFSET] = ftello(pfp)) == -1) p7_Fail("Failed to ftello() current disk position of profile db file");
+  open_db_files(go, hmmfile, &(cfg.mfp), &(cfg.ffp), &(cfg.pfp), &(cfg.nssi));
+
+  if (esl_newssi_AddFile(cfg.nssi, hfp->fname, 0, &(cfg.fh)) != eslOK) /* 0 = format code (HMMs don't have any yet) */
+    p7_Die("Failed to add HMM file %s to new SSI index\n", hfp->fname);
 
 #ifndef p7_IMPL_DUMMY
-      if (esl_newssi_AddKey(nssi, hmm->name, fh, om->offs[p7_MOFFSET], 0, 0) != eslOK)	p7_Fail("Failed to add key %s to SSI index", hmm->name);
-      if (hmm->acc) {
-	if (esl_newssi_AddAlias(nssi, hmm->acc, hmm->name) != eslOK) p7_Fail("Failed to add secondary key %s to SSI index", hmm->acc);
+  for (i = 0; i < cfg.nskip; i++)
+    {
+      if (esl_newssi_AddKey(cfg.nssi, cfg.name[i], cfg.fh, cfg.moff[i], 0, 0) != eslOK) p7_Fail("Failed to add key %s to SSI index", cfg.name[i]);
+      if (cfg.acc[i] && esl_newssi_AddAlias(cfg.nssi, cfg.acc[i], cfg.name[i]) != eslOK) p7_Fail("Failed to add secondary key %s to SSI index", cfg.acc[i]);
+    }
+#endif
+
+  printf("Working...    "); 
+  fflush(stdout);
+
+  /* After a scan, there's nothing left to press if every record was already pressed */
+  if (cfg.offset != NULL && cfg.nskip == cfg.nrec) ncpus = 0;
+
+#ifdef HMMER_THREADS
+  if (ncpus > 0)
+    {
+      threadObj = esl_threads_Create(&pipeline_thread);
+      queue = esl_workqueue_Create(ncpus * 2);
+    }
+#endif
+
+  infocnt = (ncpus == 0) ? 1 : ncpus;
+  ESL_ALLOC(info, sizeof(*info) * infocnt);
+
+  for (i = 0; i < infocnt; ++i)
+    {
+      info[i].hfp = NULL;
+      info[i].abc = cfg.abc;
+      info[i].bg  = NULL;
+      if (cfg.abc) {
+	info[i].bg = p7_bg_Create(cfg.abc);
+	p7_bg_SetLength(info[i].bg, 400);
       }
+
+#ifdef HMMER_THREADS
+      info[i].queue = queue;
+      if (ncpus > 0) 
+	{
+	  if (p7_hmmfile_OpenENoDB(hmmfile, NULL, &(info[i].hfp), errbuf) != eslOK) p7_Fail("Failed to reopen HMM file %s.\n%s\n", hmmfile, errbuf);
+	  esl_threads_AddThread(threadObj, &info[i]);
+	}
 #endif
+    }
 
-      p7_hmmfile_WriteBinary(mfp, -1, hmm);
-      p7_oprofile_Write(ffp, pfp, om);
+#ifdef HMMER_THREADS
+  for (i = 0; i < ncpus * 2; ++i)
+    {
+      ESL_ALLOC(item, sizeof(*item));
 
-      p7_profile_Destroy(gm);
-      p7_oprofile_Destroy(om);
-      p7_hmm_Destroy(hmm);
+      item->nhmm      = 0;
+      item->processed = FALSE;
+      item->offset    = 0;
+      item->status    = eslOK;
+      item->hmm       = NULL;
+      item->om        = NULL;
+
+      status = esl_workqueue_Init(queue, item);
+      if (status != eslOK) esl_fatal("Failed to add block to work queue");
     }
-  if      (status == eslEFORMAT)   p7_Fail("bad file format in HMM file %s",             hmmfile);
-  else if (status == eslEINCOMPAT) p7_Fail("HMM file %s contains different alphabets",   hmmfile);
-  else if (status != eslEOF)       p7_Fail("Unexpected error in reading HMMs from %s",   hmmfile);
+#endif
 
-  if (esl_newssi_Write(nssi) != eslOK) p7_Fail("Failed to write keys to ssi file\n");
+  if (cfg.offset == NULL || cfg.nskip < cfg.nrec)
+    {
+#ifdef HMMER_THREADS
+      if (ncpus > 0) thread_loop(threadObj, queue, &cfg);
+      else           serial_loop(info, &cfg);
+#else
+      serial_loop(info, &cfg);
+#endif
+    }
+
+  if (esl_newssi_Write(cfg.nssi) != eslOK) p7_Fail("Failed to write keys to ssi file\n");
   
   printf("done.\n");
-  if (nssi->nsecondary > 0) 
-    printf("Pressed and indexed %d HMMs (%ld names and %ld accessions).\n", nmodel, (long) nssi->nprimary, (long) nssi->nsecondary);
+  if (do_append)
+    printf("Appended %d HMMs to %d already pressed.\n", cfg.nmodel, cfg.nskip);
+  if (cfg.nssi->nsecondary > 0) 
+    printf("Pressed and indexed %d HMMs (%ld names and %ld accessions).\n", cfg.nskip + cfg.nmodel, (long) cfg.nssi->nprimary, (long) cfg.nssi->nsecondary);
   else 
-    printf("Pressed and indexed %d HMMs (%ld names).\n", nmodel, (long) nssi->nprimary);
+    printf("Pressed and indexed %d HMMs (%ld names).\n", cfg.nskip + cfg.nmodel, (long) cfg.nssi->nprimary);
   printf("Models pressed into binary file:   %s.h3m\n", hfp->fname);
   printf("SSI index for binary model file:   %s.h3i\n", hfp->fname);
   printf("Profiles (MSV part) pressed into:  %s.h3f\n", hfp->fname);
   printf("Profiles (remainder) pressed into: %s.h3p\n", hfp->fname);
 
-  fclose(mfp);
-  fclose(ffp); 
-  fclose(pfp);
-  esl_newssi_Close(nssi);
-  p7_bg_Destroy(bg);
+  for (i = 0; i < infocnt; ++i)
+    {
+      p7_bg_Destroy(info[i].bg);
+      if (info[i].hfp) p7_hmmfile_Close(info[i].hfp);
+    }
+  free(info);
+
+#ifdef HMMER_THREADS
+  if (ncpus > 0)
+    {
+      esl_workqueue_Reset(queue);
+      while (esl_workqueue_Remove(queue, (void **) &item) == eslOK)
+	free(item);
+      esl_workqueue_Destroy(queue);
+      esl_threads_Destroy(threadObj);
+    }
+#endif
+
+  for (i = 0; i < cfg.nskip; i++) 
+    {
+      free(cfg.name[i]);
+      free(cfg.acc[i]);
+    }
+  free(cfg.name);
+  free(cfg.acc);
+  free(cfg.moff);
+  free(cfg.offset);
+  free(ssifile);
+  fclose(cfg.mfp);
+  fclose(cfg.ffp); 
+  fclose(cfg.pfp);
+  esl_newssi_Close(cfg.nssi);
   p7_hmmfile_Close(hfp);
-  esl_alphabet_Destroy(abc);
+  esl_alphabet_Destroy(cfg.abc);
   esl_getopts_Destroy(go);
   return 0;
+
+ ERROR:
+  p7_Fail("hmmpress failed: memory allocation problem");
+  return status;
 }
 
 
@@ -136,25 +321,38 @@ open_db_files(ESL_GETOPTS *go, char *basename, FILE **ret_mfp,  FILE **ret_ffp,
   FILE       *pfp             = NULL;
   ESL_NEWSSI *nssi            = NULL;
   int         allow_overwrite = esl_opt_GetBoolean(go, "-f");
+  int         do_append       = esl_opt_GetBoolean(go, "--append");
+  char       *mode            = (do_append ? "r+b" : "wb");
   int         status;
 
+  /* An append rewrites the whole index: the old keys were read by read_pressed(). */
   if (esl_sprintf(&ssifile, "%s.h3i", basename) != eslOK) p7_Die("esl_sprintf() failed");
-  status = esl_newssi_Open(ssifile, allow_overwrite, &nssi);
+  status = esl_newssi_Open(ssifile, allow_overwrite || do_append, &nssi);
   if      (status == eslENOTFOUND)   p7_Fail("failed to open SSI index %s", ssifile);
   else if (status == eslEOVERWRITE)  p7_Fail("Looks like %s is already pressed (.h3i file present, anyway):\nDelete old hmmpress indices first", basename);
   else if (status != eslOK)          p7_Fail("failed to create a new SSI index");
 
   if (esl_sprintf(&mfile, "%s.h3m", basename) != eslOK) p7_Die("esl_sprintf() failed");
-  if (! allow_overwrite && esl_FileExists(mfile))       p7_Fail("Binary HMM file %s already exists;\nDelete old hmmpress indices first", mfile);
-  if ((mfp = fopen(mfile, "wb"))              == NULL)  p7_Fail("Failed to open binary HMM file %s for writing", mfile);
+  if (do_append && ! esl_FileExists(mfile))             p7_Fail("--append: binary HMM file %s not found; re-press with -f", mfile);
+  if (! allow_overwrite && ! do_append && esl_FileExists(mfile)) p7_Fail("Binary HMM file %s already exists;\nDelete old hmmpress indices first", mfile);
+  if ((mfp = fopen(mfile, mode))              == NULL)  p7_Fail("Failed to open binary HMM file %s for writing", mfile);
 
   if (esl_sprintf(&ffile, "%s.h3f", basename) != eslOK) p7_Die("esl_sprintf() failed");
-  if (! allow_overwrite && esl_FileExists(ffile))       p7_Fail("Binary MSV filter file %s already exists\nDelete old hmmpress indices first", ffile);
-  if ((ffp = fopen(ffile, "wb"))              == NULL)  p7_Fail("Failed to open binary MSV filter file %s for writing", ffile);
+  if (do_append && ! esl_FileExists(ffile))             p7_Fail("--append: binary MSV filter file %s not found; re-press with -f", ffile);
+  if (! allow_overwrite && ! do_append && esl_FileExists(ffile)) p7_Fail("Binary MSV filter file %s already exists\nDelete old hmmpress indices first", ffile);
+  if ((ffp = fopen(ffile, mode))              == NULL)  p7_Fail("Failed to open binary MSV filter file %s for writing", ffile);
 
   if (esl_sprintf(&pfile, "%s.h3p", basename) != eslOK) p7_Die("esl_sprintf() failed");
-  if (! allow_overwrite && esl_FileExists(pfile))       p7_Fail("Binary profile file %s already exists\nDelete old hmmpress indices first", pfile);
-  if ((pfp = fopen(pfile, "wb"))              == NULL)  p7_Fail("Failed to open binary profile file %s for writing", pfile);
+  if (do_append && ! esl_FileExists(pfile))             p7_Fail("--append: binary profile file %s not found; re-press with -f", pfile);
+  if (! allow_overwrite && ! do_append && esl_FileExists(pfile)) p7_Fail("Binary profile file %s already exists\nDelete old hmmpress indices first", pfile);
+  if ((pfp = fopen(pfile, mode))              == NULL)  p7_Fail("Failed to open binary profile file %s for writing", pfile);
+
+  if (do_append) 
+    {
+      if (fseeko(mfp, 0, SEEK_END) != 0) p7_Fail("Failed to fseeko() to end of %s", mfile);
+      if (fseeko(ffp, 0, SEEK_END) != 0) p7_Fail("Failed to fseeko() to end of %s", ffile);
+      if (fseeko(pfp, 0, SEEK_END) != 0) p7_Fail("Failed to fseeko() to end of %s", pfile);
+    }
 
   free(mfile);     free(ffile);     free(pfile);      free(ssifile);
   *ret_mfp = mfp;  *ret_ffp = ffp;  *ret_pfp = pfp;   *ret_nssi = nssi;
@@ -162,6 +360,379 @@ open_db_files(ESL_GETOPTS *go, char *basename, FILE **ret_mfp,  FILE **ret_ffp,
 }
 
 
+/* scan_hmmfile()
+ * Find where each model record starts in ASCII <hmmfile>, without
+ * parsing the models: records start at their "HMMER" format tag
+ * lines and end at "//". For the first <nnamed> records, also keep
+ * their NAME and ACC. Sets <cfg->offset>, <cfg->nrec>, and (if
+ * <nnamed> > 0) <cfg->name>, <cfg->acc>.
+ *
+ * Returns <eslEFORMAT> with a message in <errbuf> if anything but
+ * blank lines appears between records; <eslENOTFOUND> if the file
+ * can't be opened.
+ */
+static int
+scan_hmmfile(char *hmmfile, int nnamed, struct cfg_s *cfg, char *errbuf)
+{
+  FILE   *fp      = NULL;
+  char   *buf     = NULL;
+  int     n       = 0;
+  char   *s;
+  char   *tok;
+  off_t   pos     = 0;
+  off_t   start;
+  int     linenum = 0;
+  int     in_hmm  = FALSE;
+  int     nalloc  = 256;
+  void   *p;
+  int     i;
+  int     status;
+
+  ESL_ALLOC(cfg->offset, sizeof(off_t) * nalloc);
+  if (nnamed > 0) {
+    ESL_ALLOC(cfg->name, sizeof(char *) * nnamed);
+    ESL_ALLOC(cfg->acc,  sizeof(char *) * nnamed);
+    for (i = 0; i < nnamed; i++) cfg->name[i] = cfg->acc[i] = NULL;
+  }
+  cfg->nrec = 0;
+
+  if ((fp = fopen(hmmfile, "r")) == NULL) ESL_XFAIL(eslENOTFOUND, errbuf, "couldn't open %s for reading", hmmfile);
+
+  while ((status = esl_fgets(&buf, &n, fp)) == eslOK)
+    {
+      linenum++;
+      start  = pos;
+      pos   += strlen(buf);
+
+      if (strncmp(buf, "HMMER", 5) == 0)
+	{
+	  if (cfg->nrec == nalloc) {
+	    nalloc *= 2;
+	    ESL_RALLOC(cfg->offset, p, sizeof(off_t) * nalloc);
+	  }
+	  cfg->offset[cfg->nrec++] = start;
+	  in_hmm = TRUE;
+	}
+      else if (strncmp(buf, "//", 2) == 0)
+	in_hmm = FALSE;
+      else if (! in_hmm && buf[strspn(buf, " \t\r\n")] != '\0')
+	ESL_XFAIL(eslEFORMAT, errbuf, "line %d: unexpected text outside any HMM record", linenum);
+      else if (in_hmm && cfg->nrec <= nnamed && (strncmp(buf, "NAME ", 5) == 0 || strncmp(buf, "ACC ", 4) == 0))
+	{
+	  s = buf;
+	  esl_strtok(&s, " \t\r\n", &tok);                     /* the NAME or ACC tag */
+	  if (esl_strtok(&s, " \t\r\n", &tok) != eslOK) continue; /* leave an empty field to the parser */
+	  if (buf[0] == 'N') status = esl_strdup(tok, -1, &(cfg->name[cfg->nrec-1]));
+	  else               status = esl_strdup(tok, -1, &(cfg->acc[cfg->nrec-1]));
+	  if (status != eslOK) goto ERROR;
+	}
+    }
+  if (status != eslEOF) ESL_XFAIL(status, errbuf, "read failed at line %d", linenum);
+
+  fclose(fp);
+  free(buf);
+  return eslOK;
+
+ ERROR:
+  if (status == eslEMEM) sprintf(errbuf, "allocation failed");
+  if (fp) fclose(fp);
+  free(buf);
+  return status;
+}
+
+
+/* read_pressed()
+ * For --append: check that the models in the old SSI index <ssi> are
+ * the first <cfg->nskip> models of <hmmfile>, in order, and collect
+ * their .h3m offsets so the new index can list them again.
+ * Any mismatch is fatal; the user has to re-press with -f.
+ */
+static int
+read_pressed(struct cfg_s *cfg, ESL_SSI *ssi)
+{
+  uint16_t fh;
+  int      i;
+  int      status;
+
+  if (cfg->nrec < cfg->nskip) 
+    p7_Fail("--append: %s has %d models, but %d are already pressed;\nre-press with -f", cfg->hmmfile, cfg->nrec, cfg->nskip);
+
+  ESL_ALLOC(cfg->moff, sizeof(off_t) * ESL_MAX(1, cfg->nskip));
+  for (i = 0; i < cfg->nskip; i++)
+    {
+      if (cfg->name[i] == NULL) 
+	p7_Fail("Every HMM must have a name to be indexed. Failed to find name of HMM #%d\n", i+1);
+      if (esl_ssi_FindName(ssi, cfg->name[i], &fh, &(cfg->moff[i]), NULL, NULL) != eslOK ||
+	  (i > 0 && cfg->moff[i] <= cfg->moff[i-1]))
+	p7_Fail("--append: HMM #%d (%s) in %s isn't where the pressed files have it;\nre-press with -f", i+1, cfg->name[i], cfg->hmmfile);
+    }
+  return eslOK;
+
+ ERROR:
+  p7_Fail("read_pressed failed: memory allocation problem");
+  return status;
+}
+
+
+/* convert_model()
+ * Configure <hmm> as hmmscan will use it, and return its 
+ * optimized profile.
+ */
+static P7_OPROFILE *
+convert_model(P7_HMM *hmm, P7_BG *bg)
+{
+  P7_PROFILE  *gm = p7_profile_Create(hmm->M, hmm->abc);
+  P7_OPROFILE *om = p7_oprofile_Create(hmm->M, hmm->abc);
+
+  if (gm == NULL || om == NULL) p7_Fail("Failed to allocate profiles for HMM %s", hmm->name ? hmm->name : "");
+  p7_ProfileConfig(hmm, bg, gm, 400, p7_LOCAL);
+  p7_oprofile_Convert(gm, om);
+  p7_profile_Destroy(gm);
+  return om;
+}
+
+
+/* press_model()
+ * Write the next model to the pressed files and index it.
+ * Models must come here in file order.
+ */
+static void
+press_model(struct cfg_s *cfg, P7_HMM *hmm, P7_OPROFILE *om)
+{
+  if (hmm->name == NULL) p7_Fail("Every HMM must have a name to be indexed. Failed to find name of HMM #%d\n", cfg->nskip + cfg->nmodel + 1);
+
+  cfg->nmodel++;
+  cfg->totM += hmm->M;
+
+  if ((om->offs[p7_MOFFSET] = ftello(cfg->mfp)) == -1) p7_Fail("Failed to ftello() current disk position of HMM db file");
+  if ((om->offs[p7_FOFFSET] = ftello(cfg->ffp)) == -1) p7_Fail("Failed to ftello() current disk position of MSV db file");
+  if ((om->offs[p7_POFFSET] = ftello(cfg->pfp)) == -1) p7_Fail("Failed to ftello() current disk position of profile db file");
+
+#ifndef p7_IMPL_DUMMY
+  if (esl_newssi_AddKey(cfg->nssi, hmm->name, cfg->fh, om->offs[p7_MOFFSET], 0, 0) != eslOK)	p7_Fail("Failed to add key %s to SSI index", hmm->name);
+  if (hmm->acc) {
+    if (esl_newssi_AddAlias(cfg->nssi, hmm->acc, hmm->name) != eslOK) p7_Fail("Failed to add secondary key %s to SSI index", hmm->acc);
+  }
+#endif
+
+  p7_hmmfile_WriteBinary(cfg->mfp, -1, hmm);
+  p7_oprofile_Write(cfg->ffp, cfg->pfp, om);
+}
+
+
+static void
+read_failure(struct cfg_s *cfg, int status)
+{
+  if      (status == eslEFORMAT)   p7_Fail("bad file format in HMM file %s",             cfg->hmmfile);
+  else if (status == eslEINCOMPAT) p7_Fail("HMM file %s contains different alphabets",   cfg->hmmfile);
+  else if (status == eslEOF)       p7_Fail("bad file format in HMM file %s",             cfg->hmmfile); /* a scanned record came up empty */
+  else                             p7_Fail("Unexpected error in reading HMMs from %s",   cfg->hmmfile);
+}
+
+
+static void
+serial_loop(WORKER_INFO *info, struct cfg_s *cfg)
+{
+  P7_HMM      *hmm = NULL;
+  P7_OPROFILE *om  = NULL;
+  int          status;
+
+  if (cfg->offset != NULL && p7_hmmfile_Position(cfg->hfp, cfg->offset[cfg->nskip]) != eslOK)
+    p7_Fail("Failed to position HMM file %s to its first new model", cfg->hmmfile);
+
+  while ((status = p7_hmmfile_Read(cfg->hfp, &(cfg->abc), &hmm)) == eslOK)
+    {
+      if (info->bg == NULL) { 	/* first time initialization, now that alphabet known */
+	info->bg = p7_bg_Create(cfg->abc);
+	p7_bg_SetLength(info->bg, 400);
+      }
+
+      om = convert_model(hmm, info->bg);
+      press_model(cfg, hmm, om);
+
+      p7_oprofile_Destroy(om);
+      p7_hmm_Destroy(hmm);
+    }
+  if (status != eslEOF) read_failure(cfg, status);
+}
+
+
+#ifdef HMMER_THREADS
+/* thread_loop()
+ * The master hands out record offsets from the scan; the workers
+ * read and convert the models; the master presses them in file order,
+ * holding any that finish early on a pending list.
+ */
+static void
+thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, struct cfg_s *cfg)
+{
+  int          status    = eslOK;
+  int          sstatus   = eslOK;
+  int          processed = 0;
+  int          nread     = 0;
+  WORK_ITEM   *item;
+  void        *newItem;
+
+  int           next     = 1;
+  PENDING_ITEM *top      = NULL;
+  PENDING_ITEM *empty    = NULL;
+  PENDING_ITEM *tmp      = NULL;
+
+  esl_workqueue_Reset(queue);
+  esl_threads_WaitForStart(obj);
+
+  status = esl_workqueue_ReaderUpdate(queue, NULL, &newItem);
+  if (status != eslOK) esl_fatal("Work queue reader failed");
+      
+  /* Main loop: */
+  item = (WORK_ITEM *) newItem;
+  while (sstatus == eslOK) {
+    sstatus = (cfg->nskip + nread < cfg->nrec) ? eslOK : eslEOF;
+    if (sstatus == eslOK) {
+      item->offset = cfg->offset[cfg->nskip + nread];
+      item->nhmm   = ++nread;
+    }
+    else if (processed < nread) sstatus = eslOK;
+	  
+    if (sstatus == eslOK) {
+      status = esl_workqueue_ReaderUpdate(queue, item, &newItem);
+      if (status != eslOK) esl_fatal("Work queue reader failed");
+
+      /* process any results */
+      item = (WORK_ITEM *) newItem;
+      if (item->processed == TRUE) {
+	++processed;
+
+	/* press in the same order as <hmmfile> */
+	if (item->nhmm == next) {
+	  if (item->status != eslOK) read_failure(cfg, item->status);
+	  press_model(cfg, item->hmm, item->om);
+
+	  p7_oprofile_Destroy(item->om);
+	  p7_hmm_Destroy(item->hmm);
+
+	  ++next;
+
+	  /* press any pending models as long as the order
+	   * remains the same as read in.
+	   */
+	  while (top != NULL && top->nhmm == next) {
+	    if (top->status != eslOK) read_failure(cfg, top->status);
+	    press_model(cfg, top->hmm, top->om);
+
+	    p7_oprofile_Destroy(top->om);
+	    p7_hmm_Destroy(top->hmm);
+
+	    tmp = top;
+	    top = tmp->next;
+
+	    tmp->next = empty;
+	    empty     = tmp;
+	    
+	    ++next;
+	  }
+	} else {
+	  /* hold the model until the ones before it are pressed */
+	  if (empty != NULL) {
+	    tmp   = empty;
+	    empty = tmp->next;
+	  } else {
+	    ESL_ALLOC(tmp, sizeof(PENDING_ITEM));
+	  }
+
+	  tmp->nhmm    = item->nhmm;
+	  tmp->status  = item->status;
+	  tmp->hmm     = item->hmm;
+	  tmp->om      = item->om;
+
+	  /* add the model to the pending list */
+	  if (top == NULL || tmp->nhmm < top->nhmm) {
+	    tmp->next = top;
+	    top       = tmp;
+	  } else {
+	    PENDING_ITEM *ptr = top;
+	    while (ptr->next != NULL && tmp->nhmm > ptr->next->nhmm) {
+	      ptr = ptr->next;
+	    }
+	    tmp->next = ptr->next;
+	    ptr->next = tmp;
+	  }
+	}
+
+	item->nhmm      = 0;
+	item->processed = FALSE;
+	item->status    = eslOK;
+	item->hmm       = NULL;
+	item->om        = NULL;
+      }
+    }
+  }
+
+  if (top != NULL) esl_fatal("Top is not empty\n");
+
+  while (empty != NULL) {
+    tmp   = empty;
+    empty = tmp->next;
+    free(tmp);
+  }
+
+  status = esl_workqueue_ReaderUpdate(queue, item, NULL);
+  if (status != eslOK) esl_fatal("Work queue reader failed");
+
+  /* wait for all the threads to complete */
+  esl_threads_WaitForFinish(obj);
+  esl_workqueue_Complete(queue);  
+  return;
+
+ ERROR:
+  p7_Fail("thread_loop failed: memory allocation problem");
+}
+
+static void 
+pipeline_thread(void *arg)
+{
+  int           workeridx;
+  int           status;
+
+  WORK_ITEM    *item;
+  void         *newItem;
+
+  WORKER_INFO  *info;
+  ESL_THREADS  *obj;
+
+  obj = (ESL_THREADS *) arg;
+  esl_threads_Started(obj, &workeridx);
+
+  info = (WORKER_INFO *) esl_threads_GetData(obj, workeridx);
+
+  status = esl_workqueue_WorkerUpdate(info->queue, NULL, &newItem);
+  if (status != eslOK) esl_fatal("Work queue worker failed");
+
+  /* loop until all models have been processed */
+  item = (WORK_ITEM *) newItem;
+  while (item->nhmm != 0)
+    {
+      /* errors are reported by the master, when it gets to this model in order */
+      item->status = p7_hmmfile_Position(info->hfp, item->offset);
+      if (item->status == eslOK) item->status = p7_hmmfile_Read(info->hfp, &(info->abc), &item->hmm);
+      if (item->status == eslOK) item->om     = convert_model(item->hmm, info->bg);
+      item->processed = TRUE;
+
+      status = esl_workqueue_WorkerUpdate(info->queue, item, &newItem);
+      if (status != eslOK) esl_fatal("Work queue worker failed");
+
+      item = (WORK_ITEM *) newItem;
+    }
+
+  status = esl_workqueue_WorkerUpdate(info->queue, item, NULL);
+  if (status != eslOK) esl_fatal("Work queue worker failed");
+
+  esl_threads_Finished(obj, workeridx);
+  return;
+}
+#endif /*HMMER_THREADS*/
+
+
 /*****************************************************************
  * HMMER - Biological sequence analysis with profile HMMs
  * Version 3.1b2; February 2015
@@ -45,8 +45,49 @@ if ($? != 0)                                     { die "hmmpress -f failed to pr
 if ($output !~ /Pressed and indexed (\d+) HMMs/) { die "unexpected hmmpress -f output"; }
 if ($1 != $nmodels)                              { die "unexpected number of models after hmmpress -f"; }
 
+# Press all but the last model, then restore the last one and
+# press it with --append. The pressed files should be the same as
+# pressing all of them at once.
+#
+foreach $sfx ("h3m", "h3i", "h3f", "h3p") { rename("$tmppfx.hmm.$sfx", "$tmppfx.full.$sfx") || die "failed to rename $tmppfx.hmm.$sfx"; }
+open(HMMFILE, "$tmppfx.hmm") || die "failed to read $tmppfx.hmm";
+$hmmtext = join("", <HMMFILE>);
+close HMMFILE;
+@records = split(/^(?=HMMER)/m, $hmmtext);
+pop @records;
+$prefix = join("", @records);
+
+open(HMMFILE, ">$tmppfx.hmm") || die "failed to write $tmppfx.hmm";
+print HMMFILE $prefix;
+close HMMFILE;
+$output = `$hmmpress $tmppfx.hmm 2>&1`;
+if ($? != 0)                                     { die "failed to press all but last model"; }
+if ($output !~ /Pressed and indexed (\d+) HMMs/) { die "unexpected hmmpress output"; }
+if ($1 != $nmodels-1)                            { die "unexpected number of models pressed"; }
+
+open(HMMFILE, ">$tmppfx.hmm") || die "failed to write $tmppfx.hmm";
+print HMMFILE $hmmtext;
+close HMMFILE;
+$output = `$hmmpress --append $tmppfx.hmm 2>&1`;
+if ($? != 0)                                     { die "hmmpress --append failed"; }
+if ($output !~ /Appended 1 HMMs to (\d+) already pressed/) { die "unexpected hmmpress --append output"; }
+if ($1 != $nmodels-1)                            { die "unexpected number of models already pressed"; }
+if ($output !~ /Pressed and indexed (\d+) HMMs/) { die "unexpected hmmpress --append output"; }
+if ($1 != $nmodels)                              { die "unexpected number of models after hmmpress --append"; }
+foreach $sfx ("h3m", "h3i", "h3f", "h3p") {
+    system("cmp $tmppfx.hmm.$sfx $tmppfx.full.$sfx > /dev/null 2>&1");
+    if ($? != 0) { die "hmmpress --append gave different .$sfx file"; }
+}
+
+# --append with nothing new only rewrites the same index.
+$output = `$hmmpress --append $tmppfx.hmm 2>&1`;
+if ($? != 0)                                     { die "hmmpress --append with no new models failed"; }
+system("cmp $tmppfx.hmm.h3i $tmppfx.full.h3i > /dev/null 2>&1");
+if ($? != 0)                                     { die "hmmpress --append with no new models changed the index"; }
+
 print "ok\n";
 unlink <$tmppfx.hmm*>;
+unlink <$tmppfx.full.*>;
 exit 0;
 
 
@@ -14,6 +14,7 @@
 #include "easel.h"
 #include "esl_alphabet.h"
 #include "esl_getopts.h"
+#include "esl_mem.h"
 #include "esl_sq.h"
 #include "esl_sqio.h"
 #include "esl_stopwatch.h"
@@ -30,6 +31,7 @@
 #endif /*HMMER_THREADS*/
 
 #include "hmmer.h"
+#include "p7_hmmcache.h"
 
 typedef struct {
 #ifdef HMMER_THREADS
@@ -39,8 +41,22 @@ typedef struct {
   P7_BG            *bg;	         /* null model                              */
   P7_PIPELINE      *pli;         /* work pipeline                           */
   P7_TOPHITS       *th;          /* top hit results                         */
+
+  /* --cache: a batch of queries against the resident profile database */
+  P7_HMMCACHE      *hcache;      /* resident profile database               */
+  ESL_SQ          **qsqv;        /* batch of query sequences [0..nq-1]      */
+  int               nq;          /* number of queries in the batch          */
+  P7_PIPELINE      *qpli;        /* per-query accounting [0..nq-1]; see cache_master() */
+  P7_TOPHITS      **thv;         /* per-query hit lists [0..nq-1]           */
 } WORKER_INFO;
 
+#ifdef HMMER_THREADS
+typedef struct {
+  int               start;       /* index of first profile in the block, in the cache */
+  int               n;           /* # of profiles in block; 0 tells the worker to stop */
+} WORK_ITEM;
+#endif /*HMMER_THREADS*/
+
 #define REPOPTS     "-E,-T,--cut_ga,--cut_nc,--cut_tc"
 #define DOMREPOPTS  "--domE,--domT,--cut_ga,--cut_nc,--cut_tc"
 #define INCOPTS     "--incE,--incT,--cut_ga,--cut_nc,--cut_tc"
@@ -56,9 +72,11 @@ typedef struct {
 #endif
 
 #ifdef HAVE_MPI
-#define DAEMONOPTS  "-o,--tblout,--domtblout,--pfamtblout,--mpi,--stall"
+#define DAEMONOPTS  "-o,--tblout,--domtblout,--dombinout,--pfamtblout,--mpi,--stall"
+#define CACHEOPTS   "--daemon,--mpi"
 #else
-#define DAEMONOPTS  "-o,--tblout,--domtblout,--pfamtblout"
+#define DAEMONOPTS  "-o,--tblout,--domtblout,--dombinout,--pfamtblout"
+#define CACHEOPTS   "--daemon"
 #endif
 
 static ESL_OPTIONS options[] = {
@@ -68,6 +86,8 @@ static ESL_OPTIONS options[] = {
   { "-o",           eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "direct output to file <f>, not stdout",                         2 },
   { "--tblout",     eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save parseable table of per-sequence hits to file <f>",         2 },
   { "--domtblout",  eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save parseable table of per-domain hits to file <f>",           2 },
+  { "--dombinout",  eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save binary table of per-domain hits to file <f>",              2 },
+  { "--dombinali",  eslARG_NONE,   FALSE, NULL, NULL,    NULL,  "--dombinout",NULL,     "include alignment strings in --dombinout table",                2 },
   { "--pfamtblout", eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save table of hits and domains to file, in Pfam format <f>",    2 },
   { "--acc",        eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "prefer accessions over names in output",                        2 },
   { "--noali",      eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "don't output alignments, so output is smaller",                 2 },
@@ -98,8 +118,11 @@ static ESL_OPTIONS options[] = {
   { "-Z",           eslARG_REAL,   FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "set # of comparisons done, for E-value calculation",           12 },
   { "--domZ",       eslARG_REAL,   FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "set # of significant seqs, for domain E-value calculation",    12 },
   { "--seed",       eslARG_INT,    "42",  NULL, "n>=0",  NULL,  NULL,  NULL,            "set RNG seed to <n> (if 0: one-time arbitrary seed)",          12 },
+  { "--dsample",    eslARG_INT,    FALSE, NULL, "n>0",   NULL,  NULL,  NULL,            "adaptive trace sampling: test convergence every <n> traces",   12 },
   { "--qformat",    eslARG_STRING,  NULL, NULL, NULL,    NULL,  NULL,  NULL,            "assert input <seqfile> is in format <s>: no autodetection",    12 },
   { "--daemon",     eslARG_NONE,    NULL, NULL, NULL,    NULL,  NULL,  DAEMONOPTS,      "run program as a daemon",                                      12 },
+  { "--cache",      eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  CACHEOPTS,       "keep profile db resident; search query seqs in batches",       12 },
+  { "--qbatch",     eslARG_INT,   "1000", NULL, "n>0",   NULL,"--cache", NULL,          "with --cache: number of query seqs per batch",                 12 },
 #ifdef HMMER_THREADS
   { "--cpu",        eslARG_INT, NULL,"HMMER_NCPU","n>=0",NULL,  NULL,  CPUOPTS,         "number of parallel CPU workers to use for multithreads",       12 },
 #endif
@@ -130,11 +153,15 @@ static char banner[] = "search sequence(s) against a profile database";
 
 static int  serial_master(ESL_GETOPTS *go, struct cfg_s *cfg);
 static int  serial_loop  (WORKER_INFO *info, P7_HMMFILE *hfp);
+static int  cache_master (ESL_GETOPTS *go, struct cfg_s *cfg);
+static void cache_loop   (WORKER_INFO *info, int start, int n);
 #ifdef HMMER_THREADS
 #define BLOCK_SIZE 1000
 
 static int  thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_HMMFILE *hfp);
 static void pipeline_thread(void *arg);
+static void cache_thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, int N, int blocksize);
+static void cache_pipeline_thread(void *arg);
 #endif /*HMMER_THREADS*/
 
 #ifdef HAVE_MPI
@@ -221,6 +248,8 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *hmmfile, char *seqfile)
   if (esl_opt_IsUsed(go, "-o")          && fprintf(ofp, "# output directed to file:         %s\n",            esl_opt_GetString(go, "-o"))          < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--tblout")    && fprintf(ofp, "# per-seq hits tabular output:     %s\n",            esl_opt_GetString(go, "--tblout"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domtblout") && fprintf(ofp, "# per-dom hits tabular output:     %s\n",            esl_opt_GetString(go, "--domtblout")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dombinout") && fprintf(ofp, "# per-dom hits binary output:      %s\n",            esl_opt_GetString(go, "--dombinout")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dombinali") && fprintf(ofp, "# alignments in binary table:      yes\n")                                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--pfamtblout")&& fprintf(ofp, "# pfam-style tabular hit output:   %s\n",            esl_opt_GetString(go, "--pfamtblout")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--acc")       && fprintf(ofp, "# prefer accessions over names:    yes\n")                                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--noali")     && fprintf(ofp, "# show alignments in output:       no\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -245,12 +274,15 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *hmmfile, char *seqfile)
   if (esl_opt_IsUsed(go, "--nonull2")   && fprintf(ofp, "# null2 bias corrections:          off\n")                                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "-Z")          && fprintf(ofp, "# sequence search space set to:    %.0f\n",          esl_opt_GetReal(go, "-Z"))            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domZ")      && fprintf(ofp, "# domain search space set to:      %.0f\n",          esl_opt_GetReal(go, "--domZ"))        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dsample")    && fprintf(ofp, "# adaptive trace sampling every:   %d\n",             esl_opt_GetInteger(go, "--dsample")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--seed"))  {
     if (esl_opt_GetInteger(go, "--seed")==0 && fprintf(ofp, "# random number seed:              one-time arbitrary\n")                              < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
     else if (                                  fprintf(ofp, "# random number seed set to:       %d\n",        esl_opt_GetInteger(go, "--seed"))     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   }
   if (esl_opt_IsUsed(go, "--qformat")   && fprintf(ofp, "# input seqfile format asserted:   %s\n",            esl_opt_GetString(go, "--qformat"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--daemon")    && fprintf(ofp, "run as a daemon process\n")                                                                < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--cache")     && fprintf(ofp, "# profile database kept resident:  yes\n")                                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--qbatch")    && fprintf(ofp, "# query seqs per batch:            %d\n",            esl_opt_GetInteger(go, "--qbatch"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 #ifdef HMMER_THREADS
   if (esl_opt_IsUsed(go, "--cpu")       && fprintf(ofp, "# number of worker threads:        %d\n",            esl_opt_GetInteger(go, "--cpu"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");  
 #endif
@@ -306,7 +338,8 @@ main(int argc, char **argv)
   else
 #endif /*HAVE_MPI*/
     {
-      status = serial_master(go, &cfg);
+      if (esl_opt_GetBoolean(go, "--cache")) status = cache_master (go, &cfg);
+      else                                   status = serial_master(go, &cfg);
     }
 
   esl_getopts_Destroy(go);
@@ -327,6 +360,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   FILE            *ofp      = stdout;	         /* output file for results (default stdout)        */
   FILE            *tblfp    = NULL;		 /* output stream for tabular per-seq (--tblout)    */
   FILE            *domtblfp = NULL;	  	 /* output stream for tabular per-seq (--domtblout) */
+  FILE            *dombinfp = NULL;	  	 /* output stream for binary per-dom (--dombinout) */
   FILE            *pfamtblfp= NULL;              /* output stream for pfam tabular output (--pfamtblout)    */
   int              seqfmt   = eslSQFILE_UNKNOWN; /* format of seqfile                               */
   ESL_SQFILE      *sqfp     = NULL;              /* open seqfile                                    */
@@ -346,6 +380,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   int              infocnt  = 0;
   WORKER_INFO     *info     = NULL;
+  P7_TOPHITS     **thv      = NULL;  /* the other workers' hit lists, for merging into info[0]'s */
 #ifdef HMMER_THREADS
   P7_OM_BLOCK     *block    = NULL;
   ESL_THREADS     *threadObj= NULL;
@@ -402,6 +437,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (esl_opt_IsOn(go, "-o"))          { if ((ofp      = fopen(esl_opt_GetString(go, "-o"),          "w")) == NULL)  esl_fatal("Failed to open output file %s for writing\n",                 esl_opt_GetString(go, "-o")); }
   if (esl_opt_IsOn(go, "--tblout"))    { if ((tblfp    = fopen(esl_opt_GetString(go, "--tblout"),    "w")) == NULL)  esl_fatal("Failed to open tabular per-seq output file %s for writing\n", esl_opt_GetString(go, "--tblout")); }
   if (esl_opt_IsOn(go, "--domtblout")) { if ((domtblfp = fopen(esl_opt_GetString(go, "--domtblout"), "w")) == NULL)  esl_fatal("Failed to open tabular per-dom output file %s for writing\n", esl_opt_GetString(go, "--domtblout")); }
+  if (esl_opt_IsOn(go, "--dombinout")) { if ((dombinfp = fopen(esl_opt_GetString(go, "--dombinout"), "w")) == NULL)  esl_fatal("Failed to open binary per-dom output file %s for writing\n", esl_opt_GetString(go, "--dombinout")); }
   if (esl_opt_IsOn(go, "--pfamtblout")){ if ((pfamtblfp = fopen(esl_opt_GetString(go, "--pfamtblout"), "w")) == NULL)  esl_fatal("Failed to open pfam-style tabular output file %s for writing\n", esl_opt_GetString(go, "--pfamtblout")); }
 
   output_header(ofp, go, cfg->hmmfile, cfg->seqfile);
@@ -420,6 +456,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   infocnt = (ncpus == 0) ? 1 : ncpus;
   ESL_ALLOC(info, sizeof(*info) * infocnt);
+  ESL_ALLOC(thv,  sizeof(P7_TOPHITS *) * infocnt);
 
   for (i = 0; i < infocnt; ++i)
     {
@@ -468,6 +505,9 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	  /* Create processing pipeline and hit list */
 	  info[i].th  = p7_tophits_Create(); 
 	  info[i].pli = p7_pipeline_Create(go, 100, 100, FALSE, p7_SCAN_MODELS); /* M_hint = 100, L_hint = 100 are just dummies for now */
+	  info[i].pli->ddef->do_alidisplay = (info[i].pli->show_alignments || esl_opt_GetBoolean(go, "--dombinali"));  /* build full alignment displays only if they get shown */
+	  if (esl_opt_IsOn(go, "--dsample")) info[i].pli->ddef->nsamples_check = esl_opt_GetInteger(go, "--dsample");
+	  info[i].pli->ddef->nthreads = ncpus;
 	  info[i].pli->hfp = hfp;  /* for two-stage input, pipeline needs <hfp> */
 
 	  p7_pli_NewSeq(info[i].pli, qsq);
@@ -492,10 +532,11 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	default: 	   p7_Fail("Unexpected error in reading HMMs from %s",   cfg->hmmfile); 
 	}
 
-      /* merge the results of the search results */
+      /* merge the results of the search results; each worker has sorted its own hits */
+      for (i = 1; i < infocnt; ++i) thv[i-1] = info[i].th;
+      p7_tophits_MergeAll(info[0].th, thv, infocnt-1);
       for (i = 1; i < infocnt; ++i)
 	{
-	  p7_tophits_Merge(info[0].th, info[i].th);
 	  p7_pipeline_Merge(info[0].pli, info[i].pli);
 
 	  p7_pipeline_Destroy(info[i].pli);
@@ -511,6 +552,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
       if (tblfp)     p7_tophits_TabularTargets(tblfp,    qsq->name, qsq->acc, info->th, info->pli, (nquery == 1));
       if (domtblfp)  p7_tophits_TabularDomains(domtblfp, qsq->name, qsq->acc, info->th, info->pli, (nquery == 1));
+      if (dombinfp)  p7_tophits_BinaryDomains(dombinfp, qsq->name, qsq->acc, info->th, info->pli, esl_opt_GetBoolean(go, "--dombinali"));
       if (pfamtblfp) p7_tophits_TabularXfam(pfamtblfp, qsq->name, qsq->acc, info->th, info->pli);
 
       esl_stopwatch_Stop(w);
@@ -552,6 +594,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 #endif
 
   free(info);
+  free(thv);
 
   esl_sq_Destroy(qsq);
   esl_stopwatch_Destroy(w);
@@ -561,6 +604,281 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (ofp != stdout) fclose(ofp);
   if (tblfp)         fclose(tblfp);
   if (domtblfp)      fclose(domtblfp);
+  if (dombinfp)      fclose(dombinfp);
+  if (pfamtblfp)     fclose(pfamtblfp);
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* cache_master()
+ * The --cache version of serial_master().
+ *
+ * The pressed profile database is read once, into a P7_HMMCACHE,
+ * and stays resident. Query sequences are read in batches of up to
+ * --qbatch, and each batch is searched model-major: each resident
+ * profile is compared to every query in the batch before going on
+ * to the next profile. Each query has its own hit list and its own
+ * pipeline accounting. Results are then output query by query, in
+ * input order, just as serial_master() would have.
+ *
+ * The per-query accounting <qpli[q]> is a struct copy of the worker's
+ * <pli>. The copies share <pli>'s DP matrices and domain definition
+ * workspace, which a worker only uses for one comparison at a time,
+ * while keeping their own counters (and hence Z). Only <pli> itself
+ * is ever destroyed.
+ *
+ * The CPU time reported for each query is that of its whole batch.
+ */
+static int
+cache_master(ESL_GETOPTS *go, struct cfg_s *cfg)
+{
+  FILE            *ofp      = stdout;	         /* output file for results (default stdout)        */
+  FILE            *tblfp    = NULL;		 /* output stream for tabular per-seq (--tblout)    */
+  FILE            *domtblfp = NULL;	  	 /* output stream for tabular per-seq (--domtblout) */
+  FILE            *dombinfp = NULL;	  	 /* output stream for binary per-dom (--dombinout) */
+  FILE            *pfamtblfp= NULL;              /* output stream for pfam tabular output (--pfamtblout)    */
+  int              seqfmt   = eslSQFILE_UNKNOWN; /* format of seqfile                               */
+  ESL_SQFILE      *sqfp     = NULL;              /* open seqfile                                    */
+  P7_HMMFILE      *hfp      = NULL;		 /* open HMM database file                          */
+  P7_HMMCACHE     *hcache   = NULL;		 /* resident profile database                       */
+  char            *dbname   = NULL;              /* resolved name of the HMM database               */
+  ESL_ALPHABET    *abc      = NULL;              /* sequence alphabet (owned by <hcache>)           */
+  ESL_STOPWATCH   *w        = NULL;              /* timing                                          */
+  ESL_SQ         **qsqv     = NULL;		 /* batch of query sequences                        */
+  int              qbatch   = esl_opt_GetInteger(go, "--qbatch");
+  int              nq       = 0;                 /* # of queries in current batch                   */
+  int              nquery   = 0;
+  int              textw;
+  int              status   = eslOK;
+  int              sstatus  = eslOK;
+  int              i, q;
+
+  int              ncpus    = 0;
+
+  int              infocnt  = 0;
+  WORKER_INFO     *info     = NULL;
+  P7_TOPHITS     **thv      = NULL;  /* one query's hit lists from the other workers, for merging */
+  P7_PIPELINE     *pli      = NULL;
+  P7_TOPHITS      *th       = NULL;
+#ifdef HMMER_THREADS
+  WORK_ITEM       *item     = NULL;
+  ESL_THREADS     *threadObj= NULL;
+  ESL_WORK_QUEUE  *queue    = NULL;
+#endif
+  char             errbuf[eslERRBUFSIZE];
+
+  w = esl_stopwatch_Create();
+
+  if (esl_opt_GetBoolean(go, "--notextw")) textw = 0;
+  else                                     textw = esl_opt_GetInteger(go, "--textw");
+
+  /* If caller declared an input format, decode it */
+  if (esl_opt_IsOn(go, "--qformat")) {
+    seqfmt = esl_sqio_EncodeFormat(esl_opt_GetString(go, "--qformat"));
+    if (seqfmt == eslSQFILE_UNKNOWN) p7_Fail("%s is not a recognized input sequence file format\n", esl_opt_GetString(go, "--qformat"));
+  }
+
+  /* Open the target profile database, just to find it (possibly in $HMMERDB) and check that it's pressed */
+  status = p7_hmmfile_OpenE(cfg->hmmfile, p7_HMMDBENV, &hfp, errbuf);
+  if      (status == eslENOTFOUND) p7_Fail("File existence/permissions problem in trying to open HMM file %s.\n%s\n", cfg->hmmfile, errbuf);
+  else if (status == eslEFORMAT)   p7_Fail("File format problem, trying to open HMM file %s.\n%s\n",                  cfg->hmmfile, errbuf);
+  else if (status != eslOK)        p7_Fail("Unexpected error %d in opening HMM file %s.\n%s\n",               status, cfg->hmmfile, errbuf);  
+  if (! hfp->is_pressed)           p7_Fail("Failed to open binary auxfiles for %s: use hmmpress first\n",             hfp->fname);
+
+  /* hfp->fname is the .h3m file we found; the cache wants the base name */
+  if (esl_memstrdup(hfp->fname, strlen(hfp->fname) - 4, &dbname) != eslOK) p7_Fail("allocation failure");
+  p7_hmmfile_Close(hfp);
+
+  /* Read all the profiles into memory */
+  status = p7_hmmcache_Open(dbname, &hcache, errbuf);
+  if      (status == eslEFORMAT)   p7_Fail("bad format, binary auxfiles, %s:\n%s",     cfg->hmmfile, errbuf);
+  else if (status == eslEINCOMPAT) p7_Fail("HMM file %s contains different alphabets", cfg->hmmfile);
+  else if (status != eslOK)        p7_Fail("Unexpected error in reading HMMs from %s", cfg->hmmfile); 
+  if (hcache->n == 0)              p7_Fail("Unexpected error in reading HMMs from %s", cfg->hmmfile); 
+  abc = hcache->abc;
+
+  /* Open the query sequence database */
+  status = esl_sqfile_OpenDigital(abc, cfg->seqfile, seqfmt, NULL, &sqfp);
+  if      (status == eslENOTFOUND) p7_Fail("Failed to open sequence file %s for reading\n",      cfg->seqfile);
+  else if (status == eslEFORMAT)   p7_Fail("Sequence file %s is empty or misformatted\n",        cfg->seqfile);
+  else if (status == eslEINVAL)    p7_Fail("Can't autodetect format of a stdin or .gz seqfile");
+  else if (status != eslOK)        p7_Fail("Unexpected error %d opening sequence file %s\n", status, cfg->seqfile);
+
+  ESL_ALLOC(qsqv, sizeof(ESL_SQ *) * qbatch);
+  for (q = 0; q < qbatch; q++) qsqv[q] = esl_sq_CreateDigital(abc);
+
+  /* Open the results output files */
+  if (esl_opt_IsOn(go, "-o"))          { if ((ofp      = fopen(esl_opt_GetString(go, "-o"),          "w")) == NULL)  esl_fatal("Failed to open output file %s for writing\n",                 esl_opt_GetString(go, "-o")); }
+  if (esl_opt_IsOn(go, "--tblout"))    { if ((tblfp    = fopen(esl_opt_GetString(go, "--tblout"),    "w")) == NULL)  esl_fatal("Failed to open tabular per-seq output file %s for writing\n", esl_opt_GetString(go, "--tblout")); }
+  if (esl_opt_IsOn(go, "--domtblout")) { if ((domtblfp = fopen(esl_opt_GetString(go, "--domtblout"), "w")) == NULL)  esl_fatal("Failed to open tabular per-dom output file %s for writing\n", esl_opt_GetString(go, "--domtblout")); }
+  if (esl_opt_IsOn(go, "--dombinout")) { if ((dombinfp = fopen(esl_opt_GetString(go, "--dombinout"), "w")) == NULL)  esl_fatal("Failed to open binary per-dom output file %s for writing\n", esl_opt_GetString(go, "--dombinout")); }
+  if (esl_opt_IsOn(go, "--pfamtblout")){ if ((pfamtblfp = fopen(esl_opt_GetString(go, "--pfamtblout"), "w")) == NULL)  esl_fatal("Failed to open pfam-style tabular output file %s for writing\n", esl_opt_GetString(go, "--pfamtblout")); }
+
+  output_header(ofp, go, cfg->hmmfile, cfg->seqfile);
+
+#ifdef HMMER_THREADS
+  /* initialize thread data */
+  if (esl_opt_IsOn(go, "--cpu")) ncpus = esl_opt_GetInteger(go, "--cpu");
+  else                           esl_threads_CPUCount(&ncpus);
+
+  if (ncpus > 0)
+    {
+      threadObj = esl_threads_Create(&cache_pipeline_thread);
+      queue     = esl_workqueue_Create(ncpus * 2);
+    }
+#endif
+
+  infocnt = (ncpus == 0) ? 1 : ncpus;
+  ESL_ALLOC(info, sizeof(*info) * infocnt);
+  ESL_ALLOC(thv,  sizeof(P7_TOPHITS *) * infocnt);
+
+  for (i = 0; i < infocnt; ++i)
+    {
+      info[i].bg     = p7_bg_Create(abc);
+      info[i].pli    = p7_pipeline_Create(go, 100, 100, FALSE, p7_SCAN_MODELS); /* M_hint = 100, L_hint = 100 are just dummies for now */
+      info[i].pli->ddef->do_alidisplay = (info[i].pli->show_alignments || esl_opt_GetBoolean(go, "--dombinali"));
+      if (esl_opt_IsOn(go, "--dsample")) info[i].pli->ddef->nsamples_check = esl_opt_GetInteger(go, "--dsample");
+      info[i].pli->ddef->nthreads = ncpus;
+      info[i].hcache = hcache;
+      info[i].qsqv   = qsqv;
+      info[i].nq     = 0;
+      info[i].qpli   = NULL;
+      info[i].thv    = NULL;
+      ESL_ALLOC(info[i].qpli, sizeof(P7_PIPELINE)  * qbatch);
+      ESL_ALLOC(info[i].thv,  sizeof(P7_TOPHITS *) * qbatch);
+#ifdef HMMER_THREADS
+      info[i].queue  = queue;
+#endif
+    }
+
+#ifdef HMMER_THREADS
+  for (i = 0; i < ncpus * 2; ++i)
+    {
+      ESL_ALLOC(item, sizeof(WORK_ITEM));
+      status = esl_workqueue_Init(queue, item);
+      if (status != eslOK)  esl_fatal("Failed to add block to work queue");
+    }
+#endif
+
+  /* Outside loop: over each batch of query sequences in <seqfile>. */
+  while (sstatus == eslOK)
+    {
+      for (nq = 0; nq < qbatch; nq++)
+	if ((sstatus = esl_sqio_Read(sqfp, qsqv[nq])) != eslOK) break;
+      if (nq == 0) break;
+
+      esl_stopwatch_Start(w);	                          
+
+      for (i = 0; i < infocnt; ++i)
+	{
+	  info[i].nq = nq;
+	  for (q = 0; q < nq; q++)
+	    {
+	      info[i].qpli[q] = *(info[i].pli);
+	      p7_pli_NewSeq(&(info[i].qpli[q]), qsqv[q]);
+	      info[i].thv[q]  = p7_tophits_Create(); 
+	    }
+#ifdef HMMER_THREADS
+	  if (ncpus > 0) esl_threads_AddThread(threadObj, &info[i]);
+#endif
+	}
+
+#ifdef HMMER_THREADS
+      if (ncpus > 0)  cache_thread_loop(threadObj, queue, hcache->n, ESL_MAX(1, ESL_MIN(BLOCK_SIZE, hcache->n / (ncpus * 4))));
+      else	      cache_loop(info, 0, hcache->n);
+#else
+      cache_loop(info, 0, hcache->n);
+#endif
+      esl_stopwatch_Stop(w);
+
+      for (q = 0; q < nq; q++)
+	{
+	  pli = &(info[0].qpli[q]);
+	  th  = info[0].thv[q];
+	  nquery++;
+
+	  /* merge the results of the search results; each worker has sorted its own hits */
+	  for (i = 1; i < infocnt; ++i) thv[i-1] = info[i].thv[q];
+	  p7_tophits_MergeAll(th, thv, infocnt-1);
+	  for (i = 1; i < infocnt; ++i)
+	    {
+	      p7_pipeline_Merge(pli, &(info[i].qpli[q]));
+	      p7_tophits_Destroy(info[i].thv[q]);
+	    }
+
+	  if (fprintf(ofp, "Query:       %s  [L=%ld]\n", qsqv[q]->name, (long) qsqv[q]->n) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+	  if (qsqv[q]->acc[0]  != 0 && fprintf(ofp, "Accession:   %s\n", qsqv[q]->acc)         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+	  if (qsqv[q]->desc[0] != 0 && fprintf(ofp, "Description: %s\n", qsqv[q]->desc)        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+
+	  /* Print results */
+	  p7_tophits_SortBySortkey(th);
+	  p7_tophits_Threshold(th, pli);
+
+	  p7_tophits_Targets(ofp, th, pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+	  p7_tophits_Domains(ofp, th, pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+
+	  if (tblfp)     p7_tophits_TabularTargets(tblfp,    qsqv[q]->name, qsqv[q]->acc, th, pli, (nquery == 1));
+	  if (domtblfp)  p7_tophits_TabularDomains(domtblfp, qsqv[q]->name, qsqv[q]->acc, th, pli, (nquery == 1));
+	  if (dombinfp)  p7_tophits_BinaryDomains(dombinfp, qsqv[q]->name, qsqv[q]->acc, th, pli, esl_opt_GetBoolean(go, "--dombinali"));
+	  if (pfamtblfp) p7_tophits_TabularXfam(pfamtblfp, qsqv[q]->name, qsqv[q]->acc, th, pli);
+
+	  p7_pli_Statistics(ofp, pli, w);
+	  if (fprintf(ofp, "//\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+
+	  p7_tophits_Destroy(th);
+	  esl_sq_Reuse(qsqv[q]);
+	}
+      fflush(ofp);
+    }
+  if      (sstatus == eslEFORMAT) esl_fatal("Parse failed (sequence file %s):\n%s\n",
+					    sqfp->filename, esl_sqfile_GetErrorBuf(sqfp));
+  else if (sstatus != eslEOF)     esl_fatal("Unexpected error %d reading sequence file %s",
+					    sstatus, sqfp->filename);
+
+  /* Terminate outputs - any last words?
+   */
+  if (tblfp)    p7_tophits_TabularTail(tblfp,    "hmmscan", p7_SCAN_MODELS, cfg->seqfile, cfg->hmmfile, go);
+  if (domtblfp) p7_tophits_TabularTail(domtblfp, "hmmscan", p7_SCAN_MODELS, cfg->seqfile, cfg->hmmfile, go);
+  if (pfamtblfp)p7_tophits_TabularTail(pfamtblfp,"hmmscan", p7_SEARCH_SEQS, cfg->seqfile, cfg->hmmfile, go);
+  if (ofp)      { if (fprintf(ofp, "[ok]\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
+
+  /* Cleanup - prepare for successful exit
+   */
+  for (i = 0; i < infocnt; ++i)
+    {
+      p7_bg_Destroy(info[i].bg);
+      p7_pipeline_Destroy(info[i].pli);
+      free(info[i].qpli);
+      free(info[i].thv);
+    }
+
+#ifdef HMMER_THREADS
+  if (ncpus > 0)
+    {
+      esl_workqueue_Reset(queue);
+      while (esl_workqueue_Remove(queue, (void **) &item) == eslOK)
+	free(item);
+      esl_workqueue_Destroy(queue);
+      esl_threads_Destroy(threadObj);
+    }
+#endif
+
+  free(info);
+  free(thv);
+
+  for (q = 0; q < qbatch; q++) esl_sq_Destroy(qsqv[q]);
+  free(qsqv);
+  esl_stopwatch_Destroy(w);
+  esl_sqfile_Close(sqfp);
+  p7_hmmcache_Close(hcache);
+  free(dbname);
+
+  if (ofp != stdout) fclose(ofp);
+  if (tblfp)         fclose(tblfp);
+  if (domtblfp)      fclose(domtblfp);
+  if (dombinfp)      fclose(dombinfp);
   if (pfamtblfp)     fclose(pfamtblfp);
   return eslOK;
 
@@ -739,6 +1057,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   FILE            *ofp      = stdout;	         /* output file for results (default stdout)        */
   FILE            *tblfp    = NULL;		 /* output stream for tabular per-seq (--tblout)    */
   FILE            *domtblfp = NULL;	  	 /* output stream for tabular per-seq (--domtblout) */
+  FILE            *dombinfp = NULL;	  	 /* output stream for binary per-dom (--dombinout) */
   FILE            *pfamtblfp= NULL;              /* output stream for pfam-style tabular output  (--pfamtblout) */
   int              seqfmt   = eslSQFILE_UNKNOWN; /* format of seqfile                               */
   P7_BG           *bg       = NULL;	         /* null model                                      */
@@ -805,6 +1124,8 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
     mpi_failure("Failed to open tabular per-seq output file %s for writing\n", esl_opt_GetString(go, "--tblfp"));
   if (esl_opt_IsOn(go, "--domtblout") && (domtblfp = fopen(esl_opt_GetString(go, "--domtblout"), "w")) == NULL)  
     mpi_failure("Failed to open tabular per-dom output file %s for writing\n", esl_opt_GetString(go, "--domtblfp"));
+  if (esl_opt_IsOn(go, "--dombinout") && (dombinfp = fopen(esl_opt_GetString(go, "--dombinout"), "w")) == NULL)  
+    mpi_failure("Failed to open binary per-dom output file %s for writing\n", esl_opt_GetString(go, "--dombinout"));
   if (esl_opt_IsOn(go, "--pfamtblout") && (pfamtblfp = fopen(esl_opt_GetString(go, "--pfamtblout"), "w")) == NULL)
     mpi_failure("Failed to open pfam-style tabular output file %s for writing\n", esl_opt_GetString(go, "--pfamtblout"));
  
@@ -843,6 +1164,8 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       /* Create processing pipeline and hit list */
       th  = p7_tophits_Create(); 
       pli = p7_pipeline_Create(go, 100, 100, FALSE, p7_SCAN_MODELS); /* M_hint = 100, L_hint = 100 are just dummies for now */
+      pli->ddef->do_alidisplay = (pli->show_alignments || esl_opt_GetBoolean(go, "--dombinali"));
+      if (esl_opt_IsOn(go, "--dsample")) pli->ddef->nsamples_check = esl_opt_GetInteger(go, "--dsample");
       pli->hfp = hfp;  /* for two-stage input, pipeline needs <hfp> */
 
       p7_pli_NewSeq(pli, qsq);
@@ -942,6 +1265,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
       if (tblfp)     p7_tophits_TabularTargets(tblfp,    qsq->name, qsq->acc, th, pli, (nquery == 1));
       if (domtblfp)  p7_tophits_TabularDomains(domtblfp, qsq->name, qsq->acc, th, pli, (nquery == 1));
+      if (dombinfp)  p7_tophits_BinaryDomains(dombinfp, qsq->name, qsq->acc, th, pli, esl_opt_GetBoolean(go, "--dombinali"));
       if (pfamtblfp) p7_tophits_TabularXfam(pfamtblfp,   qsq->name, qsq->acc, th, pli);
 
       esl_stopwatch_Stop(w);
@@ -1001,6 +1325,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (ofp != stdout) fclose(ofp);
   if (tblfp)         fclose(tblfp);
   if (domtblfp)      fclose(domtblfp);
+  if (dombinfp)      fclose(dombinfp);
   if (pfamtblfp)     fclose(pfamtblfp);
 
   return eslOK;
@@ -1078,6 +1403,8 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
       /* Create processing pipeline and hit list */
       th  = p7_tophits_Create(); 
       pli = p7_pipeline_Create(go, 100, 100, FALSE, p7_SCAN_MODELS); /* M_hint = 100, L_hint = 100 are just dummies for now */
+      pli->ddef->do_alidisplay = (pli->show_alignments || esl_opt_GetBoolean(go, "--dombinali"));
+      if (esl_opt_IsOn(go, "--dsample")) pli->ddef->nsamples_check = esl_opt_GetInteger(go, "--dsample");
       pli->hfp = hfp;  /* for two-stage input, pipeline needs <hfp> */
 
       p7_pli_NewSeq(pli, qsq);
@@ -1198,6 +1525,35 @@ serial_loop(WORKER_INFO *info, P7_HMMFILE *hfp)
   return status;
 }
 
+/* cache_loop()
+ * Compare resident profiles <start..start+n-1> to each query in the
+ * current batch, model-major. Used serially, and by each worker
+ * thread on the blocks of profiles it's given. A profile is only
+ * ever worked on by one thread at a time, so reconfiguring its
+ * length for each query is safe.
+ */
+static void
+cache_loop(WORKER_INFO *info, int start, int n)
+{
+  P7_OPROFILE   *om;
+  int            m, q;
+
+  for (m = start; m < start + n; m++)
+    {
+      om = info->hcache->list[m];
+      for (q = 0; q < info->nq; q++)
+	{
+	  p7_pli_NewModel(&(info->qpli[q]), om, info->bg);
+	  p7_bg_SetLength(info->bg, info->qsqv[q]->n);
+	  p7_oprofile_ReconfigLength(om, info->qsqv[q]->n);
+
+	  p7_Pipeline(&(info->qpli[q]), om, info->bg, info->qsqv[q], info->thv[q]);
+
+	  p7_pipeline_Reuse(&(info->qpli[q]));
+	}
+    }
+}
+
 #ifdef HMMER_THREADS
 static int
 thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_HMMFILE *hfp)
@@ -1240,6 +1596,7 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_HMMFILE *hfp)
     {
       /* wait for all the threads to complete */
       esl_threads_WaitForFinish(obj);
+      p7_domaindef_ReclaimThreads();
       esl_workqueue_Complete(queue);  
     }
   
@@ -1295,9 +1652,92 @@ pipeline_thread(void *arg)
       block = (P7_OM_BLOCK *) newBlock;
     }
 
+  /* sort this worker's hits now, in parallel with the others, ready for the merge */
+  p7_tophits_SortBySortkey(info->th);
+
   status = esl_workqueue_WorkerUpdate(info->queue, block, NULL);
   if (status != eslOK) esl_fatal("Work queue worker failed");
 
+  p7_domaindef_LendThread();
+  esl_threads_Finished(obj, workeridx);
+  return;
+}
+static void
+cache_thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, int N, int blocksize)
+{
+  int        status;
+  int        next     = 0;
+  int        eofCount = 0;
+  WORK_ITEM *item;
+  void      *newItem;
+
+  esl_workqueue_Reset(queue);
+  esl_threads_WaitForStart(obj);
+
+  status = esl_workqueue_ReaderUpdate(queue, NULL, &newItem);
+  if (status != eslOK) esl_fatal("Work queue reader failed");
+
+  while (eofCount < esl_threads_GetWorkerCount(obj))
+    {
+      item        = (WORK_ITEM *) newItem;
+      item->start = next;
+      item->n     = ESL_MIN(blocksize, N - next);
+      next       += item->n;
+      if (item->n == 0) eofCount++;
+
+      status = esl_workqueue_ReaderUpdate(queue, item, &newItem);
+      if (status != eslOK) esl_fatal("Work queue reader failed");
+    }
+
+  status = esl_workqueue_ReaderUpdate(queue, newItem, NULL);
+  if (status != eslOK) esl_fatal("Work queue reader failed");
+
+  /* wait for all the threads to complete */
+  esl_threads_WaitForFinish(obj);
+  p7_domaindef_ReclaimThreads();
+  esl_workqueue_Complete(queue);  
+}
+
+static void 
+cache_pipeline_thread(void *arg)
+{
+  int          status;
+  int          workeridx;
+  int          q;
+  WORKER_INFO *info;
+  ESL_THREADS *obj;
+  WORK_ITEM   *item;
+  void        *newItem;
+  
+  impl_Init();
+
+  obj = (ESL_THREADS *) arg;
+  esl_threads_Started(obj, &workeridx);
+
+  info = (WORKER_INFO *) esl_threads_GetData(obj, workeridx);
+
+  status = esl_workqueue_WorkerUpdate(info->queue, NULL, &newItem);
+  if (status != eslOK) esl_fatal("Work queue worker failed");
+
+  /* loop until all blocks have been processed */
+  item = (WORK_ITEM *) newItem;
+  while (item->n > 0)
+    {
+      cache_loop(info, item->start, item->n);
+
+      status = esl_workqueue_WorkerUpdate(info->queue, item, &newItem);
+      if (status != eslOK) esl_fatal("Work queue worker failed");
+
+      item = (WORK_ITEM *) newItem;
+    }
+
+  /* sort this worker's hits for each query now, in parallel with the others, ready for the merge */
+  for (q = 0; q < info->nq; q++) p7_tophits_SortBySortkey(info->thv[q]);
+
+  status = esl_workqueue_WorkerUpdate(info->queue, item, NULL);
+  if (status != eslOK) esl_fatal("Work queue worker failed");
+
+  p7_domaindef_LendThread();
   esl_threads_Finished(obj, workeridx);
   return;
 }
@@ -65,6 +65,8 @@ static ESL_OPTIONS options[] = {
   { "-A",           eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save multiple alignment of all hits to file <f>",              2 },
   { "--tblout",     eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save parseable table of per-sequence hits to file <f>",        2 },
   { "--domtblout",  eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save parseable table of per-domain hits to file <f>",          2 },
+  { "--dombinout",  eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save binary table of per-domain hits to file <f>",             2 },
+  { "--dombinali",  eslARG_NONE,   FALSE, NULL, NULL,    NULL,  "--dombinout",NULL,     "include alignment strings in --dombinout table",               2 },
   { "--pfamtblout", eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save table of hits and domains to file, in Pfam format <f>",   2 },
   { "--acc",        eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "prefer accessions over names in output",                       2 },
   { "--noali",      eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "don't output alignments, so output is smaller",                2 },
@@ -75,6 +77,7 @@ static ESL_OPTIONS options[] = {
   { "-T",           eslARG_REAL,   FALSE, NULL, NULL,    NULL,  NULL,  REPOPTS,         "report sequences >= this score threshold in output",           4 },
   { "--domE",       eslARG_REAL,  "10.0", NULL, "x>0",   NULL,  NULL,  DOMREPOPTS,      "report domains <= this E-value threshold in output",           4 },
   { "--domT",       eslARG_REAL,   FALSE, NULL, NULL,    NULL,  NULL,  DOMREPOPTS,      "report domains >= this score cutoff in output",                4 },
+  { "--maxhits",    eslARG_INT,    FALSE, NULL, "n>0",   NULL,  NULL,  NULL,            "report only the <n> top-ranked sequences",                     4 },
   /* Control of inclusion (significance) thresholds */
   { "--incE",       eslARG_REAL,  "0.01", NULL, "x>0",   NULL,  NULL,  INCOPTS,         "consider sequences <= this E-value threshold as significant",  5 },
   { "--incT",       eslARG_REAL,   FALSE, NULL, NULL,    NULL,  NULL,  INCOPTS,         "consider sequences >= this score threshold as significant",    5 },
@@ -96,6 +99,7 @@ static ESL_OPTIONS options[] = {
   { "-Z",           eslARG_REAL,   FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "set # of comparisons done, for E-value calculation",          12 },
   { "--domZ",       eslARG_REAL,   FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "set # of significant seqs, for domain E-value calculation",   12 },
   { "--seed",       eslARG_INT,    "42",  NULL, "n>=0",  NULL,  NULL,  NULL,            "set RNG seed to <n> (if 0: one-time arbitrary seed)",         12 },
+  { "--dsample",    eslARG_INT,    FALSE, NULL, "n>0",   NULL,  NULL,  NULL,            "adaptive trace sampling: test convergence every <n> traces",  12 },
   { "--tformat",    eslARG_STRING,  NULL, NULL, NULL,    NULL,  NULL,  NULL,            "assert target <seqfile> is in format <s>: no autodetection",  12 },
 
 #ifdef HMMER_THREADS 
@@ -139,6 +143,7 @@ struct cfg_s {
 };
 
 static int  serial_master(ESL_GETOPTS *go, struct cfg_s *cfg);
+static int  read_query   (P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_HMM **ret_hmm, P7_OPROFILE **ret_om);
 static int  serial_loop  (WORKER_INFO *info, ESL_SQFILE *dbfp, int n_targetseqs);
 #ifdef HMMER_THREADS
 #define BLOCK_SIZE 1000
@@ -226,6 +231,8 @@ output_header(FILE *ofp, const ESL_GETOPTS *go, char *hmmfile, char *seqfile)
   if (esl_opt_IsUsed(go, "-A")           && fprintf(ofp, "# MSA of all hits saved to file:   %s\n",             esl_opt_GetString(go, "-A"))           < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--tblout")     && fprintf(ofp, "# per-seq hits tabular output:     %s\n",             esl_opt_GetString(go, "--tblout"))     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domtblout")  && fprintf(ofp, "# per-dom hits tabular output:     %s\n",             esl_opt_GetString(go, "--domtblout"))  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dombinout")  && fprintf(ofp, "# per-dom hits binary output:      %s\n",             esl_opt_GetString(go, "--dombinout"))  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dombinali")  && fprintf(ofp, "# alignments in binary table:      yes\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--pfamtblout") && fprintf(ofp, "# pfam-style tabular hit output:   %s\n",             esl_opt_GetString(go, "--pfamtblout")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--acc")        && fprintf(ofp, "# prefer accessions over names:    yes\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--noali")      && fprintf(ofp, "# show alignments in output:       no\n")                                                    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -235,6 +242,7 @@ output_header(FILE *ofp, const ESL_GETOPTS *go, char *hmmfile, char *seqfile)
   if (esl_opt_IsUsed(go, "-T")           && fprintf(ofp, "# sequence reporting threshold:    score >= %g\n",    esl_opt_GetReal(go, "-T"))             < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domE")       && fprintf(ofp, "# domain reporting threshold:      E-value <= %g\n",  esl_opt_GetReal(go, "--domE"))         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domT")       && fprintf(ofp, "# domain reporting threshold:      score >= %g\n",    esl_opt_GetReal(go, "--domT"))         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--maxhits")    && fprintf(ofp, "# max sequences reported:          %d\n",            esl_opt_GetInteger(go, "--maxhits"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--incE")       && fprintf(ofp, "# sequence inclusion threshold:    E-value <= %g\n",  esl_opt_GetReal(go, "--incE"))         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--incT")       && fprintf(ofp, "# sequence inclusion threshold:    score >= %g\n",    esl_opt_GetReal(go, "--incT"))         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--incdomE")    && fprintf(ofp, "# domain inclusion threshold:      E-value <= %g\n",  esl_opt_GetReal(go, "--incdomE"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -254,6 +262,7 @@ output_header(FILE *ofp, const ESL_GETOPTS *go, char *hmmfile, char *seqfile)
   if (esl_opt_IsUsed(go, "--nonull2")    && fprintf(ofp, "# null2 bias corrections:          off\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "-Z")           && fprintf(ofp, "# sequence search space set to:    %.0f\n",           esl_opt_GetReal(go, "-Z"))             < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domZ")       && fprintf(ofp, "# domain search space set to:      %.0f\n",           esl_opt_GetReal(go, "--domZ"))         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dsample")    && fprintf(ofp, "# adaptive trace sampling every:   %d\n",             esl_opt_GetInteger(go, "--dsample")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--seed"))  {
     if (esl_opt_GetInteger(go, "--seed") == 0 && fprintf(ofp, "# random number seed:              one-time arbitrary\n")                               < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
     else if (                               fprintf(ofp, "# random number seed set to:       %d\n",             esl_opt_GetInteger(go, "--seed"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -359,10 +368,12 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   FILE            *afp      = NULL;              /* alignment output file (-A)                      */
   FILE            *tblfp    = NULL;              /* output stream for tabular per-seq (--tblout)    */
   FILE            *domtblfp = NULL;              /* output stream for tabular per-dom (--domtblout) */
+  FILE            *dombinfp = NULL;              /* output stream for binary per-dom (--dombinout) */
   FILE            *pfamtblfp= NULL;              /* output stream for pfam tabular output (--pfamtblout)    */
   P7_HMMFILE      *hfp      = NULL;              /* open input HMM file                             */
   ESL_SQFILE      *dbfp     = NULL;              /* open input sequence file                        */
   P7_HMM          *hmm      = NULL;              /* one HMM query                                   */
+  P7_OPROFILE     *om       = NULL;              /* optimized query profile: pressed, or from <hmm> */
   ESL_ALPHABET    *abc      = NULL;              /* digital alphabet                                */
   int              dbfmt    = eslSQFILE_UNKNOWN; /* format code for sequence database file          */
   ESL_STOPWATCH   *w;
@@ -377,6 +388,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   int              infocnt  = 0;
   WORKER_INFO     *info     = NULL;
+  P7_TOPHITS     **thv      = NULL;  /* the other workers' hit lists, for merging into info[0]'s */
 #ifdef HMMER_THREADS
   ESL_SQ_BLOCK    *block    = NULL;
   ESL_THREADS     *threadObj= NULL;
@@ -422,12 +434,14 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (esl_opt_IsOn(go, "-A"))          { if ((afp      = fopen(esl_opt_GetString(go, "-A"), "w")) == NULL) p7_Fail("Failed to open alignment file %s for writing\n", esl_opt_GetString(go, "-A")); }
   if (esl_opt_IsOn(go, "--tblout"))    { if ((tblfp    = fopen(esl_opt_GetString(go, "--tblout"),    "w")) == NULL)  esl_fatal("Failed to open tabular per-seq output file %s for writing\n", esl_opt_GetString(go, "--tblout")); }
   if (esl_opt_IsOn(go, "--domtblout")) { if ((domtblfp = fopen(esl_opt_GetString(go, "--domtblout"), "w")) == NULL)  esl_fatal("Failed to open tabular per-dom output file %s for writing\n", esl_opt_GetString(go, "--domtblout")); }
+  if (esl_opt_IsOn(go, "--dombinout")) { if ((dombinfp = fopen(esl_opt_GetString(go, "--dombinout"), "w")) == NULL)  esl_fatal("Failed to open binary per-dom output file %s for writing\n", esl_opt_GetString(go, "--dombinout")); }
   if (esl_opt_IsOn(go, "--pfamtblout")){ if ((pfamtblfp = fopen(esl_opt_GetString(go, "--pfamtblout"), "w")) == NULL)  esl_fatal("Failed to open pfam-style tabular output file %s for writing\n", esl_opt_GetString(go, "--pfamtblout")); }
 
 #ifdef HMMER_THREADS
   /* initialize thread data */
   if (esl_opt_IsOn(go, "--cpu")) ncpus = esl_opt_GetInteger(go, "--cpu");
   else                                   esl_threads_CPUCount(&ncpus);
+  p7_tracealign_SetThreads(ncpus);
 
   if (ncpus > 0)
     {
@@ -438,9 +452,10 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   infocnt = (ncpus == 0) ? 1 : ncpus;
   ESL_ALLOC(info, sizeof(*info) * infocnt);
+  ESL_ALLOC(thv,  sizeof(P7_TOPHITS *) * infocnt);
 
   /* <abc> is not known 'til first HMM is read. */
-  hstatus = p7_hmmfile_Read(hfp, &abc, &hmm);
+  hstatus = read_query(hfp, &abc, &hmm, &om);
   if (hstatus == eslOK)
     {
       /* One-time initializations after alphabet <abc> becomes known */
@@ -471,7 +486,6 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   while (hstatus == eslOK) 
     {
       P7_PROFILE      *gm      = NULL;
-      P7_OPROFILE     *om      = NULL;       /* optimized query profile                  */
 
       nquery++;
       esl_stopwatch_Start(w);
@@ -492,15 +506,17 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
           p7_Fail("Failure setting restrictdb_stkey to %d\n", cfg->firstseq_key);
       }
 
-      if (fprintf(ofp, "Query:       %s  [M=%d]\n", hmm->name, hmm->M)  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-      if (hmm->acc)  { if (fprintf(ofp, "Accession:   %s\n", hmm->acc)  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
-      if (hmm->desc) { if (fprintf(ofp, "Description: %s\n", hmm->desc) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
+      /* Convert to an optimized model, unless it was read pressed */
+      if (om == NULL) {
+        gm = p7_profile_Create (hmm->M, abc);
+        om = p7_oprofile_Create(hmm->M, abc);
+        p7_ProfileConfig(hmm, info->bg, gm, 100, p7_LOCAL); /* 100 is a dummy length for now; and MSVFilter requires local mode */
+        p7_oprofile_Convert(gm, om);                  /* <om> is now p7_LOCAL, multihit */
+      }
 
-      /* Convert to an optimized model */
-      gm = p7_profile_Create (hmm->M, abc);
-      om = p7_oprofile_Create(hmm->M, abc);
-      p7_ProfileConfig(hmm, info->bg, gm, 100, p7_LOCAL); /* 100 is a dummy length for now; and MSVFilter requires local mode */
-      p7_oprofile_Convert(gm, om);                  /* <om> is now p7_LOCAL, multihit */
+      if (fprintf(ofp, "Query:       %s  [M=%d]\n", om->name, om->M)  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+      if (om->acc)  { if (fprintf(ofp, "Accession:   %s\n", om->acc)  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
+      if (om->desc) { if (fprintf(ofp, "Description: %s\n", om->desc) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
 
       for (i = 0; i < infocnt; ++i)
       {
@@ -508,6 +524,10 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
         info[i].th  = p7_tophits_Create();
         info[i].om  = p7_oprofile_Clone(om);
         info[i].pli = p7_pipeline_Create(go, om->M, 100, FALSE, p7_SEARCH_SEQS); /* L_hint = 100 is just a dummy for now */
+        info[i].pli->ddef->do_alidisplay = (info[i].pli->show_alignments || esl_opt_IsOn(go, "-A") || esl_opt_GetBoolean(go, "--dombinali"));  /* build full alignment displays only if they get shown */
+        if (esl_opt_IsOn(go, "--dsample")) info[i].pli->ddef->nsamples_check = esl_opt_GetInteger(go, "--dsample");
+        if (esl_opt_IsOn(go, "--maxhits")) info[i].th->maxhits = esl_opt_GetInteger(go, "--maxhits"); /* each worker keeps its own top <n> */
+        info[i].pli->ddef->nthreads = ncpus;
         p7_pli_NewModel(info[i].pli, info[i].om, info[i].bg);
 
 #ifdef HMMER_THREADS
@@ -534,10 +554,11 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
         esl_fatal("Unexpected error %d reading sequence file %s", sstatus, dbfp->filename);
       }
 
-      /* merge the results of the search results */
+      /* merge the results of the search results; each worker has sorted its own hits */
+      for (i = 1; i < infocnt; ++i) thv[i-1] = info[i].th;
+      p7_tophits_MergeAll(info[0].th, thv, infocnt-1);
       for (i = 1; i < infocnt; ++i)
       {
-        p7_tophits_Merge(info[0].th, info[i].th);
         p7_pipeline_Merge(info[0].pli, info[i].pli);
 
         p7_pipeline_Destroy(info[i].pli);
@@ -551,9 +572,10 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       p7_tophits_Targets(ofp, info->th, info->pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
       p7_tophits_Domains(ofp, info->th, info->pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 
-      if (tblfp)     p7_tophits_TabularTargets(tblfp,    hmm->name, hmm->acc, info->th, info->pli, (nquery == 1));
-      if (domtblfp)  p7_tophits_TabularDomains(domtblfp, hmm->name, hmm->acc, info->th, info->pli, (nquery == 1));
-      if (pfamtblfp) p7_tophits_TabularXfam(pfamtblfp, hmm->name, hmm->acc, info->th, info->pli);
+      if (tblfp)     p7_tophits_TabularTargets(tblfp,    om->name, om->acc, info->th, info->pli, (nquery == 1));
+      if (domtblfp)  p7_tophits_TabularDomains(domtblfp, om->name, om->acc, info->th, info->pli, (nquery == 1));
+      if (dombinfp)  p7_tophits_BinaryDomains(dombinfp, om->name, om->acc, info->th, info->pli, esl_opt_GetBoolean(go, "--dombinali"));
+      if (pfamtblfp) p7_tophits_TabularXfam(pfamtblfp, om->name, om->acc, info->th, info->pli);
   
       esl_stopwatch_Stop(w);
       p7_pli_Statistics(ofp, info->pli, w);
@@ -582,7 +604,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       p7_profile_Destroy(gm);
       p7_hmm_Destroy(hmm);
 
-      hstatus = p7_hmmfile_Read(hfp, &abc, &hmm);
+      hstatus = read_query(hfp, &abc, &hmm, &om);
     } /* end outer loop over query HMMs */
 
   switch(hstatus) {
@@ -618,6 +640,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 #endif
 
   free(info);
+  free(thv);
   p7_hmmfile_Close(hfp);
   esl_sqfile_Close(dbfp);
   esl_alphabet_Destroy(abc);
@@ -627,6 +650,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (afp)           fclose(afp);
   if (tblfp)         fclose(tblfp);
   if (domtblfp)      fclose(domtblfp);
+  if (dombinfp)      fclose(dombinfp);
   if (pfamtblfp)     fclose(pfamtblfp);
 
   return eslOK;
@@ -635,6 +659,33 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   return eslFAIL;
 }
 
+/* read_query()
+ * Read the next query from <hfp>. A pressed HMM database already holds
+ * each model's optimized profile in its .h3f and .h3p files, so from
+ * one of those we read <*ret_om> directly, skipping the .h3m model,
+ * profile configuration and conversion; <*ret_hmm> is left NULL.
+ * Otherwise read <*ret_hmm>, and leave <*ret_om> NULL for the caller
+ * to convert. Returns the status of the read, as <p7_hmmfile_Read()>.
+ */
+static int
+read_query(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_HMM **ret_hmm, P7_OPROFILE **ret_om)
+{
+  int status;
+
+  *ret_hmm = NULL;
+  *ret_om  = NULL;
+  if (! hfp->is_pressed) return p7_hmmfile_Read(hfp, byp_abc, ret_hmm);
+
+  if ((status = p7_oprofile_ReadMSV(hfp, byp_abc, ret_om)) != eslOK) return status;
+  if ((status = p7_oprofile_ReadRest(hfp, *ret_om))        != eslOK) 
+    {
+      p7_oprofile_Destroy(*ret_om);
+      *ret_om = NULL;
+      return (status == eslEOF ? eslEOD : status); /* .h3p ended before .h3f did */
+    }
+  return eslOK;
+}
+
 #ifdef HAVE_MPI
 
 /* Define common tags used by the MPI master/slave processes */
@@ -809,6 +860,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   FILE            *afp      = NULL;              /* alignment output file (-A)                      */
   FILE            *tblfp    = NULL;              /* output stream for tabular per-seq (--tblout)    */
   FILE            *domtblfp = NULL;              /* output stream for tabular per-dom (--domtblout) */
+  FILE            *dombinfp = NULL;              /* output stream for binary per-dom (--dombinout) */
   FILE            *pfamtblfp= NULL;              /* output stream for pfam-style tabular output  (--pfamtblout) */
   P7_BG           *bg       = NULL;	         /* null model                                      */
   P7_HMMFILE      *hfp      = NULL;              /* open input HMM file                             */
@@ -880,6 +932,8 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   if (esl_opt_IsOn(go, "--domtblout") && (domtblfp = fopen(esl_opt_GetString(go, "--domtblout"), "w")) == NULL)
     mpi_failure("Failed to open tabular per-dom output file %s for writing\n", esl_opt_GetString(go, "--domtblout"));
+  if (esl_opt_IsOn(go, "--dombinout") && (dombinfp = fopen(esl_opt_GetString(go, "--dombinout"), "w")) == NULL)
+    mpi_failure("Failed to open binary per-dom output file %s for writing\n", esl_opt_GetString(go, "--dombinout"));
 
   if (esl_opt_IsOn(go, "--pfamtblout") && (pfamtblfp = fopen(esl_opt_GetString(go, "--pfamtblout"), "w")) == NULL)
     mpi_failure("Failed to open pfam-style tabular output file %s for writing\n", esl_opt_GetString(go, "--pfamtblout"));
@@ -937,6 +991,9 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       /* Create processing pipeline and hit list */
       th  = p7_tophits_Create(); 
       pli = p7_pipeline_Create(go, hmm->M, 100, FALSE, p7_SEARCH_SEQS);
+      pli->ddef->do_alidisplay = (pli->show_alignments || esl_opt_IsOn(go, "-A") || esl_opt_GetBoolean(go, "--dombinali"));
+      if (esl_opt_IsOn(go, "--dsample")) pli->ddef->nsamples_check = esl_opt_GetInteger(go, "--dsample");
+      if (esl_opt_IsOn(go, "--maxhits")) th->maxhits = esl_opt_GetInteger(go, "--maxhits");   /* bound only the master's merged list: workers don't send pruned targets */
       p7_pli_NewModel(pli, om, bg);
 
       /* Main loop: */
@@ -1036,6 +1093,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
       if (tblfp)    p7_tophits_TabularTargets(tblfp,    hmm->name, hmm->acc, th, pli, (nquery == 1));
       if (domtblfp) p7_tophits_TabularDomains(domtblfp, hmm->name, hmm->acc, th, pli, (nquery == 1));
+      if (dombinfp) p7_tophits_BinaryDomains(dombinfp, hmm->name, hmm->acc, th, pli, esl_opt_GetBoolean(go, "--dombinali"));
       if (pfamtblfp) p7_tophits_TabularXfam(pfamtblfp, hmm->name, hmm->acc, th, pli);
 
       esl_stopwatch_Stop(w);
@@ -1118,6 +1176,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (afp)           fclose(afp);
   if (tblfp)         fclose(tblfp);
   if (domtblfp)      fclose(domtblfp);
+  if (dombinfp)      fclose(dombinfp);
   if (pfamtblfp)     fclose(pfamtblfp);
 
   return eslOK;
@@ -1196,6 +1255,8 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
 
       th  = p7_tophits_Create(); 
       pli = p7_pipeline_Create(go, om->M, 100, FALSE, p7_SEARCH_SEQS); /* L_hint = 100 is just a dummy for now */
+      pli->ddef->do_alidisplay = (pli->show_alignments || esl_opt_IsOn(go, "-A") || esl_opt_GetBoolean(go, "--dombinali"));
+      if (esl_opt_IsOn(go, "--dsample")) pli->ddef->nsamples_check = esl_opt_GetInteger(go, "--dsample");
       p7_pli_NewModel(pli, om, bg);
 
       /* receive a sequence block from the master */
@@ -1363,6 +1424,7 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, int n_tar
     {
       /* wait for all the threads to complete */
       esl_threads_WaitForFinish(obj);
+      p7_domaindef_ReclaimThreads();
       esl_workqueue_Complete(queue);  
     }
 
@@ -1416,9 +1478,13 @@ pipeline_thread(void *arg)
       block = (ESL_SQ_BLOCK *) newBlock;
     }
 
+  /* sort this worker's hits now, in parallel with the others, ready for the merge */
+  p7_tophits_SortBySortkey(info->th);
+
   status = esl_workqueue_WorkerUpdate(info->queue, block, NULL);
   if (status != eslOK) esl_fatal("Work queue worker failed");
 
+  p7_domaindef_LendThread();
   esl_threads_Finished(obj, workeridx);
   return;
 }
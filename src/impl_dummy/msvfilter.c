@@ -68,8 +68,13 @@ p7_MSVFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float
  *            SSVFilter code. As dummy functions are deprecated, there's no
  *            need to update it.
  *
+ *            If <complementarity> is <p7_COMPLEMENT>, the reverse
+ *            complement of <dsq> is scanned instead; here that is done
+ *            by building a temporary reverse-complemented copy.
+ *
  * Args:      dsq        - digital target sequence, 1..L
  *            L          - length of dsq in residues
+ *            complementarity - p7_NOCOMPLEMENT to scan <dsq>, or p7_COMPLEMENT to scan its reverse complement
  *            om         - optimized profile
  *            ox         - DP matrix
  *            msvdata    - compact representation of substitution scores, for backtracking diagonals
@@ -82,13 +87,28 @@ p7_MSVFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float
  * Returns:   <eslOK> on success.
  *
  * Throws:    <eslEINVAL> if <ox> allocation is too small.
+ *            <eslEMEM> on allocation failure.
  */
 int
-p7_SSVFilter_longtarget(const ESL_DSQ *dsq, int L, P7_OPROFILE *om, P7_OMX *ox, const P7_SCOREDATA *msvdata, P7_BG *bg, double P, P7_HMM_WINDOWLIST *windowlist)
+p7_SSVFilter_longtarget(const ESL_DSQ *dsq, int L, int complementarity, P7_OPROFILE *om, P7_OMX *ox, const P7_SCOREDATA *msvdata, P7_BG *bg, double P, P7_HMM_WINDOWLIST *windowlist)
 {
-	  int status;
+	  int      status;
+	  int      i;
+	  ESL_DSQ *rc = NULL;
+
 	  if ((status = p7_gmx_GrowTo(ox, om->M, L)) != eslOK) return status;
-	  return p7_GMSV_longtarget(dsq, L, om, ox, 2.0, bg, P, windowlist);
+	  if (complementarity != p7_COMPLEMENT)
+	    return p7_GMSV_longtarget(dsq, L, om, ox, 2.0, bg, P, windowlist);
+
+	  ESL_ALLOC(rc, sizeof(ESL_DSQ) * (L+2));
+	  rc[0] = rc[L+1] = eslDSQ_SENTINEL;
+	  for (i = 1; i <= L; i++) rc[i] = om->abc->complement[dsq[L-i+1]];
+	  status = p7_GMSV_longtarget(rc, L, om, ox, 2.0, bg, P, windowlist);
+	  free(rc);
+	  return status;
+
+	ERROR:
+	  return status;
 }
 
 
@@ -33,9 +33,9 @@
 #include <stdlib.h>
 #include <string.h>
 
-#ifdef HMMER_THREADS
-#include <pthread.h>
-#endif
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
 
 #include <xmmintrin.h>		/* SSE  */
 #include <emmintrin.h>		/* SSE2 */
@@ -63,6 +63,22 @@ static uint32_t  v3b_pmagic = 0xb3e2f0f3; /* 3/b binary profile file, SSE: "3bps
 static uint32_t  v3a_fmagic = 0xe8b3e6f3; /* 3/a binary MSV file, SSE:     "h3fs" = 0x 68 33 66 73  + 0x80808080 */
 static uint32_t  v3a_pmagic = 0xe8b3f0f3; /* 3/a binary profile file, SSE: "h3ps" = 0x 68 33 70 73  + 0x80808080 */
 
+/* REST_READER: the start of one .h3p record, read in a single
+ * positioned read, and the parse position within the record.
+ */
+typedef struct {
+  int     fd;			/* descriptor of the open .h3p file   */
+  off_t   offset;		/* disk offset of the record          */
+  size_t  pos;			/* parse position within the record   */
+  char    buf[1024];		/* start of the record                */
+  size_t  nbuf;			/* number of valid bytes in <buf>     */
+} REST_READER;
+
+static int  pread_full (int fd, char *buf, size_t n, off_t offset, size_t *ret_nread);
+static int  preadv_full(int fd, struct iovec *iov, int iovcnt, off_t offset, size_t *ret_nread);
+static int  rest_get   (REST_READER *rd, void *dest, size_t n);
+static void rest_iov   (struct iovec *iov, int *iovcnt, void *p, size_t n);
+
 
 /*****************************************************************
  *# 1. Writing optimized profiles to two files.
@@ -484,38 +500,42 @@ p7_oprofile_ReadBlockMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OM_BLOCK *h
  *            or on any parsing error, and set <hfp->errbuf> to
  *            an informative error message.
  *
- * Throws:    <eslESYS> if an <fseek()> fails to reposition the
- *            binary <.h3p> file.
+ * Throws:    <eslESYS> if a read of the binary <.h3p> file fails.
  *            
  *            <eslEMEM> on allocation error.
+ *
+ * Note:      The record is fetched with positioned reads on the file
+ *            descriptor of <hfp->pfp>, which neither use nor move the
+ *            stream's file position; so worker threads can call
+ *            <p7_oprofile_ReadRest()> on a shared <hfp> concurrently,
+ *            without serializing on <hfp->readMutex>. The name,
+ *            accession, and description come from one small read of
+ *            the start of the record, and the vector parts are
+ *            scattered straight into <om> with a single <preadv()>.
  */
 int
 p7_oprofile_ReadRest(P7_HMMFILE *hfp, P7_OPROFILE *om)
 {
+  REST_READER   rd;
+  struct iovec *iov  = NULL;
+  char         *name = NULL;
+  size_t        nbody, nread;
   uint32_t      magic;
   int           M, Q4, Q8;
-  int           x,n;
-  char         *name = NULL;
+  int           x,n,i;
   int           alphatype;
   int           status;
 
-#ifdef HMMER_THREADS
-  /* lock the mutex to prevent other threads from reading from the optimized
-   * profile at the same time.
-   */
-  if (hfp->syncRead)
-    {
-      if (pthread_mutex_lock (&hfp->readMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex lock failed");
-    }
-#endif
-
   if (hfp->errbuf != NULL) hfp->errbuf[0] = '\0';
   if (hfp->pfp == NULL) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "no MSV profile file; hmmpress probably wasn't run");
  
-  /* Position the <hfp->pfp> using offset stored in <om> */
-  if (fseeko(hfp->pfp, om->offs[p7_POFFSET], SEEK_SET) != 0)                       ESL_EXCEPTION(eslESYS, "fseeko() failed");
+  /* Read the start of the record at the offset stored in <om> */
+  rd.fd     = fileno(hfp->pfp);
+  rd.offset = om->offs[p7_POFFSET];
+  rd.pos    = 0;
+  if (pread_full(rd.fd, rd.buf, sizeof(rd.buf), rd.offset, &(rd.nbuf)) != eslOK) ESL_EXCEPTION(eslESYS, "pread() failed");
    
-  if (! fread( (char *) &magic,          sizeof(uint32_t), 1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read magic");
+  if (! rest_get(&rd, &magic,        sizeof(uint32_t)))                            ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read magic");
   if (magic == v3a_pmagic) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/a); please hmmpress your HMM file again");
   if (magic == v3b_pmagic) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/b); please hmmpress your HMM file again");
   if (magic == v3c_pmagic) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/c); please hmmpress your HMM file again");
@@ -523,81 +543,164 @@ p7_oprofile_ReadRest(P7_HMMFILE *hfp, P7_OPROFILE *om)
   if (magic == v3e_pmagic) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/e); please hmmpress your HMM file again");
   if (magic != v3f_pmagic) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad magic; not an HMM database file?");
 
-  if (! fread( (char *) &M,              sizeof(int),      1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read model size M");
-  if (! fread( (char *) &alphatype,      sizeof(int),      1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read alphabet type");  
-  if (! fread( (char *) &n,              sizeof(int),      1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read name length");  
+  if (! rest_get(&rd, &M,            sizeof(int)))                                 ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read model size M");
+  if (! rest_get(&rd, &alphatype,    sizeof(int)))                                 ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read alphabet type");  
+  if (! rest_get(&rd, &n,            sizeof(int)))                                 ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read name length");  
   if (M         != om->M)                                                          ESL_XFAIL(eslEFORMAT, hfp->errbuf, "p/f model length mismatch");
   if (alphatype != om->abc->type)                                                  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "p/f alphabet type mismatch");
 
   ESL_ALLOC(name, sizeof(char) * (n+1));
-  if (! fread( (char *) name,            sizeof(char),     n+1,         hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read name");  
+  if (! rest_get(&rd, name,          sizeof(char) * (n+1)))                        ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read name");  
   if (strcmp(name, om->name) != 0)                                                 ESL_XFAIL(eslEFORMAT, hfp->errbuf, "p/f name mismatch");  
   
-  if (! fread((char *) &n,               sizeof(int),      1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read accession length");
+  if (! rest_get(&rd, &n,            sizeof(int)))                                 ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read accession length");
   if (n > 0) {
     ESL_ALLOC(om->acc, sizeof(char) * (n+1));
-    if (! fread( (char *) om->acc,       sizeof(char),     n+1,         hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read accession");      
+    if (! rest_get(&rd, om->acc,     sizeof(char) * (n+1)))                        ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read accession");      
   }
-  if (! fread((char *) &n,               sizeof(int),      1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read description length");
+  if (! rest_get(&rd, &n,            sizeof(int)))                                 ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read description length");
   if (n > 0) {
     ESL_ALLOC(om->desc, sizeof(char) * (n+1));
-    if (! fread( (char *) om->desc,      sizeof(char),     n+1,         hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read description");      
+    if (! rest_get(&rd, om->desc,    sizeof(char) * (n+1)))                        ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read description");      
   }
 
-  if (! fread((char *) om->rf,           sizeof(char),     M+2,         hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read rf annotation");
-  if (! fread((char *) om->mm,           sizeof(char),     M+2,         hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read mm annotation");
-  if (! fread((char *) om->cs,           sizeof(char),     M+2,         hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read cs annotation");
-  if (! fread((char *) om->consensus,    sizeof(char),     M+2,         hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read consensus annotation");
-
+  /* Everything else is fixed-size given M and Kp: one scattered read. */
   Q4  = p7O_NQF(om->M);
   Q8  = p7O_NQW(om->M);
-
-  if (! fread((char *) om->twv,             sizeof(__m128i),  8*Q8,        hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read <tu>, vitfilter transitions");
+  ESL_ALLOC(iov, sizeof(struct iovec) * (2*om->abc->Kp + 2*p7O_NXSTATES + 16));
+  i = 0;
+  rest_iov(iov, &i, om->rf,                sizeof(char)    * (M+2));
+  rest_iov(iov, &i, om->mm,                sizeof(char)    * (M+2));
+  rest_iov(iov, &i, om->cs,                sizeof(char)    * (M+2));
+  rest_iov(iov, &i, om->consensus,         sizeof(char)    * (M+2));
+  rest_iov(iov, &i, om->twv,               sizeof(__m128i) * 8*Q8);
   for (x = 0; x < om->abc->Kp; x++)
-    if (! fread( (char *) om->rwv[x],       sizeof(__m128i),  Q8,          hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read <ru>[%d], vitfilter emissions for sym %c", x, om->abc->sym[x]);
+    rest_iov(iov, &i, om->rwv[x],          sizeof(__m128i) * Q8);
   for (x = 0; x < p7O_NXSTATES; x++)
-    if (! fread( (char *) om->xw[x],        sizeof(int16_t),  p7O_NXTRANS, hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read <xu>[%d], vitfilter special transitions", x);
-  if (! fread((char *) &(om->scale_w),      sizeof(float),    1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read scale_w");
-  if (! fread((char *) &(om->base_w),       sizeof(int16_t),  1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read base_w");
-  if (! fread((char *) &(om->ddbound_w),    sizeof(int16_t),  1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read ddbound_w");
-  if (! fread((char *) &(om->ncj_roundoff), sizeof(float),    1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read ddbound_w");
-
-  if (! fread((char *) om->tfv,          sizeof(__m128),   8*Q4,        hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read <tf> transitions");
+    rest_iov(iov, &i, om->xw[x],           sizeof(int16_t) * p7O_NXTRANS);
+  rest_iov(iov, &i, &(om->scale_w),        sizeof(float));
+  rest_iov(iov, &i, &(om->base_w),         sizeof(int16_t));
+  rest_iov(iov, &i, &(om->ddbound_w),      sizeof(int16_t));
+  rest_iov(iov, &i, &(om->ncj_roundoff),   sizeof(float));
+  rest_iov(iov, &i, om->tfv,               sizeof(__m128)  * 8*Q4);
   for (x = 0; x < om->abc->Kp; x++)
-    if (! fread( (char *) om->rfv[x],    sizeof(__m128),   Q4,          hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read <rf>[%d] emissions for sym %c", x, om->abc->sym[x]);
+    rest_iov(iov, &i, om->rfv[x],          sizeof(__m128)  * Q4);
   for (x = 0; x < p7O_NXSTATES; x++)
-    if (! fread( (char *) om->xf[x],     sizeof(float),    p7O_NXTRANS, hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read <xf>[%d] special transitions", x);
-
-  if (! fread((char *)   om->cutoff,     sizeof(float),    p7_NCUTOFFS, hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read Pfam score cutoffs");
-  if (! fread((char *) &(om->nj),        sizeof(float),    1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read nj");
-  if (! fread((char *) &(om->mode),      sizeof(int),      1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read mode");
-  if (! fread((char *) &(om->L)   ,      sizeof(int),      1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read L");
-
+    rest_iov(iov, &i, om->xf[x],           sizeof(float)   * p7O_NXTRANS);
+  rest_iov(iov, &i, om->cutoff,            sizeof(float)   * p7_NCUTOFFS);
+  rest_iov(iov, &i, &(om->nj),             sizeof(float));
+  rest_iov(iov, &i, &(om->mode),           sizeof(int));
+  rest_iov(iov, &i, &(om->L),              sizeof(int));
   /* record ends with magic sentinel, for detecting binary file corruption */
-  if (! fread( (char *) &magic,     sizeof(uint32_t), 1, hfp->pfp))  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "no sentinel magic: .h3p file corrupted?");
-  if (magic != v3f_pmagic)                                           ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad sentinel magic; .h3p file corrupted?");
+  rest_iov(iov, &i, &magic,                sizeof(uint32_t));
 
-#ifdef HMMER_THREADS
-  if (hfp->syncRead)
-    {
-      if (pthread_mutex_unlock (&hfp->readMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
-    }
-#endif
+  for (nbody = 0, x = 0; x < i; x++) nbody += iov[x].iov_len;
+  if (preadv_full(rd.fd, iov, i, rd.offset + rd.pos, &nread) != eslOK)           ESL_XEXCEPTION(eslESYS, "pread() failed");
+  if (nread < nbody - sizeof(uint32_t))                                            ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read profile vectors; .h3p file truncated?");
+  if (nread < nbody)                                                               ESL_XFAIL(eslEFORMAT, hfp->errbuf, "no sentinel magic: .h3p file corrupted?");
+  if (magic != v3f_pmagic)                                                         ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad sentinel magic; .h3p file corrupted?");
 
+  free(iov);
   free(name);
   return eslOK;
 
  ERROR:
+  if (iov  != NULL) free(iov);
+  if (name != NULL) free(name);
+  return status;
+}
+
+/* pread_full()
+ * Read up to <n> bytes from offset <offset> of open file descriptor
+ * <fd> into <buf>, retrying short and interrupted reads, and return
+ * the number of bytes read in <*ret_nread>; that's less than <n> only
+ * at end of file. Returns <eslOK>, or <eslESYS> on a read error.
+ */
+static int
+pread_full(int fd, char *buf, size_t n, off_t offset, size_t *ret_nread)
+{
+  size_t  nread = 0;
+  ssize_t nb;
 
-#ifdef HMMER_THREADS
-  if (hfp->syncRead)
+  while (nread < n)
     {
-      if (pthread_mutex_unlock (&hfp->readMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
+      nb = pread(fd, buf + nread, n - nread, offset + nread);
+      if      (nb == 0) break;
+      else if (nb <  0) { if (errno == EINTR) continue; *ret_nread = nread; return eslESYS; }
+      nread += nb;
+    }
+  *ret_nread = nread;
+  return eslOK;
+}
+
+/* preadv_full()
+ * Like <pread_full()>, but scattering the bytes at <offset> across
+ * the <iovcnt> buffers of <iov>, in order. The <iov> array is used as
+ * scratch space. Where <preadv()> isn't available, reads each buffer
+ * with its own <pread()>.
+ */
+static int
+preadv_full(int fd, struct iovec *iov, int iovcnt, off_t offset, size_t *ret_nread)
+{
+  size_t  nread = 0;
+#ifdef HAVE_PREADV
+  long    iovmax = sysconf(_SC_IOV_MAX); /* POSIX guarantees at least 16 */
+  ssize_t nb;
+
+  if (iovmax <= 0) iovmax = 16;
+  while (iovcnt > 0)
+    {
+      nb = preadv(fd, iov, ESL_MIN(iovcnt, iovmax), offset + nread);
+      if      (nb == 0) break;
+      else if (nb <  0) { if (errno == EINTR) continue; *ret_nread = nread; return eslESYS; }
+      nread += nb;
+      for (; iovcnt > 0 && (size_t) nb >= iov->iov_len; iov++, iovcnt--) nb -= iov->iov_len;
+      if (iovcnt > 0) { iov->iov_base = (char *) iov->iov_base + nb; iov->iov_len -= nb; }
+    }
+#else
+  size_t  nb;
+  int     i;
+  int     status;
+
+  for (i = 0; i < iovcnt; i++)
+    {
+      if ((status = pread_full(fd, iov[i].iov_base, iov[i].iov_len, offset + nread, &nb)) != eslOK) { *ret_nread = nread + nb; return status; }
+      nread += nb;
+      if (nb < iov[i].iov_len) break;
     }
 #endif
+  *ret_nread = nread;
+  return eslOK;
+}
 
-  if (name != NULL) free(name);
-  return status;
+/* rest_get()
+ * Copy the next <n> bytes of the record being read by <rd> to <dest>,
+ * from its buffered start when they're there, otherwise straight from
+ * disk. Returns TRUE on success, FALSE if the record ends first.
+ */
+static int
+rest_get(REST_READER *rd, void *dest, size_t n)
+{
+  size_t nread;
+
+  if (rd->pos + n <= rd->nbuf) 
+    memcpy(dest, rd->buf + rd->pos, n);
+  else if (pread_full(rd->fd, dest, n, rd->offset + rd->pos, &nread) != eslOK || nread < n)
+    return FALSE;
+  rd->pos += n;
+  return TRUE;
+}
+
+/* rest_iov()
+ * Append buffer <p> of <n> bytes to the scatter list <iov>, which
+ * currently has <*iovcnt> entries.
+ */
+static void
+rest_iov(struct iovec *iov, int *iovcnt, void *p, size_t n)
+{
+  iov[*iovcnt].iov_base = p;
+  iov[*iovcnt].iov_len  = n;
+  (*iovcnt)++;
 }
 /*----------- end, reading optimized profiles -------------------*/
 
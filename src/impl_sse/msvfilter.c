@@ -233,8 +233,17 @@ p7_MSVFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float
  *            These windows can be merged by the calling function.
  *
  *
+ *            If <complementarity> is <p7_COMPLEMENT>, the scan runs over
+ *            the reverse complement of <dsq>, reading residues back to
+ *            front through the alphabet's complement map; <dsq> itself
+ *            is not modified, and no reverse-complemented copy is made.
+ *            Windows are then reported in reverse-complement coordinates
+ *            (position 1 is the complement of <dsq[L]>), exactly as if
+ *            the caller had reverse complemented <dsq> first.
+ *
  * Args:      dsq     - digital target sequence, 1..L
  *            L       - length of dsq in residues
+ *            complementarity - p7_NOCOMPLEMENT to scan <dsq>, or p7_COMPLEMENT to scan its reverse complement
  *            om      - optimized profile
  *            ox      - DP matrix
  *            msvdata    - compact representation of substitution scores, for backtracking diagonals
@@ -254,8 +263,13 @@ p7_MSVFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float
  *
  * Throws:    <eslEINVAL> if <ox> allocation is too small.
  */
+/* residue <j> of the strand being scanned: <rdsq> and <step> walk <dsq> forward
+ * or backward, and <rmap> complements on the bottom strand, so neither strand
+ * tests for it per residue */
+#define SSV_RESIDUE(j) (rmap[rdsq[step*(j)]])
+
 int
-p7_SSVFilter_longtarget(const ESL_DSQ *dsq, int L, P7_OPROFILE *om, P7_OMX *ox, const P7_SCOREDATA *ssvdata,
+p7_SSVFilter_longtarget(const ESL_DSQ *dsq, int L, int complementarity, P7_OPROFILE *om, P7_OMX *ox, const P7_SCOREDATA *ssvdata,
                         P7_BG *bg, double P, P7_HMM_WINDOWLIST *windowlist)
 {
 
@@ -289,6 +303,12 @@ p7_SSVFilter_longtarget(const ESL_DSQ *dsq, int L, P7_OPROFILE *om, P7_OMX *ox,
   int pos_since_max;
   float ret_sc;
 
+  const ESL_DSQ *rdsq;             /* rdsq[step*j] is the <dsq> residue read as position j       */
+  int            step;
+  ESL_DSQ        rmap[256];        /* rmap[x]: <dsq> residue x as read on the scanned strand     */
+  __m128i       *rbv[256];         /* rbv[x]: match score vectors for <dsq> residue x            */
+  int            x;
+
   union { __m128i v; uint8_t b[16]; } u;
 
   /*
@@ -341,8 +361,16 @@ p7_SSVFilter_longtarget(const ESL_DSQ *dsq, int L, P7_OPROFILE *om, P7_OMX *ox,
 
   xBv = _mm_subs_epu8(basev, tjbmv);
 
+  /* settle the strand once, here, rather than per residue */
+  for (x = 0; x < om->abc->Kp; x++) {
+    rmap[x] = (complementarity == p7_COMPLEMENT ? om->abc->complement[x] : x);
+    rbv[x]  = om->rbv[rmap[x]];
+  }
+  if (complementarity == p7_COMPLEMENT) { rdsq = dsq + L + 1; step = -1; }
+  else                                  { rdsq = dsq;         step =  1; }
+
   for (i = 1; i <= L; i++) {
-    rsc = om->rbv[dsq[i]];
+    rsc = rbv[rdsq[step*i]];
     xEv = _mm_setzero_si128();
 
 	  /* Right shifts by 1 byte. 4,8,12,x becomes x,4,8,12.
@@ -388,7 +416,7 @@ p7_SSVFilter_longtarget(const ESL_DSQ *dsq, int L, P7_OPROFILE *om, P7_OMX *ox,
 	    target_end = target_start = i;  // target position
 	    sc = rem_sc;
 	    while (rem_sc > om->base_b - om->tjb_b - om->tbm_b) {
-	      rem_sc -= om->bias_b -  ssvdata->ssv_scores[start*om->abc->Kp + dsq[target_start]];
+	      rem_sc -= om->bias_b -  ssvdata->ssv_scores[start*om->abc->Kp + SSV_RESIDUE(target_start)];
 	      --start;
 	      --target_start;
 	    }
@@ -403,7 +431,7 @@ p7_SSVFilter_longtarget(const ESL_DSQ *dsq, int L, P7_OPROFILE *om, P7_OMX *ox,
 	    max_sc = sc;
 	    pos_since_max = 0;
 	    while (k<om->M && n<=L) {
-	      sc += om->bias_b -  ssvdata->ssv_scores[k*om->abc->Kp + dsq[n]];
+	      sc += om->bias_b -  ssvdata->ssv_scores[k*om->abc->Kp + SSV_RESIDUE(n)];
 
 	      if (sc >= max_sc) {
 	        max_sc = sc;
@@ -433,7 +461,7 @@ p7_SSVFilter_longtarget(const ESL_DSQ *dsq, int L, P7_OPROFILE *om, P7_OMX *ox,
                          end,                // position in the model at which the diagonal ends
                          end-start+1 ,       // length of diagonal
                          ret_sc,             // score of diagonal
-                         p7_NOCOMPLEMENT,    // always p7_NOCOMPLEMENT here;  varies in FM-based filter
+                         p7_NOCOMPLEMENT,    // coordinates are always relative to the scanned strand here;  varies in FM-based filter
                          L
                        );
 
@@ -446,6 +474,7 @@ p7_SSVFilter_longtarget(const ESL_DSQ *dsq, int L, P7_OPROFILE *om, P7_OMX *ox,
   return eslOK;
 
 }
+#undef SSV_RESIDUE
 /*------------------ end, p7_SSVFilter_longtarget() ------------------------*/
 
 
@@ -30,11 +30,18 @@
 #endif /*HMMER_THREADS*/
 
 #include "hmmer.h"
+#include "cachedb.h"
 
 typedef struct {
 #ifdef HMMER_THREADS
   ESL_WORK_QUEUE   *queue;
+  int              *next_seq;     /* with --dbcache: next cached target to hand out  */
+  pthread_mutex_t  *next_mutex;   /*   ... and the lock on it                        */
 #endif
+  P7_SEQCACHE      *seqcache;     /* target database held in memory, or NULL         */
+  float            *msvP;         /* --skipfar: each cached target's last MSV P-value */
+  double            skipP;        /* skip cached targets with msvP > skipP; 1.0: none */
+  uint64_t          nskipped;     /* # of targets skipped this round                 */
   P7_BG            *bg;
   P7_PIPELINE      *pli;
   P7_TOPHITS       *th;
@@ -67,6 +74,8 @@ static ESL_OPTIONS options[] = {
   { "-A",           eslARG_OUTFILE,      NULL, NULL, NULL,      NULL,    NULL,  NULL,            "save multiple alignment of hits to file <f>",                  2 },
   { "--tblout",     eslARG_OUTFILE,      NULL, NULL, NULL,      NULL,    NULL,  NULL,            "save parseable table of per-sequence hits to file <f>",        2 },
   { "--domtblout",  eslARG_OUTFILE,      NULL, NULL, NULL,      NULL,    NULL,  NULL,            "save parseable table of per-domain hits to file <f>",          2 },
+  { "--dombinout",  eslARG_OUTFILE,      NULL, NULL, NULL,      NULL,    NULL,  NULL,            "save binary table of per-domain hits to file <f>",             2 },
+  { "--dombinali",  eslARG_NONE,        FALSE, NULL, NULL,      NULL,    "--dombinout",NULL,     "include alignment strings in --dombinout table",               2 },
   { "--chkhmm",     eslARG_OUTFILE,      NULL, NULL, NULL,      NULL,    NULL,  NULL,            "save HMM checkpoints to files <f>-<iteration>.hmm",            2 },
   { "--chkali",     eslARG_OUTFILE,      NULL, NULL, NULL,      NULL,    NULL,  NULL,            "save alignment checkpoints to files <f>-<iteration>.sto",      2 },
   { "--acc",        eslARG_NONE,        FALSE, NULL, NULL,      NULL,    NULL,  NULL,            "prefer accessions over names in output",                       2 },
@@ -98,6 +107,7 @@ static ESL_OPTIONS options[] = {
   { "--F2",         eslARG_REAL,       "1e-3", NULL, NULL,      NULL,    NULL, "--max",          "Stage 2 (Vit) threshold: promote hits w/ P <= F2",             7 },
   { "--F3",         eslARG_REAL,       "1e-5", NULL, NULL,      NULL,    NULL, "--max",          "Stage 3 (Fwd) threshold: promote hits w/ P <= F3",             7 },
   { "--nobias",     eslARG_NONE,         NULL, NULL, NULL,      NULL,    NULL, "--max",          "turn off composition bias filter",                             7 },
+  { "--skipfar",    eslARG_REAL,         NULL, NULL, "0<x<1",   NULL,"--dbcache",NULL,           "skip targets w/ last-round MSV P > x (rounds 2+)",             7 },
 /* Alternative model construction strategies */
   { "--fast",       eslARG_NONE,        FALSE, NULL, NULL,   CONOPTS,    NULL,  NULL,            "assign cols w/ >= symfrac residues as consensus",              8 },
   { "--hand",       eslARG_NONE,    "default", NULL, NULL,   CONOPTS,    NULL,  NULL,            "manual construction (requires reference annotation)",          8 },
@@ -134,8 +144,10 @@ static ESL_OPTIONS options[] = {
   { "-Z",           eslARG_REAL,        FALSE, NULL, "x>0",     NULL,    NULL,  NULL,            "set # of comparisons done, for E-value calculation",          12 },
   { "--domZ",       eslARG_REAL,        FALSE, NULL, "x>0",     NULL,    NULL,  NULL,            "set # of significant seqs, for domain E-value calculation",   12 },
   { "--seed",       eslARG_INT,          "42", NULL, "n>=0",    NULL,    NULL,  NULL,            "set RNG seed to <n> (if 0: one-time arbitrary seed)",         12 },
+  { "--dsample",    eslARG_INT,         FALSE, NULL, "n>0",     NULL,    NULL,  NULL,            "adaptive trace sampling: test convergence every <n> traces",  12 },
   { "--qformat",    eslARG_STRING,       NULL, NULL, NULL,      NULL,    NULL,  NULL,            "assert query <seqfile> is in format <s>: no autodetection",   12 },
   { "--tformat",    eslARG_STRING,       NULL, NULL, NULL,      NULL,    NULL,  NULL,            "assert target <seqdb> is in format <s>>: no autodetection",   12 },
+  { "--dbcache",    eslARG_NONE,        FALSE, NULL, NULL,      NULL,    NULL,  NULL,            "read <seqdb> into memory once, for all rounds and queries",   12 },
 
 #ifdef HMMER_THREADS
   { "--cpu",        eslARG_INT,       NULL,"HMMER_NCPU","n>=0", NULL,    NULL,  CPUOPTS,         "number of parallel CPU workers to use for multithreads",      12 },
@@ -168,10 +180,13 @@ struct cfg_s {
 
 static int  serial_master(ESL_GETOPTS *go, struct cfg_s *cfg);
 static int  serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp);
+static int  serial_loop_cache(WORKER_INFO *info, P7_SEQCACHE *seqcache);
+static void search_cached(WORKER_INFO *info, ESL_SQ *dbsq, HMMER_SEQ *seq);
 #ifdef HMMER_THREADS
 #define BLOCK_SIZE 1000
 
 static int  thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp);
+static int  thread_loop_cache(ESL_THREADS *obj, int *next_seq);
 static void pipeline_thread(void *arg);
 #endif /*HMMER_THREADS*/
 
@@ -276,6 +291,8 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *qfile, char *dbfile)
   if (esl_opt_IsUsed(go, "-A")           && fprintf(ofp, "# MSA of hits saved to file:       %s\n",             esl_opt_GetString(go, "-A"))          < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--tblout")     && fprintf(ofp, "# per-seq hits tabular output:     %s\n",             esl_opt_GetString(go, "--tblout"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domtblout")  && fprintf(ofp, "# per-dom hits tabular output:     %s\n",             esl_opt_GetString(go, "--domtblout")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dombinout")  && fprintf(ofp, "# per-dom hits binary output:      %s\n",             esl_opt_GetString(go, "--dombinout")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dombinali")  && fprintf(ofp, "# alignments in binary table:      yes\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--chkhmm")     && fprintf(ofp, "# HMM checkpoint files output:     %s-<i>.hmm\n",     esl_opt_GetString(go, "--chkhmm"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--chkali")     && fprintf(ofp, "# MSA checkpoint files output:     %s-<i>.sto\n",     esl_opt_GetString(go, "--chkali"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--acc")        && fprintf(ofp, "# prefer accessions over names:    yes\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -302,6 +319,7 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *qfile, char *dbfile)
   if (esl_opt_IsUsed(go, "--F2")         && fprintf(ofp, "# Vit filter P threshold:       <= %g\n",             esl_opt_GetReal(go, "--F2"))          < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--F3")         && fprintf(ofp, "# Fwd filter P threshold:       <= %g\n",             esl_opt_GetReal(go, "--F3"))          < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--nobias")     && fprintf(ofp, "# biased composition HMM filter:   off\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--skipfar")    && fprintf(ofp, "# skip targets w/ last MSV P:      > %g\n",            esl_opt_GetReal(go, "--skipfar"))     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--fast")       && fprintf(ofp, "# model architecture construction: fast/heuristic\n")                                       < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--hand")       && fprintf(ofp, "# model architecture construction: hand-specified by RF annotation\n")                      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--symfrac")    && fprintf(ofp, "# sym frac for model structure:    %.3f\n",           esl_opt_GetReal(go, "--symfrac"))     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -330,6 +348,7 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *qfile, char *dbfile)
   if (esl_opt_IsUsed(go, "--nonull2")    && fprintf(ofp, "# null2 bias corrections:          off\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "-Z")           && fprintf(ofp, "# sequence search space set to:    %.0f\n",           esl_opt_GetReal(go, "-Z"))            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domZ")       && fprintf(ofp, "# domain search space set to:      %.0f\n",           esl_opt_GetReal(go, "--domZ"))        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dsample")    && fprintf(ofp, "# adaptive trace sampling every:   %d\n",             esl_opt_GetInteger(go, "--dsample")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--seed"))
     {
       if (esl_opt_GetInteger(go, "--seed") == 0  && fprintf(ofp, "# random number seed:              one-time arbitrary\n")                           < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -337,6 +356,7 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *qfile, char *dbfile)
     }
   if (esl_opt_IsUsed(go, "--qformat")    && fprintf(ofp, "# query <seqfile> format asserted: %s\n",             esl_opt_GetString(go, "--qformat"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--tformat")    && fprintf(ofp, "# target <seqdb> format asserted:  %s\n",             esl_opt_GetString(go, "--tformat"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dbcache")    && fprintf(ofp, "# target <seqdb> held in memory:   yes\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 #ifdef HMMER_THREADS
   if (esl_opt_IsUsed(go, "--cpu")        && fprintf(ofp, "# number of worker threads:        %d\n",             esl_opt_GetInteger(go, "--cpu"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 #endif
@@ -415,10 +435,16 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   FILE            *afp      = NULL;               /* alignment output file (-A option)               */
   FILE            *tblfp    = NULL;		  /* output stream for tabular per-seq (--tblout)    */
   FILE            *domtblfp = NULL;		  /* output stream for tabular per-seq (--domtblout) */
+  FILE            *dombinfp = NULL;		  /* output stream for binary per-dom (--dombinout) */
   int              qformat  = eslSQFILE_UNKNOWN;  /* format of qfile                                 */
   int              dbformat = eslSQFILE_UNKNOWN;  /* format of dbfile                                */
   ESL_SQFILE      *qfp      = NULL;		  /* open qfile                                      */
   ESL_SQFILE      *dbfp     = NULL;               /* open dbfile                                     */
+  P7_SEQCACHE     *seqcache = NULL;               /* with --dbcache, dbfile held in memory           */
+  float           *msvP     = NULL;               /* with --skipfar, last MSV P-value of each target */
+  int              do_skip;                       /* TRUE if this round skips far-off targets        */
+  int              nskipped;                      /* # of targets skipped in this round              */
+  int              confirming;                    /* TRUE if this round is confirming a convergence  */
   ESL_ALPHABET    *abc      = NULL;               /* sequence alphabet                               */
   P7_BG           *bg       = NULL;		  /* null model                                      */
   P7_BUILDER      *bld      = NULL;               /* HMM construction configuration                  */
@@ -440,10 +466,13 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   int              infocnt  = 0;
   WORKER_INFO     *info     = NULL;
+  P7_TOPHITS     **thv      = NULL;  /* the other workers' hit lists, for merging into info[0]'s */
 #ifdef HMMER_THREADS
   ESL_SQ_BLOCK    *block    = NULL;
   ESL_THREADS     *threadObj= NULL;
   ESL_WORK_QUEUE  *queue    = NULL;
+  pthread_mutex_t  next_mutex;
+  int              next_seq = 0;
 #endif
 
   /* Initializations */
@@ -488,6 +517,8 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
     p7_Fail("Failed to open tabular per-seq output file %s for writing\n", esl_opt_GetString(go, "--tblout"));
   if (esl_opt_IsOn(go, "--domtblout") && (domtblfp = fopen(esl_opt_GetString(go, "--domtblout"), "w")) == NULL)  
     p7_Fail("Failed to open tabular per-dom output file %s for writing\n", esl_opt_GetString(go, "--domtblout"));
+  if (esl_opt_IsOn(go, "--dombinout") && (dombinfp = fopen(esl_opt_GetString(go, "--dombinout"), "w")) == NULL)  
+    p7_Fail("Failed to open binary per-dom output file %s for writing\n", esl_opt_GetString(go, "--dombinout"));
 
   /* Open the target sequence database for sequential access. */
   status =  esl_sqfile_OpenDigital(abc, cfg->dbfile, dbformat, p7_SEQDBENV, &dbfp);
@@ -496,7 +527,18 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   else if (status == eslEINVAL)    p7_Fail("Can't autodetect format of a stdin or .gz seqfile");
   else if (status != eslOK)        p7_Fail("Unexpected error %d opening target sequence database file %s\n", status, cfg->dbfile);
   
-  if (! esl_sqfile_IsRewindable(dbfp)) 
+  /* With --dbcache, parse and digitize the target database once, here, and search it from memory
+   * in every round; the file need not be rewindable then.
+   */
+  if (esl_opt_GetBoolean(go, "--dbcache"))
+    {
+      status = p7_seqcache_Read(dbfp, &seqcache);
+      if      (status == eslEFORMAT) p7_Fail("Parse failed (sequence file %s):\n%s\n", dbfp->filename, esl_sqfile_GetErrorBuf(dbfp));
+      else if (status != eslOK)      p7_Fail("Unexpected error %d reading sequence file %s", status, dbfp->filename);
+
+      if (esl_opt_IsOn(go, "--skipfar")) ESL_ALLOC(msvP, sizeof(float) * ESL_MAX(1, seqcache->count));
+    }
+  else if (! esl_sqfile_IsRewindable(dbfp)) 
     p7_Fail("Target sequence file %s isn't rewindable; jackhmmer requires that it is", cfg->dbfile);
 
   /* Open the query sequence file  */
@@ -511,16 +553,20 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   /* initialize thread data */
   if (esl_opt_IsOn(go, "--cpu")) ncpus = esl_opt_GetInteger(go, "--cpu");
   else                           esl_threads_CPUCount(&ncpus);
+  p7_tracealign_SetThreads(ncpus);
 
   if (ncpus > 0)
     {
       threadObj = esl_threads_Create(&pipeline_thread);
       queue = esl_workqueue_Create(ncpus * 2);
+      if (seqcache && pthread_mutex_init(&next_mutex, NULL) != 0) p7_Fail("Failed to initialize mutex");
     }
+  bld->ncpus = ncpus;		/* workers are idle while each round's model is built; calibrate with them */
 #endif
 
   infocnt = (ncpus == 0) ? 1 : ncpus;
   ESL_ALLOC(info, sizeof(*info) * infocnt);
+  ESL_ALLOC(thv,  sizeof(P7_TOPHITS *) * infocnt);
 
   /* Ready to begin */
   output_header(ofp, go, cfg->qfile, cfg->dbfile);
@@ -531,8 +577,14 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       info[i].th    = NULL;
       info[i].om    = NULL;
       info[i].bg    = p7_bg_Clone(bg);
+      info[i].seqcache = seqcache;
+      info[i].msvP     = msvP;
+      info[i].skipP    = 1.0;
+      info[i].nskipped = 0;
 #ifdef HMMER_THREADS
-      info[i].queue = queue;
+      info[i].queue      = queue;
+      info[i].next_seq   = &next_seq;
+      info[i].next_mutex = &next_mutex;
 #endif
     }
 
@@ -572,17 +624,38 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       if (qsq->desc[0] != '\0' && fprintf(ofp, "Description: %s\n", qsq->desc) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");  
       if (fprintf(ofp, "\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 
+      confirming = FALSE;
       for (iteration = 1; iteration <= maxiterations; iteration++)
 	{       /* We enter each iteration with an optimized profile. */
 	  esl_stopwatch_Start(w);
 
-	  if (om        != NULL) p7_oprofile_Destroy(om);
+	  /* With --skipfar, round 1 scores every target and records its MSV P-value. Later rounds
+	   * skip the targets that were far from passing the MSV filter last time, except for the
+	   * last permitted round; and a round that converges while skipping is repeated with the
+	   * same model as a full search. So the final results always come from a full search.
+	   */
+	  do_skip  = (msvP != NULL && iteration > 1 && iteration < maxiterations && ! confirming);
+	  for (i = 0; i < infocnt; ++i)
+	    {
+	      info[i].skipP    = (do_skip ? esl_opt_GetReal(go, "--skipfar") : 1.0);
+	      info[i].nskipped = 0;
+	    }
+
+	  if (om        != NULL && ! confirming) p7_oprofile_Destroy(om);
 	  if (info->pli != NULL) p7_pipeline_Destroy(info->pli);
 	  if (info->th  != NULL) p7_tophits_Destroy(info->th);
 	  if (info->om  != NULL) p7_oprofile_Destroy(info->om);
 
- 	  /* Create the search model: from query alone (round 1) or from MSA (round 2+) */
-	  if (msa == NULL)	/* round 1 */
+ 	  /* Create the search model: from query alone (round 1) or from MSA (round 2+); or keep it, to repeat a round */
+	  if (confirming)
+	    {
+	      if (fprintf(ofp, "@@\n")                                               < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");  
+	      if (fprintf(ofp, "@@ Round:                  %d (repeated, searching all targets)\n", iteration) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+	      if (fprintf(ofp, "@@\n\n")                                             < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+	      esl_msa_Destroy(msa);
+	      msa = NULL;
+	    }
+	  else if (msa == NULL)	/* round 1 */
 	    {
 	      p7_SingleBuilder(bld, qsq, info[0].bg, ret_hmm, &qtr, NULL, &om); /* bypass HMM - only need model */
 	      prv_msa_nseq = 1;
@@ -607,7 +680,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	    }
 
 	  /* HMM checkpoint output */
-	  if (esl_opt_IsOn(go, "--chkhmm")) {
+	  if (esl_opt_IsOn(go, "--chkhmm") && hmm != NULL) {
 	    checkpoint_hmm(nquery, hmm, esl_opt_GetString(go, "--chkhmm"), iteration);
 	    p7_hmm_Destroy(hmm);
 	    hmm = NULL;
@@ -619,6 +692,8 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	      info[i].th  = p7_tophits_Create();
 	      info[i].om  = p7_oprofile_Clone(om);
 	      info[i].pli = p7_pipeline_Create(go, om->M, 400, FALSE, p7_SEARCH_SEQS); /* 400 is a dummy length for now */
+	      if (esl_opt_IsOn(go, "--dsample")) info[i].pli->ddef->nsamples_check = esl_opt_GetInteger(go, "--dsample");
+	      info[i].pli->ddef->nthreads = ncpus;
 	      p7_pli_NewModel(info[i].pli, info[i].om, info[i].bg);
 
 #ifdef HMMER_THREADS
@@ -627,10 +702,13 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	    }
 
 #ifdef HMMER_THREADS
-	  if (ncpus > 0) sstatus = thread_loop(threadObj, queue, dbfp);
-	  else           sstatus = serial_loop(info, dbfp);
+	  if      (ncpus > 0 && seqcache) sstatus = thread_loop_cache(threadObj, &next_seq);
+	  else if (ncpus > 0)             sstatus = thread_loop(threadObj, queue, dbfp);
+	  else if (seqcache)              sstatus = serial_loop_cache(info, seqcache);
+	  else                            sstatus = serial_loop(info, dbfp);
 #else
-	  sstatus = serial_loop(info, dbfp);
+	  if (seqcache) sstatus = serial_loop_cache(info, seqcache);
+	  else          sstatus = serial_loop(info, dbfp);
 #endif
 	  switch(sstatus)
 	    {
@@ -646,10 +724,13 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 			sstatus, dbfp->filename);
 	    }
 
-	  /* merge the results of the search results */
+	  /* merge the results of the search results; each worker has sorted its own hits */
+	  for (i = 1; i < infocnt; ++i) thv[i-1] = info[i].th;
+	  p7_tophits_MergeAll(info[0].th, thv, infocnt-1);
+	  nskipped = info[0].nskipped;
 	  for (i = 1; i < infocnt; ++i)
 	    {
-	      p7_tophits_Merge(info[0].th, info[i].th);
+	      nskipped += info[i].nskipped;
 	      p7_pipeline_Merge(info[0].pli, info[i].pli);
 
 	      p7_pipeline_Destroy(info[i].pli);
@@ -670,8 +751,11 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	  esl_msa_Digitize(abc,msa,NULL);
 	  esl_msa_FormatName(msa, "%s-i%d", qsq->name, iteration);
 
+	  /* A round that converged while skipping targets doesn't count; it is repeated in full. */
+	  confirming = (nnew_targets == 0 && msa->nseq <= prv_msa_nseq && nskipped > 0);
+
 	  /* Optional checkpointing */
-	  if (esl_opt_IsOn(go, "--chkali")) checkpoint_msa(nquery, msa, esl_opt_GetString(go, "--chkali"), iteration);
+	  if (esl_opt_IsOn(go, "--chkali") && ! confirming) checkpoint_msa(nquery, msa, esl_opt_GetString(go, "--chkali"), iteration);
 
 	  esl_stopwatch_Stop(w);
 	  p7_pli_Statistics(ofp, info->pli, w);
@@ -682,7 +766,13 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	  if (fprintf(ofp, "@@ New targets included:   %d\n", nnew_targets)  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 	  if (fprintf(ofp, "@@ New alignment includes: %d subseqs (was %d), including original query\n",
 		  msa->nseq, prv_msa_nseq)                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-	  if (nnew_targets == 0 && msa->nseq <= prv_msa_nseq)
+	  if (do_skip && fprintf(ofp, "@@ Far-off targets skipped: %d\n", nskipped) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+	  if (confirming)
+	    {
+	      if (fprintf(ofp, "@@ Converged on the targets searched; repeating round with all targets.\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+	      iteration--;
+	    }
+	  else if (nnew_targets == 0 && msa->nseq <= prv_msa_nseq)
 	    {
 	      if (fprintf(ofp, "@@\n")                                       < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 	      if (fprintf(ofp, "@@ CONVERGED (in %d rounds). \n", iteration) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -692,7 +782,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	  else if (iteration < maxiterations)
 	    { if (fprintf(ofp, "@@ Continuing to next round.\n\n")           < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
 
-	  esl_sqfile_Position(dbfp, 0);
+	  if (! seqcache) esl_sqfile_Position(dbfp, 0);
 	} /* end iteration loop */
 
       /* Because we destroy/create the hitlist, om, pipeline, and msa above, rather than create/destroy,
@@ -701,6 +791,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
        */
       if (tblfp)    p7_tophits_TabularTargets(tblfp,    qsq->name, qsq->acc, info->th, info->pli, (nquery == 1));
       if (domtblfp) p7_tophits_TabularDomains(domtblfp, qsq->name, qsq->acc, info->th, info->pli, (nquery == 1));
+      if (dombinfp) p7_tophits_BinaryDomains(dombinfp, qsq->name, qsq->acc, info->th, info->pli, esl_opt_GetBoolean(go, "--dombinali"));
       if (afp) 
 	{
 	  if (textw > 0) eslx_msafile_Write(afp, msa, eslMSAFILE_STOCKHOLM);
@@ -723,7 +814,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       p7_trace_Destroy(qtr);
       esl_sq_Reuse(qsq);
       esl_keyhash_Reuse(kh);
-      esl_sqfile_Position(dbfp, 0);
+      if (! seqcache) esl_sqfile_Position(dbfp, 0);
     }
   if      (qstatus == eslEFORMAT) p7_Fail("Parse failed (sequence file %s):\n%s\n",
 					    qfp->filename, esl_sqfile_GetErrorBuf(qfp));
@@ -749,14 +840,18 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	esl_sq_DestroyBlock(block);
       esl_workqueue_Destroy(queue);
       esl_threads_Destroy(threadObj);
+      if (seqcache) pthread_mutex_destroy(&next_mutex);
     }
 #endif
 
   free(info);
+  free(thv);
 
   esl_keyhash_Destroy(kh);
   esl_sqfile_Close(qfp);
   esl_sqfile_Close(dbfp);
+  if (seqcache) p7_seqcache_Close(seqcache);
+  if (msvP)     free(msvP);
   esl_sq_Destroy(qsq);  
   esl_stopwatch_Destroy(w);
   p7_builder_Destroy(bld);
@@ -767,6 +862,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (afp      != NULL)   fclose(afp);
   if (tblfp    != NULL)   fclose(tblfp);
   if (domtblfp != NULL)   fclose(domtblfp);
+  if (dombinfp != NULL)   fclose(dombinfp);
 
   return eslOK;
 
@@ -968,6 +1064,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   FILE            *afp      = NULL;               /* alignment output file (-A option)               */
   FILE            *tblfp    = NULL;		  /* output stream for tabular per-seq (--tblout)    */
   FILE            *domtblfp = NULL;		  /* output stream for tabular per-seq (--domtblout) */
+  FILE            *dombinfp = NULL;		  /* output stream for binary per-dom (--dombinout) */
   int              qformat  = eslSQFILE_UNKNOWN;  /* format of qfile                                 */
   int              dbformat = eslSQFILE_UNKNOWN;  /* format of dbfile                                */
   ESL_SQFILE      *qfp      = NULL;		  /* open qfile                                      */
@@ -1038,6 +1135,8 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
     mpi_failure("Failed to open tabular per-seq output file %s for writing\n", esl_opt_GetString(go, "--tblfp"));
   if (esl_opt_IsOn(go, "--domtblout") && (domtblfp = fopen(esl_opt_GetString(go, "--domtblout"), "w")) == NULL)  
     mpi_failure("Failed to open tabular per-dom output file %s for writing\n", esl_opt_GetString(go, "--domtblfp"));
+  if (esl_opt_IsOn(go, "--dombinout") && (dombinfp = fopen(esl_opt_GetString(go, "--dombinout"), "w")) == NULL)  
+    mpi_failure("Failed to open binary per-dom output file %s for writing\n", esl_opt_GetString(go, "--dombinout"));
 
   /* Open the target sequence database for sequential access. */
   status =  esl_sqfile_OpenDigital(abc, cfg->dbfile, dbformat, p7_SEQDBENV, &dbfp);
@@ -1135,6 +1234,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	  /* Create new processing pipeline and top hits list; destroy old. (TODO: reuse rather than recreate) */
 	  th  = p7_tophits_Create();
 	  pli = p7_pipeline_Create(go, om->M, 400, FALSE, p7_SEARCH_SEQS); /* 400 is a dummy length for now */
+	  if (esl_opt_IsOn(go, "--dsample")) pli->ddef->nsamples_check = esl_opt_GetInteger(go, "--dsample");
 	  p7_pli_NewModel(pli, om, bg);
 
 	  /* Send to all the workers the optimized model to search with */
@@ -1265,6 +1365,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
        */
       if (tblfp)    p7_tophits_TabularTargets(tblfp,    qsq->name, qsq->acc, th, pli, (nquery == 1));
       if (domtblfp) p7_tophits_TabularDomains(domtblfp, qsq->name, qsq->acc, th, pli, (nquery == 1));
+      if (dombinfp) p7_tophits_BinaryDomains(dombinfp, qsq->name, qsq->acc, th, pli, esl_opt_GetBoolean(go, "--dombinali"));
       if (afp) 
 	{
 	  if (textw > 0) eslx_msafile_Write(afp, msa, eslMSAFILE_STOCKHOLM);
@@ -1336,6 +1437,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (afp      != NULL)   fclose(afp);
   if (tblfp    != NULL)   fclose(tblfp);
   if (domtblfp != NULL)   fclose(domtblfp);
+  if (dombinfp != NULL)   fclose(dombinfp);
 
   return eslOK;
 
@@ -1447,6 +1549,7 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
 	  /* Create new processing pipeline and top hits list; destroy old. (TODO: reuse rather than recreate) */
 	  th  = p7_tophits_Create();
 	  pli = p7_pipeline_Create(go, om->M, 400, FALSE, p7_SEARCH_SEQS); /* 400 is a dummy length for now */
+	  if (esl_opt_IsOn(go, "--dsample")) pli->ddef->nsamples_check = esl_opt_GetInteger(go, "--dsample");
 	  p7_pli_NewModel(pli, om, bg);
 
 	  /* receive a sequence block from the master */
@@ -1603,6 +1706,57 @@ serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp)
   return sstatus;
 }
 
+/* search_cached()
+ *
+ * Run the pipeline on one target from the --dbcache cache, presented
+ * as <dbsq>, an ESL_SQ that only points into the cache. With
+ * --skipfar the target may be skipped instead: it still counts
+ * toward the database size Z, so E-values are unaffected.
+ */
+static void
+search_cached(WORKER_INFO *info, ESL_SQ *dbsq, HMMER_SEQ *seq)
+{
+  dbsq->name = seq->name;
+  dbsq->acc  = seq->acc;
+  dbsq->desc = seq->desc;
+  dbsq->dsq  = seq->dsq;
+  dbsq->n    = dbsq->L = seq->n;
+  dbsq->idx  = seq->idx;
+
+  p7_pli_NewSeq(info->pli, dbsq);
+  if (info->skipP < 1.0 && info->msvP[seq->idx] > info->skipP) { info->nskipped++; return; }
+
+  p7_bg_SetLength(info->bg, dbsq->n);
+  p7_oprofile_ReconfigLength(info->om, dbsq->n);
+      
+  p7_Pipeline(info->pli, info->om, info->bg, dbsq, info->th);
+  if (info->msvP) info->msvP[seq->idx] = info->pli->msvP;
+
+  p7_pipeline_Reuse(info->pli);
+}
+
+/* serial_loop_cache()
+ *
+ * Like serial_loop(), but the targets come from the in-memory
+ * <seqcache> (--dbcache) instead of being parsed from the file
+ * again. Each cached sequence is presented to the pipeline as
+ * an ESL_SQ that only points into the cache.
+ */
+static int
+serial_loop_cache(WORKER_INFO *info, P7_SEQCACHE *seqcache)
+{
+  ESL_SQ   dbsq;
+  uint32_t i;
+
+  memset(&dbsq, 0, sizeof(ESL_SQ));
+  dbsq.abc = info->om->abc;
+
+  for (i = 0; i < seqcache->count; i++)
+    search_cached(info, &dbsq, seqcache->list + i);
+
+  return eslEOF;
+}
+
 #ifdef HMMER_THREADS
 static int
 thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp)
@@ -1644,12 +1798,31 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp)
     {
       /* wait for all the threads to complete */
       esl_threads_WaitForFinish(obj);
+      p7_domaindef_ReclaimThreads();
       esl_workqueue_Complete(queue);  
     }
 
   return sstatus;
 }
 
+/* thread_loop_cache()
+ *
+ * With --dbcache there is nothing for the master to read; the
+ * workers claim BLOCK_SIZE runs of cached targets for themselves
+ * (see pipeline_thread()), and the master only waits for them.
+ * The workers are already running by the time we're called, so
+ * <next_seq> is reset for the next round on the way out, not here.
+ */
+static int
+thread_loop_cache(ESL_THREADS *obj, int *next_seq)
+{
+  esl_threads_WaitForStart(obj);
+  esl_threads_WaitForFinish(obj);
+  p7_domaindef_ReclaimThreads();
+  *next_seq = 0;
+  return eslEOF;
+}
+
 static void 
 pipeline_thread(void *arg)
 {
@@ -1670,6 +1843,33 @@ pipeline_thread(void *arg)
 
   info = (WORKER_INFO *) esl_threads_GetData(obj, workeridx);
 
+  if (info->seqcache)
+    {
+      ESL_SQ dbsq;
+      int    first, last;
+
+      memset(&dbsq, 0, sizeof(ESL_SQ));
+      dbsq.abc = info->om->abc;
+
+      while (1)
+	{
+	  if (pthread_mutex_lock(info->next_mutex) != 0) p7_Fail("mutex lock failed");
+	  first = *info->next_seq;
+	  *info->next_seq = ESL_MIN(first + BLOCK_SIZE, (int) info->seqcache->count);
+	  last  = *info->next_seq;
+	  if (pthread_mutex_unlock(info->next_mutex) != 0) p7_Fail("mutex unlock failed");
+	  if (first >= last) break;
+
+	  for (i = first; i < last; ++i)
+	    search_cached(info, &dbsq, info->seqcache->list + i);
+	}
+
+      p7_tophits_SortBySortkey(info->th);   /* sorted in parallel, ready for the merge */
+      p7_domaindef_LendThread();
+      esl_threads_Finished(obj, workeridx);
+      return;
+    }
+
   status = esl_workqueue_WorkerUpdate(info->queue, NULL, &newBlock);
   if (status != eslOK) p7_Fail("Work queue worker failed");
 
@@ -1698,9 +1898,13 @@ pipeline_thread(void *arg)
       block = (ESL_SQ_BLOCK *) newBlock;
     }
 
+  /* sort this worker's hits now, in parallel with the others, ready for the merge */
+  p7_tophits_SortBySortkey(info->th);
+
   status = esl_workqueue_WorkerUpdate(info->queue, block, NULL);
   if (status != eslOK) p7_Fail("Work queue worker failed");
 
+  p7_domaindef_LendThread();
   esl_threads_Finished(obj, workeridx);
   return;
 }
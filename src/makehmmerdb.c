@@ -31,6 +31,7 @@ static ESL_OPTIONS options[] = {
   { "--bin_length", eslARG_INT,        "256", NULL, NULL,    NULL,  NULL,  NULL,        "bin length (power of 2;  32<=b<=4096)",                     3 },
   { "--sa_freq",    eslARG_INT,        "8",   NULL, NULL,    NULL,  NULL,  NULL,        "suffix array sample rate (power of 2)",                     3 },
   { "--block_size", eslARG_INT,        "50",  NULL, NULL,    NULL,  NULL,  NULL,        "input sequence broken into chunks this size (Mbases)",      3 },
+  { "--rankblocks", eslARG_NONE,       FALSE, NULL, NULL,    NULL,  NULL,  NULL,        "answer rank queries from interleaved popcount blocks",      3 },
 
   /* hidden*/
   { "--fwd_only",   eslARG_NONE,       FALSE, NULL, NULL,    NULL,  NULL,  NULL,        "build FM-index only for forward search (not for HMMER)",    9 },
@@ -105,6 +106,7 @@ output_header(FILE *ofp, const ESL_GETOPTS *go, char *seqfile, char *fmfile)
   if (fprintf(ofp, "# output binary-formatted HMMER database:  %s\n", fmfile)                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (fprintf(ofp, "# bin_length:                              %d\n", esl_opt_GetInteger(go, "--bin_length")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (fprintf(ofp, "# suffix array sample rate:                %d\n", esl_opt_GetInteger(go, "--sa_freq"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--rankblocks") && fprintf(ofp, "# rank query layout:                       interleaved rank blocks\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 //  if (esl_opt_IsUsed(go, "--amino")      && fprintf(ofp, "# input is asserted to be:                 protein\n")                                        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 //  if (esl_opt_IsUsed(go, "--dna")        && fprintf(ofp, "# input is asserted to be:                 DNA\n")                                            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 //  if (esl_opt_IsUsed(go, "--rna")        && fprintf(ofp, "# input is asserted to be:                 RNA\n")                                            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -252,9 +254,11 @@ int buildAndWriteFMIndex (FM_METADATA *meta, uint32_t seq_offset, uint32_t ambig
     }
   }
 
-  //wrap up the counting;
+  //wrap up the counting; if N lands on a bin boundary the final b count was already
+  //stored in the loop above (and cnts_b may since have been reset at an sb boundary)
   for (c=0; c<meta->alph_size; c++) {
-    FM_OCC_CNT(b, num_freq_cnts_b-1, c ) = cnts_b[c];
+    if (N % meta->freq_cnt_b)
+      FM_OCC_CNT(b, num_freq_cnts_b-1, c ) = cnts_b[c];
     FM_OCC_CNT(sb, num_freq_cnts_sb-1, c ) = cnts_sb[c];
   }
 
@@ -426,6 +430,7 @@ main(int argc, char **argv)
   uint32_t ambig_cnt;
 
   uint32_t prev_numseqs = 0;
+  uint8_t  meta_flags;
 
   int compressed_bytes;
   uint32_t term_loc;
@@ -526,6 +531,8 @@ main(int argc, char **argv)
   if (esl_opt_IsOn(go, "--fwd_only") )
     meta->fwd_only = 1;
 
+  meta->rank_layout = (esl_opt_GetBoolean(go, "--rankblocks") ? fm_RANK_BLOCKS : fm_RANK_SAMPLED);
+
   //getInverseAlphabet
   fm_alphabetCreate(meta, &(meta->charBits));
   chars_per_byte = 8/meta->charBits;
@@ -708,8 +715,9 @@ main(int argc, char **argv)
     esl_fatal( "%s: Cannot open file `%s': ", argv[0], fname_out);
 
 
-    //write out meta data
-  if( fwrite(&(meta->fwd_only),     sizeof(meta->fwd_only),     1, fp) != 1 ||
+    //write out meta data; the rank layout rides in the high bit of the fwd_only byte
+  meta_flags = meta->fwd_only | (meta->rank_layout == fm_RANK_BLOCKS ? FM_META_RANKBLOCKS_FLAG : 0);
+  if( fwrite(&meta_flags,           sizeof(meta_flags),         1, fp) != 1 ||
       fwrite(&(meta->alph_type),    sizeof(meta->alph_type),    1, fp) != 1 ||
       fwrite(&(meta->alph_size),    sizeof(meta->alph_size),    1, fp) != 1 ||
       fwrite(&(meta->charBits),     sizeof(meta->charBits),     1, fp) != 1 ||
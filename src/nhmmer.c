@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "easel.h"
 #include "esl_alphabet.h"
@@ -19,7 +20,6 @@
 
 
 #ifdef HMMER_THREADS
-#include <unistd.h>
 #include "esl_threads.h"
 #include "esl_workqueue.h"
 #endif /*HMMER_THREADS*/
@@ -34,6 +34,55 @@
 #define NHMMER_MAX_RESIDUE_COUNT (1024 * 256)  /* 1/4 Mb */
 #endif
 
+/* Checkpointing (--checkpoint).
+ *
+ * The checkpoint file is a header (magic number, format version,
+ * query and target file names, the search options, and how the
+ * search divides the targets into units; see checkpoint_Open())
+ * followed by one record per completed unit of work: a window of a
+ * target sequence for a sequence database, or a block for an FM
+ * index. Each record holds the query index, the unit's key, the
+ * pipeline accounting the unit added, and the hits it found. Units
+ * are identified by key, not by position in the file, so threaded
+ * workers save them in whatever order they finish, and a resumed
+ * search skips exactly the units that have records. Records are
+ * only appended, and a partially written record at the end of the
+ * file (from a run that was killed) is discarded when the file is
+ * reopened. Native binary, not portable.
+ */
+typedef struct {
+  int64_t  target;          /* target sequence index; or FM block number        */
+  int64_t  pos;             /* end of the window in the target; 0 for FM blocks */
+} CHECKPOINT_UNIT;
+
+#define NHMMER_CKPT_NCOUNT 9            /* # of P7_PIPELINE counters saved per record */
+
+/* What a worker has already saved of its own pipeline and hit list */
+typedef struct {
+  uint64_t  nhits;                        /* # of hits in its <th> that are in the file      */
+  uint64_t  counts[NHMMER_CKPT_NCOUNT];   /* its pipeline counters when it last saved a unit */
+} CHECKPOINT_MARK;
+
+typedef struct checkpoint_s {
+  char            *filename;
+  FILE            *fp;             /* open for reading, and for appending records      */
+  int              qidx;           /* index of the current query, 0..nquery-1         */
+  int              nrec;           /* # of records in the file when it was opened      */
+  int              nalloc;
+  int             *rec_qidx;       /* query index of each of those records, ...        */
+  long            *rec_offset;     /* ... and where the record starts in the file      */
+  CHECKPOINT_UNIT *done;           /* units of the current query that have records, sorted */
+  int              ndone;
+  int              donealloc;
+#ifdef HMMER_THREADS
+  pthread_mutex_t  lock;           /* serializes workers' appends                      */
+#endif
+} CHECKPOINT;
+
+#define NHMMER_CKPT_MAGIC   0x4e48434bu  /* "NHCK" */
+#define NHMMER_CKPT_VERSION 2
+#define NHMMER_CKPT_RECORD  0x52454332u  /* "REC2" */
+
 typedef struct {
 #ifdef HMMER_THREADS
   ESL_WORK_QUEUE   *queue;
@@ -44,11 +93,14 @@ typedef struct {
   P7_OPROFILE      *om;          /* optimized query profile                 */
   FM_CFG           *fm_cfg;      /* global data for FM-index for fast SSV */
   P7_SCOREDATA     *scoredata;   /* hmm-specific data used by nhmmer */
+  CHECKPOINT       *ckpt;        /* --checkpoint state; NULL if not checkpointing */
+  CHECKPOINT_MARK   ckpt_mark;   /* what this worker has saved to <ckpt>    */
 } WORKER_INFO;
 
 typedef struct {
   FM_DATA  *fmf;
   FM_DATA  *fmb;
+  int      block;   //index of the block in the FM index
   int      active;  //TRUE is worker is supposed to work on the contents, FALSE otherwise
 } FM_THREAD_INFO;
 
@@ -70,6 +122,13 @@ static void            destroy_id_length( ID_LENGTH_LIST *list );
 static int             add_id_length(ID_LENGTH_LIST *list, int id, int L);
 static int             assign_Lengths(P7_TOPHITS *th, ID_LENGTH_LIST *id_length_list);
 
+static int  checkpoint_Open   (const char *filename, const ESL_GETOPTS *go, const char *queryfile, const char *dbfile, const char *units, CHECKPOINT **ret_ckpt, char *errbuf);
+static int  checkpoint_Restore(CHECKPOINT *ckpt, int qidx, P7_PIPELINE *pli, P7_TOPHITS *th, char *errbuf);
+static void checkpoint_Mark   (P7_PIPELINE *pli, P7_TOPHITS *th, CHECKPOINT_MARK *mark);
+static int  checkpoint_IsDone (const CHECKPOINT *ckpt, int64_t target, int64_t pos);
+static int  checkpoint_Save   (CHECKPOINT *ckpt, int64_t target, int64_t pos, P7_PIPELINE *pli, P7_TOPHITS *th, CHECKPOINT_MARK *mark);
+static void checkpoint_Close  (CHECKPOINT *ckpt);
+
 #define REPOPTS     "-E,-T,--cut_ga,--cut_nc,--cut_tc"
 #define DOMREPOPTS  "--domE,--domT,--cut_ga,--cut_nc,--cut_tc"
 #define INCOPTS     "--incE,--incT,--cut_ga,--cut_nc,--cut_tc"
@@ -139,11 +198,13 @@ static ESL_OPTIONS options[] = {
   { "--nonull2",    eslARG_NONE,         NULL, NULL, NULL,    NULL,  NULL,           NULL,     "turn off biased composition score corrections",                 12 },
   { "-Z",           eslARG_REAL,        FALSE, NULL, "x>0",   NULL,  NULL,           NULL,     "set database size (Megabases) to <x> for E-value calculations", 12 },
   { "--seed",       eslARG_INT,          "42", NULL, "n>=0",  NULL,  NULL,           NULL,     "set RNG seed to <n> (if 0: one-time arbitrary seed)",           12 },
+  { "--dsample",    eslARG_INT,         FALSE, NULL, "n>0",   NULL,  NULL,           NULL,     "adaptive trace sampling: test convergence every <n> traces",    12 },
   { "--w_beta",     eslARG_REAL,         NULL, NULL, NULL,    NULL,  NULL,           NULL,     "tail mass at which window length is determined",                12 },
   { "--w_length",   eslARG_INT,          NULL, NULL, NULL,    NULL,  NULL,           NULL,     "window length - essentially max expected hit length" ,          12 },
   { "--block_length", eslARG_INT,        NULL, NULL, "n>=50000", NULL, NULL,         NULL,     "length of blocks read from target database (threaded) ",        12 },
   { "--toponly",     eslARG_NONE,         NULL, NULL, NULL,    NULL,  NULL,   "--bottomonly",  "only search the top strand",                                    12 },
   { "--bottomonly",  eslARG_NONE,         NULL, NULL, NULL,    NULL,  NULL,      "--toponly",  "only search the bottom strand",                                 12 },
+  { "--checkpoint", eslARG_STRING,       NULL, NULL, NULL,    NULL,  NULL,           NULL,     "save progress to file <f>, and resume from it if it exists",    12 },
 
 
   /* Restrict search to subset of database - hidden because these flags are
@@ -364,7 +425,9 @@ output_header(FILE *ofp, const ESL_GETOPTS *go, char *queryfile, char *seqfile,
 
   if (esl_opt_IsUsed(go, "--toponly")    && fprintf(ofp, "# search only top strand:          on\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--bottomonly") && fprintf(ofp, "# search only bottom strand:       on\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--checkpoint") && fprintf(ofp, "# checkpoint file:                 %s\n",             esl_opt_GetString(go, "--checkpoint")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "-Z")           && fprintf(ofp, "# database size is set to:         %.1f Mb\n",        esl_opt_GetReal(go, "-Z"))            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dsample")    && fprintf(ofp, "# adaptive trace sampling every:   %d\n",             esl_opt_GetInteger(go, "--dsample")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--seed"))  {
     if (esl_opt_GetInteger(go, "--seed") == 0 && fprintf(ofp, "# random number seed:              one-time arbitrary\n")                              < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
     else if                              (  fprintf(ofp, "# random number seed set to:       %d\n",             esl_opt_GetInteger(go, "--seed"))     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -376,7 +439,7 @@ output_header(FILE *ofp, const ESL_GETOPTS *go, char *queryfile, char *seqfile,
   if (esl_opt_IsUsed(go, "--block_length")&&fprintf(ofp, "# block length :                   %d\n",             esl_opt_GetInteger(go, "--block_length")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 #ifdef HMMER_THREADS
   //if (esl_opt_IsUsed(go, "--cpu")        && fprintf(ofp, "# number of worker threads:        %d\n",             esl_opt_GetInteger(go, "--cpu"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-  if (fprintf(ofp, "# number of worker threads:        %d\n",             ncpus)      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (fprintf(ofp, "# number of worker threads:        %d\n",             ncpus)                                < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 #endif
   if (fprintf(ofp, "# - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -\n\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   return eslOK;
@@ -485,6 +548,8 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   double           resCnt    = 0;
   /* used to keep track of the lengths of the sequences that are processed */
   ID_LENGTH_LIST  *id_length_list = NULL;
+  CHECKPOINT      *ckpt           = NULL;
+  char            *ckpt_units     = NULL;
 
   /* these variables are only used if db type is FM-index*/
   FM_CFG      *fm_cfg       = NULL;
@@ -497,6 +562,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   int              infocnt  = 0;
   WORKER_INFO     *info     = NULL;
+  P7_TOPHITS     **thv      = NULL;  /* the other workers' hit lists, for merging into info[0]'s */
 #ifdef HMMER_THREADS
   ESL_SQ_BLOCK    *block    = NULL;
   FM_THREAD_INFO  *fminfo   = NULL;
@@ -689,6 +755,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   /* initialize thread data */
   if (esl_opt_IsOn(go, "--cpu")) ncpus = esl_opt_GetInteger(go, "--cpu");
   else                                   esl_threads_CPUCount(&ncpus);
+  p7_tracealign_SetThreads(ncpus);
 
 
   if (ncpus > 0) {
@@ -703,6 +770,15 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   }
 #endif
 
+  if (esl_opt_IsOn(go, "--checkpoint")) {
+    /* the threaded reader cuts long targets into windows at different places than the serial one */
+    if      (dbformat == eslSQFILE_FMINDEX) ckpt_units = "FM index blocks";
+    else if (ncpus > 0)                     ckpt_units = "windows of threaded reads";
+    else                                    ckpt_units = "windows of serial reads";
+    status = checkpoint_Open(esl_opt_GetString(go, "--checkpoint"), go, cfg->queryfile, cfg->dbfile, ckpt_units, &ckpt, errbuf);
+    if (status != eslOK) p7_Fail("Failed to open checkpoint file %s:\n%s\n", esl_opt_GetString(go, "--checkpoint"), errbuf);
+  }
+
   if (esl_opt_IsOn(go, "--bgfile")) {
     bg_manual = p7_bg_Create(abc);
     status = p7_bg_Read(esl_opt_GetString(go, "--bgfile"), bg_manual, errbuf);
@@ -711,6 +787,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   infocnt = (ncpus == 0) ? 1 : ncpus;
   ESL_ALLOC(info, sizeof(*info) * infocnt);
+  ESL_ALLOC(thv,  sizeof(P7_TOPHITS *) * infocnt);
 
   if (! (abc->type == eslRNA || abc->type == eslDNA))
     p7_Fail("Invalid alphabet type in hmm for nhmmer. Expect DNA or RNA\n");
@@ -726,6 +803,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
           info[i].pli    = NULL;
           info[i].th     = NULL;
           info[i].om     = NULL;
+          info[i].ckpt   = ckpt;
           if (bg_manual != NULL)
             info[i].bg = p7_bg_Clone(bg_manual);
           else
@@ -898,6 +976,9 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
           info[i].th  = p7_tophits_Create();
           info[i].om = p7_oprofile_Copy(om);
           info[i].pli = p7_pipeline_Create(go, om->M, 100, TRUE, p7_SEARCH_SEQS); /* L_hint = 100 is just a dummy for now */
+          info[i].pli->ddef->do_alidisplay = (info[i].pli->show_alignments || esl_opt_IsOn(go, "-A") || esl_opt_IsOn(go, "--aliscoresout"));  /* build full alignment displays only if they get shown */
+          if (esl_opt_IsOn(go, "--dsample")) info[i].pli->ddef->nsamples_check = esl_opt_GetInteger(go, "--dsample");
+          info[i].pli->ddef->nthreads = ncpus;
 
           //set method specific --F1, if it wasn't set at command line
           if (!esl_opt_IsOn(go, "--F1") ) {
@@ -939,6 +1020,15 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 #endif
       }
 
+      /* pick up the units of this query that a checkpointed run already searched;
+       * their accounting and hits go to the first worker, before any new ones */
+      if (ckpt != NULL) {
+        if (checkpoint_Restore(ckpt, nquery-1, info[0].pli, info[0].th, errbuf) != eslOK)
+          p7_Fail("Failed to restore from checkpoint file %s:\n%s\n", ckpt->filename, errbuf);
+        for (i = 0; i < infocnt; ++i)
+          checkpoint_Mark(info[i].pli, info[i].th, &(info[i].ckpt_mark));
+      }
+
       /* establish the id_lengths data structutre */
       id_length_list = init_id_length(1000);
 
@@ -959,8 +1049,12 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       }
 #else //HMMER_THREADS
   #if defined (p7_IMPL_SSE)
-      if (dbformat == eslSQFILE_FMINDEX)
+      if (dbformat == eslSQFILE_FMINDEX) {
+        for(i=0; i<fm_cfg->meta->seq_count; i++)
+          add_id_length(id_length_list, fm_cfg->meta->seq_data[i].target_id, fm_cfg->meta->seq_data[i].target_start + fm_cfg->meta->seq_data[i].length - 1);
+
         sstatus = serial_loop_FM (info, dbfp);
+      }
       else
   #endif // defined (p7_IMPL_SSE)
         sstatus = serial_loop    (info, id_length_list, dbfp, cfg->firstseq_key, cfg->n_targetseq/*, ssv_watch_master, postssv_watch_master, watch_slave*/);
@@ -1004,8 +1098,9 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
           p7_tophits_ComputeNhmmerEvalues(info[i].th, resCnt, info[i].om->max_length);
 
       /* merge the results of the search results */
+      for (i = 1; i < infocnt; ++i) thv[i-1] = info[i].th;
+      p7_tophits_MergeAll(info[0].th, thv, infocnt-1);
       for (i = 1; i < infocnt; ++i) {
-          p7_tophits_Merge(info[0].th, info[i].th);
           p7_pipeline_Merge(info[0].pli, info[i].pli);
 
           p7_pipeline_Destroy(info[i].pli);
@@ -1159,6 +1254,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 #endif
 
   free(info);
+  free(thv);
 
 
 
@@ -1186,6 +1282,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (tblfp)         fclose(tblfp);
   if (dfamtblfp)     fclose(dfamtblfp);
   if (aliscoresfp)   fclose(aliscoresfp);
+  checkpoint_Close(ckpt);
 
   return eslOK;
 
@@ -1202,6 +1299,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
    if (tblfp)         fclose(tblfp);
    if (dfamtblfp)     fclose(dfamtblfp);
    if (aliscoresfp)   fclose(aliscoresfp);
+   checkpoint_Close(ckpt);
 
 #if defined (p7_IMPL_SSE)
    if (dbformat == eslSQFILE_FMINDEX) {
@@ -1223,47 +1321,43 @@ serial_loop(WORKER_INFO *info, ID_LENGTH_LIST *id_length_list, ESL_SQFILE *dbfp,
   int prev_hit_cnt;
   int seq_id = 0;
   ESL_SQ   *dbsq   =  esl_sq_CreateDigital(info->om->abc);
-#ifdef eslAUGMENT_ALPHABET
-  ESL_SQ   *dbsq_revcmp;
-
-
-  if (dbsq->abc->complement != NULL)
-    dbsq_revcmp =  esl_sq_CreateDigital(info->om->abc);
-#endif /*eslAUGMENT_ALPHABET*/
 
   wstatus = esl_sqio_ReadWindow(dbfp, 0, info->pli->block_length, dbsq);
 
-
   while (wstatus == eslOK && (n_targetseqs==-1 || seq_id < n_targetseqs) ) {
       dbsq->idx = seq_id;
 
-      p7_pli_NewSeq(info->pli, dbsq);
+      if (info->ckpt == NULL || ! checkpoint_IsDone(info->ckpt, seq_id, dbsq->end)) { // else a checkpointed run already searched this window
+        p7_pli_NewSeq(info->pli, dbsq);
 
-      if (info->pli->strands != p7_STRAND_BOTTOMONLY) {
-
-        info->pli->nres -= dbsq->C; // to account for overlapping region of windows
-        prev_hit_cnt = info->th->N;
-        p7_Pipeline_LongTarget(info->pli, info->om, info->scoredata, info->bg, info->th, info->pli->nseqs, dbsq, p7_NOCOMPLEMENT, NULL, NULL, NULL/*, ssv_watch_master, postssv_watch_master, watch_slave*/);
-        p7_pipeline_Reuse(info->pli); // prepare for next search
+        if (info->pli->strands != p7_STRAND_BOTTOMONLY) {
 
-      } else {
-        info->pli->nres -= dbsq->n;
-      }
-#ifdef eslAUGMENT_ALPHABET
-      //reverse complement
-      if (info->pli->strands != p7_STRAND_TOPONLY && dbsq->abc->complement != NULL )
-      {
+          info->pli->nres -= dbsq->C; // to account for overlapping region of windows
           prev_hit_cnt = info->th->N;
-          esl_sq_Copy(dbsq,dbsq_revcmp);
-          esl_sq_ReverseComplement(dbsq_revcmp);
-          p7_Pipeline_LongTarget(info->pli, info->om, info->scoredata, info->bg, info->th, info->pli->nseqs, dbsq_revcmp, p7_COMPLEMENT, NULL, NULL, NULL/*, ssv_watch_master, postssv_watch_master, watch_slave*/);
+          p7_Pipeline_LongTarget(info->pli, info->om, info->scoredata, info->bg, info->th, info->pli->nseqs, dbsq, p7_NOCOMPLEMENT, NULL, NULL, NULL/*, ssv_watch_master, postssv_watch_master, watch_slave*/);
           p7_pipeline_Reuse(info->pli); // prepare for next search
 
-          info->pli->nres += dbsq_revcmp->W;
+        } else {
+          info->pli->nres -= dbsq->n;
+        }
+#ifdef eslAUGMENT_ALPHABET
+        //reverse complement
+        if (info->pli->strands != p7_STRAND_TOPONLY && dbsq->abc->complement != NULL )
+        {
+            prev_hit_cnt = info->th->N;
+            // scans the bottom strand straight from dbsq; no reverse-complemented copy of the window is made
+            p7_Pipeline_LongTargetRevComp(info->pli, info->om, info->scoredata, info->bg, info->th, info->pli->nseqs, dbsq);
+            p7_pipeline_Reuse(info->pli); // prepare for next search
 
-      }
+            info->pli->nres += dbsq->W;
+
+        }
 #endif /*eslAUGMENT_ALPHABET*/
 
+        if (info->ckpt != NULL && checkpoint_Save(info->ckpt, seq_id, dbsq->end, info->pli, info->th, &(info->ckpt_mark)) != eslOK)
+          p7_Fail("Failed to write checkpoint file %s\n", info->ckpt->filename);
+      }
+
       wstatus = esl_sqio_ReadWindow(dbfp, info->om->max_length, info->pli->block_length, dbsq);
       if (wstatus == eslEOD) { // no more left of this sequence ... move along to the next sequence.
           add_id_length(id_length_list, dbsq->idx, dbsq->L);
@@ -1279,7 +1373,6 @@ serial_loop(WORKER_INFO *info, ID_LENGTH_LIST *id_length_list, ESL_SQFILE *dbfp,
 
 
   if (dbsq) esl_sq_Destroy(dbsq);
-  if (dbsq_revcmp) esl_sq_Destroy(dbsq_revcmp);
 
   return wstatus;
 
@@ -1299,7 +1392,6 @@ serial_loop_FM(WORKER_INFO *info, ESL_SQFILE *dbfp /*, ESL_STOPWATCH *ssv_watch_
 
   FM_METADATA *meta = info->fm_cfg->meta;
 
-
   for ( i=0; i<info->fm_cfg->meta->block_count; i++ ) {
 
     wstatus = fm_FM_read( &fmf, meta, TRUE );
@@ -1310,9 +1402,14 @@ serial_loop_FM(WORKER_INFO *info, ESL_SQFILE *dbfp /*, ESL_STOPWATCH *ssv_watch_
     fmb.SA = fmf.SA;
     fmb.T  = fmf.T;
 
-    wstatus = p7_Pipeline_LongTarget(info->pli, info->om, info->scoredata, info->bg,
-        info->th, -1, NULL, -1,  &fmf, &fmb, info->fm_cfg/*, ssv_watch_master, postssv_watch_master, watch_slave*/);
-    if (wstatus != eslOK) return wstatus;
+    if (info->ckpt == NULL || ! checkpoint_IsDone(info->ckpt, i, 0)) { // else this block was searched by a checkpointed run
+      wstatus = p7_Pipeline_LongTarget(info->pli, info->om, info->scoredata, info->bg,
+          info->th, -1, NULL, -1,  &fmf, &fmb, info->fm_cfg/*, ssv_watch_master, postssv_watch_master, watch_slave*/);
+      if (wstatus != eslOK) return wstatus;
+
+      if (info->ckpt != NULL && checkpoint_Save(info->ckpt, i, 0, info->pli, info->th, &(info->ckpt_mark)) != eslOK)
+        p7_Fail("Failed to write checkpoint file %s\n", info->ckpt->filename);
+    }
 
     fm_FM_destroy(&fmf, 1);
     fm_FM_destroy(&fmb, 0);
@@ -1421,6 +1518,7 @@ thread_loop(WORKER_INFO *info, ID_LENGTH_LIST *id_length_list, ESL_THREADS *obj,
   if (sstatus == eslEOF) {
       /* wait for all the threads to complete */
       esl_threads_WaitForFinish(obj);
+      p7_domaindef_ReclaimThreads();
       esl_workqueue_Complete(queue);  
     }
 
@@ -1462,6 +1560,9 @@ pipeline_thread(void *arg)
     {
       ESL_SQ *dbsq = block->list + i;
 
+      if (info->ckpt != NULL && checkpoint_IsDone(info->ckpt, block->first_seqidx + i, dbsq->end))
+        continue; // a checkpointed run already searched this window
+
       p7_pli_NewSeq(info->pli, dbsq);
 
       if (info->pli->strands != p7_STRAND_BOTTOMONLY) {
@@ -1480,8 +1581,7 @@ pipeline_thread(void *arg)
       if (info->pli->strands != p7_STRAND_TOPONLY && dbsq->abc->complement != NULL)
       {
           prev_hit_cnt = info->th->N;
-          esl_sq_ReverseComplement(dbsq);
-          p7_Pipeline_LongTarget(info->pli, info->om, info->scoredata, info->bg, info->th, block->first_seqidx + i, dbsq, p7_COMPLEMENT, NULL, NULL, NULL/*, NULL, NULL, NULL*/);
+          p7_Pipeline_LongTargetRevComp(info->pli, info->om, info->scoredata, info->bg, info->th, block->first_seqidx + i, dbsq);
           p7_pipeline_Reuse(info->pli); // prepare for next search
 
           info->pli->nres += dbsq->W;
@@ -1489,6 +1589,8 @@ pipeline_thread(void *arg)
 
 #endif /*eslAUGMENT_ALPHABET*/
 
+      if (info->ckpt != NULL && checkpoint_Save(info->ckpt, block->first_seqidx + i, dbsq->end, info->pli, info->th, &(info->ckpt_mark)) != eslOK)
+        esl_fatal("Failed to write checkpoint file %s\n", info->ckpt->filename);
     }
 
       status = esl_workqueue_WorkerUpdate(info->queue, block, &newBlock);
@@ -1501,6 +1603,7 @@ pipeline_thread(void *arg)
   status = esl_workqueue_WorkerUpdate(info->queue, block, NULL);
   if (status != eslOK) esl_fatal("Work queue worker failed");
 
+  p7_domaindef_LendThread();
   esl_threads_Finished(obj, workeridx);
   return;
 }
@@ -1535,6 +1638,7 @@ thread_loop_FM(WORKER_INFO *info, ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_S
 
     fminfo->fmb->SA = fminfo->fmf->SA;
     fminfo->fmb->T  = fminfo->fmf->T;
+    fminfo->block   = i;
     fminfo->active  = TRUE;
 
     status = esl_workqueue_ReaderUpdate(queue, fminfo, &newFMinfo);
@@ -1559,6 +1663,7 @@ thread_loop_FM(WORKER_INFO *info, ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_S
   if (status != eslOK) esl_fatal("Work queue reader failed");
 
   esl_threads_WaitForFinish(obj);
+  p7_domaindef_ReclaimThreads();
   esl_workqueue_Complete(queue);
 
   return status;
@@ -1593,9 +1698,14 @@ pipeline_thread_FM(void *arg)
 
   while (fminfo->active)
   {
-      status = p7_Pipeline_LongTarget(info->pli, info->om, info->scoredata, info->bg,
-          info->th, -1, NULL, -1,  fminfo->fmf, fminfo->fmb, info->fm_cfg/*, NULL, NULL, NULL */);
-      if (status != eslOK) esl_fatal ("Work queue worker failed");
+      if (info->ckpt == NULL || ! checkpoint_IsDone(info->ckpt, fminfo->block, 0)) { // else this block was searched by a checkpointed run
+        status = p7_Pipeline_LongTarget(info->pli, info->om, info->scoredata, info->bg,
+            info->th, -1, NULL, -1,  fminfo->fmf, fminfo->fmb, info->fm_cfg/*, NULL, NULL, NULL */);
+        if (status != eslOK) esl_fatal ("Work queue worker failed");
+
+        if (info->ckpt != NULL && checkpoint_Save(info->ckpt, fminfo->block, 0, info->pli, info->th, &(info->ckpt_mark)) != eslOK)
+          esl_fatal("Failed to write checkpoint file %s\n", info->ckpt->filename);
+      }
 
       fm_FM_destroy(fminfo->fmf, 1);
       fm_FM_destroy(fminfo->fmb, 0);
@@ -1609,6 +1719,7 @@ pipeline_thread_FM(void *arg)
   status = esl_workqueue_WorkerUpdate(info->queue, fminfo, NULL);
   if (status != eslOK) esl_fatal("Work queue worker failed");
 
+  p7_domaindef_LendThread();
   esl_threads_Finished(obj, workeridx);
   return;
 }
@@ -1691,6 +1802,402 @@ assign_Lengths(P7_TOPHITS *th, ID_LENGTH_LIST *id_length_list) {
   return eslOK;
 }
 
+
+/* helper functions for --checkpoint */
+
+/* the pipeline counters that searching a unit adds to */
+static void
+checkpoint_counters(P7_PIPELINE *pli, uint64_t **c)
+{
+  c[0] = &(pli->nres);
+  c[1] = &(pli->n_past_msv);
+  c[2] = &(pli->n_past_bias);
+  c[3] = &(pli->n_past_vit);
+  c[4] = &(pli->n_past_fwd);
+  c[5] = &(pli->pos_past_msv);
+  c[6] = &(pli->pos_past_bias);
+  c[7] = &(pli->pos_past_vit);
+  c[8] = &(pli->pos_past_fwd);
+}
+
+/* The settings a checkpoint is only valid for, as one string: every
+ * option's value, except those that only control output or how the
+ * work is run. A resumed search must be using the same ones, or its
+ * results would be a mix of two different searches.
+ */
+static int
+checkpoint_options(const ESL_GETOPTS *go, char **ret_opts)
+{
+  static const char *skip[] = { "-h", "-o", "-A", "--tblout", "--dfamtblout", "--aliscoresout", "--hmmout",
+                                "--acc", "--noali", "--notextw", "--textw", "--cpu", "--stall", "--mpi",
+                                "--checkpoint", "--ssifile" };
+  int   nskip = sizeof(skip) / sizeof(char *);
+  char *opts  = NULL;
+  int   i, k;
+  int   status;
+
+  if ((status = esl_strdup("", 0, &opts)) != eslOK) goto ERROR;
+  for (i = 0; i < go->nopts; i++)
+    {
+      for (k = 0; k < nskip; k++)
+        if (strcmp(go->opt[i].name, skip[k]) == 0) break;
+      if (k < nskip) continue;
+
+      if ((status = esl_strcat(&opts, -1, go->opt[i].name, -1))                          != eslOK) goto ERROR;
+      if ((status = esl_strcat(&opts, -1, "=", 1))                                       != eslOK) goto ERROR;
+      if ((status = esl_strcat(&opts, -1, go->val[i] == NULL ? "off" : go->val[i], -1)) != eslOK) goto ERROR;
+      if ((status = esl_strcat(&opts, -1, " ", 1))                                       != eslOK) goto ERROR;
+    }
+  *ret_opts = opts;
+  return eslOK;
+
+ ERROR:
+  if (opts != NULL) free(opts);
+  *ret_opts = NULL;
+  return status;
+}
+
+static int
+checkpoint_write_string(FILE *fp, const char *s)
+{
+  int32_t n = strlen(s);
+  if (fwrite(&n, sizeof(int32_t), 1, fp) != 1) return eslEWRITE;
+  if (fwrite(s, sizeof(char), n, fp)     != n) return eslEWRITE;
+  return eslOK;
+}
+
+static int
+checkpoint_match_string(FILE *fp, const char *s)
+{
+  int32_t n;
+  char   *buf = NULL;
+  int     status;
+
+  if (fread(&n, sizeof(int32_t), 1, fp) != 1 || n < 0) return eslEFORMAT;
+  ESL_ALLOC(buf, sizeof(char) * (n+1));
+  if (fread(buf, sizeof(char), n, fp) != n) { free(buf); return eslEFORMAT; }
+  buf[n] = '\0';
+  status = (strcmp(buf, s) == 0 ? eslOK : eslEINCOMPAT);
+  free(buf);
+  return status;
+
+ ERROR:
+  return status;
+}
+
+static int
+checkpoint_unit_sorter(const void *vu1, const void *vu2)
+{
+  const CHECKPOINT_UNIT *u1 = (const CHECKPOINT_UNIT *) vu1;
+  const CHECKPOINT_UNIT *u2 = (const CHECKPOINT_UNIT *) vu2;
+
+  if      (u1->target < u2->target) return -1;
+  else if (u1->target > u2->target) return  1;
+  else if (u1->pos    < u2->pos)    return -1;
+  else if (u1->pos    > u2->pos)    return  1;
+  else                              return  0;
+}
+
+/* Read one record from <fp>. Its hits are appended to <th>; its unit
+ * key goes in <ret_unit>, and the pipeline counts it added in
+ * <counts>. Returns <eslEOF> at a clean end of file, <eslEFORMAT> if
+ * the record is incomplete, <eslEINCOMPAT> if its hits are in a
+ * format this build can't read.
+ */
+static int
+checkpoint_read_record(FILE *fp, int *ret_qidx, CHECKPOINT_UNIT *ret_unit, uint64_t *counts, P7_TOPHITS *th)
+{
+  uint32_t  magic;
+  int32_t   qidx;
+  int       status;
+
+  if (fread(&magic, sizeof(uint32_t), 1, fp) != 1)                                   return eslEOF;
+  if (magic != NHMMER_CKPT_RECORD)                                                   return eslEFORMAT;
+  if (fread(&qidx, sizeof(int32_t), 1, fp) != 1)                                     return eslEFORMAT;
+  if (fread(&(ret_unit->target), sizeof(int64_t), 1, fp) != 1)                       return eslEFORMAT;
+  if (fread(&(ret_unit->pos),    sizeof(int64_t), 1, fp) != 1)                       return eslEFORMAT;
+  if (fread(counts, sizeof(uint64_t), NHMMER_CKPT_NCOUNT, fp) != NHMMER_CKPT_NCOUNT) return eslEFORMAT;
+  if ((status = p7_tophits_ReadBinary(fp, th)) != eslOK)                             return (status == eslEOF ? eslEFORMAT : status);
+
+  *ret_qidx = qidx;
+  return eslOK;
+}
+
+/* Function:  checkpoint_Open()
+ * Synopsis:  Open (or create) an nhmmer checkpoint file.
+ *
+ * Purpose:   If <filename> exists and is not empty, check that it is a
+ *            checkpoint for a search of <queryfile> against <dbfile>
+ *            with the same search options in <go>, dividing the
+ *            targets into the same kind of <units>; index where each
+ *            of its records starts, so <checkpoint_Restore()> can go
+ *            straight to a query's records; drop any incomplete
+ *            record at its end; and open it for appending. Otherwise
+ *            create it and write its header.
+ *
+ * Returns:   <eslOK> on success; <*ret_ckpt> is the new checkpoint.
+ *            <eslEFORMAT> if the file isn't an nhmmer checkpoint, or
+ *            <eslEINCOMPAT> if it is another version of the format,
+ *            belongs to a different search, or one with different
+ *            options or units; a message is in <errbuf>.
+ *
+ * Throws:    <eslEMEM> on allocation failure; <eslESYS> or
+ *            <eslEWRITE> on system call or write failure.
+ */
+static int
+checkpoint_Open(const char *filename, const ESL_GETOPTS *go, const char *queryfile, const char *dbfile, const char *units, CHECKPOINT **ret_ckpt, char *errbuf)
+{
+  CHECKPOINT     *ckpt  = NULL;
+  FILE           *fp    = NULL;
+  char           *opts  = NULL;
+  P7_TOPHITS     *th    = NULL;
+  CHECKPOINT_UNIT unit;
+  uint32_t        magic;
+  uint32_t        version;
+  uint64_t        counts[NHMMER_CKPT_NCOUNT];
+  int             qidx;
+  long            offset;
+  long            good_end;
+  int             status;
+
+  ESL_ALLOC(ckpt, sizeof(CHECKPOINT));
+  ckpt->filename   = NULL;
+  ckpt->fp         = NULL;
+  ckpt->qidx       = 0;
+  ckpt->nrec       = 0;
+  ckpt->nalloc     = 0;
+  ckpt->rec_qidx   = NULL;
+  ckpt->rec_offset = NULL;
+  ckpt->done       = NULL;
+  ckpt->ndone      = 0;
+  ckpt->donealloc  = 0;
+#ifdef HMMER_THREADS
+  if (pthread_mutex_init(&(ckpt->lock), NULL) != 0) ESL_XEXCEPTION(eslESYS, "mutex init failed");
+#endif
+  if ((status = esl_strdup(filename, -1, &(ckpt->filename))) != eslOK) goto ERROR;
+  if ((status = checkpoint_options(go, &opts))                != eslOK) goto ERROR;
+
+  if ((fp = fopen(filename, "r+b")) != NULL && fread(&magic, sizeof(uint32_t), 1, fp) == 1)
+    {
+      /* resuming: validate the header, then index the complete records */
+      if (magic != NHMMER_CKPT_MAGIC)                                   ESL_XFAIL(eslEFORMAT,   errbuf, "%s is not an nhmmer checkpoint file", filename);
+      if (fread(&version, sizeof(uint32_t), 1, fp) != 1)               ESL_XFAIL(eslEFORMAT,   errbuf, "checkpoint file %s is truncated", filename);
+      if (version != NHMMER_CKPT_VERSION)                               ESL_XFAIL(eslEINCOMPAT, errbuf, "checkpoint file %s is in another format version (%u, not %d)", filename, version, NHMMER_CKPT_VERSION);
+      if ((status = checkpoint_match_string(fp, queryfile)) != eslOK)   ESL_XFAIL(status,       errbuf, "checkpoint file %s was not made with query file %s", filename, queryfile);
+      if ((status = checkpoint_match_string(fp, dbfile))    != eslOK)   ESL_XFAIL(status,       errbuf, "checkpoint file %s was not made with target file %s", filename, dbfile);
+      if ((status = checkpoint_match_string(fp, opts))      != eslOK)   ESL_XFAIL(status,       errbuf, "checkpoint file %s was made with different search options", filename);
+      if ((status = checkpoint_match_string(fp, units))     != eslOK)   ESL_XFAIL(status,       errbuf, "checkpoint file %s doesn't record %s: resume it with --cpu as it was made (threaded or not)", filename, units);
+
+      if ((th = p7_tophits_Create()) == NULL) { status = eslEMEM; goto ERROR; }
+      good_end = offset = ftell(fp);
+      while ((status = checkpoint_read_record(fp, &qidx, &unit, counts, th)) == eslOK)
+        {
+          if (ckpt->nrec == ckpt->nalloc) {
+            ckpt->nalloc = (ckpt->nalloc == 0 ? 256 : ckpt->nalloc * 2);
+            ESL_REALLOC(ckpt->rec_qidx,   sizeof(int)  * ckpt->nalloc);
+            ESL_REALLOC(ckpt->rec_offset, sizeof(long) * ckpt->nalloc);
+          }
+          ckpt->rec_qidx[ckpt->nrec]   = qidx;
+          ckpt->rec_offset[ckpt->nrec] = offset;
+          ckpt->nrec++;
+
+          good_end = offset = ftell(fp);
+          p7_tophits_Reuse(th);
+        }
+      if (status == eslEMEM)      goto ERROR;
+      if (status == eslEINCOMPAT) ESL_XFAIL(eslEINCOMPAT, errbuf, "checkpoint file %s holds hits in another format version", filename);
+      p7_tophits_Destroy(th);     th    = NULL;
+
+      fclose(fp);
+      fp = NULL;
+      if (truncate(filename, good_end) != 0)                   ESL_XEXCEPTION_SYS(eslESYS, "failed to truncate checkpoint file %s", filename);
+      if ((ckpt->fp = fopen(filename, "a+b")) == NULL)         ESL_XEXCEPTION_SYS(eslESYS, "failed to open checkpoint file %s", filename);
+    }
+  else
+    {
+      if (fp != NULL) fclose(fp);
+      fp = NULL;
+      if ((ckpt->fp = fopen(filename, "w+b")) == NULL)         ESL_XFAIL(eslESYS, errbuf, "failed to create checkpoint file %s", filename);
+      magic   = NHMMER_CKPT_MAGIC;
+      version = NHMMER_CKPT_VERSION;
+      if (fwrite(&magic,   sizeof(uint32_t), 1, ckpt->fp) != 1) ESL_XEXCEPTION_SYS(eslEWRITE, "checkpoint write failed");
+      if (fwrite(&version, sizeof(uint32_t), 1, ckpt->fp) != 1) ESL_XEXCEPTION_SYS(eslEWRITE, "checkpoint write failed");
+      if (checkpoint_write_string(ckpt->fp, queryfile) != eslOK) ESL_XEXCEPTION_SYS(eslEWRITE, "checkpoint write failed");
+      if (checkpoint_write_string(ckpt->fp, dbfile)    != eslOK) ESL_XEXCEPTION_SYS(eslEWRITE, "checkpoint write failed");
+      if (checkpoint_write_string(ckpt->fp, opts)      != eslOK) ESL_XEXCEPTION_SYS(eslEWRITE, "checkpoint write failed");
+      if (checkpoint_write_string(ckpt->fp, units)     != eslOK) ESL_XEXCEPTION_SYS(eslEWRITE, "checkpoint write failed");
+      if (fflush(ckpt->fp) != 0 || fsync(fileno(ckpt->fp)) != 0) ESL_XEXCEPTION_SYS(eslEWRITE, "checkpoint write failed");
+    }
+
+  free(opts);
+  *ret_ckpt = ckpt;
+  return eslOK;
+
+ ERROR:
+  if (opts  != NULL) free(opts);
+  if (th    != NULL) p7_tophits_Destroy(th);
+  if (fp    != NULL) fclose(fp);
+  checkpoint_Close(ckpt);
+  *ret_ckpt = NULL;
+  return status;
+}
+
+/* Function:  checkpoint_Restore()
+ * Synopsis:  Restore saved progress on one query.
+ *
+ * Purpose:   Make query <qidx> the current one, and read the records
+ *            saved for it, seeking straight to each one by the index
+ *            <checkpoint_Open()> made: their hits are appended to
+ *            <th>, the accounting they added is added to <pli>, and
+ *            their units are noted, so that <checkpoint_IsDone()> is
+ *            TRUE for them. The caller searches the other units.
+ *
+ * Returns:   <eslOK> on success; <eslEFORMAT> if the file can't be
+ *            read, with a message in <errbuf>.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+static int
+checkpoint_Restore(CHECKPOINT *ckpt, int qidx, P7_PIPELINE *pli, P7_TOPHITS *th, char *errbuf)
+{
+  uint64_t       *c[NHMMER_CKPT_NCOUNT];
+  uint64_t        counts[NHMMER_CKPT_NCOUNT];
+  int             rqidx;
+  int             r, i;
+  int             status;
+
+  ckpt->qidx  = qidx;
+  ckpt->ndone = 0;
+  checkpoint_counters(pli, c);
+
+  for (r = 0; r < ckpt->nrec; r++)
+    {
+      if (ckpt->rec_qidx[r] != qidx) continue;
+
+      if (ckpt->ndone == ckpt->donealloc) {
+        ckpt->donealloc = (ckpt->donealloc == 0 ? 256 : ckpt->donealloc * 2);
+        ESL_REALLOC(ckpt->done, sizeof(CHECKPOINT_UNIT) * ckpt->donealloc);
+      }
+      if (fseek(ckpt->fp, ckpt->rec_offset[r], SEEK_SET) != 0) ESL_XFAIL(eslEFORMAT, errbuf, "failed to seek in checkpoint file");
+      status = checkpoint_read_record(ckpt->fp, &rqidx, &(ckpt->done[ckpt->ndone]), counts, th);
+      if      (status == eslEMEM)                  goto ERROR;
+      else if (status != eslOK || rqidx != qidx)   ESL_XFAIL(eslEFORMAT, errbuf, "checkpoint record unreadable");
+
+      for (i = 0; i < NHMMER_CKPT_NCOUNT; i++) *(c[i]) += counts[i];
+      ckpt->ndone++;
+    }
+  qsort(ckpt->done, ckpt->ndone, sizeof(CHECKPOINT_UNIT), checkpoint_unit_sorter);
+
+  if (fseek(ckpt->fp, 0, SEEK_END) != 0) ESL_XFAIL(eslEFORMAT, errbuf, "failed to seek in checkpoint file");
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* Function:  checkpoint_Mark()
+ * Synopsis:  Note what a worker's pipeline and hit list hold now.
+ *
+ * Purpose:   Set <mark> to the current counters in <pli> and number of
+ *            hits in <th>, so the worker's next <checkpoint_Save()>
+ *            saves only what it adds after this point.
+ */
+static void
+checkpoint_Mark(P7_PIPELINE *pli, P7_TOPHITS *th, CHECKPOINT_MARK *mark)
+{
+  uint64_t *c[NHMMER_CKPT_NCOUNT];
+  int       i;
+
+  checkpoint_counters(pli, c);
+  for (i = 0; i < NHMMER_CKPT_NCOUNT; i++) mark->counts[i] = *(c[i]);
+  mark->nhits = th->N;
+}
+
+/* Function:  checkpoint_IsDone()
+ * Synopsis:  Check whether a unit of the current query has a record.
+ *
+ * Purpose:   Return TRUE if <checkpoint_Restore()> found a record for
+ *            the unit <target>,<pos> of the current query; FALSE if
+ *            it still needs to be searched. Doesn't change <ckpt>, so
+ *            workers can call it concurrently.
+ */
+static int
+checkpoint_IsDone(const CHECKPOINT *ckpt, int64_t target, int64_t pos)
+{
+  CHECKPOINT_UNIT unit;
+
+  unit.target = target;
+  unit.pos    = pos;
+  return (ckpt->ndone > 0 && bsearch(&unit, ckpt->done, ckpt->ndone, sizeof(CHECKPOINT_UNIT), checkpoint_unit_sorter) != NULL);
+}
+
+/* Function:  checkpoint_Save()
+ * Synopsis:  Record one more completed unit of the current query.
+ *
+ * Purpose:   Append a record marking unit <target>,<pos> done for the
+ *            current query, with the accounting and the hits that the
+ *            worker owning <pli> and <th> added since its <mark>, and
+ *            update the mark. Workers may call this concurrently, in
+ *            any order. The file is flushed and synced to disk, so the
+ *            record survives if the process (or the machine) goes
+ *            down afterwards.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEWRITE> on write failure.
+ */
+static int
+checkpoint_Save(CHECKPOINT *ckpt, int64_t target, int64_t pos, P7_PIPELINE *pli, P7_TOPHITS *th, CHECKPOINT_MARK *mark)
+{
+  uint64_t *c[NHMMER_CKPT_NCOUNT];
+  uint64_t  counts[NHMMER_CKPT_NCOUNT];
+  uint32_t  magic  = NHMMER_CKPT_RECORD;
+  int32_t   qidx   = ckpt->qidx;
+  int       i;
+  int       status;
+
+  checkpoint_counters(pli, c);
+  for (i = 0; i < NHMMER_CKPT_NCOUNT; i++) counts[i] = *(c[i]) - mark->counts[i];
+
+#ifdef HMMER_THREADS
+  if (pthread_mutex_lock(&(ckpt->lock)) != 0) ESL_EXCEPTION(eslESYS, "mutex lock failed");
+#endif
+  if (fwrite(&magic,  sizeof(uint32_t), 1, ckpt->fp) != 1)                               ESL_XEXCEPTION_SYS(eslEWRITE, "checkpoint write failed");
+  if (fwrite(&qidx,   sizeof(int32_t),  1, ckpt->fp) != 1)                               ESL_XEXCEPTION_SYS(eslEWRITE, "checkpoint write failed");
+  if (fwrite(&target, sizeof(int64_t),  1, ckpt->fp) != 1)                               ESL_XEXCEPTION_SYS(eslEWRITE, "checkpoint write failed");
+  if (fwrite(&pos,    sizeof(int64_t),  1, ckpt->fp) != 1)                               ESL_XEXCEPTION_SYS(eslEWRITE, "checkpoint write failed");
+  if (fwrite(counts,  sizeof(uint64_t), NHMMER_CKPT_NCOUNT, ckpt->fp) != NHMMER_CKPT_NCOUNT) ESL_XEXCEPTION_SYS(eslEWRITE, "checkpoint write failed");
+  if ((status = p7_tophits_WriteBinary(ckpt->fp, th, mark->nhits)) != eslOK)            goto ERROR;
+  if (fflush(ckpt->fp) != 0 || fsync(fileno(ckpt->fp)) != 0)                            ESL_XEXCEPTION_SYS(eslEWRITE, "checkpoint write failed");
+#ifdef HMMER_THREADS
+  pthread_mutex_unlock(&(ckpt->lock));
+#endif
+
+  checkpoint_Mark(pli, th, mark);
+  return eslOK;
+
+ ERROR:
+#ifdef HMMER_THREADS
+  pthread_mutex_unlock(&(ckpt->lock));
+#endif
+  return status;
+}
+
+static void
+checkpoint_Close(CHECKPOINT *ckpt)
+{
+  if (ckpt == NULL) return;
+  if (ckpt->fp         != NULL) fclose(ckpt->fp);
+  if (ckpt->filename   != NULL) free(ckpt->filename);
+  if (ckpt->rec_qidx   != NULL) free(ckpt->rec_qidx);
+  if (ckpt->rec_offset != NULL) free(ckpt->rec_offset);
+  if (ckpt->done       != NULL) free(ckpt->done);
+#ifdef HMMER_THREADS
+  pthread_mutex_destroy(&(ckpt->lock));
+#endif
+  free(ckpt);
+}
+
 /*****************************************************************
  * HMMER - Biological sequence analysis with profile HMMs
  * Version 3.1b2; February 2015
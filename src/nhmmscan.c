@@ -82,6 +82,7 @@ static ESL_OPTIONS options[] = {
   { "--nonull2",    eslARG_NONE,    NULL, NULL, NULL,    NULL,  NULL,  NULL,             "turn off biased composition score corrections",                12 },
   { "-Z",           eslARG_REAL,   FALSE, NULL, "x>0",   NULL,  NULL,  NULL,             "set # of comparisons done, for E-value calculation",           12 },
   { "--seed",       eslARG_INT,    "42",  NULL, "n>=0",  NULL,  NULL,  NULL,             "set RNG seed to <n> (if 0: one-time arbitrary seed)",          12 },
+  { "--dsample",    eslARG_INT,    FALSE, NULL, "n>0",   NULL,  NULL,  NULL,             "adaptive trace sampling: test convergence every <n> traces",   12 },
   { "--w_beta",     eslARG_REAL,    NULL, NULL, NULL,    NULL,  NULL,           NULL,    "tail mass at which window length is determined",               12 },
   { "--w_length",   eslARG_INT,     NULL, NULL, NULL,    NULL,  NULL,           NULL,    "window length - essentially max expected hit length ",                                                12 },
   { "--toponly",     eslARG_NONE,   NULL, NULL, NULL,    NULL,  NULL,   "--bottomonly",  "only search the top strand",                                   12 },
@@ -253,6 +254,7 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *hmmfile, char *seqfile)
   if (esl_opt_IsUsed(go, "--bottomonly") && fprintf(ofp, "# search only bottom strand:       on\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 
   if (esl_opt_IsUsed(go, "-Z")          && fprintf(ofp, "# sequence search space set to:    %.0f\n",          esl_opt_GetReal(go, "-Z"))            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dsample")    && fprintf(ofp, "# adaptive trace sampling every:   %d\n",             esl_opt_GetInteger(go, "--dsample")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--seed"))  {
     if (esl_opt_GetInteger(go, "--seed")==0 && fprintf(ofp, "# random number seed:              one-time arbitrary\n")                              < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
     else if (                                  fprintf(ofp, "# random number seed set to:       %d\n",        esl_opt_GetInteger(go, "--seed"))     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -330,6 +332,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   int              infocnt  = 0;
   WORKER_INFO     *info     = NULL;
+  P7_TOPHITS     **thv      = NULL;  /* the other workers' hit lists, for merging into info[0]'s */
 #ifdef HMMER_THREADS
   P7_OM_BLOCK     *block    = NULL;
   ESL_THREADS     *threadObj= NULL;
@@ -418,6 +421,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   infocnt = (ncpus == 0) ? 1 : ncpus;
   ESL_ALLOC(info, sizeof(*info) * infocnt);
+  ESL_ALLOC(thv,  sizeof(P7_TOPHITS *) * infocnt);
 
   for (i = 0; i < infocnt; ++i)
   {
@@ -477,6 +481,9 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
         /* Create processing pipeline and hit list */
         info[i].th  = p7_tophits_Create();
         info[i].pli = p7_pipeline_Create(go, 100, 100, TRUE, p7_SCAN_MODELS); /* M_hint = 100, L_hint = 100 are just dummies for now */
+        info[i].pli->ddef->do_alidisplay = (info[i].pli->show_alignments || esl_opt_IsOn(go, "--aliscoresout"));  /* build full alignment displays only if they get shown */
+        if (esl_opt_IsOn(go, "--dsample")) info[i].pli->ddef->nsamples_check = esl_opt_GetInteger(go, "--dsample");
+        info[i].pli->ddef->nthreads = ncpus;
         info[i].pli->hfp = hfp;  /* for two-stage input, pipeline needs <hfp> */
 
         p7_pli_NewSeq(info[i].pli, qsq);
@@ -514,10 +521,11 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
 
 
-      /* merge the results of the search results */
+      /* merge the results of the search results; each worker has sorted its own hits */
+      for (i = 1; i < infocnt; ++i) thv[i-1] = info[i].th;
+      p7_tophits_MergeAll(info[0].th, thv, infocnt-1);
       for (i = 1; i < infocnt; ++i)
       {
-        p7_tophits_Merge(info[0].th, info[i].th);
         p7_pipeline_Merge(info[0].pli, info[i].pli);
 
         p7_pipeline_Destroy(info[i].pli);
@@ -610,6 +618,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   p7_bg_Destroy(bg_manual);
 
   if (info!=NULL) free(info);
+  if (thv !=NULL) free(thv);
 
   if (qsq!=NULL)  esl_sq_Destroy(qsq);
   if (w!=NULL)    esl_stopwatch_Destroy(w);
@@ -765,6 +774,7 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_HMMFILE *hfp)
   {
       /* wait for all the threads to complete */
       esl_threads_WaitForFinish(obj);
+      p7_domaindef_ReclaimThreads();
       esl_workqueue_Complete(queue);  
   }
   
@@ -888,9 +898,13 @@ pipeline_thread(void *arg)
 
   if (info->fwd_emissions != NULL) free(info->fwd_emissions);
 
+  /* sort this worker's hits now, in parallel with the others, ready for the merge */
+  p7_tophits_SortBySortkey(info->th);
+
   status = esl_workqueue_WorkerUpdate(info->queue, block, NULL);
   if (status != eslOK) esl_fatal("Work queue worker failed");
 
+  p7_domaindef_LendThread();
   esl_threads_Finished(obj, workeridx);
   return;
 
@@ -26,6 +26,36 @@
  * 1. The P7_ALIDISPLAY object
  *****************************************************************/
 
+/* find_domain()
+ * Find the piece of trace <tr> that an alignment display of domain
+ * <which> represents, from its first to its last M state; return
+ * those trace positions in <*ret_z1>, <*ret_z2>. Return <eslFAIL> if
+ * there's no such domain, or it has no M state (a corrupt trace).
+ */
+static int
+find_domain(const P7_TRACE *tr, int which, int *ret_z1, int *ret_z2)
+{
+  int z1, z2;
+
+  if (tr->ndom > 0) {		/* if we have an index, this is a little faster: */
+    for (z1 = tr->tfrom[which]; z1 < tr->N; z1++) if (tr->st[z1] == p7T_M) break;  /* find next M state      */
+    if (z1 == tr->N) return eslFAIL;                                               /* no M? corrupt trace    */
+    for (z2 = tr->tto[which];   z2 >= 0 ;   z2--) if (tr->st[z2] == p7T_M) break;  /* find prev M state      */
+    if (z2 == -1) return eslFAIL;                                                  /* no M? corrupt trace    */
+  } else {			/* without an index, we can still do it fine:    */
+    for (z1 = 0; which >= 0 && z1 < tr->N; z1++) if (tr->st[z1] == p7T_B) which--; /* find the right B state */
+    if (z1 == tr->N) return eslFAIL;                                               /* no such domain <which> */
+    for (; z1 < tr->N; z1++) if (tr->st[z1] == p7T_M) break;                       /* find next M state      */
+    if (z1 == tr->N) return eslFAIL;                                               /* no M? corrupt trace    */
+    for (z2 = z1; z2 < tr->N; z2++) if (tr->st[z2] == p7T_E) break;                /* find the next E state  */
+    for (; z2 >= 0;    z2--) if (tr->st[z2] == p7T_M) break;                       /* find prev M state      */
+    if (z2 == -1) return eslFAIL;                                                  /* no M? corrupt trace    */
+  }
+  *ret_z1 = z1;
+  *ret_z2 = z2;
+  return eslOK;
+}
+
 
 /* Function:  p7_alidisplay_Create()
  * Synopsis:  Create an alignment display, from trace and oprofile.
@@ -70,20 +100,7 @@ p7_alidisplay_Create(const P7_TRACE *tr, int which, const P7_OPROFILE *om, const
   /* First figure out which piece of the trace (from first match to last match) 
    * we're going to represent, and how big it is.
    */
-  if (tr->ndom > 0) {		/* if we have an index, this is a little faster: */
-    for (z1 = tr->tfrom[which]; z1 < tr->N; z1++) if (tr->st[z1] == p7T_M) break;  /* find next M state      */
-    if (z1 == tr->N) return NULL;                                                  /* no M? corrupt trace    */
-    for (z2 = tr->tto[which];   z2 >= 0 ;   z2--) if (tr->st[z2] == p7T_M) break;  /* find prev M state      */
-    if (z2 == -1) return NULL;                                                     /* no M? corrupt trace    */
-  } else {			/* without an index, we can still do it fine:    */
-    for (z1 = 0; which >= 0 && z1 < tr->N; z1++) if (tr->st[z1] == p7T_B) which--; /* find the right B state */
-    if (z1 == tr->N) return NULL;                                                  /* no such domain <which> */
-    for (; z1 < tr->N; z1++) if (tr->st[z1] == p7T_M) break;                       /* find next M state      */
-    if (z1 == tr->N) return NULL;                                                  /* no M? corrupt trace    */
-    for (z2 = z1; z2 < tr->N; z2++) if (tr->st[z2] == p7T_E) break;                /* find the next E state  */
-    for (; z2 >= 0;    z2--) if (tr->st[z2] == p7T_M) break;                       /* find prev M state      */
-    if (z2 == -1) return NULL;                                                     /* no M? corrupt trace    */
-  }
+  if (find_domain(tr, which, &z1, &z2) != eslOK) return NULL;
 
   /* Now we know that z1..z2 in the trace will be represented in the
    * alidisplay; that's z2-z1+1 positions. We need a \0 trailer on all
@@ -214,6 +231,89 @@ p7_alidisplay_Create(const P7_TRACE *tr, int which, const P7_OPROFILE *om, const
 }
 
 
+/* Function:  p7_alidisplay_CreateCoords()
+ * Synopsis:  Create an alignment display that holds only coordinates.
+ *
+ * Purpose:   Same as <p7_alidisplay_Create()>, but skip building the
+ *            display lines. The returned object has the names,
+ *            <hmmfrom..hmmto>, <sqfrom..sqto>, <M> and <L> of the
+ *            alignment of domain <which> in trace <tr>, exactly as
+ *            <p7_alidisplay_Create()> would set them; its <model>,
+ *            <mline> and <aseq> are empty strings, its optional
+ *            lines are <NULL>, and <N> is 0.
+ *
+ *            This is for callers that only report coordinates (tabular
+ *            output, or main output without alignments): building the
+ *            display costs time and memory in proportion to the
+ *            alignment length, for every domain envelope.  Such an
+ *            object can be cloned, serialized, and sent like any
+ *            other, but it can't be printed or backconverted.
+ *
+ * Returns:   ptr to the new <P7_ALIDISPLAY>.
+ *
+ * Throws:    <NULL> on allocation failure, or if the trace has no
+ *            such domain.
+ */
+P7_ALIDISPLAY *
+p7_alidisplay_CreateCoords(const P7_TRACE *tr, int which, const P7_OPROFILE *om, const ESL_SQ *sq)
+{
+  P7_ALIDISPLAY *ad = NULL;
+  int            n, pos;
+  int            z1, z2;
+  int            hmm_namelen, hmm_acclen, hmm_desclen;
+  int            sq_namelen,  sq_acclen,  sq_desclen;
+  int            status;
+
+  if (find_domain(tr, which, &z1, &z2) != eslOK) return NULL;
+
+  n = 3;                                 /* model, mline, aseq: just their \0   */
+  hmm_namelen = strlen(om->name);                           n += hmm_namelen + 1;
+  hmm_acclen  = (om->acc  != NULL ? strlen(om->acc)  : 0);  n += hmm_acclen  + 1;
+  hmm_desclen = (om->desc != NULL ? strlen(om->desc) : 0);  n += hmm_desclen + 1;
+  sq_namelen  = strlen(sq->name);                           n += sq_namelen  + 1;
+  sq_acclen   = strlen(sq->acc);                            n += sq_acclen   + 1;
+  sq_desclen  = strlen(sq->desc);                           n += sq_desclen  + 1;
+
+  ESL_ALLOC(ad, sizeof(P7_ALIDISPLAY));
+  ad->mem = NULL;
+
+  pos = 0;
+  ad->memsize = sizeof(char) * n;
+  ESL_ALLOC(ad->mem, ad->memsize);
+  ad->rfline  = ad->mmline = ad->csline = ad->ppline = NULL;
+  ad->model   = ad->mem + pos;  pos += 1;
+  ad->mline   = ad->mem + pos;  pos += 1;
+  ad->aseq    = ad->mem + pos;  pos += 1;
+  ad->hmmname = ad->mem + pos;  pos += hmm_namelen +1;
+  ad->hmmacc  = ad->mem + pos;  pos += hmm_acclen +1;
+  ad->hmmdesc = ad->mem + pos;  pos += hmm_desclen +1;
+  ad->sqname  = ad->mem + pos;  pos += sq_namelen +1;
+  ad->sqacc   = ad->mem + pos;  pos += sq_acclen +1;
+  ad->sqdesc  = ad->mem + pos;  pos += sq_desclen +1;
+
+  ad->model[0] = ad->mline[0] = ad->aseq[0] = '\0';
+  strcpy(ad->hmmname, om->name);
+  if (om->acc  != NULL) strcpy(ad->hmmacc,  om->acc);  else ad->hmmacc[0]  = 0;
+  if (om->desc != NULL) strcpy(ad->hmmdesc, om->desc); else ad->hmmdesc[0] = 0;
+  strcpy(ad->sqname,  sq->name);
+  strcpy(ad->sqacc,   sq->acc);
+  strcpy(ad->sqdesc,  sq->desc);
+
+  ad->hmmfrom = tr->k[z1];
+  ad->hmmto   = tr->k[z2];
+  ad->M       = om->M;
+  ad->sqfrom  = tr->i[z1];
+  ad->sqto    = tr->i[z2];
+  ad->L       = sq->n;
+  ad->N       = 0;
+  return ad;
+
+ ERROR:
+  p7_alidisplay_Destroy(ad);
+  return NULL;
+}
+
+
 /* Function:  p7_alidisplay_Clone()
  * Synopsis:  Make a duplicate of an ALIDISPLAY.
  *
@@ -664,8 +764,9 @@ p7_alidisplay_Print(FILE *fp, P7_ALIDISPLAY *ad, int min_aliwidth, int linewidth
  * Returns:   <eslOK> on success.
  *
  * Throws:    <eslEMEM> on allocation failures. <eslECORRUPT> on unexpected internal
- *            data corruption. On any exception, <*ret_sq> and <*ret_tr> are
- *            <NULL>.
+ *            data corruption. <eslEINVAL> if <ad> holds only coordinates
+ *            (see <p7_alidisplay_CreateCoords()>). On any exception, 
+ *            <*ret_sq> and <*ret_tr> are <NULL>.
  *
  * Xref:      SRE:J4/29.
  */
@@ -679,6 +780,8 @@ p7_alidisplay_Backconvert(const P7_ALIDISPLAY *ad, const ESL_ALPHABET *abc, ESL_
   char      cur_st, nxt_st;	/* state type: MDI                   */
   int       status;
   
+  if (ad->N == 0) ESL_XEXCEPTION(eslEINVAL, "alignment display has coordinates only; can't backconvert");
+
   /* Make a first pass over <ad> just to calculate subseq length */
   for (a = 0; a < ad->N; a++)
     if (! esl_abc_CIsGap(abc, ad->aseq[a])) subL++;
@@ -1196,6 +1299,67 @@ utest_Backconvert(int be_verbose, ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, int nt
     }
   return;
 }
+
+/* utest_CreateCoords()
+ * A coordinate-only alidisplay has the same coords and names as a
+ * full one made from the same trace, and survives clone/serialize.
+ */
+static void
+utest_CreateCoords(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, int ntrials, int M)
+{
+  char           msg[] = "utest_CreateCoords failed";
+  P7_HMM        *hmm   = NULL;
+  P7_BG         *bg    = p7_bg_Create(abc);
+  P7_PROFILE    *gm    = p7_profile_Create(M, abc);
+  P7_OPROFILE   *om    = p7_oprofile_Create(M, abc);
+  ESL_SQ        *sq    = esl_sq_CreateDigital(abc);
+  P7_TRACE      *tr    = p7_trace_Create();
+  P7_ALIDISPLAY *ad    = NULL;
+  P7_ALIDISPLAY *ad2   = NULL;
+  P7_ALIDISPLAY *ad3   = NULL;
+  int            trial, d;
+
+  if ( p7_hmm_Sample(rng, M, abc, &hmm)           != eslOK) esl_fatal(msg);
+  if ( p7_ProfileConfig(hmm, bg, gm, 100, p7_LOCAL) != eslOK) esl_fatal(msg);
+  if ( p7_oprofile_Convert(gm, om)                != eslOK) esl_fatal(msg);
+
+  for (trial = 0; trial < ntrials; trial++)
+    {
+      if ( p7_ProfileEmit(rng, hmm, gm, bg, sq, tr) != eslOK) esl_fatal(msg);
+      if ( esl_sq_SetName(sq, "target")             != eslOK) esl_fatal(msg);
+      if ( p7_trace_Index(tr)                       != eslOK) esl_fatal(msg);
+
+      for (d = 0; d < tr->ndom; d++)
+	{
+	  if ( (ad  = p7_alidisplay_Create      (tr, d, om, sq)) == NULL) esl_fatal(msg);
+	  if ( (ad2 = p7_alidisplay_CreateCoords(tr, d, om, sq)) == NULL) esl_fatal(msg);
+
+	  if (ad2->N != 0 || ad2->aseq[0] != '\0')        esl_fatal(msg);
+	  if (ad2->hmmfrom != ad->hmmfrom || ad2->hmmto != ad->hmmto || ad2->M != ad->M) esl_fatal(msg);
+	  if (ad2->sqfrom  != ad->sqfrom  || ad2->sqto  != ad->sqto  || ad2->L != ad->L) esl_fatal(msg);
+	  if (strcmp(ad2->hmmname, ad->hmmname) != 0 || strcmp(ad2->sqname, ad->sqname) != 0) esl_fatal(msg);
+
+	  if ( (ad3 = p7_alidisplay_Clone(ad2))       == NULL)  esl_fatal(msg);
+	  if ( p7_alidisplay_Deserialize(ad2)         != eslOK) esl_fatal(msg);
+	  if ( p7_alidisplay_Compare(ad2, ad3)        != eslOK) esl_fatal(msg);
+	  if ( p7_alidisplay_Serialize(ad2)           != eslOK) esl_fatal(msg);
+	  if ( p7_alidisplay_Compare(ad2, ad3)        != eslOK) esl_fatal(msg);
+
+	  p7_alidisplay_Destroy(ad);
+	  p7_alidisplay_Destroy(ad2);
+	  p7_alidisplay_Destroy(ad3);
+	}
+      p7_trace_Reuse(tr);
+      esl_sq_Reuse(sq);
+    }
+
+  p7_trace_Destroy(tr);
+  esl_sq_Destroy(sq);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_bg_Destroy(bg);
+  p7_hmm_Destroy(hmm);
+}
 #endif /*p7ALIDISPLAY_TESTDRIVE*/
 /*------------------- end, unit tests ---------------------------*/
 
@@ -1237,6 +1401,7 @@ main(int argc, char **argv)
 
   utest_Serialize  (            rng,      N, L);
   utest_Backconvert(be_verbose, rng, abc, N, L);
+  utest_CreateCoords(           rng, abc, N, L);
 
   esl_alphabet_Destroy(abc);
   esl_randomness_Destroy(rng);
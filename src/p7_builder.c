@@ -117,6 +117,7 @@ p7_builder_Create(const ESL_GETOPTS *go, const ESL_ALPHABET *abc)
   bld->EfL        = (go != NULL) ?  esl_opt_GetInteger(go, "--EfL")        : 100;
   bld->EfN        = (go != NULL) ?  esl_opt_GetInteger(go, "--EfN")        : 200;
   bld->Eft        = (go != NULL) ?  esl_opt_GetReal   (go, "--Eft")        : 0.04;
+  bld->ncpus      = 0;	/* callers that have idle threads during a build may set this */
 
   /* Normally we reinitialize the RNG to original seed before calibrating each model.
    * This eliminates run-to-run variation.
@@ -467,6 +468,101 @@ p7_Builder(P7_BUILDER *bld, ESL_MSA *msa, P7_BG *bg,
 }
 
 
+/* Function:  p7_BuilderStream()
+ * Synopsis:  Build a new HMM from a streamed MSA.
+ *
+ * Purpose:   Same as <p7_Builder()>, but for the current alignment in
+ *            the stream <ms> (after <p7_msastream_Next()>), which is
+ *            read in passes instead of being held in memory. The
+ *            model is identical to what <p7_Builder()> would build
+ *            from the same alignment.
+ *
+ *            The alignment must be named (<ms->hdr->name>). The
+ *            relative weighting strategy must be <p7_WGT_PB> or
+ *            <p7_WGT_NONE>, and the effective sequence number
+ *            strategy can't be <p7_EFFN_CLUST>, because those need
+ *            the whole alignment at once. There's no faux tracebacks
+ *            or post-MSA option, for the same reason.
+ *
+ * Args:      bld         - build configuration
+ *            ms          - alignment stream
+ *            bg          - null model
+ *            opt_hmm     - optRETURN: new HMM
+ *            opt_gm      - optRETURN: profile corresponding to <hmm>
+ *            opt_om      - optRETURN: optimized profile corresponding to <gm>
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            Returns <eslENORESULT> if no consensus columns were annotated.
+ *            Returns <eslEFORMAT> on MSA format problems, such as a missing RF annotation
+ *            line in hand architecture construction.
+ *            Returns <eslEINVAL> if the alignment has missing data characters
+ *            other than at fragment edges, or if <bld> asks for a strategy that
+ *            can't be used on a stream. On any returned error,
+ *            <bld->errbuf> contains an informative error message.
+ *
+ * Throws:    <eslEMEM> on allocation error.
+ */
+int
+p7_BuilderStream(P7_BUILDER *bld, P7_MSASTREAM *ms, P7_BG *bg,
+		 P7_HMM **opt_hmm, P7_PROFILE **opt_gm, P7_OPROFILE **opt_om)
+{
+  const char *name   = (ms->hdr->name != NULL ? ms->hdr->name : "");
+  P7_HMM     *hmm    = NULL;
+  int         i,j;
+  int         status;
+
+  if (opt_gm != NULL) *opt_gm = NULL;
+  if (opt_om != NULL) *opt_om = NULL;
+
+  if (bld->wgt_strategy != p7_WGT_PB && bld->wgt_strategy != p7_WGT_NONE) ESL_XFAIL(eslEINVAL, bld->errbuf, "Only PB weights or no weights can be used on a streamed alignment.\n");
+  if (bld->effn_strategy == p7_EFFN_CLUST)                                 ESL_XFAIL(eslEINVAL, bld->errbuf, "Clustering for effective sequence number can't be used on a streamed alignment.\n");
+  if (ms->badseq != NULL) ESL_XFAIL(eslEINVAL, bld->errbuf, "msa %s; sequence %s\nhas missing data chars (~) other than at fragment edges", name, ms->badseq);
+
+  status = p7_Streammodelmaker(ms, bld, &hmm);
+  if      (status == eslENORESULT && bld->arch_strategy == p7_ARCH_FAST) ESL_XFAIL(status, bld->errbuf, "Alignment %s has no consensus columns w/ > %d%% residues - can't build a model.\n", name, (int) (100 * bld->symfrac));
+  else if (status == eslENORESULT)                                       ESL_XFAIL(status, bld->errbuf, "Alignment %s has no annotated consensus columns - can't build a model.\n", name);
+  else if (status == eslEFORMAT && bld->arch_strategy == p7_ARCH_HAND && ms->hdr->rf == NULL)
+                                                                         ESL_XFAIL(status, bld->errbuf, "Alignment %s has no reference annotation line\n", name);
+  else if (status == eslEFORMAT)                                         ESL_XFAIL(status, bld->errbuf, "Alignment %.32s: %.80s\n", name, ms->errmsg);
+  else if (status == eslEMEM)                                            ESL_XFAIL(status, bld->errbuf, "Memory allocation failure in model construction.\n");
+  else if (status != eslOK)                                              ESL_XFAIL(status, bld->errbuf, "internal error in model construction.\n");
+
+  if (bld->max_insert_len>0)
+    for (i=1; i<hmm->M; i++ )
+      hmm->t[i][p7H_II] = ESL_MIN(hmm->t[i][p7H_II], bld->max_insert_len*hmm->t[i][p7H_MI]);
+
+  if ((status =  effective_seqnumber  (bld, ms->hdr, hmm, bg))          != eslOK) goto ERROR;
+  if ((status =  parameterize         (bld, hmm))                       != eslOK) goto ERROR;
+  if ((status =  annotate             (bld, ms->hdr, hmm))              != eslOK) goto ERROR;
+  if ((status =  calibrate            (bld, hmm, bg, opt_gm, opt_om))   != eslOK) goto ERROR;
+
+  if (hmm->mm != NULL)
+    for (i=1; i<hmm->M; i++ )
+      if (hmm->mm[i] == 'm')
+        for (j=0; j<hmm->abc->K; j++)
+          hmm->mat[i][j] = bg->f[j];
+
+  if ( bld->abc->type == eslDNA ||  bld->abc->type == eslRNA ) {
+	  if (bld->w_len > 0)           hmm->max_length = bld->w_len;
+	  else if (bld->w_beta == 0.0)  hmm->max_length = hmm->M *4;
+	  else if ( (status =  p7_Builder_MaxLength(hmm, bld->w_beta)) != eslOK) goto ERROR;
+  }
+
+  hmm->checksum = ms->checksum;
+  hmm->flags   |= p7H_CHKSUM;
+
+  if (opt_hmm   != NULL) *opt_hmm   = hmm; else p7_hmm_Destroy(hmm);
+  return eslOK;
+
+ ERROR:
+  p7_hmm_Destroy(hmm);
+  if (opt_gm    != NULL) p7_profile_Destroy(*opt_gm);
+  if (opt_om    != NULL) p7_oprofile_Destroy(*opt_om);
+  return status;
+}
+
+
 /* Function:  p7_SingleBuilder()
  * Synopsis:  Build a new HMM from a single sequence.
  *
@@ -871,7 +967,7 @@ effective_seqnumber(P7_BUILDER *bld, const ESL_MSA *msa, P7_HMM *hmm, const P7_B
 {
   int    status;
 
-  if      (bld->effn_strategy == p7_EFFN_NONE)    hmm->eff_nseq = msa->nseq;
+  if      (bld->effn_strategy == p7_EFFN_NONE)    hmm->eff_nseq = hmm->nseq;
   else if (bld->effn_strategy == p7_EFFN_SET)     hmm->eff_nseq = bld->eset;
   else if (bld->effn_strategy == p7_EFFN_CLUST)
     {
@@ -36,8 +36,13 @@
 #include "p7_config.h"
 
 #include <math.h>
+#include <stdlib.h>
 #include <string.h>
 
+#ifdef HMMER_THREADS
+#include <pthread.h>
+#endif
+
 #include "easel.h"
 #include "esl_random.h"
 #include "esl_sq.h"
@@ -46,11 +51,18 @@
 
 #include "hmmer.h"
 
+static int next_region            (const P7_DOMAINDEF *ddef, int L, int *pos, int *ret_i, int *ret_j);
 static int is_multidomain_region  (P7_DOMAINDEF *ddef, int i, int j);
+static int define_region          (P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, int i, int j, int is_multi, int saveL,
+				   P7_OMX *fwd, P7_OMX *bck, P7_BG *bg, int long_target, P7_BG *bg_tmp, float *scores_arr, float *fwd_emissions_arr);
 static int region_trace_ensemble  (P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_DSQ *dsq, int ireg, int jreg, const P7_OMX *fwd, P7_OMX *wrk, int *ret_nc);
+static int ensemble_converged     (P7_DOMAINDEF *ddef, int ireg, int jreg, int nt, int *ret_nc);
 static int rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, P7_OMX *ox1, P7_OMX *ox2,
 				   int i, int j, int null2_is_done, P7_BG *bg, int long_target, P7_BG *bg_tmp, float *scores_arr, float *fwd_emissions_arr);
-
+#ifdef HMMER_THREADS
+static int define_regions_threaded(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, int saveL,
+				   P7_OMX *fwd, P7_OMX *bck, P7_BG *bg, int long_target, P7_BG *bg_tmp, float *scores_arr, float *fwd_emissions_arr);
+#endif
 
 /*****************************************************************
  * 1. The P7_DOMAINDEF object: allocation, reuse, destruction
@@ -80,7 +92,9 @@ p7_domaindef_Create(ESL_RANDOMNESS *r)
   ESL_ALLOC(ddef, sizeof(P7_DOMAINDEF));
   ddef->mocc = ddef->btot = ddef->etot = NULL;
   ddef->n2sc = NULL;
+  ddef->n2prv = NULL;
   ddef->sp   = NULL;
+  ddef->sigc_prv = NULL;
   ddef->tr   = NULL;
   ddef->dcl  = NULL;
 
@@ -89,6 +103,7 @@ p7_domaindef_Create(ESL_RANDOMNESS *r)
   ESL_ALLOC(ddef->btot, sizeof(float) * (Lalloc+1));
   ESL_ALLOC(ddef->etot, sizeof(float) * (Lalloc+1));
   ESL_ALLOC(ddef->n2sc, sizeof(float) * (Lalloc+1));
+  ESL_ALLOC(ddef->n2prv, sizeof(float) * (Lalloc+1));
   ddef->mocc[0] = ddef->etot[0] = ddef->btot[0] = 0.;
   ddef->n2sc[0] = 0.;
   ddef->Lalloc  = Lalloc;
@@ -104,12 +119,16 @@ p7_domaindef_Create(ESL_RANDOMNESS *r)
   ddef->nclustered = 0;
   ddef->noverlaps  = 0;
   ddef->nenvelopes = 0;
+  ddef->nthreads   = 0;
+  ddef->do_alidisplay = TRUE;
 
   /* default thresholds */
   ddef->rt1           = 0.25;
   ddef->rt2           = 0.10;
   ddef->rt3           = 0.20;
   ddef->nsamples      = 200;
+  ddef->nsamples_check = 0;
+  ddef->n2tol         = 0.5;
   ddef->min_overlap   = 0.8;
   ddef->of_smaller    = TRUE;
   ddef->max_diagdiff  = 4;
@@ -120,6 +139,8 @@ p7_domaindef_Create(ESL_RANDOMNESS *r)
   ddef->sp  = p7_spensemble_Create(1024, 64, 32); /* init allocs = # sampled pairs; max endpoint range; # of domains */
   ddef->tr  = p7_trace_CreateWithPP();
   ddef->gtr = p7_trace_Create();
+  ddef->nsigc_prv       = 0;
+  ddef->nsigc_prv_alloc = 0;
 
   /* keep a copy of ptr to the RNG */
   ddef->r            = r;  
@@ -159,6 +180,7 @@ p7_domaindef_GrowTo(P7_DOMAINDEF *ddef, int L)
   ESL_RALLOC(ddef->btot, p, sizeof(float) * (L+1));
   ESL_RALLOC(ddef->etot, p, sizeof(float) * (L+1));
   ESL_RALLOC(ddef->n2sc, p, sizeof(float) * (L+1));
+  ESL_RALLOC(ddef->n2prv, p, sizeof(float) * (L+1));
   ddef->Lalloc = L;
   return eslOK;
 
@@ -291,6 +313,8 @@ p7_domaindef_Destroy(P7_DOMAINDEF *ddef)
   if (ddef->btot != NULL) free(ddef->btot);
   if (ddef->etot != NULL) free(ddef->etot);
   if (ddef->n2sc != NULL) free(ddef->n2sc);
+  if (ddef->n2prv != NULL) free(ddef->n2prv);
+  if (ddef->sigc_prv != NULL) free(ddef->sigc_prv);
 
   if (ddef->dcl  != NULL) {
     for (d = 0; d < ddef->ndom; d++) {
@@ -375,12 +399,34 @@ p7_domaindef_ByViterbi(P7_PROFILE *gm, const ESL_SQ *sq, P7_GMX *gx1, P7_GMX *gx
  *            Upon return, <ddef> contains the definitions of all the
  *            domains: their bounds, their null-corrected Forward
  *            scores, and their optimal posterior accuracy alignments.
+ *            If the caller has set <ddef->do_alidisplay> to FALSE
+ *            because no alignment output is wanted, each domain's
+ *            <ad> carries only the alignment's coordinates (see
+ *            <p7_alidisplay_CreateCoords()>), not its display lines.
+ *            
+ *            In a threaded build, if <ddef->nthreads> is >1 and the
+ *            sequence has enough work in two or more regions, the
+ *            regions are shared among up to <ddef->nthreads> threads,
+ *            each with its own copy of <om> and its own workspace.
+ *            Threads beyond the caller's own are only started on
+ *            slots lent by idle pipeline workers (see
+ *            <p7_domaindef_LendThread()>); with none to borrow, the
+ *            regions are processed serially.
+ *            Domains are still registered in order of position, and
+ *            the results are identical to the serial ones, because
+ *            each region's trace ensemble starts from a reseeded RNG.
+ *            (If <ddef->do_reseeding> is FALSE, regions are always
+ *            processed serially.)
  *            
  * Returns:   <eslOK> on success.           
  *            
  *            <eslERANGE> on numeric overflow in posterior
  *            decoding. This should not be possible for multihit
  *            models.
+ *
+ * Throws:    <eslEMEM> on allocation failure, and <eslESYS> if
+ *            threads can't be started; in either case, <ddef>'s
+ *            domain results are incomplete.
  */
 int
 p7_domaindef_ByPosteriorHeuristics(const ESL_SQ *sq, P7_OPROFILE *om, 
@@ -390,11 +436,7 @@ p7_domaindef_ByPosteriorHeuristics(const ESL_SQ *sq, P7_OPROFILE *om,
 )
 {
   int i, j;
-  int triggered;
-  int d;
-  int i2,j2;
-  int last_j2;
-  int nc;
+  int pos;
   int saveL     = om->L;	/* Save the length config of <om>; will restore upon return */
   int save_mode = om->mode;	/* Likewise for the mode. */
   int status;
@@ -406,93 +448,26 @@ p7_domaindef_ByPosteriorHeuristics(const ESL_SQ *sq, P7_OPROFILE *om,
   ddef->nexpected = ddef->btot[sq->n];             /* posterior expectation for # of domains (same as etot[sq->n])   */
 
   p7_oprofile_ReconfigUnihit(om, saveL);	   /* process each domain in unihit mode, regardless of om->mode     */
-  i     = -1;
-  triggered = FALSE;
 
-  for (j = 1; j <= sq->n; j++)
-  {
-
-    if (! triggered)
-    {			/* xref J2/101 for what the logic below is: */
-      if       (ddef->mocc[j] - (ddef->btot[j] - ddef->btot[j-1]) <  ddef->rt2) i = j;
-      else if  (i == -1)                                                        i = j;
-      if       (ddef->mocc[j]                                     >= ddef->rt1) triggered = TRUE;
-    }
-    else if (ddef->mocc[j] - (ddef->etot[j] - ddef->etot[j-1])  <  ddef->rt2)
+#ifdef HMMER_THREADS
+  /* Regions are independent once the posteriors are known, provided
+   * the RNG is reseeded for each trace ensemble: so they can be
+   * shared out among threads, and give the same results.
+   */
+  if (ddef->nthreads > 1 && ddef->do_reseeding)
+    status = define_regions_threaded(ddef, om, sq, saveL, fwd, bck, bg, long_target, bg_tmp, scores_arr, fwd_emissions_arr);
+  else
+#endif
     {
-        /* We have a region i..j to evaluate. */
-        p7_omx_GrowTo(fwd, om->M, j-i+1, j-i+1);
-        p7_omx_GrowTo(bck, om->M, j-i+1, j-i+1);
-        ddef->nregions++;
-        if (is_multidomain_region(ddef, i, j))
-        {
-            /* This region appears to contain more than one domain, so we have to
-             * resolve it by cluster analysis of posterior trace samples, to define
-             * one or more domain envelopes.
-             */
-            ddef->nclustered++;
-
-            /* Resolve the region into domains by stochastic trace
-             * clustering; assign position-specific null2 model by
-             * stochastic trace clustering; there is redundancy
-             * here; we will consolidate later if null2 strategy
-             * works
-             */
-            p7_oprofile_ReconfigMultihit(om, saveL);
-            p7_Forward(sq->dsq+i-1, j-i+1, om, fwd, NULL);
-
-            region_trace_ensemble(ddef, om, sq->dsq, i, j, fwd, bck, &nc);
-            p7_oprofile_ReconfigUnihit(om, saveL);
-            /* ddef->n2sc is now set on i..j by the traceback-dependent method */
-
-            last_j2 = 0;
-            for (d = 0; d < nc; d++) {
-                  p7_spensemble_GetClusterCoords(ddef->sp, d, &i2, &j2, NULL, NULL, NULL);
-                  if (i2 <= last_j2) ddef->noverlaps++;
-
-                  /* Note that k..m coords on model are available, but
-                     * we're currently ignoring them.  This leads to a
-                     * rare clustering bug that we eventually need to fix
-                     * properly [xref J3/32]: two different regions in one
-                     * profile HMM might have hit same seq domain, and
-                     * when we now go to calculate an OA trace, nothing
-                     * constrains us to find the two different alignments
-                     * to the HMM; in fact, because OA is optimal, we'll
-                     * find one and the *same* alignment, leading to an
-                     * apparent duplicate alignment in the output.
-                     *
-                     * Registered as #h74, Dec 2009, after EBI finds and
-                     * reports it.  #h74 is worked around in p7_tophits.c
-                     * by hiding all but one envelope with an identical
-                     * alignment, in the rare event that this
-                     * happens. [xref J5/130].
-                  */
-                  ddef->nenvelopes++;
-
-                  /*the !long_target argument will cause the function to recompute null2
-                   * scores if this is part of a long_target (nhmmer) pipeline */
-                  if (rescore_isolated_domain(ddef, om, sq, fwd, bck, i2, j2, TRUE, bg, long_target, bg_tmp, scores_arr, fwd_emissions_arr) == eslOK)
-                       last_j2 = j2;
-            }
-            p7_spensemble_Reuse(ddef->sp);
-            p7_trace_Reuse(ddef->tr);
-        }
-        else
-        {
-            /* The region looks simple, single domain; convert the region to an envelope. */
-            ddef->nenvelopes++;
-            rescore_isolated_domain(ddef, om, sq, fwd, bck, i, j, FALSE, bg, long_target, bg_tmp, scores_arr, fwd_emissions_arr);
-        }
-        i     = -1;
-        triggered = FALSE;
+      pos = 1;
+      while (next_region(ddef, sq->n, &pos, &i, &j))
+	define_region(ddef, om, sq, i, j, is_multidomain_region(ddef, i, j), saveL, fwd, bck, bg, long_target, bg_tmp, scores_arr, fwd_emissions_arr);
     }
-  }
-
 
   /* Restore model to uni/multihit mode, and to its original length model */
   if (p7_IsMulti(save_mode)) p7_oprofile_ReconfigMultihit(om, saveL); 
   else                       p7_oprofile_ReconfigUnihit  (om, saveL); 
-  return eslOK;
+  return status;
 }
 
 
@@ -502,6 +477,145 @@ p7_domaindef_ByPosteriorHeuristics(const ESL_SQ *sq, P7_OPROFILE *om,
  *****************************************************************/
 
 
+/* next_region()
+ *
+ * Scan the posterior arrays in <ddef> for a sequence of length <L>,
+ * starting at position <*pos>, for the next "region" <i>..<j> that
+ * needs evaluating: one that's triggered by a residue with mocc >=
+ * rt1, and extended in both directions while mocc minus the B (on
+ * the left) or E (on the right) occupancy stays >= rt2.
+ * 
+ * If one is found, return TRUE, with its coords in <*ret_i>, <*ret_j>,
+ * and <*pos> advanced to <j+1> for the next call. If the rest of the
+ * sequence has no more regions, return FALSE.
+ * 
+ * Xref:    J2/101.
+ */
+static int
+next_region(const P7_DOMAINDEF *ddef, int L, int *pos, int *ret_i, int *ret_j)
+{
+  int i         = -1;
+  int triggered = FALSE;
+  int j;
+
+  for (j = *pos; j <= L; j++)
+    {
+      if (! triggered)
+	{			/* xref J2/101 for what the logic below is: */
+	  if       (ddef->mocc[j] - (ddef->btot[j] - ddef->btot[j-1]) <  ddef->rt2) i = j;
+	  else if  (i == -1)                                                        i = j;
+	  if       (ddef->mocc[j]                                     >= ddef->rt1) triggered = TRUE;
+	}
+      else if (ddef->mocc[j] - (ddef->etot[j] - ddef->etot[j-1])  <  ddef->rt2)
+	{
+	  *ret_i = i;
+	  *ret_j = j;
+	  *pos   = j+1;
+	  return TRUE;
+	}
+    }
+  *pos = L+1;
+  return FALSE;
+}
+
+
+/* define_region()
+ *
+ * We have a region <i>..<j> to evaluate in sequence <sq>. If
+ * <is_multi> is TRUE (see <is_multidomain_region()>), resolve it into
+ * one or more domain envelopes by clustering an ensemble of
+ * stochastic traces; else convert the whole region to one envelope.
+ * Each envelope is scored, aligned, and registered in <ddef->dcl> by
+ * <rescore_isolated_domain()>, in order of position.
+ * 
+ * The caller provides <om> configured in unihit mode, with <saveL>
+ * its length config; it's returned the same way. <fwd> and <bck> are
+ * DP workspaces, reallocated here as needed. <bg>, <long_target>,
+ * <bg_tmp>, <scores_arr>, and <fwd_emissions_arr> are passed through
+ * to <rescore_isolated_domain()>.
+ * 
+ * Uses <ddef>'s <n2sc[i..j]>, <sp>, <tr>, and <r> as working memory,
+ * and bumps its region, cluster, overlap, and envelope counts; so
+ * regions can be defined concurrently only with a separate <ddef>
+ * (and <om>, and workspaces) for each thread.
+ * 
+ * Returns <eslOK>.
+ */
+static int
+define_region(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, int i, int j, int is_multi, int saveL,
+	      P7_OMX *fwd, P7_OMX *bck, P7_BG *bg, int long_target, P7_BG *bg_tmp, float *scores_arr, float *fwd_emissions_arr)
+{
+  int d;
+  int i2,j2;
+  int last_j2;
+  int nc;
+
+  p7_omx_GrowTo(fwd, om->M, j-i+1, j-i+1);
+  p7_omx_GrowTo(bck, om->M, j-i+1, j-i+1);
+  ddef->nregions++;
+  if (is_multi)
+    {
+      /* This region appears to contain more than one domain, so we have to
+       * resolve it by cluster analysis of posterior trace samples, to define
+       * one or more domain envelopes.
+       */
+      ddef->nclustered++;
+
+      /* Resolve the region into domains by stochastic trace
+       * clustering; assign position-specific null2 model by
+       * stochastic trace clustering; there is redundancy
+       * here; we will consolidate later if null2 strategy
+       * works
+       */
+      p7_oprofile_ReconfigMultihit(om, saveL);
+      p7_Forward(sq->dsq+i-1, j-i+1, om, fwd, NULL);
+
+      region_trace_ensemble(ddef, om, sq->dsq, i, j, fwd, bck, &nc);
+      p7_oprofile_ReconfigUnihit(om, saveL);
+      /* ddef->n2sc is now set on i..j by the traceback-dependent method */
+
+      last_j2 = 0;
+      for (d = 0; d < nc; d++) {
+	p7_spensemble_GetClusterCoords(ddef->sp, d, &i2, &j2, NULL, NULL, NULL);
+	if (i2 <= last_j2) ddef->noverlaps++;
+
+	/* Note that k..m coords on model are available, but
+	 * we're currently ignoring them.  This leads to a
+	 * rare clustering bug that we eventually need to fix
+	 * properly [xref J3/32]: two different regions in one
+	 * profile HMM might have hit same seq domain, and
+	 * when we now go to calculate an OA trace, nothing
+	 * constrains us to find the two different alignments
+	 * to the HMM; in fact, because OA is optimal, we'll
+	 * find one and the *same* alignment, leading to an
+	 * apparent duplicate alignment in the output.
+	 *
+	 * Registered as #h74, Dec 2009, after EBI finds and
+	 * reports it.  #h74 is worked around in p7_tophits.c
+	 * by hiding all but one envelope with an identical
+	 * alignment, in the rare event that this
+	 * happens. [xref J5/130].
+	 */
+	ddef->nenvelopes++;
+
+	/*the !long_target argument will cause the function to recompute null2
+	 * scores if this is part of a long_target (nhmmer) pipeline */
+	if (rescore_isolated_domain(ddef, om, sq, fwd, bck, i2, j2, TRUE, bg, long_target, bg_tmp, scores_arr, fwd_emissions_arr) == eslOK)
+	  last_j2 = j2;
+      }
+      p7_spensemble_Reuse(ddef->sp);
+      p7_trace_Reuse(ddef->tr);
+    }
+  else
+    {
+      /* The region looks simple, single domain; convert the region to an envelope. */
+      ddef->nenvelopes++;
+      rescore_isolated_domain(ddef, om, sq, fwd, bck, i, j, FALSE, bg, long_target, bg_tmp, scores_arr, fwd_emissions_arr);
+    }
+  return eslOK;
+}
+
+
 /* is_multidomain_region()
  * SRE, Fri Feb  8 11:35:04 2008 [Janelia]
  *
@@ -575,6 +689,14 @@ is_multidomain_region(P7_DOMAINDEF *ddef, int i, int j)
  * Reuse() the whole <ddef>, when it's in the process of analyzing
  * regions.
  * 
+ * If <ddef->nsamples_check> is >0, sampling is adaptive: every
+ * <nsamples_check> traces, <ensemble_converged()> clusters the
+ * ensemble so far and compares it to the previous check, and we
+ * stop early once the clusters and the null2 scores have settled
+ * down. Results still depend only on the RNG seed. With
+ * <nsamples_check> at 0 (the default), all <ddef->nsamples> traces
+ * are always taken.
+ * 
  * Upon return, <*ret_nc> contains the number of clusters that were
  * defined.
  * 
@@ -605,9 +727,13 @@ region_trace_ensemble(P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_DSQ *
   int    nov, n;
   int    nc;
   int    pos;
+  int    status;
+  int    do_adapt     = (ddef->nsamples_check > 0 && ddef->nsamples_check < ddef->nsamples);
+  int    is_clustered = FALSE;
   float  null2[p7_MAXCODE];
 
   esl_vec_FSet(ddef->n2sc+ireg, Lr, 0.0); /* zero the null2 scores in region */
+  ddef->nsigc_prv = -1;			  /* no convergence check done yet      */
 
   /* By default, we make results reproducible by forcing a reset of
    * the RNG to its originally seeded state.
@@ -638,14 +764,27 @@ region_trace_ensemble(P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_DSQ *
       for (; pos <= Lr; pos++)  ddef->n2sc[ireg+pos-1] += 1.0;
 
       p7_trace_Reuse(ddef->tr);        
+
+      /* Adaptive sampling: every <nsamples_check> traces, see if the ensemble has settled down. */
+      if (do_adapt && (t+1) % ddef->nsamples_check == 0 && t+1 < ddef->nsamples)
+	{
+	  status = ensemble_converged(ddef, ireg, jreg, t+1, &nc);
+	  if      (status == eslOK)   { is_clustered = TRUE; t++; break; }
+	  else if (status != eslFAIL) do_adapt = FALSE; /* allocation failure: just take the full sample */
+	}
     }
 
   /* Convert the accumulated n2sc[] ratios in this region to log odds null2 scores on each residue. */
   for (pos = ireg; pos <= jreg; pos++)
-    ddef->n2sc[pos] = logf(ddef->n2sc[pos] / (float) ddef->nsamples);
+    ddef->n2sc[pos] = logf(ddef->n2sc[pos] / (float) t);
 
-  /* Cluster the ensemble of traces to break region into envelopes. */
-  p7_spensemble_Cluster(ddef->sp, ddef->min_overlap, ddef->of_smaller, ddef->max_diagdiff, ddef->min_posterior, ddef->min_endpointp, &nc);
+  /* Cluster the ensemble of traces to break region into envelopes. 
+   * (Unless a convergence check already has, for the same ensemble.) 
+   */
+  if (! is_clustered) {
+    ddef->sp->nsigc = 0;
+    p7_spensemble_Cluster(ddef->sp, ddef->min_overlap, ddef->of_smaller, ddef->max_diagdiff, ddef->min_posterior, ddef->min_endpointp, &nc);
+  }
 
   /* A little hacky now. Remove "dominated" domains relative to seq coords. */
   for (d = 0; d < nc; d++) 
@@ -681,6 +820,74 @@ region_trace_ensemble(P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_DSQ *
 }
 
 
+/* ensemble_converged()
+ * 
+ * Adaptive trace sampling, for <region_trace_ensemble()>: after the
+ * first <nt> sampled traces of region <ireg>..<jreg> have been added
+ * to <ddef->sp> and accumulated in <ddef->n2sc>, cluster the
+ * ensemble, and compare the clusters and the null2 scores to what
+ * they were at the previous check.
+ * 
+ * The ensemble has converged if it has the same number of clusters,
+ * each with endpoints within <ddef->max_diagdiff> of their previous
+ * ones on both sequence and model; and if the null2 log ratios,
+ * summed over the region, moved by no more than <ddef->n2tol> nats
+ * in total (so no envelope's null2 correction can have moved by
+ * more). Two checks are needed to converge; the first only records
+ * the state in <ddef->sigc_prv> and <ddef->n2prv>.
+ * 
+ * Either way, <ddef->sp> holds the clustering of these <nt> traces
+ * on return, and <*ret_nc> is its number of clusters.
+ * 
+ * Returns <eslOK> if converged, <eslFAIL> if not (yet).
+ * 
+ * Throws  <eslEMEM> on allocation failure.
+ */
+static int
+ensemble_converged(P7_DOMAINDEF *ddef, int ireg, int jreg, int nt, int *ret_nc)
+{
+  P7_SPENSEMBLE *sp          = ddef->sp;
+  int            is_stable   = TRUE;
+  float          n2diff      = 0.;
+  float          n2;
+  int            nc, c, pos;
+  int            status;
+
+  sp->nsigc = 0;
+  if ((status = p7_spensemble_Cluster(sp, ddef->min_overlap, ddef->of_smaller, ddef->max_diagdiff, ddef->min_posterior, ddef->min_endpointp, &nc)) != eslOK) return status;
+  *ret_nc = nc;
+
+  if (ddef->nsigc_prv != nc) is_stable = FALSE;
+  for (c = 0; is_stable && c < nc; c++)
+    if (abs(sp->sigc[c].i - ddef->sigc_prv[c].i) > ddef->max_diagdiff ||
+	abs(sp->sigc[c].j - ddef->sigc_prv[c].j) > ddef->max_diagdiff ||
+	abs(sp->sigc[c].k - ddef->sigc_prv[c].k) > ddef->max_diagdiff ||
+	abs(sp->sigc[c].m - ddef->sigc_prv[c].m) > ddef->max_diagdiff) 
+      is_stable = FALSE;
+
+  for (pos = ireg; pos <= jreg; pos++)
+    {
+      n2 = logf(ddef->n2sc[pos] / (float) nt);
+      if (ddef->nsigc_prv >= 0) n2diff += fabsf(n2 - ddef->n2prv[pos]);
+      ddef->n2prv[pos] = n2;
+    }
+  if (ddef->nsigc_prv < 0 || n2diff > ddef->n2tol) is_stable = FALSE;
+
+  if (nc > ddef->nsigc_prv_alloc) {
+    void *p;
+    ESL_RALLOC(ddef->sigc_prv, p, sizeof(struct p7_spcoord_s) * nc);
+    ddef->nsigc_prv_alloc = nc;
+  }
+  if (nc > 0) memcpy(ddef->sigc_prv, sp->sigc, sizeof(struct p7_spcoord_s) * nc);
+  ddef->nsigc_prv = nc;
+
+  return (is_stable ? eslOK : eslFAIL);
+
+ ERROR:
+  return status;
+}
+
+
 
 
 /* Function:  reparameterize_model()
@@ -779,6 +986,15 @@ reparameterize_model (P7_BG *bg, P7_OPROFILE *om, const ESL_SQ *sq, int start, i
  * which is (efficiently, we trust) managing any necessary temporary
  * working space and heuristic thresholds.
  *
+ * The Forward/Backward here can't start from rows of any earlier
+ * pass, because no earlier pass is under this configuration: the
+ * pipeline's parsers run multihit on the whole target, and a
+ * multidomain region's Forward runs multihit on the region. A region
+ * judged to hold a single domain has had no Forward of its own; this
+ * is it. Rows of the multihit passes sum over paths that unihit
+ * scoring must not count, so reusing them would change envelope
+ * scores.
+ *
  * If <long_target> is TRUE, the calling function  optionally
  * passes in three allocated arrays (bgf_arr, scores_arr,
  * fwd_emissions_arr) used for temporary storage in
@@ -858,7 +1074,7 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq,
     ddef->nalloc *= 2;
   }
   dom = &(ddef->dcl[ddef->ndom]);
-  dom->ad             = p7_alidisplay_Create(ddef->tr, 0, om, sq);
+  dom->ad             = (ddef->do_alidisplay ? p7_alidisplay_Create(ddef->tr, 0, om, sq) : p7_alidisplay_CreateCoords(ddef->tr, 0, om, sq));
   dom->scores_per_pos = NULL;
 
 
@@ -905,7 +1121,7 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq,
 
        /* store the results in it, first destroying the old alidisplay object */
        p7_alidisplay_Destroy(dom->ad);
-       dom->ad            = p7_alidisplay_Create(ddef->tr, 0, om, sq);
+       dom->ad            = (ddef->do_alidisplay ? p7_alidisplay_Create(ddef->tr, 0, om, sq) : p7_alidisplay_CreateCoords(ddef->tr, 0, om, sq));
     }
 
     /* Estimate bias correction, by computing what the score would've been without
@@ -915,7 +1131,7 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq,
     if (scores_arr!=NULL) { //revert bg and om back to original,
                             //and while I'm at it, capture what the default parameterized score would have been, for "null2"
       reparameterize_model (bg, om, NULL, 0, 0, fwd_emissions_arr, bg_tmp->f, scores_arr);
-      p7_Forward (sq->dsq + i-1, Ld, om,      ox1, &domcorrection);
+      p7_ForwardParser(sq->dsq + i-1, Ld, om, ox1, &domcorrection); /* only the score is needed: the parser gives the same one, without storing the matrix */
     }
 
     p7_oprofile_ReconfigRestLength(om, orig_L);
@@ -971,6 +1187,329 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq,
 }
   
     
+
+#ifdef HMMER_THREADS
+#define p7_DOMAINDEF_MINPARCELLS 1000000  /* min total region L*M before regions are run in parallel */
+
+/* Spare threads, process-wide. A search's pipeline workers each keep
+ * a core busy until the work queue runs dry; the ones that run out
+ * first lend their slot here as they exit (p7_domaindef_LendThread()),
+ * and only those slots are used to share out the regions of a long
+ * sequence that another worker is still on. So a search never runs
+ * more threads than it has workers. The master takes the slots back
+ * once all its workers have finished (p7_domaindef_ReclaimThreads()).
+ */
+static pthread_mutex_t spare_lock = PTHREAD_MUTEX_INITIALIZER;
+static int             nspare     = 0;
+
+/* Function:  p7_domaindef_LendThread()
+ * Synopsis:  A pipeline worker offers its slot for region threads.
+ *
+ * Purpose:   Called by a threaded search's worker when it has no more
+ *            sequences to process, just before it exits.
+ */
+void
+p7_domaindef_LendThread(void)
+{
+  pthread_mutex_lock(&spare_lock);
+  nspare++;
+  pthread_mutex_unlock(&spare_lock);
+}
+
+/* Function:  p7_domaindef_ReclaimThreads()
+ * Synopsis:  Take back the slots lent by a finished search's workers.
+ *
+ * Purpose:   Called by a threaded search's master after all its
+ *            workers have finished, so no region threads can still
+ *            be running on lent slots.
+ */
+void
+p7_domaindef_ReclaimThreads(void)
+{
+  pthread_mutex_lock(&spare_lock);
+  nspare = 0;
+  pthread_mutex_unlock(&spare_lock);
+}
+
+/* borrow up to <want> spare slots; return how many we got */
+static int
+borrow_threads(int want)
+{
+  int n;
+
+  pthread_mutex_lock(&spare_lock);
+  n       = ESL_MIN(want, nspare);
+  nspare -= n;
+  pthread_mutex_unlock(&spare_lock);
+  return n;
+}
+
+static void
+return_threads(int n)
+{
+  if (n == 0) return;
+  pthread_mutex_lock(&spare_lock);
+  nspare += n;
+  pthread_mutex_unlock(&spare_lock);
+}
+
+typedef struct {
+  int  i, j;			/* region coords in the sequence                  */
+  int  is_multi;		/* TRUE if region is resolved by trace clustering */
+  int  w;			/* which worker defined it                        */
+  int  d0, nd;			/* its domains are <w>'s dcl[d0..d0+nd-1]         */
+} DDEF_REGION;
+
+typedef struct {
+  /* shared by all workers, read-only */
+  const ESL_SQ     *sq;
+  DDEF_REGION      *reg;
+  int               nreg;
+  int               saveL;
+  int               long_target;
+  float            *fwd_emissions_arr;
+  /* shared, under <lock> */
+  pthread_mutex_t   lock;
+  int               next;	/* next region to be taken by a worker */
+} DDEF_REGIONS;
+
+typedef struct {
+  DDEF_REGIONS     *shared;
+  int               w;		/* index of this worker */
+  P7_DOMAINDEF     *ddef;
+  P7_OPROFILE      *om;
+  P7_OMX           *fwd;
+  P7_OMX           *bck;
+  P7_BG            *bg;
+  P7_BG            *bg_tmp;
+  float            *scores_arr;
+} DDEF_WORKER;
+
+/* define_regions_thread()
+ *
+ * A worker: take regions off the shared list until there are none
+ * left, defining their domains in the worker's own <ddef>.
+ */
+static void *
+define_regions_thread(void *arg)
+{
+  DDEF_WORKER  *wk = (DDEF_WORKER *) arg;
+  DDEF_REGIONS *rs = wk->shared;
+  DDEF_REGION  *reg;
+  int           r;
+
+  impl_Init();			/* per-thread FTZ/DAZ setting: workers must compute just like the caller */
+  while (1)
+    {
+      pthread_mutex_lock(&rs->lock);
+      r = rs->next++;
+      pthread_mutex_unlock(&rs->lock);
+      if (r >= rs->nreg) break;
+
+      reg     = rs->reg + r;
+      reg->w  = wk->w;
+      reg->d0 = wk->ddef->ndom;
+      define_region(wk->ddef, wk->om, rs->sq, reg->i, reg->j, reg->is_multi, rs->saveL, wk->fwd, wk->bck,
+		    wk->bg, rs->long_target, wk->bg_tmp, wk->scores_arr, rs->fwd_emissions_arr);
+      reg->nd = wk->ddef->ndom - reg->d0;
+    }
+  return NULL;
+}
+
+/* define_regions_threaded()
+ *
+ * The threaded version of the region loop in
+ * <p7_domaindef_ByPosteriorHeuristics()>, with the same arguments.
+ * Collect all the regions first; then, if there are at least two of
+ * them and enough DP cells among them to be worth starting threads
+ * for, hand them out one at a time to up to <ddef->nthreads>
+ * workers: the caller, plus as many threads as it can borrow from
+ * the spare slots of idle pipeline workers (see <borrow_threads()>).
+ * Each worker has its own <P7_DOMAINDEF>, profile, and DP matrices,
+ * and records which of its domains came from which region.
+ * Finally, the domains and null2 scores are moved into <ddef> in
+ * order of region, just as the serial loop would have left them.
+ * 
+ * Returns <eslOK> on success. Throws <eslEMEM> on allocation
+ * failure, and <eslESYS> if a thread can't be started.
+ */
+static int
+define_regions_threaded(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, int saveL,
+			P7_OMX *fwd, P7_OMX *bck, P7_BG *bg, int long_target, P7_BG *bg_tmp, float *scores_arr, float *fwd_emissions_arr)
+{
+  DDEF_REGIONS    rs;
+  DDEF_WORKER    *wk      = NULL;
+  pthread_t      *tid     = NULL;
+  ESL_RANDOMNESS *r;
+  int             nralloc = 16;
+  int             nw      = 0;	/* number of workers set up  */
+  int             nt      = 0;	/* number of threads started */
+  int             nbor    = 0;	/* spare slots borrowed      */
+  int64_t         ncells  = 0;
+  int             do_copy = (long_target && scores_arr != NULL); /* reparameterization modifies <om>, <bg> in place */
+  int             pos, i, j, w, d, nd;
+  void           *p;
+  int             status;
+
+  rs.sq                = sq;
+  rs.reg               = NULL;
+  rs.nreg              = 0;
+  rs.saveL             = saveL;
+  rs.long_target       = long_target;
+  rs.fwd_emissions_arr = fwd_emissions_arr;
+  rs.next              = 0;
+
+  ESL_ALLOC(rs.reg, sizeof(DDEF_REGION) * nralloc);
+  pos = 1;
+  while (next_region(ddef, sq->n, &pos, &i, &j))
+    {
+      if (rs.nreg == nralloc) { ESL_RALLOC(rs.reg, p, sizeof(DDEF_REGION) * nralloc * 2); nralloc *= 2; }
+      rs.reg[rs.nreg].i        = i;
+      rs.reg[rs.nreg].j        = j;
+      rs.reg[rs.nreg].is_multi = is_multidomain_region(ddef, i, j);
+      ncells += (int64_t) (j-i+1) * (int64_t) om->M;
+      rs.nreg++;
+    }
+
+  /* Not worth it, or no idle threads to help? Then do the regions here, serially. */
+  if (rs.nreg >= 2 && ncells >= p7_DOMAINDEF_MINPARCELLS)
+    nbor = borrow_threads(ESL_MIN(ddef->nthreads, rs.nreg) - 1);
+  if (nbor == 0)
+    {
+      for (d = 0; d < rs.nreg; d++)
+	define_region(ddef, om, sq, rs.reg[d].i, rs.reg[d].j, rs.reg[d].is_multi, saveL, fwd, bck, bg, long_target, bg_tmp, scores_arr, fwd_emissions_arr);
+      free(rs.reg);
+      return eslOK;
+    }
+
+  /* Set up the workers; worker 0 uses the caller's <om>, DP matrices, and <bg>'s. */
+  nw = 1 + nbor;
+  ESL_ALLOC(wk,  sizeof(DDEF_WORKER) * nw);
+  ESL_ALLOC(tid, sizeof(pthread_t)   * nw);
+  for (w = 0; w < nw; w++)
+    {
+      wk[w].shared = &rs;
+      wk[w].w      = w;
+      wk[w].ddef   = NULL;
+      wk[w].om     = NULL;
+      wk[w].fwd    = wk[w].bck    = NULL;
+      wk[w].bg     = wk[w].bg_tmp = NULL;
+      wk[w].scores_arr = NULL;
+    }
+  for (w = 0; w < nw; w++)
+    {
+      r = (ddef->r->type == eslRND_FAST ? esl_randomness_CreateFast(esl_randomness_GetSeed(ddef->r)) : esl_randomness_Create(esl_randomness_GetSeed(ddef->r)));
+      if (r == NULL) { status = eslEMEM; goto ERROR; }
+      if ((wk[w].ddef = p7_domaindef_Create(r)) == NULL) { esl_randomness_Destroy(r); status = eslEMEM; goto ERROR; }
+      wk[w].ddef->do_reseeding  = ddef->do_reseeding;
+      wk[w].ddef->do_alidisplay = ddef->do_alidisplay;
+      wk[w].ddef->rt1           = ddef->rt1;
+      wk[w].ddef->rt2           = ddef->rt2;
+      wk[w].ddef->rt3           = ddef->rt3;
+      wk[w].ddef->nsamples      = ddef->nsamples;
+      wk[w].ddef->nsamples_check = ddef->nsamples_check;
+      wk[w].ddef->n2tol         = ddef->n2tol;
+      wk[w].ddef->min_overlap   = ddef->min_overlap;
+      wk[w].ddef->of_smaller    = ddef->of_smaller;
+      wk[w].ddef->max_diagdiff  = ddef->max_diagdiff;
+      wk[w].ddef->min_posterior = ddef->min_posterior;
+      wk[w].ddef->min_endpointp = ddef->min_endpointp;
+      if ((status = p7_domaindef_GrowTo(wk[w].ddef, sq->n)) != eslOK) goto ERROR;
+      esl_vec_FSet(wk[w].ddef->n2sc, sq->n+1, 0.0);
+
+      if (w == 0) 
+	{
+	  wk[w].om     = om;
+	  wk[w].fwd    = fwd;
+	  wk[w].bck    = bck;
+	  wk[w].bg     = bg;
+	  wk[w].bg_tmp = bg_tmp;
+	  wk[w].scores_arr = scores_arr;
+	}
+      else
+	{
+	  if ((wk[w].om  = (do_copy ? p7_oprofile_Copy(om) : p7_oprofile_Clone(om))) == NULL) { status = eslEMEM; goto ERROR; }
+	  if ((wk[w].fwd = p7_omx_Create(om->M, 0, 0))                                == NULL) { status = eslEMEM; goto ERROR; }
+	  if ((wk[w].bck = p7_omx_Create(om->M, 0, 0))                                == NULL) { status = eslEMEM; goto ERROR; }
+	  if (do_copy)
+	    {
+	      if ((wk[w].bg     = p7_bg_Clone(bg))     == NULL) { status = eslEMEM; goto ERROR; }
+	      if ((wk[w].bg_tmp = p7_bg_Clone(bg_tmp)) == NULL) { status = eslEMEM; goto ERROR; }
+	      ESL_ALLOC(wk[w].scores_arr, sizeof(float) * om->abc->Kp * 4);
+	    }
+	  else
+	    {
+	      wk[w].bg     = bg;
+	      wk[w].bg_tmp = bg_tmp;
+	      wk[w].scores_arr = scores_arr;
+	    }
+	}
+    }
+
+  /* Run them: the caller's thread is worker 0. */
+  if (pthread_mutex_init(&rs.lock, NULL) != 0) ESL_XEXCEPTION(eslESYS, "mutex init failed");
+  for (nt = 1; nt < nw; nt++)
+    if (pthread_create(&tid[nt], NULL, define_regions_thread, &wk[nt]) != 0) break;
+  define_regions_thread(&wk[0]);
+  for (w = 1; w < nt; w++)
+    pthread_join(tid[w], NULL);
+  pthread_mutex_destroy(&rs.lock);
+  /* if some thread didn't start, the ones that did have still done every region */
+
+  return_threads(nbor);
+  nbor = 0;
+
+  /* Collect the results in region order. Make room for all of them
+   * first: until they're copied, the workers' ddefs still own their
+   * alidisplays and free them on error.
+   */
+  for (nd = 0, d = 0; d < rs.nreg; d++) nd += rs.reg[d].nd;
+  while (ddef->ndom + nd > ddef->nalloc) {
+    ESL_RALLOC(ddef->dcl, p, sizeof(P7_DOMAIN) * (ddef->nalloc*2));
+    ddef->nalloc *= 2;
+  }
+  for (d = 0; d < rs.nreg; d++)
+    {
+      DDEF_REGION  *reg = rs.reg + d;
+      P7_DOMAINDEF *wd  = wk[reg->w].ddef;
+
+      memcpy(ddef->dcl + ddef->ndom, wd->dcl + reg->d0, sizeof(P7_DOMAIN) * reg->nd);
+      ddef->ndom += reg->nd;
+      esl_vec_FCopy(wd->n2sc + reg->i, reg->j - reg->i + 1, ddef->n2sc + reg->i);
+    }
+  for (w = 0; w < nw; w++)
+    {
+      ddef->nregions   += wk[w].ddef->nregions;
+      ddef->nclustered += wk[w].ddef->nclustered;
+      ddef->noverlaps  += wk[w].ddef->noverlaps;
+      ddef->nenvelopes += wk[w].ddef->nenvelopes;
+      wk[w].ddef->ndom  = 0;	/* its alidisplays now belong to <ddef> */
+    }
+  status = eslOK;
+  /* fallthrough: clean up */
+
+ ERROR:
+  for (w = 0; wk && w < nw; w++)
+    {
+      if (wk[w].ddef) { esl_randomness_Destroy(wk[w].ddef->r); p7_domaindef_Destroy(wk[w].ddef); }
+      if (w == 0) continue;
+      if (wk[w].om)  p7_oprofile_Destroy(wk[w].om);
+      if (wk[w].fwd) p7_omx_Destroy(wk[w].fwd);
+      if (wk[w].bck) p7_omx_Destroy(wk[w].bck);
+      if (do_copy) {
+	if (wk[w].bg)         p7_bg_Destroy(wk[w].bg);
+	if (wk[w].bg_tmp)     p7_bg_Destroy(wk[w].bg_tmp);
+	if (wk[w].scores_arr) free(wk[w].scores_arr);
+      }
+    }
+  if (wk)     free(wk);
+  if (tid)    free(tid);
+  if (rs.reg) free(rs.reg);
+  return_threads(nbor);
+  return status;
+}
+#endif /*HMMER_THREADS*/
+
 /*****************************************************************
  * Example driver.
  *****************************************************************/
@@ -1,8 +1,8 @@
-/* The Plan7 MSVDATA data structure, which holds a compact representation
- * of substitution scores and maximal extensions, used by nhmmer.
+/* The P7_HMM_WINDOWLIST data structure, which holds the lists of
+ * sequence windows passed between stages of the nhmmer pipeline.
  *
  * Contents:
- *   1. The P7_MSVDATA object: allocation, initialization, destruction.
+ *   1. The P7_HMM_WINDOWLIST object: allocation, merging, destruction.
  *   2. Unit tests.
  *   3. Test driver.
  *   4. Copyright and license.
@@ -13,7 +13,7 @@
 
 
 /*********************************************************************
- *# 1. The P7_MSVDATA object: allocation, initialization, destruction.
+ *# 1. The P7_HMM_WINDOWLIST object: allocation, merging, destruction.
  *********************************************************************/
 
 
@@ -26,8 +26,9 @@
 int
 p7_hmmwindow_init (P7_HMM_WINDOWLIST *list) {
   int status;
-  list->size = 10000;
-  list->count = 0;
+  list->size    = 10000;
+  list->count   = 0;
+  list->windows = NULL;
   ESL_ALLOC(list->windows, list->size * sizeof(P7_HMM_WINDOW));
 
   return eslOK;
@@ -37,6 +38,57 @@ ERROR:
 
 }
 
+/* Function:  p7_hmmwindow_grow()
+ *
+ * Synopsis:  Make room for at least <n> windows on the list
+ *
+ * Purpose:   Reallocate <list>, if necessary, so it can hold <n>
+ *            windows without further reallocation. Callers that
+ *            know how many windows they are about to add (e.g. one
+ *            per FM seed) call this once, rather than letting
+ *            p7_hmmwindow_new() grow the list piecemeal.
+ *
+ * Returns:   eslEMEM in event of allocation failure, otherwise eslOK
+ */
+int
+p7_hmmwindow_grow (P7_HMM_WINDOWLIST *list, int n) {
+  int status;
+
+  if (n <= list->size) return eslOK;
+
+  list->size = n;
+  ESL_REALLOC(list->windows, list->size * sizeof(P7_HMM_WINDOW));
+
+  return eslOK;
+
+ERROR:
+  return eslEMEM;
+}
+
+/* Function:  p7_hmmwindow_reuse()
+ *
+ * Synopsis:  Empty the list, keeping its allocation
+ */
+void
+p7_hmmwindow_reuse (P7_HMM_WINDOWLIST *list) {
+  list->count = 0;
+}
+
+/* Function:  p7_hmmwindow_destroy()
+ *
+ * Synopsis:  Free the memory held by the list
+ *
+ * Purpose:   Free the arrays allocated by p7_hmmwindow_init(). The
+ *            list itself is usually embedded in another structure,
+ *            so it is not freed.
+ */
+void
+p7_hmmwindow_destroy (P7_HMM_WINDOWLIST *list) {
+  if (list->windows != NULL) free(list->windows);
+  list->windows = NULL;
+  list->count   = list->size = 0;
+}
+
 /* Function:  p7_hmmwindow_new()
  *
  * Synopsis:  Return a pointer to the next window element on the list
@@ -52,13 +104,11 @@ ERROR:
 
 P7_HMM_WINDOW *
 p7_hmmwindow_new (P7_HMM_WINDOWLIST *list, uint32_t id, uint32_t pos, uint32_t fm_pos, uint16_t k, uint32_t length, float score, uint8_t complementarity, uint32_t target_len) {
-  int status;
   P7_HMM_WINDOW *window;
 
-  if (list->count == list->size) {
-    list->size *= 4;
-    ESL_REALLOC(list->windows, list->size * sizeof(P7_HMM_WINDOW));
-  }
+  if (list->count == list->size && p7_hmmwindow_grow(list, ESL_MAX(list->size * 4, 16)) != eslOK)
+    return NULL;
+
   window = list->windows + list->count;
 
   window->id               = id;
@@ -73,24 +123,212 @@ p7_hmmwindow_new (P7_HMM_WINDOWLIST *list, uint32_t id, uint32_t pos, uint32_t f
   list->count++;
 
   return window;
+}
 
-ERROR:
-  return NULL;
+
+/* window_sorter(): qsort's pawn, below. Orders windows by strand,
+ * then sequence, then start position; remaining fields only break
+ * ties, so the order is fully determined.
+ */
+static int
+window_sorter(const void *vw1, const void *vw2)
+{
+  const P7_HMM_WINDOW *w1 = (const P7_HMM_WINDOW *) vw1;
+  const P7_HMM_WINDOW *w2 = (const P7_HMM_WINDOW *) vw2;
+
+  if (w1->complementarity != w2->complementarity) return (w1->complementarity < w2->complementarity ? -1 : 1);
+  if (w1->id     != w2->id)     return (w1->id     < w2->id     ? -1 : 1);
+  if (w1->n      != w2->n)      return (w1->n      < w2->n      ? -1 : 1);
+  if (w1->length != w2->length) return (w1->length > w2->length ? -1 : 1);  /* longer window first */
+  if (w1->fm_n   != w2->fm_n)   return (w1->fm_n   < w2->fm_n   ? -1 : 1);
+  if (w1->k      != w2->k)      return (w1->k      < w2->k      ? -1 : 1);
+  if (w1->score  != w2->score)  return (w1->score  > w2->score  ? -1 : 1);
+  return 0;
 }
 
+/* Function:  p7_hmmwindow_merge()
+ *
+ * Synopsis:  Merge overlapping windows on the list
+ *
+ * Purpose:   Merge (in place) windows on the same strand of the same
+ *            sequence that overlap by more than <pct_overlap> of the
+ *            shorter one. The result is ordered by strand, sequence,
+ *            and start position.
+ *
+ *            Windows are usually added in order of position, so the
+ *            list is sorted only if it is found to be out of order;
+ *            either way, a single sweep then merges each window into
+ *            the one before it.
+ *
+ * Returns:   eslOK
+ */
+int
+p7_hmmwindow_merge (P7_HMM_WINDOWLIST *list, float pct_overlap) {
+  P7_HMM_WINDOW *w     = list->windows;
+  int64_t        start, end;    /* extent of window <c>, as merged so far */
+  int64_t        ovl_start, ovl_end;
+  int32_t        ovl_len;
+  int            sorted = TRUE;
+  int            i;
+  int            c      = 0;  /* window that others are currently being merged into */
+
+  if (list->count == 0) return eslOK;
+
+  for (i=1; i<list->count && sorted; i++)
+    if (   w[i].complementarity <  w[i-1].complementarity
+        || (w[i].complementarity == w[i-1].complementarity && w[i].id <  w[i-1].id)
+        || (w[i].complementarity == w[i-1].complementarity && w[i].id == w[i-1].id && w[i].n < w[i-1].n))
+      sorted = FALSE;
+  if (! sorted)
+    qsort(w, list->count, sizeof(P7_HMM_WINDOW), window_sorter);
+
+  start = w[0].n;
+  end   = w[0].n + w[0].length - 1;
+  for (i=1; i<list->count; i++) {
+    ovl_start = ESL_MAX(start, w[i].n);
+    ovl_end   = ESL_MIN(end,   w[i].n + w[i].length - 1);
+    ovl_len   = ovl_end - ovl_start + 1;
+
+    if (  w[c].complementarity == w[i].complementarity &&
+          w[c].id == w[i].id &&
+          (float)(ovl_len)/ESL_MIN(end - start + 1, w[i].length) > pct_overlap )
+    {
+      if (w[i].n < start) {
+        w[c].fm_n -= (start - w[i].n);
+        start      = w[i].n;
+      }
+      end = ESL_MAX(end, w[i].n + w[i].length - 1);
+    } else {
+      w[c].n      = start;
+      w[c].length = end - start + 1;
+      c++;
+      if (c != i) w[c] = w[i];
+      start = w[c].n;
+      end   = w[c].n + w[c].length - 1;
+    }
+  }
+  w[c].n      = start;
+  w[c].length = end - start + 1;
+  list->count = c+1;
+
+  return eslOK;
+}
 
 
 
 /*****************************************************************
  * 2. Unit tests
  *****************************************************************/
+#ifdef p7HMMWINDOW_TESTDRIVE
+#include "esl_random.h"
+#include "esl_vectorops.h"
+
+/* Merge a list of random windows with <pct_overlap> = 0, in random
+ * order, and check the result against a coverage map of the input:
+ * every input position must be covered by exactly one output window
+ * of the same strand and sequence, and no output window may cover
+ * a position that no input window did.
+ */
+static void
+utest_merge(ESL_RANDOMNESS *rng, int N, int L)
+{
+  char               msg[]  = "hmmwindow merge unit test failed";
+  P7_HMM_WINDOWLIST  list;
+  P7_HMM_WINDOW      tmp;
+  int               *cover  = NULL;   /* [0..3][1..L]: # of input/output windows covering each position, per strand/seq */
+  int                i, j, g, pos, len;
+  int                status;
+
+  if (p7_hmmwindow_init(&list) != eslOK) esl_fatal(msg);
+  ESL_ALLOC(cover, sizeof(int) * 4 * (L+1));
+  esl_vec_ISet(cover, 4 * (L+1), 0);
+
+  for (i = 0; i < N; i++) {
+    len = 1 + esl_rnd_Roll(rng, L/20);
+    pos = 1 + esl_rnd_Roll(rng, L - len + 1);
+    if (p7_hmmwindow_new(&list, esl_rnd_Roll(rng, 2), pos, pos, 0, len, 0.0, esl_rnd_Roll(rng, 2), L) == NULL) esl_fatal(msg);
+  }
+  for (i = list.count-1; i > 0; i--) {   /* shuffle */
+    j = esl_rnd_Roll(rng, i+1);
+    tmp = list.windows[i]; list.windows[i] = list.windows[j]; list.windows[j] = tmp;
+  }
+  for (i = 0; i < list.count; i++) {
+    g = 2*list.windows[i].complementarity + list.windows[i].id;
+    for (pos = list.windows[i].n; pos < list.windows[i].n + list.windows[i].length; pos++)
+      cover[g*(L+1) + pos] = 1;
+  }
+
+  if (p7_hmmwindow_merge(&list, 0.) != eslOK) esl_fatal(msg);
+
+  for (i = 0; i < list.count; i++) {
+    if (i > 0 && list.windows[i].complementarity == list.windows[i-1].complementarity && list.windows[i].id == list.windows[i-1].id
+        && list.windows[i].n <= list.windows[i-1].n)                esl_fatal(msg);
+    if (list.windows[i].fm_n != list.windows[i].n)                  esl_fatal(msg);
+    g = 2*list.windows[i].complementarity + list.windows[i].id;
+    for (pos = list.windows[i].n; pos < list.windows[i].n + list.windows[i].length; pos++) {
+      if (cover[g*(L+1) + pos] != 1) esl_fatal(msg);   /* not in any input window, or in two output windows */
+      cover[g*(L+1) + pos] = 2;
+    }
+  }
+  for (i = 0; i < 4 * (L+1); i++)
+    if (cover[i] == 1) esl_fatal(msg);                /* input position lost */
 
+  /* merging again changes nothing */
+  j = list.count;
+  if (p7_hmmwindow_merge(&list, 0.) != eslOK || list.count != j) esl_fatal(msg);
+
+  p7_hmmwindow_destroy(&list);
+  free(cover);
+  return;
+
+ ERROR:
+  esl_fatal(msg);
+}
+#endif /*p7HMMWINDOW_TESTDRIVE*/
 
 
 /*****************************************************************
  * 3. Test driver
  *****************************************************************/
+#ifdef p7HMMWINDOW_TESTDRIVE
+#include "esl_config.h"
+
+#include <stdio.h>
 
+#include "easel.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+
+#include "hmmer.h"
+
+static ESL_OPTIONS options[] = {
+   /* name  type         default  env   range togs  reqs  incomp  help                docgrp */
+  {"-h",  eslARG_NONE,    FALSE, NULL, NULL, NULL, NULL, NULL, "show help and usage",                            0},
+  {"-s",  eslARG_INT,       "0", NULL, NULL, NULL, NULL, NULL, "set random number seed to <n>",                  0},
+  {"-v",  eslARG_NONE,    FALSE, NULL, NULL, NULL, NULL, NULL, "show verbose commentary/output",                 0},
+  { 0,0,0,0,0,0,0,0,0,0},
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for p7_hmmwindow";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go          = esl_getopts_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *rng         = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  int             be_verbose  = esl_opt_GetBoolean(go, "-v");
+
+  if (be_verbose) printf("p7_hmmwindow unit test: rng seed %" PRIu32 "\n", esl_randomness_GetSeed(rng));
+
+  utest_merge(rng,     1,  1000);
+  utest_merge(rng,    50, 10000);
+  utest_merge(rng, 20000, 50000);   /* more windows than the initial allocation */
+
+  esl_randomness_Destroy(rng);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /* p7HMMWINDOW_TESTDRIVE */
 
 
 /************************************************************
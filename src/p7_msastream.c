@@ -0,0 +1,897 @@
+/* Streaming input of deep Stockholm alignments, for model construction.
+ *
+ * hmmbuild normally reads each alignment into an ESL_MSA, holding
+ * nseq x alen residues plus names and annotation in memory; for very
+ * deep alignments, that's what limits the size of what we can build.
+ * A P7_MSASTREAM reads a Pfam-format (one line per sequence) Stockholm
+ * file in several sequential passes over each alignment record. A
+ * scan pass collects the annotation the model needs, the number of
+ * sequences, per-column residue counts, and the checksum; each later
+ * pass delivers the aligned sequences in order, a small chunk of
+ * digital rows at a time. Memory is O(alen), not O(nseq * alen).
+ *
+ * Contents:
+ *    1. P7_MSASTREAM: opening, scanning, reading chunks.
+ *    2. Position-based weights for a streamed alignment.
+ *    3. Internal functions: reading and parsing lines.
+ *    4. Unit tests.
+ *    5. Test driver.
+ *    6. Copyright and license information.
+ */
+#include "p7_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_keyhash.h"
+#include "esl_mem.h"
+#include "esl_msa.h"
+#include "esl_vectorops.h"
+
+#include "hmmer.h"
+
+static int msastream_getline       (P7_MSASTREAM *ms, char **ret_p, esl_pos_t *ret_n);
+static int msastream_guess_alphabet(P7_MSASTREAM *ms, int *ret_type);
+static int msastream_set_alen      (P7_MSASTREAM *ms, esl_pos_t n);
+static int msastream_parse_gf      (P7_MSASTREAM *ms, char *p, esl_pos_t n);
+static int msastream_parse_gc      (P7_MSASTREAM *ms, char *p, esl_pos_t n);
+static int msastream_parse_sq      (P7_MSASTREAM *ms, char *p, esl_pos_t n, uint32_t *val);
+
+#define p7_MSASTREAM_MULTIBLOCK "alignment has more than one block; streaming needs Pfam format, one line per sequence (see esl-reformat pfam)"
+
+/*****************************************************************
+ * 1. P7_MSASTREAM: opening, scanning, reading chunks.
+ *****************************************************************/
+
+/* Function:  p7_msastream_Open()
+ * Synopsis:  Open a Stockholm alignment file for streaming.
+ *
+ * Purpose:   Open Stockholm alignment file <filename> for streamed
+ *            reading, and return the new stream in <*ret_ms>.
+ *
+ *            The alphabet follows the same convention as
+ *            <eslx_msafile_Open()>: if <*byp_abc> is provided, it is
+ *            used; if <byp_abc> points to <NULL>, the alphabet is
+ *            guessed from the residues in the file, created, and
+ *            returned in <*byp_abc>. The caller is responsible for
+ *            freeing the alphabet after closing the stream.
+ *
+ *            The file is read in several passes, so it must be a
+ *            seekable, uncompressed file, not a stream or a pipe.
+ *
+ *            Caller may optionally provide an <errbuf> ptr to at
+ *            least <eslERRBUFSIZE> bytes, to capture an informative
+ *            error message on failure.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslENOTFOUND> if <filename> can't be opened for reading.
+ *            <eslENOALPHABET> if the alphabet can't be guessed.
+ *            On errors, <*ret_ms> is <NULL>.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_msastream_Open(const char *filename, ESL_ALPHABET **byp_abc, P7_MSASTREAM **ret_ms, char *errbuf)
+{
+  P7_MSASTREAM *ms        = NULL;
+  ESL_ALPHABET *abc       = NULL;
+  int           alphatype = eslUNKNOWN;
+  int           sym;
+  int           status;
+
+  if (errbuf) errbuf[0] = '\0';
+
+  ESL_ALLOC(ms, sizeof(P7_MSASTREAM));
+  ms->fp         = NULL;
+  ms->filename   = NULL;
+  ms->abc        = NULL;
+  ms->buf        = NULL;
+  ms->nalloc     = 0;
+  ms->linenumber = 0;
+  ms->datastart  = 0;
+  ms->startline  = 0;
+  ms->dataend    = -1;
+  ms->endline    = 0;
+  ms->hdr        = NULL;
+  ms->nseq       = 0;
+  ms->alen       = -1;
+  ms->checksum   = 0;
+  ms->nres       = NULL;
+  ms->badseq     = NULL;
+  ms->ax         = NULL;
+  ms->names      = NULL;
+  ms->chunk      = NULL;
+  ms->nchunk     = 0;
+  ms->seqi       = 0;
+  ms->at_end     = FALSE;
+  ms->errmsg[0]  = '\0';
+
+  if ((ms->fp = fopen(filename, "r")) == NULL) ESL_XFAIL(eslENOTFOUND, errbuf, "Failed to open alignment file %s for reading", filename);
+  if ((status = esl_strdup(filename, -1, &(ms->filename))) != eslOK) goto ERROR;
+  if ((ms->names = esl_keyhash_Create())                   == NULL)  { status = eslEMEM; goto ERROR; }
+
+  if (esl_byp_IsProvided(byp_abc)) abc = *byp_abc;
+  else
+    {
+      status = msastream_guess_alphabet(ms, &alphatype);
+      if      (status == eslENOALPHABET) ESL_XFAIL(eslENOALPHABET, errbuf, "couldn't guess alphabet of %s (maybe try --dna/--rna/--amino if available)", filename);
+      else if (status != eslOK)          goto ERROR;
+      if ((abc = esl_alphabet_Create(alphatype)) == NULL) { status = eslEMEM; goto ERROR; }
+    }
+
+  /* Same input map that the Stockholm parser uses */
+  ms->abc = abc;
+  for (sym = 0; sym < 128; sym++) ms->inmap[sym] = abc->inmap[sym];
+  ms->inmap[0] = esl_abc_XGetUnknown(abc);
+
+  if (esl_byp_IsReturned(byp_abc)) *byp_abc = abc;
+  *ret_ms = ms;
+  return eslOK;
+
+ ERROR:
+  if (abc && ! esl_byp_IsProvided(byp_abc)) esl_alphabet_Destroy(abc);
+  p7_msastream_Close(ms);
+  *ret_ms = NULL;
+  return status;
+}
+
+
+/* Function:  p7_msastream_Next()
+ * Synopsis:  Scan the next alignment in a stream.
+ *
+ * Purpose:   Scan the next alignment record in <ms>, in one pass that
+ *            parses and validates it without keeping its sequences.
+ *
+ *            Upon return, <ms->hdr> is a zero-sequence MSA holding
+ *            the alignment's name, accession, description, Pfam
+ *            score cutoffs, and its <#=GC> RF, MM, SS_cons, and
+ *            SA_cons lines, with <ms->hdr->alen> set; <ms->nseq> and
+ *            <ms->alen> are set; <ms->nres> has the canonical residue
+ *            counts in each column; <ms->checksum> is the same as
+ *            <esl_msa_Checksum()> on the digital MSA; and
+ *            <ms->badseq> names the first sequence with missing data
+ *            other than at its ends, or is <NULL>.
+ *
+ *            The stream is left rewound to the first sequence of the
+ *            alignment, ready for <p7_msastream_ReadChunk()>.
+ *
+ *            Only Pfam format is supported: the alignment must be a
+ *            single block, with one line per sequence. Per-sequence
+ *            (<#=GS>, <#=GR>) annotation, comments, and other <#=GF>
+ *            and <#=GC> lines are skipped, since models don't use
+ *            them.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEOF> if there are no more alignments in the file.
+ *            <eslEFORMAT> on a parse error, including a multi-block
+ *            alignment; <ms->errmsg> contains an informative message,
+ *            and <ms->linenumber> is the offending line.
+ *
+ * Throws:    <eslEMEM> on allocation failure; <eslESYS> if a file
+ *            positioning call fails.
+ */
+int
+p7_msastream_Next(P7_MSASTREAM *ms)
+{
+  char     *p;
+  esl_pos_t n;
+  uint32_t  val      = 0;	/* Jenkins hash of all digital residues, as esl_msa_Checksum() */
+  int       in_block = FALSE;
+  int       nblock   = 0;
+  int       status;
+
+  ms->errmsg[0] = '\0';
+
+  /* Resume after the end of the previous alignment, if there was one */
+  if (ms->dataend != -1)
+    {
+      if (fseeko(ms->fp, ms->dataend, SEEK_SET) != 0) ESL_EXCEPTION(eslESYS, "fseeko() failed");
+      ms->linenumber = ms->endline;
+    }
+
+  /* Reset the per-alignment information */
+  esl_msa_Destroy(ms->hdr);
+  if (ms->nres   != NULL) free(ms->nres);
+  if (ms->ax     != NULL) free(ms->ax);
+  if (ms->badseq != NULL) free(ms->badseq);
+  ms->nres   = NULL;
+  ms->ax     = NULL;
+  ms->badseq = NULL;
+  ms->nseq   = 0;
+  ms->alen   = -1;
+  esl_keyhash_Reuse(ms->names);
+  if ((ms->hdr = esl_msa_CreateDigital(ms->abc, 16, -1)) == NULL) return eslEMEM;
+
+  /* Skip leading blank lines and comments. EOF here is a normal EOF return. */
+  do {
+    if ((status = msastream_getline(ms, &p, &n)) != eslOK) return status; /* eslEOF, [eslEMEM] */
+  } while (esl_memspn(p, n, " \t") == n ||
+	   (esl_memstrpfx(p, n, "#") && ! esl_memstrpfx(p, n, "# STOCKHOLM")));
+
+  if (! esl_memstrpfx(p, n, "# STOCKHOLM 1.")) ESL_FAIL(eslEFORMAT, ms->errmsg, "missing Stockholm header (streaming needs an uncompressed Stockholm file)");
+  if ((ms->datastart = ftello(ms->fp)) < 0)    ESL_EXCEPTION(eslESYS, "ftello() failed");
+  ms->startline = ms->linenumber;
+  ms->dataend   = -1;
+
+  while ((status = msastream_getline(ms, &p, &n)) == eslOK)
+    {
+      while (n && (*p == ' ' || *p == '\t')) { p++; n--; } /* skip leading whitespace */
+
+      if (!n || esl_memstrpfx(p, n, "//"))
+	{
+	  if (in_block) { nblock++; in_block = FALSE; }
+	  if (esl_memstrpfx(p, n, "//")) break;
+	  else continue;
+	}
+
+      if (*p == '#')
+	{
+	  if (esl_memstrpfx(p, n, "#=GF"))
+	    { if ((status = msastream_parse_gf(ms, p, n)) != eslOK) return status; }
+	  else if (esl_memstrpfx(p, n, "#=GC"))
+	    {
+	      if (nblock) ESL_FAIL(eslEFORMAT, ms->errmsg, p7_MSASTREAM_MULTIBLOCK);
+	      if ((status = msastream_parse_gc(ms, p, n)) != eslOK) return status;
+	      in_block = TRUE;
+	    }
+	  else if (esl_memstrpfx(p, n, "#=GR"))
+	    {
+	      if (nblock) ESL_FAIL(eslEFORMAT, ms->errmsg, p7_MSASTREAM_MULTIBLOCK);
+	      in_block = TRUE;
+	    }
+	  else if (esl_memstrcmp(p, n, "# STOCKHOLM 1.0")) ESL_FAIL(eslEFORMAT, ms->errmsg, "two # STOCKHOLM 1.0 headers in a row?");
+	  /* else: #=GS lines and comments; nothing we need */
+	}
+      else
+	{
+	  if (nblock) ESL_FAIL(eslEFORMAT, ms->errmsg, p7_MSASTREAM_MULTIBLOCK);
+	  if ((status = msastream_parse_sq(ms, p, n, &val)) != eslOK) return status;
+	  in_block = TRUE;
+	}
+    }
+  if      (status == eslEOF) ESL_FAIL(eslEFORMAT, ms->errmsg, "missing // terminator after MSA");
+  else if (status != eslOK)  return status;
+  if (ms->nseq == 0)         ESL_FAIL(eslEFORMAT, ms->errmsg, "no aligned sequences followed Stockholm header");
+
+  if ((ms->dataend = ftello(ms->fp)) < 0) ESL_EXCEPTION(eslESYS, "ftello() failed");
+  ms->endline   = ms->linenumber;
+  ms->hdr->alen = ms->alen;
+
+  val += (val <<  3);
+  val ^= (val >> 11);
+  val += (val << 15);
+  ms->checksum = val;
+
+  /* A chunk of rows for the later passes; reused while alen and depth allow */
+  if (ms->chunk == NULL || ms->chunk->alen != ms->alen || ms->nchunk < ESL_MIN(ms->nseq, p7_MSASTREAM_CHUNK))
+    {
+      if (ms->chunk) { ms->chunk->nseq = ms->nchunk; esl_msa_Destroy(ms->chunk); }
+      ms->nchunk = ESL_MIN(ms->nseq, p7_MSASTREAM_CHUNK);
+      if ((ms->chunk = esl_msa_CreateDigital(ms->abc, ms->nchunk, ms->alen)) == NULL) return eslEMEM;
+    }
+
+  return p7_msastream_Rewind(ms);
+}
+
+
+/* Function:  p7_msastream_Rewind()
+ * Synopsis:  Start another pass over the current alignment.
+ *
+ * Purpose:   Reposition <ms> at the first sequence of the alignment
+ *            that <p7_msastream_Next()> scanned.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslESYS> if <fseeko()> fails.
+ */
+int
+p7_msastream_Rewind(P7_MSASTREAM *ms)
+{
+  if (fseeko(ms->fp, ms->datastart, SEEK_SET) != 0) ESL_EXCEPTION(eslESYS, "fseeko() failed");
+  ms->linenumber = ms->startline;
+  ms->seqi       = 0;
+  ms->at_end     = FALSE;
+  return eslOK;
+}
+
+
+/* Function:  p7_msastream_ReadChunk()
+ * Synopsis:  Read the next chunk of aligned sequences.
+ *
+ * Purpose:   Read up to <p7_MSASTREAM_CHUNK> more aligned sequences
+ *            of the current alignment in <ms>, in file order, and
+ *            return them as a digital MSA in <*ret_chunk>, with
+ *            <(*ret_chunk)->nseq> rows of <ms->alen> columns. Only
+ *            the digital rows are set, not names or annotation; row
+ *            <i> is sequence <ms->seqi - (*ret_chunk)->nseq + i> of
+ *            the alignment.
+ *
+ *            The chunk belongs to <ms> and is overwritten by the
+ *            next call; the caller may modify its rows and weights
+ *            in the meantime.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEOF> when this pass has delivered every sequence;
+ *            <*ret_chunk> is <NULL>.
+ *            <eslEFORMAT> if the file no longer matches the scan (it
+ *            was changed while being read); <ms->errmsg> is set.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_msastream_ReadChunk(P7_MSASTREAM *ms, ESL_MSA **ret_chunk)
+{
+  ESL_MSA  *chunk = ms->chunk;
+  char     *p, *seqname;
+  esl_pos_t n, seqnamelen;
+  int64_t   L;
+  int       i      = 0;
+  int       status = eslOK;
+
+  ms->errmsg[0] = '\0';
+  *ret_chunk    = NULL;
+  if (ms->at_end) return eslEOF;
+
+  while (i < ms->nchunk && (status = msastream_getline(ms, &p, &n)) == eslOK)
+    {
+      while (n && (*p == ' ' || *p == '\t')) { p++; n--; }
+      if (esl_memstrpfx(p, n, "//")) { ms->at_end = TRUE; break; }
+      if (!n || *p == '#') continue;
+
+      if (ms->seqi == ms->nseq) ESL_FAIL(eslEFORMAT, ms->errmsg, "more sequences than scanned; alignment file changed while being read?");
+      esl_memtok(&p, &n, " \t", &seqname, &seqnamelen);
+      while (n && strchr(" \t", p[n-1])) n--;
+      if (n != ms->alen) ESL_FAIL(eslEFORMAT, ms->errmsg, "aligned sequence length changed since scan; alignment file changed while being read?");
+
+      L = 0;
+      status = esl_abc_dsqcat_noalloc(ms->inmap, chunk->ax[i], &L, p, n);
+      if (status != eslOK || L != ms->alen) ESL_FAIL(eslEFORMAT, ms->errmsg, "invalid sequence character(s) on line");
+      i++;
+      ms->seqi++;
+    }
+  if      (status == eslEOF) ESL_FAIL(eslEFORMAT, ms->errmsg, "missing // terminator after MSA");
+  else if (status != eslOK)  return status;
+  if (ms->at_end && ms->seqi != ms->nseq) ESL_FAIL(eslEFORMAT, ms->errmsg, "fewer sequences than scanned; alignment file changed while being read?");
+  if (i == 0) return eslEOF;
+
+  chunk->nseq = i;
+  *ret_chunk  = chunk;
+  return eslOK;
+}
+
+
+/* Function:  p7_msastream_Close()
+ * Synopsis:  Close an alignment stream.
+ *
+ * Purpose:   Close <ms> and free it. The alphabet is not freed; it
+ *            belongs to the caller.
+ */
+void
+p7_msastream_Close(P7_MSASTREAM *ms)
+{
+  if (ms == NULL) return;
+
+  if (ms->fp       != NULL) fclose(ms->fp);
+  if (ms->filename != NULL) free(ms->filename);
+  if (ms->buf      != NULL) free(ms->buf);
+  if (ms->hdr      != NULL) esl_msa_Destroy(ms->hdr);
+  if (ms->nres     != NULL) free(ms->nres);
+  if (ms->badseq   != NULL) free(ms->badseq);
+  if (ms->ax       != NULL) free(ms->ax);
+  if (ms->names    != NULL) esl_keyhash_Destroy(ms->names);
+  if (ms->chunk    != NULL) { ms->chunk->nseq = ms->nchunk; esl_msa_Destroy(ms->chunk); }
+  free(ms);
+}
+/*------------------ end, P7_MSASTREAM --------------------------*/
+
+
+
+/*****************************************************************
+ * 2. Position-based weights for a streamed alignment.
+ *****************************************************************/
+
+/* Function:  p7_msastream_PBWeights()
+ * Synopsis:  Henikoff position-based weights, in one pass.
+ *
+ * Purpose:   Calculate position-based sequence weights for the current
+ *            alignment in <ms> in one pass over its sequences, and
+ *            put them in <wgt[0..ms->nseq-1]>, allocated by the caller.
+ *
+ *            The weights are identical to what <esl_msaweight_PB()>
+ *            computes for the whole digital MSA: column residue counts
+ *            come from the scan, each sequence's increments are summed
+ *            in column order, and the weights are normalized the same
+ *            way.
+ *
+ *            The stream is left rewound to the first sequence.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEFORMAT> if the file changed since the scan.
+ *
+ * Throws:    <eslEMEM> on allocation failure; <eslESYS> on a file
+ *            positioning failure.
+ */
+int
+p7_msastream_PBWeights(P7_MSASTREAM *ms, double *wgt)
+{
+  ESL_MSA *chunk  = NULL;
+  int     *ntotal = NULL;	/* number of different residues in each column, 1..alen */
+  int      K      = ms->abc->K;
+  ESL_DSQ *ax;
+  double   w;
+  int64_t  apos;
+  int      rlen;
+  int      idx, i, x;
+  int      status;
+
+  if (ms->nseq == 1) { wgt[0] = 1.0; return eslOK; }
+
+  ESL_ALLOC(ntotal, sizeof(int) * (ms->alen+1));
+  for (apos = 1; apos <= ms->alen; apos++)
+    for (ntotal[apos] = 0, x = 0; x < K; x++)
+      if (ms->nres[apos*K+x] > 0) ntotal[apos]++;
+
+  /* PB rule: residue x, in a column with ntotal different residues, gets 1/(ntotal*nres[x]);
+   * then normalize by the number of residues counted in each seq.
+   */
+  if ((status = p7_msastream_Rewind(ms)) != eslOK) goto ERROR;
+  for (idx = 0; (status = p7_msastream_ReadChunk(ms, &chunk)) == eslOK; )
+    for (i = 0; i < chunk->nseq; i++, idx++)
+      {
+	for (w = 0., rlen = 0, ax = chunk->ax[i], apos = 1; apos <= ms->alen; apos++)
+	  if (esl_abc_XIsCanonical(ms->abc, ax[apos]))
+	    {
+	      w += 1. / (double) (ntotal[apos] * ms->nres[apos*K + ax[apos]]);
+	      rlen++;
+	    }
+	wgt[idx] = (rlen > 0 ? w / (double) rlen : 0.);
+      }
+  if (status != eslEOF) goto ERROR;
+
+  /* Normalize to sum to nseq; if all weights were 0, they become 1.0 */
+  esl_vec_DNorm (wgt, ms->nseq);
+  esl_vec_DScale(wgt, ms->nseq, (double) ms->nseq);
+
+  free(ntotal);
+  return p7_msastream_Rewind(ms);
+
+ ERROR:
+  if (ntotal != NULL) free(ntotal);
+  return status;
+}
+/*----------------- end, streamed PB weights --------------------*/
+
+
+
+/*****************************************************************
+ * 3. Internal functions: reading and parsing lines.
+ *****************************************************************/
+
+/* msastream_getline()
+ * Read the next line into <ms->buf>; return a ptr to it in <*ret_p>
+ * and its length, without the newline, in <*ret_n>.
+ * Returns <eslEOF> at end of file. Throws <eslEMEM>.
+ */
+static int
+msastream_getline(P7_MSASTREAM *ms, char **ret_p, esl_pos_t *ret_n)
+{
+  esl_pos_t n;
+  int       status;
+
+  if ((status = esl_fgets(&(ms->buf), &(ms->nalloc), ms->fp)) != eslOK) return status;
+  ms->linenumber++;
+
+  n = strlen(ms->buf);
+  if (n && ms->buf[n-1] == '\n') n--;
+  if (n && ms->buf[n-1] == '\r') n--;
+
+  *ret_p = ms->buf;
+  *ret_n = n;
+  return eslOK;
+}
+
+
+/* msastream_guess_alphabet()
+ * Same as esl_msafile_stockholm_GuessAlphabet(): count letters on
+ * sequence lines, trying to decide after 500, 5000, and 50000
+ * residues, else at EOF. Rewinds the file to its start.
+ */
+static int
+msastream_guess_alphabet(P7_MSASTREAM *ms, int *ret_type)
+{
+  int       threshold[3] = { 500, 5000, 50000 };
+  int       nsteps       = 3;
+  int       step         = 0;
+  int       nres         = 0;
+  int64_t   ct[26];
+  char     *p, *tok;
+  esl_pos_t n, toklen, pos;
+  int       x;
+  int       status;
+
+  for (x = 0; x < 26; x++) ct[x] = 0;
+
+  while ((status = msastream_getline(ms, &p, &n)) == eslOK)
+    {
+      if (esl_memtok(&p, &n, " \t", &tok, &toklen) != eslOK || *tok == '#') continue;
+
+      for (pos = 0; pos < n; pos++)
+	if (isalpha(p[pos])) {
+	  ct[toupper(p[pos]) - 'A']++;
+	  nres++;
+	}
+
+      if (step < nsteps && nres > threshold[step]) {
+	if ((status = esl_abc_GuessAlphabet(ct, ret_type)) == eslOK) goto DONE;
+	step++;
+      }
+    }
+  if (status != eslEOF) return status;
+  status = esl_abc_GuessAlphabet(ct, ret_type); /* (eslENOALPHABET) */
+
+ DONE:
+  rewind(ms->fp);
+  ms->linenumber = 0;
+  return status;
+}
+
+
+/* msastream_set_alen()
+ * The first aligned line of an alignment sets alen, and allocates
+ * the per-column scan storage; every other one must agree.
+ */
+static int
+msastream_set_alen(P7_MSASTREAM *ms, esl_pos_t n)
+{
+  int status;
+
+  if (ms->alen == -1)
+    {
+      ms->alen = n;
+      ESL_ALLOC(ms->ax,   sizeof(ESL_DSQ) * (ms->alen+2));
+      ESL_ALLOC(ms->nres, sizeof(int)     * (ms->alen+1) * ms->abc->K);
+      esl_vec_ISet(ms->nres, (ms->alen+1) * ms->abc->K, 0);
+    }
+  else if (n != ms->alen) ESL_FAIL(eslEFORMAT, ms->errmsg, "unexpected number of aligned columns (%d, not %d) on line", (int) n, (int) ms->alen);
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+
+/* msastream_parse_gf()
+ * #=GF lines: the ones that models use are parsed the same as in the
+ * Stockholm parser: ID, AC, DE, and the GA, NC, TC cutoffs.
+ */
+static int
+msastream_parse_gf(P7_MSASTREAM *ms, char *p, esl_pos_t n)
+{
+  ESL_MSA   *msa = ms->hdr;
+  char      *gf,  *tag,   *tok;
+  esl_pos_t gflen, taglen, toklen;
+  int        which[2];
+  int        z;
+  int        status;
+
+  if ( (status = esl_memtok(&p, &n, " \t", &gf,  &gflen))  != eslOK) ESL_EXCEPTION(eslEINCONCEIVABLE, "EOL can't happen here.");
+  if ( (status = esl_memtok(&p, &n, " \t", &tag, &taglen)) != eslOK) ESL_FAIL(eslEFORMAT, ms->errmsg, "#=GF line is missing <tag>, annotation");
+  if (! esl_memstrcmp(gf, gflen, "#=GF"))                            ESL_FAIL(eslEFORMAT, ms->errmsg, "faux #=GF line?");
+
+  if (esl_memstrcmp(tag, taglen, "ID"))
+    {
+      if ((status = esl_memtok(&p, &n, " \t", &tok, &toklen)) != eslOK) ESL_FAIL(eslEFORMAT, ms->errmsg, "No name found on #=GF ID line");
+      if (n)                                                            ESL_FAIL(eslEFORMAT, ms->errmsg, "#=GF ID line should have only one name (no whitespace allowed)");
+      return esl_msa_SetName(msa, tok, toklen);
+    }
+  else if (esl_memstrcmp(tag, taglen, "AC"))
+    {
+      if ((status = esl_memtok(&p, &n, " \t", &tok, &toklen)) != eslOK) ESL_FAIL(eslEFORMAT, ms->errmsg, "No accession found on #=GF AC line");
+      if (n)                                                            ESL_FAIL(eslEFORMAT, ms->errmsg, "#=GF AC line should have only one accession (no whitespace allowed)");
+      return esl_msa_SetAccession(msa, tok, toklen);
+    }
+  else if (esl_memstrcmp(tag, taglen, "DE"))
+    return esl_msa_SetDesc(msa, p, n);
+
+  if      (esl_memstrcmp(tag, taglen, "GA")) { which[0] = eslMSA_GA1; which[1] = eslMSA_GA2; }
+  else if (esl_memstrcmp(tag, taglen, "NC")) { which[0] = eslMSA_NC1; which[1] = eslMSA_NC2; }
+  else if (esl_memstrcmp(tag, taglen, "TC")) { which[0] = eslMSA_TC1; which[1] = eslMSA_TC2; }
+  else return eslOK;
+
+  for (z = 0; z < 2; z++)
+    {
+      if (esl_memtok(&p, &n, " \t", &tok, &toklen) != eslOK) {
+	if (z == 0) ESL_FAIL(eslEFORMAT, ms->errmsg, "No %.*s threshold value found on #=GF %.*s line", (int) taglen, tag, (int) taglen, tag);
+	break;
+      }
+      if (z == 0 && which[0] == eslMSA_NC1 && esl_memstrcmp(tok, toklen, "undefined")) continue; /* Rfam10 workaround, as in the Stockholm parser */
+      if (! esl_mem_IsReal(tok, toklen)) ESL_FAIL(eslEFORMAT, ms->errmsg, "Expected a real number for %.*s%d value on #=GF %.*s line", (int) taglen, tag, z+1, (int) taglen, tag);
+      if ((status = esl_memtof(tok, toklen, &(msa->cutoff[which[z]]))) != eslOK) return status;
+      msa->cutset[which[z]] = TRUE;
+    }
+  return eslOK;
+}
+
+
+/* msastream_parse_gc()
+ * #=GC lines: keep RF, MM, SS_cons, SA_cons, which models use.
+ * Each must be one alen-long line.
+ */
+static int
+msastream_parse_gc(P7_MSASTREAM *ms, char *p, esl_pos_t n)
+{
+  char      *gc,    *tag;
+  esl_pos_t  gclen,  taglen;
+  char     **ret_s;
+  int        status;
+
+  if (esl_memtok(&p, &n, " \t", &gc,   &gclen)    != eslOK) ESL_EXCEPTION(eslEINCONCEIVABLE, "EOL can't happen here.");
+  if (esl_memtok(&p, &n, " \t", &tag,  &taglen)   != eslOK) ESL_FAIL(eslEFORMAT, ms->errmsg, "#=GC line missing <tag>, annotation");
+  while (n && strchr(" \t", p[n-1])) n--; /* skip backwards from eol, to delimit aligned text without going through it */
+
+  if (! esl_memstrcmp(gc, gclen, "#=GC")) ESL_FAIL(eslEFORMAT, ms->errmsg, "faux #=GC line?");
+  if (! n)                                ESL_FAIL(eslEFORMAT, ms->errmsg, "#=GC line missing annotation?");
+  if ((status = msastream_set_alen(ms, n)) != eslOK) return status;
+
+  if      (esl_memstrcmp(tag, taglen, "SS_cons")) ret_s = &(ms->hdr->ss_cons);
+  else if (esl_memstrcmp(tag, taglen, "SA_cons")) ret_s = &(ms->hdr->sa_cons);
+  else if (esl_memstrcmp(tag, taglen, "RF"))      ret_s = &(ms->hdr->rf);
+  else if (esl_memstrcmp(tag, taglen, "MM"))      ret_s = &(ms->hdr->mm);
+  else    return eslOK;
+
+  if (*ret_s != NULL) ESL_FAIL(eslEFORMAT, ms->errmsg, "more than one #=GC %.*s line in block", (int) taglen, tag);
+  return esl_memstrdup(p, n, ret_s);
+}
+
+
+/* msastream_parse_sq()
+ * A sequence line, in the scan pass: digitize it as the Stockholm
+ * parser would, fold it into the checksum <*val> and the column
+ * residue counts, and check that missing data only flank it, as
+ * p7_Builder() requires.
+ */
+static int
+msastream_parse_sq(P7_MSASTREAM *ms, char *p, esl_pos_t n, uint32_t *val)
+{
+  char     *seqname;
+  esl_pos_t seqnamelen;
+  int       K  = ms->abc->K;
+  int64_t   L  = 0;
+  int64_t   apos;
+  int       status;
+
+  if (esl_memtok(&p, &n, " \t", &seqname, &seqnamelen) != eslOK) ESL_EXCEPTION(eslEINCONCEIVABLE, "EOL can't happen here.");
+  while (n && strchr(" \t", p[n-1])) n--;
+  if (! n) ESL_FAIL(eslEFORMAT, ms->errmsg, "sequence line with no sequence?");
+
+  status = esl_keyhash_Store(ms->names, seqname, seqnamelen, NULL);
+  if      (status == eslEDUP) ESL_FAIL(eslEFORMAT, ms->errmsg, "duplicate seq name %.*s", (int) seqnamelen, seqname);
+  else if (status != eslOK)   return status;
+  if ((status = msastream_set_alen(ms, n)) != eslOK) return status;
+
+  ms->ax[0] = eslDSQ_SENTINEL;
+  status = esl_abc_dsqcat_noalloc(ms->inmap, ms->ax, &L, p, n);
+  if      (status == eslEINVAL) ESL_FAIL(eslEFORMAT, ms->errmsg, "invalid sequence character(s) on line");
+  else if (status != eslOK)     return status;
+  if (L != ms->alen)            ESL_FAIL(eslEFORMAT, ms->errmsg, "unexpected number of aligned residues parsed on line");
+
+  for (apos = 1; apos <= ms->alen; apos++)
+    {
+      *val += ms->ax[apos];
+      *val += (*val << 10);
+      *val ^= (*val >>  6);
+      if (esl_abc_XIsCanonical(ms->abc, ms->ax[apos])) ms->nres[apos*K + ms->ax[apos]]++;
+    }
+
+  if (ms->badseq == NULL)
+    {
+      apos = 1;
+      while (  esl_abc_XIsMissing(ms->abc, ms->ax[apos]) && apos <= ms->alen) apos++;
+      while (! esl_abc_XIsMissing(ms->abc, ms->ax[apos]) && apos <= ms->alen) apos++;
+      while (  esl_abc_XIsMissing(ms->abc, ms->ax[apos]) && apos <= ms->alen) apos++;
+      if (apos != ms->alen+1 && (status = esl_memstrdup(seqname, seqnamelen, &(ms->badseq))) != eslOK) return status;
+    }
+
+  ms->nseq++;
+  return eslOK;
+}
+/*------------------- end, internal functions -------------------*/
+
+
+
+/*****************************************************************
+ * 4. Unit tests.
+ *****************************************************************/
+#ifdef p7MSASTREAM_TESTDRIVE
+#include "esl_getopts.h"
+#include "esl_msafile.h"
+#include "esl_random.h"
+
+/* utest_builder()
+ * Write <nali> sampled alignments of <N> seqs each to a Pfam-format
+ * file, and check that the stream scans them the same as the
+ * Stockholm parser reads them, and that p7_BuilderStream() builds
+ * the same models as p7_Builder().
+ */
+static void
+utest_builder(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, int nali, int N, int M)
+{
+  char          *msg         = "p7_msastream.c:: builder unit test failed";
+  char           tmpfile[16] = "p7tmpXXXXXX";
+  FILE          *ofp         = NULL;
+  P7_HMM        *hmm         = NULL;
+  ESL_SQ       **sq          = malloc(sizeof(ESL_SQ *)   * N);
+  P7_TRACE     **tr          = malloc(sizeof(P7_TRACE *) * N);
+  P7_BG         *bg          = p7_bg_Create(abc);
+  P7_BUILDER    *bld1        = NULL;
+  P7_BUILDER    *bld2        = NULL;
+  ESLX_MSAFILE  *afp         = NULL;
+  P7_MSASTREAM  *ms          = NULL;
+  ESL_MSA       *msa         = NULL;
+  P7_HMM        *h1          = NULL;
+  P7_HMM        *h2          = NULL;
+  char           name[32];
+  uint32_t       checksum;
+  int            a, i;
+
+  if (esl_tmpfile_named(tmpfile, &ofp) != eslOK) esl_fatal(msg);
+  for (a = 0; a < nali; a++)
+    {
+      if (p7_hmm_Sample(r, M, abc, &hmm) != eslOK) esl_fatal(msg);
+      for (i = 0; i < N; i++)
+	{
+	  sq[i] = esl_sq_CreateDigital(abc);
+	  tr[i] = p7_trace_Create();
+	  if (p7_CoreEmit(r, hmm, sq[i], tr[i]) != eslOK) esl_fatal(msg);
+	  snprintf(name, 32, "seq%d", i+1);
+	  esl_sq_SetName(sq[i], name);
+	}
+      if (p7_tracealign_Seqs(sq, tr, N, M, p7_DEFAULT, NULL, &msa) != eslOK) esl_fatal(msg);
+      snprintf(name, 32, "ali%d", a+1);
+      esl_msa_SetName(msa, name, -1);
+      esl_msa_SetDesc(msa, "a sampled alignment", -1);
+      msa->cutoff[eslMSA_GA1] = 25.0; msa->cutset[eslMSA_GA1] = TRUE;
+      msa->cutoff[eslMSA_GA2] = 20.0; msa->cutset[eslMSA_GA2] = TRUE;
+      if (eslx_msafile_Write(ofp, msa, eslMSAFILE_PFAM) != eslOK) esl_fatal(msg);
+
+      for (i = 0; i < N; i++) { esl_sq_Destroy(sq[i]); p7_trace_Destroy(tr[i]); }
+      esl_msa_Destroy(msa);
+      p7_hmm_Destroy(hmm);
+    }
+  fclose(ofp);
+
+  if (eslx_msafile_Open(&abc, tmpfile, NULL, eslMSAFILE_UNKNOWN, NULL, &afp) != eslOK) esl_fatal(msg);
+  if (p7_msastream_Open(tmpfile, &abc, &ms, NULL)                            != eslOK) esl_fatal(msg);
+  for (a = 0; a < nali; a++)
+    {
+      if (eslx_msafile_Read(afp, &msa)        != eslOK) esl_fatal(msg);
+      if (p7_msastream_Next(ms)               != eslOK) esl_fatal(msg);
+      if (esl_msa_Checksum(msa, &checksum)    != eslOK) esl_fatal(msg);
+      if (ms->nseq != msa->nseq || ms->alen != msa->alen) esl_fatal(msg);
+      if (ms->checksum != checksum)                       esl_fatal(msg);
+      if (esl_strcmp(ms->hdr->name, msa->name) != 0)      esl_fatal(msg);
+      if (esl_strcmp(ms->hdr->desc, msa->desc) != 0)      esl_fatal(msg);
+      if (esl_strcmp(ms->hdr->rf,   msa->rf)   != 0)      esl_fatal(msg);
+
+      bld1 = p7_builder_Create(NULL, abc);
+      bld2 = p7_builder_Create(NULL, abc);
+      bld1->arch_strategy = bld2->arch_strategy = (a % 2 ? p7_ARCH_HAND : p7_ARCH_FAST);
+      if (p7_Builder      (bld1, msa, bg, &h1, NULL, NULL, NULL, NULL) != eslOK) esl_fatal(msg);
+      if (p7_BuilderStream(bld2, ms,  bg, &h2, NULL, NULL)             != eslOK) esl_fatal(msg);
+      free(h2->ctime);
+      esl_strdup(h1->ctime, -1, &(h2->ctime));
+      if (p7_hmm_Compare(h1, h2, 0.0001) != eslOK) esl_fatal(msg);
+
+      p7_hmm_Destroy(h1);
+      p7_hmm_Destroy(h2);
+      p7_builder_Destroy(bld1);
+      p7_builder_Destroy(bld2);
+      esl_msa_Destroy(msa);
+    }
+  if (eslx_msafile_Read(afp, &msa) != eslEOF) esl_fatal(msg);
+  if (p7_msastream_Next(ms)        != eslEOF) esl_fatal(msg);
+
+  p7_msastream_Close(ms);
+  eslx_msafile_Close(afp);
+  p7_bg_Destroy(bg);
+  free(sq);
+  free(tr);
+  remove(tmpfile);
+}
+
+/* utest_multiblock()
+ * An interleaved Stockholm alignment can't be streamed.
+ */
+static void
+utest_multiblock(ESL_ALPHABET *abc)
+{
+  char          *msg         = "p7_msastream.c:: multiblock unit test failed";
+  char           tmpfile[16] = "p7tmpXXXXXX";
+  FILE          *ofp         = NULL;
+  P7_MSASTREAM  *ms          = NULL;
+
+  if (esl_tmpfile_named(tmpfile, &ofp) != eslOK) esl_fatal(msg);
+  fprintf(ofp, "# STOCKHOLM 1.0\n");
+  fprintf(ofp, "#=GF ID test\n\n");
+  fprintf(ofp, "seq1    ACDEFGHIKL\n");
+  fprintf(ofp, "seq2    ACDEF-HIKL\n\n");
+  fprintf(ofp, "seq1    MNPQRSTVWY\n");
+  fprintf(ofp, "seq2    MNPQRSTVWY\n");
+  fprintf(ofp, "//\n");
+  fclose(ofp);
+
+  if (p7_msastream_Open(tmpfile, &abc, &ms, NULL) != eslOK)      esl_fatal(msg);
+  if (p7_msastream_Next(ms)                       != eslEFORMAT) esl_fatal(msg);
+  if (ms->linenumber != 7)                                       esl_fatal(msg);
+
+  p7_msastream_Close(ms);
+  remove(tmpfile);
+}
+#endif /*p7MSASTREAM_TESTDRIVE*/
+/*---------------------- end, unit tests ------------------------*/
+
+
+
+/*****************************************************************
+ * 5. Test driver.
+ *****************************************************************/
+#ifdef p7MSASTREAM_TESTDRIVE
+/*
+   gcc -o p7_msastream_utest -msse2 -g -Wall -I. -L. -I../easel -L../easel -Dp7MSASTREAM_TESTDRIVE p7_msastream.c -lhmmer -leasel -lm
+   ./p7_msastream_utest
+ */
+#include "p7_config.h"
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+
+#include "hmmer.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                  0 },
+  { "-M",        eslARG_INT,     "40", NULL, NULL,  NULL,  NULL, NULL, "length of sampled models",                       0 },
+  { "-N",        eslARG_INT,    "600", NULL, NULL,  NULL,  NULL, NULL, "number of sequences per alignment",              0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "unit test driver for p7_msastream.c streamed alignment input";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go   = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r    = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc  = esl_alphabet_Create(eslAMINO);
+  int             M    = esl_opt_GetInteger(go, "-M");
+  int             N    = esl_opt_GetInteger(go, "-N");
+
+  utest_builder(r, abc, 2, N, M);
+  utest_builder(r, abc, 1, 1, M);
+  utest_multiblock(abc);
+
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  exit(0); /* success */
+}
+#endif /*p7MSASTREAM_TESTDRIVE*/
+/*-------------------- end, test driver -------------------------*/
+
+
+/*****************************************************************
+ * HMMER - Biological sequence analysis with profile HMMs
+ * Version 3.1b2; February 2015
+ * Copyright (C) 2015 Howard Hughes Medical Institute.
+ * Other copyrights also apply. See the COPYRIGHT file for a full list.
+ *
+ * HMMER is distributed under the terms of the GNU General Public License
+ * (GPLv3). See the LICENSE file for details.
+ *****************************************************************/
@@ -106,6 +106,9 @@ p7_pipeline_Create(ESL_GETOPTS *go, int M_hint, int L_hint, int long_targets, en
 
   pli->do_alignment_score_calc = 0;
   pli->long_targets = long_targets;
+  pli->msv_windowlist.windows = pli->vit_windowlist.windows = NULL;
+  pli->msv_windowlist.count   = pli->vit_windowlist.count   = 0;
+  pli->msv_windowlist.size    = pli->vit_windowlist.size    = 0;
 
   if ((pli->fwd = p7_omx_Create(M_hint, L_hint, L_hint)) == NULL) goto ERROR;
   if ((pli->bck = p7_omx_Create(M_hint, L_hint, L_hint)) == NULL) goto ERROR;
@@ -122,6 +125,12 @@ p7_pipeline_Create(ESL_GETOPTS *go, int M_hint, int L_hint, int long_targets, en
   pli->ddef               = p7_domaindef_Create(pli->r);
   pli->ddef->do_reseeding = pli->do_reseeding;
 
+  /* Window lists are only used on long targets; they are reused from one target to the next */
+  if (long_targets) {
+    if (p7_hmmwindow_init(&(pli->msv_windowlist)) != eslOK) goto ERROR;
+    if (p7_hmmwindow_init(&(pli->vit_windowlist)) != eslOK) goto ERROR;
+  }
+
   /* Configure reporting thresholds */
   pli->by_E            = TRUE;
   pli->E               = (go ? esl_opt_GetReal(go, "-E") : 10.0);
@@ -244,6 +253,7 @@ p7_pipeline_Create(ESL_GETOPTS *go, int M_hint, int L_hint, int long_targets, en
   pli->pos_past_bias   = 0;
   pli->pos_past_vit    = 0;
   pli->pos_past_fwd    = 0;
+  pli->msvP            = 1.0;
   pli->mode            = mode;
   pli->show_accessions = (go && esl_opt_GetBoolean(go, "--acc")   ? TRUE  : FALSE);
   pli->show_alignments = (go && esl_opt_GetBoolean(go, "--noali") ? FALSE : TRUE);
@@ -297,6 +307,8 @@ p7_pipeline_Destroy(P7_PIPELINE *pli)
   p7_omx_Destroy(pli->bck);
   esl_randomness_Destroy(pli->r);
   p7_domaindef_Destroy(pli->ddef);
+  p7_hmmwindow_destroy(&(pli->msv_windowlist));
+  p7_hmmwindow_destroy(&(pli->vit_windowlist));
   free(pli);
 }
 /*---------------- end, P7_PIPELINE object ----------------------*/
@@ -315,7 +327,10 @@ p7_pipeline_Destroy(P7_PIPELINE *pli)
  *            value from <om> and the prefix and suffix lengths stored
  *            in <data>, then merges (in place) windows that overlap
  *            by more than <pct_overlap> percent, ensuring that windows
- *            stay within the bounds of 1..<L>.
+ *            stay within the bounds of 1..<L>. Merging is done by
+ *            p7_hmmwindow_merge(), so the resulting windows are sorted
+ *            by strand, sequence and position, whatever order the
+ *            diagonals arrived in.
  *
  * Returns:   <eslOK>
  */
@@ -323,13 +338,10 @@ int
 p7_pli_ExtendAndMergeWindows (P7_OPROFILE *om, const P7_SCOREDATA *data, P7_HMM_WINDOWLIST *windowlist, float pct_overlap) {
 
   int i;
-  P7_HMM_WINDOW        *prev_window = NULL;
   P7_HMM_WINDOW        *curr_window = NULL;
   int64_t              window_start;
   int64_t              window_end;
-  int32_t              window_len;
   int64_t              tmp;
-  int                  new_hit_cnt = 0;
 
   if (windowlist->count == 0)
     return eslOK;
@@ -366,32 +378,7 @@ p7_pli_ExtendAndMergeWindows (P7_OPROFILE *om, const P7_SCOREDATA *data, P7_HMM_
 
 
   /* merge overlapping windows, compressing list in place. */
-  for (i=1; i<windowlist->count; i++) {
-    prev_window = windowlist->windows+new_hit_cnt;
-    curr_window = windowlist->windows+i;
-
-    window_start = ESL_MAX(prev_window->n, curr_window->n);
-    window_end   = ESL_MIN(prev_window->n+prev_window->length-1, curr_window->n+curr_window->length-1);
-    window_len   = window_end - window_start + 1;
-
-    if (  prev_window->complementarity == curr_window->complementarity &&
-          prev_window->id == curr_window->id &&
-          (float)(window_len)/ESL_MIN(prev_window->length, curr_window->length) > pct_overlap // &&
-          //curr_window->n + curr_window->length >=  prev_window->n + prev_window->length
-          )
-    {
-      //merge windows
-      window_start        = ESL_MIN(prev_window->n, curr_window->n);
-      window_end          = ESL_MAX(prev_window->n+prev_window->length-1, curr_window->n+curr_window->length-1);
-      prev_window->fm_n  -= (prev_window->n - window_start);
-      prev_window->n      = window_start;
-      prev_window->length = window_end - window_start + 1;
-    } else {
-      new_hit_cnt++;
-      windowlist->windows[new_hit_cnt] = windowlist->windows[i];
-    }
-  }
-  windowlist->count = new_hit_cnt+1;
+  p7_hmmwindow_merge(windowlist, pct_overlap);
 
   return eslOK;
 }
@@ -679,6 +666,7 @@ p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, P7_T
   int              d;
   int              status;
   
+  pli->msvP = 1.0;
   if (sq->n == 0) return eslOK;    /* silently skip length 0 seqs; they'd cause us all sorts of weird problems */
 
   p7_omx_GrowTo(pli->oxf, om->M, 0, sq->n);    /* expand the one-row omx if needed */
@@ -690,6 +678,7 @@ p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, P7_T
   p7_MSVFilter(sq->dsq, sq->n, om, pli->oxf, &usc);
   seq_score = (usc - nullsc) / eslCONST_LOG2;
   P = esl_gumbel_surv(seq_score,  om->evparam[p7_MMU],  om->evparam[p7_MLAMBDA]);
+  pli->msvP = P;
   if (P > pli->F1) return eslOK;
   pli->n_past_msv++;
 
@@ -803,6 +792,12 @@ p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, P7_T
   lnP =  esl_exp_logsurv (seq_score,  om->evparam[p7_FTAU], om->evparam[p7_FLAMBDA]);
   if (p7_pli_TargetReportable(pli, seq_score, lnP))
     {
+      /* A bounded hit list may already hold enough better hits;
+       * then this target is only counted, for domZ.
+       */
+      if (! p7_tophits_Admits(hitlist, pli->inc_by_E ? -lnP : seq_score))
+        return p7_tophits_Prune(hitlist, seq_score, lnP);
+
       p7_tophits_CreateNextHit(hitlist, &hit);
       if (pli->mode == p7_SEARCH_SEQS) {
         if (                       (status  = esl_strdup(sq->name, -1, &(hit->name)))  != eslOK) ESL_EXCEPTION(eslEMEM, "allocation failure");
@@ -1406,70 +1401,18 @@ p7_pli_postSSV_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, P7_TOPHI
 
 
 
-/* Function:  p7_Pipeline_LongTarget()
- * Synopsis:  Accelerated seq/profile comparison pipeline for long target sequences.
- *
- * Purpose:   Run HMMER's accelerated pipeline to compare profile <om>
- *            against sequence <sq>. If a significant hit is found,
- *            information about it is added to the <hitlist>. This is
- *            a variant of p7_Pipeline that runs one of two
- *            alternative SSV filters
- *              (1) the scanning SSV filter (p7_SSVFilter_longtarget) that scans
- *              a long sequence and finds high-scoring regions (windows), or
- *              (2) the FM-index-based SSV filter that finds modest-scoring
- *              diagonals using the FM-index, and extends them to maximum-
- *              scoring diagonals subjected to the SSV filter thresholds
- *
- *            Windows passing the appropriate SSV filter are then passed
- *            to the remainder of the pipeline. The pipeline accumulates
- *            bean counting information about how many comparisons and
- *            residues flow through the pipeline while it's active.
- *
- * Returns:   <eslOK> on success. If a significant hit is obtained,
- *            its information is added to the growing <hitlist>.
- *
- *            <eslEINVAL> if (in a scan pipeline) we're supposed to
- *            set GA/TC/NC bit score thresholds but the model doesn't
- *            have any.
- *
- *            <eslERANGE> on numerical overflow errors in the
- *            optimized vector implementations; particularly in
- *            posterior decoding. We don't believe this is possible for
- *            multihit local models, but we're set up to catch it
- *            anyway. We may emit a warning to the user, but cleanly
- *            skip the problematic sequence and continue.
- *
- * Args:      pli             - the main pipeline object
- *            om              - optimized profile (query)
- *            data            - for computing diagonals, and picking window edges based
- *                              on maximum prefix/suffix extensions
- *            bg              - background model
- *            hitlist         - pointer to hit storage bin (already allocated)
- *
- *            :: the next three values are assigned if a standard sequence database is being used. If FM database is used, they are ignored
- *            seqidx          - the id # of the sequence from which the current window was extracted
- *            sq              - digital sequence of the window
- *            complementarity - is <sq> from the top strand (p7_NOCOMPLEMENT), or bottom strand (P7_COMPLEMENT)
- *
- *            :: the next three are assigned if an FM database is being used. If standard sequence is used, they are set to NULL.
- *            fmf             - the FM_DATA for forward-strand search
- *            fmb             - the FM_DATA for reverse-strand (complement) search
- *            fm_cfg          - general FM configuration
- *
- * Throws:    <eslEMEM> on allocation failure.
+/* pipeline_longtarget()
+ * Shared body of p7_Pipeline_LongTarget() and p7_Pipeline_LongTargetRevComp().
+ * If <scan_revcomp> is TRUE, <sq> is a top-strand window and the bottom
+ * strand is searched without reverse complementing <sq> as a whole.
  */
-int
-p7_Pipeline_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
-                        P7_BG *bg, P7_TOPHITS *hitlist,
-                        int64_t seqidx, const ESL_SQ *sq, int complementarity,
-                        const FM_DATA *fmf, const FM_DATA *fmb, FM_CFG *fm_cfg
-                        /*, ESL_STOPWATCH *ssv_watch_master
-                        , ESL_STOPWATCH *postssv_watch_master
-                        , ESL_STOPWATCH *watch_slave
-*/
-                        )
+static int
+pipeline_longtarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
+                    P7_BG *bg, P7_TOPHITS *hitlist,
+                    int64_t seqidx, const ESL_SQ *sq, int complementarity, int scan_revcomp,
+                    const FM_DATA *fmf, const FM_DATA *fmb, FM_CFG *fm_cfg)
 {
-  int              i;
+  int              i, j;
   int              status;
   float            nullsc;   /* null model score                        */
   float            usc;      /* msv score  */
@@ -1480,15 +1423,18 @@ p7_Pipeline_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
   uint64_t         seq_start;
 
 
-  P7_HMM_WINDOWLIST msv_windowlist;
-  P7_HMM_WINDOWLIST vit_windowlist;
+  P7_HMM_WINDOWLIST *msv_windowlist = &(pli->msv_windowlist);
+  P7_HMM_WINDOWLIST *vit_windowlist = &(pli->vit_windowlist);
   P7_HMM_WINDOW    *window;
   FM_SEQDATA        seq_data;
 
-  P7_PIPELINE_LONGTARGET_OBJS *pli_tmp;
+  P7_PIPELINE_LONGTARGET_OBJS *pli_tmp = NULL;
 
   if ((sq && (sq->n == 0)) || (fmf && (fmf->N == 0))) return eslOK;    /* silently skip length 0 seqs; they'd cause us all sorts of weird problems */
 
+  if (msv_windowlist->windows == NULL && (status = p7_hmmwindow_init(msv_windowlist)) != eslOK) goto ERROR;
+  if (vit_windowlist->windows == NULL && (status = p7_hmmwindow_init(vit_windowlist)) != eslOK) goto ERROR;
+  p7_hmmwindow_reuse(msv_windowlist);
 
   ESL_ALLOC(pli_tmp, sizeof(P7_PIPELINE_LONGTARGET_OBJS));
   pli_tmp->bg = p7_bg_Clone(bg);
@@ -1496,10 +1442,6 @@ p7_Pipeline_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
   ESL_ALLOC(pli_tmp->scores, sizeof(float) * om->abc->Kp * 4); //allocation of space to store scores that will be used in p7_oprofile_Update(Fwd|Vit|MSV)EmissionScores
   ESL_ALLOC(pli_tmp->fwd_emissions_arr, sizeof(float) *  om->abc->Kp * (om->M+1));
 
-  msv_windowlist.windows = NULL;
-  vit_windowlist.windows = NULL;
-  p7_hmmwindow_init(&msv_windowlist);
-
   p7_omx_GrowTo(pli->oxf, om->M, 0, om->max_length);    /* expand the one-row omx if needed */
 
   /* Set false target length. This is a conservative estimate of the length of window that'll
@@ -1518,9 +1460,9 @@ p7_Pipeline_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
 
 
   if (fmf) // using an FM-index
-    p7_SSVFM_longlarget(om, 2.0, bg, pli->F1, fmf, fmb, fm_cfg, data, pli->strands, &msv_windowlist );
+    p7_SSVFM_longlarget(om, 2.0, bg, pli->F1, fmf, fmb, fm_cfg, data, pli->strands, msv_windowlist );
   else // compare directly to sequence
-    p7_SSVFilter_longtarget(sq->dsq, sq->n, om, pli->oxf, data, bg, pli->F1, &msv_windowlist);
+    p7_SSVFilter_longtarget(sq->dsq, sq->n, (scan_revcomp ? p7_COMPLEMENT : p7_NOCOMPLEMENT), om, pli->oxf, data, bg, pli->F1, msv_windowlist);
 /*  if (watch_slave) {
     esl_stopwatch_Stop(watch_slave);
     esl_stopwatch_Include(ssv_watch_master, watch_slave);
@@ -1530,7 +1472,7 @@ p7_Pipeline_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
 
   /* convert hits to windows, merging neighboring windows
    */
-  if ( msv_windowlist.count > 0 ) {
+  if ( msv_windowlist->count > 0 ) {
 
     /* In scan mode, if it passes the MSV filter, read the rest of the profile
      * Not necessary for dummy mode, where the ->base_w variable checks cause compilation failure*/
@@ -1549,16 +1491,16 @@ p7_Pipeline_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
     if (data->prefix_lengths == NULL)  //otherwise, already filled in
       p7_hmm_ScoreDataComputeRest(om, data);
 
-    p7_pli_ExtendAndMergeWindows (om, data, &msv_windowlist, 0);
+    p7_pli_ExtendAndMergeWindows (om, data, msv_windowlist, 0);
 
     /*  If using FM, it's possible for a seed we just created to span more than one segment
      *  in the target. Check for this, and resolve it, by trimming an over-extended
      *  segment, and tacking it on as a new window (to be dealt with in a later pass)
      */
     if (fmf) {
-      for (i=0; i<msv_windowlist.count; i++) {
+      for (i=0; i<msv_windowlist->count; i++) {
         int again = TRUE;
-        window = msv_windowlist.windows + i;
+        window = msv_windowlist->windows + i;
 
         while (again) {
           uint32_t seg_id;
@@ -1577,8 +1519,8 @@ p7_Pipeline_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
             use_length = window->length - overext + 1;
 
             if (use_length >= 8 && window->length >= 8) { // if both halves are kinda long, split the first half off as a new window
-              p7_hmmwindow_new(&msv_windowlist, seg_id + (is_compl?-1:1), window->n, window->fm_n, window->k+use_length-1, use_length, window->score, window->complementarity, fm_cfg->meta->seq_data[seg_id].length);
-              window = msv_windowlist.windows + i; // it may have moved due a a realloc
+              p7_hmmwindow_new(msv_windowlist, seg_id + (is_compl?-1:1), window->n, window->fm_n, window->k+use_length-1, use_length, window->score, window->complementarity, fm_cfg->meta->seq_data[seg_id].length);
+              window = msv_windowlist->windows + i; // it may have moved due a a realloc
               window->k      +=  use_length;
               window->length  =  overext;
               again         = TRUE;
@@ -1595,18 +1537,25 @@ p7_Pipeline_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
     }
 
   /* Pass each remaining window on to the remaining pipeline */
-    p7_hmmwindow_init(&vit_windowlist);
     pli_tmp->tmpseq = esl_sq_CreateDigital(om->abc);
-    if (!fmf )
+    if (!fmf && !scan_revcomp)
       free (pli_tmp->tmpseq->dsq);  //this ESL_SQ object is just a container that'll point to a series of other DSQs, so free the one we just created inside the larger SQ object
 
 
-    for (i=0; i<msv_windowlist.count; i++){
-      window =  msv_windowlist.windows + i ;
+    for (i=0; i<msv_windowlist->count; i++){
+      window =  msv_windowlist->windows + i ;
 
       if (fmf) {
         fm_convertRange2DSQ( fmf, fm_cfg->meta, window->fm_n, window->length, window->complementarity, pli_tmp->tmpseq, TRUE );
         subseq = pli_tmp->tmpseq->dsq;
+      } else if (scan_revcomp) {
+        /* only windows that survived SSV are materialized on the bottom strand;
+         * bottom-strand position b is the complement of top-strand position L-b+1 */
+        if (esl_sq_GrowTo(pli_tmp->tmpseq, window->length) != eslOK) { status = eslEMEM; goto ERROR; }
+        subseq = pli_tmp->tmpseq->dsq;
+        for (j = 1; j <= window->length; j++)
+          subseq[j] = om->abc->complement[sq->dsq[sq->n - (window->n + j - 1) + 1]];
+        subseq[0] = subseq[window->length+1] = eslDSQ_SENTINEL;
       } else {
         subseq = sq->dsq + window->n - 1;
       }
@@ -1634,7 +1583,7 @@ p7_Pipeline_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
       status = p7_pli_postSSV_LongTarget(pli, om, bg, hitlist, data,
             (fmf != NULL ? seq_data.target_id     : seqidx),
             window->n, window->length, subseq,
-            (fmf != NULL ? seq_start       : sq->start),
+            (fmf != NULL ? seq_start       : (scan_revcomp ? sq->end : sq->start)),
             (fmf != NULL ? seq_data.name   : sq->name),
             (fmf != NULL ? seq_data.source : sq->source),
             (fmf != NULL ? seq_data.acc    : sq->acc),
@@ -1643,19 +1592,18 @@ p7_Pipeline_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
             nullsc,
             usc,
             (fmf != NULL ? window->complementarity : complementarity),
-            &vit_windowlist,
+            vit_windowlist,
             pli_tmp
         );
         if (status != eslOK) goto ERROR;
 
     }
 
-    if (fmf)  free (pli_tmp->tmpseq->dsq);
+    if (fmf || scan_revcomp)  free (pli_tmp->tmpseq->dsq);
 
     pli_tmp->tmpseq->dsq = NULL;  //it's a pointer to a dsq object belonging to another sequence
 
     esl_sq_Destroy(pli_tmp->tmpseq);
-    free (vit_windowlist.windows);
   }
 
 /*
@@ -1664,8 +1612,6 @@ p7_Pipeline_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
     esl_stopwatch_Include(postssv_watch_master, watch_slave);
   }
 */
-  if (msv_windowlist.windows != NULL) free (msv_windowlist.windows);
-
   if (pli_tmp != NULL) {
     if (pli_tmp->bg != NULL)     p7_bg_Destroy(pli_tmp->bg);
     if (pli_tmp->om != NULL)     p7_oprofile_Destroy(pli_tmp->om);
@@ -1677,9 +1623,6 @@ p7_Pipeline_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
   return eslOK;
 
 ERROR:
-  if (msv_windowlist.windows != NULL) free (msv_windowlist.windows);
-  if (vit_windowlist.windows != NULL) free (vit_windowlist.windows);
-
   if (pli_tmp != NULL) {
     if (pli_tmp->tmpseq != NULL) esl_sq_Destroy(pli_tmp->tmpseq);
     if (pli_tmp->bg != NULL)     p7_bg_Destroy(pli_tmp->bg);
@@ -1694,6 +1637,102 @@ ERROR:
 }
 
 
+/* Function:  p7_Pipeline_LongTarget()
+ * Synopsis:  Accelerated seq/profile comparison pipeline for long target sequences.
+ *
+ * Purpose:   Run HMMER's accelerated pipeline to compare profile <om>
+ *            against sequence <sq>. If a significant hit is found,
+ *            information about it is added to the <hitlist>. This is
+ *            a variant of p7_Pipeline that runs one of two
+ *            alternative SSV filters
+ *              (1) the scanning SSV filter (p7_SSVFilter_longtarget) that scans
+ *              a long sequence and finds high-scoring regions (windows), or
+ *              (2) the FM-index-based SSV filter that finds modest-scoring
+ *              diagonals using the FM-index, and extends them to maximum-
+ *              scoring diagonals subjected to the SSV filter thresholds
+ *
+ *            Windows passing the appropriate SSV filter are then passed
+ *            to the remainder of the pipeline. The pipeline accumulates
+ *            bean counting information about how many comparisons and
+ *            residues flow through the pipeline while it's active.
+ *
+ * Returns:   <eslOK> on success. If a significant hit is obtained,
+ *            its information is added to the growing <hitlist>.
+ *
+ *            <eslEINVAL> if (in a scan pipeline) we're supposed to
+ *            set GA/TC/NC bit score thresholds but the model doesn't
+ *            have any.
+ *
+ *            <eslERANGE> on numerical overflow errors in the
+ *            optimized vector implementations; particularly in
+ *            posterior decoding. We don't believe this is possible for
+ *            multihit local models, but we're set up to catch it
+ *            anyway. We may emit a warning to the user, but cleanly
+ *            skip the problematic sequence and continue.
+ *
+ * Args:      pli             - the main pipeline object
+ *            om              - optimized profile (query)
+ *            data            - for computing diagonals, and picking window edges based
+ *                              on maximum prefix/suffix extensions
+ *            bg              - background model
+ *            hitlist         - pointer to hit storage bin (already allocated)
+ *
+ *            :: the next three values are assigned if a standard sequence database is being used. If FM database is used, they are ignored
+ *            seqidx          - the id # of the sequence from which the current window was extracted
+ *            sq              - digital sequence of the window
+ *            complementarity - is <sq> from the top strand (p7_NOCOMPLEMENT), or bottom strand (P7_COMPLEMENT)
+ *
+ *            :: the next three are assigned if an FM database is being used. If standard sequence is used, they are set to NULL.
+ *            fmf             - the FM_DATA for forward-strand search
+ *            fmb             - the FM_DATA for reverse-strand (complement) search
+ *            fm_cfg          - general FM configuration
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_Pipeline_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
+                        P7_BG *bg, P7_TOPHITS *hitlist,
+                        int64_t seqidx, const ESL_SQ *sq, int complementarity,
+                        const FM_DATA *fmf, const FM_DATA *fmb, FM_CFG *fm_cfg
+                        /*, ESL_STOPWATCH *ssv_watch_master
+                        , ESL_STOPWATCH *postssv_watch_master
+                        , ESL_STOPWATCH *watch_slave
+*/
+                        )
+{
+  return pipeline_longtarget(pli, om, data, bg, hitlist, seqidx, sq, complementarity, FALSE, fmf, fmb, fm_cfg);
+}
+
+
+/* Function:  p7_Pipeline_LongTargetRevComp()
+ * Synopsis:  Long target pipeline over the bottom strand of a top-strand sequence.
+ *
+ * Purpose:   Same as <p7_Pipeline_LongTarget()> for a standard
+ *            (non-FM) sequence database with <complementarity> set
+ *            to <p7_COMPLEMENT>, except that <sq> is the top strand
+ *            window as read from the database, not its reverse
+ *            complement. The SSV filter scans the bottom strand
+ *            directly from <sq->dsq>, and only the windows that pass
+ *            it are reverse complemented for the rest of the pipeline,
+ *            so the caller doesn't need to copy and reverse complement
+ *            each window. <sq> is not modified.
+ *
+ *            Hits are identical to those obtained by passing a reverse
+ *            complemented copy of <sq> to <p7_Pipeline_LongTarget()>.
+ *
+ * Returns:   <eslOK> on success. If a significant hit is obtained,
+ *            its information is added to the growing <hitlist>.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_Pipeline_LongTargetRevComp(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
+                              P7_BG *bg, P7_TOPHITS *hitlist, int64_t seqidx, const ESL_SQ *sq)
+{
+  return pipeline_longtarget(pli, om, data, bg, hitlist, seqidx, sq, p7_COMPLEMENT, TRUE, NULL, NULL, NULL);
+}
+
+
 /* Function:  p7_pli_Statistics()
  * Synopsis:  Final statistics output from a processing pipeline.
  *
@@ -4,19 +4,23 @@
  *    1. The P7_TOPHITS object.
  *    2. Standard (human-readable) output of pipeline results.
  *    3. Tabular (parsable) output of pipeline results.
- *    4. Benchmark driver.
- *    5. Test driver.
- *    6. Copyright and license information.
+ *    4. Binary save and restore of hit lists.
+ *    5. Benchmark driver.
+ *    6. Test driver.
+ *    7. Copyright and license information.
  */
 #include "p7_config.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <math.h>
 
 #include "easel.h"
 #include "hmmer.h"
 
+static int hit_sorter_by_sortkey(const void *vh1, const void *vh2);
+
 /*****************************************************************
  *= 1. The P7_TOPHITS object
  *****************************************************************/
@@ -37,8 +41,10 @@ p7_tophits_Create(void)
   int         status;
 
   ESL_ALLOC(h, sizeof(P7_TOPHITS));
-  h->hit    = NULL;
-  h->unsrt  = NULL;
+  h->hit        = NULL;
+  h->unsrt      = NULL;
+  h->pruned_sc  = NULL;
+  h->pruned_lnP = NULL;
 
   ESL_ALLOC(h->hit,   sizeof(P7_HIT *) * default_nalloc);
   ESL_ALLOC(h->unsrt, sizeof(P7_HIT)   * default_nalloc);
@@ -49,6 +55,10 @@ p7_tophits_Create(void)
   h->is_sorted_by_sortkey = TRUE; /* but only because there's 0 hits */
   h->is_sorted_by_seqidx  = FALSE;
   h->hit[0]    = h->unsrt;        /* if you're going to call it "sorted" when it contains just one hit, you need this */
+  h->maxhits       = 0;           /* unbounded, unless caller sets it */
+  h->minkey        = -eslINFINITY;
+  h->npruned       = 0;
+  h->npruned_alloc = 0;
   return h;
 
  ERROR:
@@ -99,6 +109,98 @@ p7_tophits_Grow(P7_TOPHITS *h)
 }
 
 
+/* pruned_grow()
+ * Make room for <n> more pruned targets in <h>.
+ */
+static int
+pruned_grow(P7_TOPHITS *h, uint64_t n)
+{
+  void    *p;
+  uint64_t nalloc;
+  int      status;
+
+  if (h->npruned + n <= h->npruned_alloc) return eslOK;
+  nalloc = ESL_MAX(2 * h->npruned_alloc, h->npruned + n);
+  nalloc = ESL_MAX(nalloc, 256);
+  ESL_RALLOC(h->pruned_sc,  p, sizeof(float)  * nalloc);
+  ESL_RALLOC(h->pruned_lnP, p, sizeof(double) * nalloc);
+  h->npruned_alloc = nalloc;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* hit_free()
+ * Free the memory a hit owns (but not the hit itself).
+ */
+static void
+hit_free(P7_HIT *hit)
+{
+  int d;
+
+  if (hit->name != NULL) free(hit->name);
+  if (hit->acc  != NULL) free(hit->acc);
+  if (hit->desc != NULL) free(hit->desc);
+  if (hit->dcl  != NULL) {
+    for (d = 0; d < hit->ndom; d++) {
+      if (hit->dcl[d].ad             != NULL) p7_alidisplay_Destroy(hit->dcl[d].ad);
+      if (hit->dcl[d].scores_per_pos != NULL) free(hit->dcl[d].scores_per_pos);
+    }
+    free(hit->dcl);
+  }
+}
+
+/* tophits_bound()
+ * If <h> is a bounded list holding more than <h->maxhits> hits,
+ * keep only the <h->maxhits> best by sortkey, free the rest and
+ * record their scores in the pruned list. Leaves <h> sorted by
+ * sortkey, and raises <h->minkey> to the worst sortkey kept:
+ * nothing below that can make it back into the list.
+ */
+static int
+tophits_bound(P7_TOPHITS *h)
+{
+  P7_HIT  *kept = NULL;
+  uint64_t i;
+  int      status;
+
+  if (h->maxhits == 0 || h->N <= h->maxhits) return eslOK;
+
+  if (! h->is_sorted_by_sortkey)
+    {
+      for (i = 0; i < h->N; i++) h->hit[i] = h->unsrt + i;
+      qsort(h->hit, h->N, sizeof(P7_HIT *), hit_sorter_by_sortkey);
+    }
+
+  /* allocate first, so we fail with <h> unchanged */
+  ESL_ALLOC(kept, sizeof(P7_HIT) * h->maxhits);
+  if ((status = pruned_grow(h, h->N - h->maxhits)) != eslOK) goto ERROR;
+
+  for (i = 0; i < h->maxhits; i++) kept[i] = *(h->hit[i]);
+  for (i = h->maxhits; i < h->N; i++)
+    {
+      h->pruned_sc [h->npruned] = h->hit[i]->score;
+      h->pruned_lnP[h->npruned] = h->hit[i]->lnP;
+      h->npruned++;
+      hit_free(h->hit[i]);
+    }
+  memcpy(h->unsrt, kept, sizeof(P7_HIT) * h->maxhits);
+  for (i = 0; i < h->maxhits; i++) h->hit[i] = h->unsrt + i;
+
+  h->N                    = h->maxhits;
+  h->minkey               = h->hit[h->N-1]->sortkey;
+  h->is_sorted_by_seqidx  = FALSE;
+  h->is_sorted_by_sortkey = TRUE;
+  free(kept);
+  return eslOK;
+
+ ERROR:
+  if (kept != NULL) free(kept);
+  return status;
+}
+
+
 /* Function:  p7_tophits_CreateNextHit()
  * Synopsis:  Get pointer to new structure for recording a hit.
  *
@@ -118,6 +220,10 @@ p7_tophits_CreateNextHit(P7_TOPHITS *h, P7_HIT **ret_hit)
   P7_HIT *hit = NULL;
   int     status;
 
+  /* A bounded list is cut back to its <maxhits> best when it reaches
+   * twice that; the hits already in it are complete by now.
+   */
+  if (h->maxhits && h->N >= 2 * h->maxhits && (status = tophits_bound(h)) != eslOK) goto ERROR;
   if ((status = p7_tophits_Grow(h)) != eslOK) goto ERROR;
   
   hit = &(h->unsrt[h->N]);
@@ -164,6 +270,54 @@ p7_tophits_CreateNextHit(P7_TOPHITS *h, P7_HIT **ret_hit)
 }
 
 
+/* Function:  p7_tophits_Admits()
+ * Synopsis:  Test whether a hit can enter a bounded hit list.
+ *
+ * Purpose:   Returns <TRUE> if a hit with sort key <sortkey> could
+ *            still be among the <h->maxhits> best hits of a bounded
+ *            list <h>; <FALSE> if it certainly can't, because
+ *            <h->maxhits> better hits are already known. Always
+ *            <TRUE> for an unbounded list (<h->maxhits> = 0).
+ *
+ *            A caller that gets <FALSE> doesn't need to build the
+ *            hit, but it should record the target's score with
+ *            <p7_tophits_Prune()>, so <domZ> still counts it.
+ */
+int
+p7_tophits_Admits(const P7_TOPHITS *h, double sortkey)
+{
+  return (h->maxhits == 0 || sortkey >= h->minkey);
+}
+
+
+/* Function:  p7_tophits_Prune()
+ * Synopsis:  Record a target left out of a bounded hit list.
+ *
+ * Purpose:   Record the per-sequence bit score <score> and log
+ *            P-value <lnP> of a reportable target that was not
+ *            added to a bounded hit list <h>. It is not shown in
+ *            any output, but <p7_tophits_Threshold()> counts it if
+ *            it is reportable, so the domain search space <domZ>
+ *            (and thence domain E-values) is the same as for an
+ *            unbounded search.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_tophits_Prune(P7_TOPHITS *h, float score, double lnP)
+{
+  int status;
+
+  if ((status = pruned_grow(h, 1)) != eslOK) return status;
+  h->pruned_sc [h->npruned] = score;
+  h->pruned_lnP[h->npruned] = lnP;
+  h->npruned++;
+  return eslOK;
+}
+
+
 
 /* Function:  p7_tophits_Add()
  * Synopsis:  Add a hit to the top hits list.
@@ -320,13 +474,20 @@ hit_sorter_by_modelname_aliposition(const void *vh1, const void *vh2)
  *            <h->hit[i]> points to the i'th ranked 
  *            <P7_HIT> for all <h->N> hits.
  *
+ *            A bounded list (<h->maxhits> > 0) is also cut back
+ *            to its <h->maxhits> best hits.
+ *
  * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure, when cutting back
+ *            a bounded list.
  */
 int
 p7_tophits_SortBySortkey(P7_TOPHITS *h)
 {
   int i;
 
+  if (h->maxhits && h->N > h->maxhits) return tophits_bound(h);
   if (h->is_sorted_by_sortkey)  return eslOK;
   for (i = 0; i < h->N; i++) h->hit[i] = h->unsrt + i;
   if (h->N > 1)  qsort(h->hit, h->N, sizeof(P7_HIT *), hit_sorter_by_sortkey);
@@ -391,6 +552,10 @@ p7_tophits_SortByModelnameAndAlipos(P7_TOPHITS *h)
  *            is effectively destroyed; caller should
  *            not access it further, and may as well free
  *            it immediately.
+ *            
+ *            If <h1> is bounded, the merged list may hold up to
+ *            <h1->N + h2->N> hits until the next sort cuts it
+ *            back; targets pruned from <h2> are carried over.
  *
  * Returns:   <eslOK> on success.
  *
@@ -412,6 +577,15 @@ p7_tophits_Merge(P7_TOPHITS *h1, P7_TOPHITS *h2)
   if ((status = p7_tophits_SortBySortkey(h1)) != eslOK) goto ERROR;
   if ((status = p7_tophits_SortBySortkey(h2)) != eslOK) goto ERROR;
 
+  /* h1 takes over h2's pruned targets, if either list is bounded */
+  if ((status = pruned_grow(h1, h2->npruned)) != eslOK) goto ERROR;
+  if (h2->npruned) {
+    memcpy(h1->pruned_sc  + h1->npruned, h2->pruned_sc,  sizeof(float)  * h2->npruned);
+    memcpy(h1->pruned_lnP + h1->npruned, h2->pruned_lnP, sizeof(double) * h2->npruned);
+    h1->npruned += h2->npruned;
+    h2->npruned  = 0;
+  }
+
   /* Attempt our allocations, so we fail early if we fail. 
    * Reallocating h1->unsrt screws up h1->hit, so fix it.
    */
@@ -453,6 +627,153 @@ p7_tophits_Merge(P7_TOPHITS *h1, P7_TOPHITS *h2)
   return status;
 }
 
+/* merge_precedes()
+ * For p7_tophits_MergeAll()'s heap: TRUE if the next hit of list
+ * <a> ranks before the next hit of list <b>. Ties go to the
+ * earlier list, as they do in a series of p7_tophits_Merge()
+ * calls, where the absorbing list is always the earlier one.
+ */
+static int
+merge_precedes(P7_TOPHITS **hv, uint64_t *pos, int a, int b)
+{
+  if (a < b) return (hit_sorter_by_sortkey(&(hv[a]->hit[pos[a]]), &(hv[b]->hit[pos[b]])) <= 0);
+  else       return (hit_sorter_by_sortkey(&(hv[b]->hit[pos[b]]), &(hv[a]->hit[pos[a]])) >  0);
+}
+
+/* Function:  p7_tophits_MergeAll()
+ * Synopsis:  Merge several top hits lists at once.
+ *
+ * Purpose:   Merge the <nh> lists <hv[0..nh-1]> into <h1>, for
+ *            example the per-thread lists of one query. Upon
+ *            return, <h1> contains the sorted, merged list, in the
+ *            same order that merging the lists one at a time with
+ *            <p7_tophits_Merge()> would give. The <hv> lists are
+ *            effectively destroyed, as in <p7_tophits_Merge()>.
+ *
+ *            Unlike a series of <p7_tophits_Merge()> calls, <h1>
+ *            is grown and each hit is copied only once, and the
+ *            lists are merged in a single pass. Lists that are
+ *            already sorted aren't sorted again, so callers can
+ *            have their threads sort their own lists in parallel
+ *            before the merge.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure, and
+ *            all the lists remain valid.
+ */
+int
+p7_tophits_MergeAll(P7_TOPHITS *h1, P7_TOPHITS **hv, int nh)
+{
+  void       *p;
+  P7_TOPHITS **lv      = NULL;	/* lv[0] = h1, lv[1..nh] = hv[0..nh-1] */
+  P7_HIT    **new_hit  = NULL;
+  uint64_t   *pos      = NULL;	/* pos[t]: next hit to take from list t  */
+  uint64_t   *off      = NULL;	/* off[t]: list t's data start here in h1->unsrt */
+  int        *heap     = NULL;	/* binary heap of lists, by their next hit       */
+  P7_HIT     *ori1     = h1->unsrt;
+  uint64_t    N, npruned, i, k;
+  int         nheap, t, c, j;
+  int         status;
+
+  if (nh == 0) return eslOK;
+
+  ESL_ALLOC(lv,   sizeof(P7_TOPHITS *) * (nh+1));
+  ESL_ALLOC(pos,  sizeof(uint64_t)     * (nh+1));
+  ESL_ALLOC(off,  sizeof(uint64_t)     * (nh+1));
+  ESL_ALLOC(heap, sizeof(int)          * (nh+1));
+  lv[0] = h1;
+  for (t = 0; t < nh; t++) lv[t+1] = hv[t];
+
+  /* Make sure all the lists are sorted (a no-op for presorted ones) */
+  for (t = 0; t <= nh; t++)
+    if ((status = p7_tophits_SortBySortkey(lv[t])) != eslOK) goto ERROR;
+
+  for (N = 0, npruned = 0, t = 0; t <= nh; t++) {
+    off[t]   = N;
+    N       += lv[t]->N;
+    npruned += lv[t]->npruned;
+  }
+
+  /* Attempt our allocations, so we fail early if we fail. 
+   * Reallocating h1->unsrt screws up h1->hit, so fix it.
+   */
+  if ((status = pruned_grow(h1, npruned - h1->npruned)) != eslOK) goto ERROR;
+  if (N > h1->Nalloc) {
+    ESL_RALLOC(h1->unsrt, p, sizeof(P7_HIT) * N);
+    h1->Nalloc = N;
+    for (i = 0; i < h1->N; i++)
+      h1->hit[i] = h1->unsrt + (h1->hit[i] - ori1);
+  }
+  ESL_ALLOC(new_hit, sizeof(P7_HIT *) * h1->Nalloc);   /* as many slots as unsrt: Grow() relies on it */
+
+  /* Append the other lists' unsorted data arrays to h1 */
+  for (t = 1; t <= nh; t++)
+    memcpy(h1->unsrt + off[t], lv[t]->unsrt, sizeof(P7_HIT) * lv[t]->N);
+
+  /* k-way merge of the sorted hit lists, taking the best next hit from a heap of lists */
+  for (nheap = 0, t = 0; t <= nh; t++)
+    {
+      pos[t] = 0;
+      if (lv[t]->N == 0) continue;
+      for (c = nheap++; c > 0 && merge_precedes(lv, pos, t, heap[(c-1)/2]); c = (c-1)/2)
+	heap[c] = heap[(c-1)/2];
+      heap[c] = t;
+    }
+  for (k = 0; nheap > 0; k++)
+    {
+      t          = heap[0];
+      new_hit[k] = h1->unsrt + off[t] + (lv[t]->hit[pos[t]] - (t == 0 ? h1->unsrt : lv[t]->unsrt));
+      if (++pos[t] == lv[t]->N) t = heap[--nheap];   /* list t is used up; sift the last one down instead */
+      for (c = 0; (j = 2*c+1) < nheap; c = j)
+	{
+	  if (j+1 < nheap && merge_precedes(lv, pos, heap[j+1], heap[j])) j++;
+	  if (! merge_precedes(lv, pos, heap[j], t)) break;
+	  heap[c] = heap[j];
+	}
+      if (nheap > 0) heap[c] = t;
+    }
+
+  /* The other lists turn over management of name, acc, desc memory
+   * and their pruned targets to h1; nullify their pointers, to
+   * prevent double free.
+   */
+  for (t = 1; t <= nh; t++)
+    {
+      for (i = 0; i < lv[t]->N; i++)
+	{
+	  lv[t]->unsrt[i].name = NULL;
+	  lv[t]->unsrt[i].acc  = NULL;
+	  lv[t]->unsrt[i].desc = NULL;
+	  lv[t]->unsrt[i].dcl  = NULL;
+	}
+      if (lv[t]->npruned) {
+	memcpy(h1->pruned_sc  + h1->npruned, lv[t]->pruned_sc,  sizeof(float)  * lv[t]->npruned);
+	memcpy(h1->pruned_lnP + h1->npruned, lv[t]->pruned_lnP, sizeof(double) * lv[t]->npruned);
+	h1->npruned    += lv[t]->npruned;
+	lv[t]->npruned  = 0;
+      }
+    }
+
+  /* Construct the new grown h1 */
+  free(h1->hit);
+  h1->hit    = new_hit;
+  h1->N      = N;
+  h1->is_sorted_by_seqidx  = FALSE;
+  h1->is_sorted_by_sortkey = TRUE;
+  free(lv); free(pos); free(off); free(heap);
+  return eslOK;
+
+ ERROR:
+  if (lv      != NULL) free(lv);
+  if (pos     != NULL) free(pos);
+  if (off     != NULL) free(off);
+  if (heap    != NULL) free(heap);
+  if (new_hit != NULL) free(new_hit);
+  return status;
+}
+
+
 /* Function:  p7_tophits_GetMaxPositionLength()
  * Synopsis:  Returns maximum position length in hit list (targets).
  *
@@ -597,6 +918,8 @@ p7_tophits_Reuse(P7_TOPHITS *h)
   h->is_sorted_by_seqidx = FALSE;
   h->is_sorted_by_sortkey = TRUE;  /* because there are 0 hits */
   h->hit[0]    = h->unsrt;
+  h->minkey    = -eslINFINITY;
+  h->npruned   = 0;
   return eslOK;
 }
 
@@ -626,6 +949,8 @@ p7_tophits_Destroy(P7_TOPHITS *h)
     }
     free(h->unsrt);
   }
+  if (h->pruned_sc  != NULL) free(h->pruned_sc);
+  if (h->pruned_lnP != NULL) free(h->pruned_lnP);
   free(h);
   return;
 }
@@ -852,7 +1177,9 @@ p7_tophits_RemoveDuplicates(P7_TOPHITS *th, int using_bit_cutoffs)
  *            targets in each target, and the size of the search space
  *            for per-domain conditional E-value calculations,
  *            <pli->domZ>. By default, <pli->domZ> is the number of
- *            significant targets reported.
+ *            significant targets reported. For a bounded list, that
+ *            includes the significant targets that were pruned from
+ *            it, though <th->nreported> doesn't.
  *
  *            If model-specific thresholds were used in the pipeline,
  *            we cannot apply those thresholds now. They were already
@@ -865,7 +1192,8 @@ p7_tophits_RemoveDuplicates(P7_TOPHITS *th, int using_bit_cutoffs)
 int
 p7_tophits_Threshold(P7_TOPHITS *th, P7_PIPELINE *pli)
 {
-  int h, d;    /* counters over sequence hits, domains in sequences */
+  int      h, d;    /* counters over sequence hits, domains in sequences */
+  uint64_t i;       /* counter over pruned targets */
   
   /* Flag reported, included targets (if we're using general thresholds) */
   if (! pli->use_bit_cutoffs) 
@@ -897,8 +1225,17 @@ p7_tophits_Threshold(P7_TOPHITS *th, P7_PIPELINE *pli)
       if (th->hit[h]->flags & p7_IS_INCLUDED)  th->nincluded++;
   }
   
-  /* Now we can determined domZ, the effective search space in which additional domains are found */
-  if (pli->domZ_setby == p7_ZSETBY_NTARGETS) pli->domZ = (double) th->nreported;
+  /* Now we can determined domZ, the effective search space in which additional domains are found.
+   * Targets pruned from a bounded list count too. They all passed the reporting threshold in the
+   * pipeline; that was final if it used model bit score cutoffs, but an E-value test may have
+   * used a lower bound on Z, so repeat it now.
+   */
+  if (pli->domZ_setby == p7_ZSETBY_NTARGETS) 
+  {
+    pli->domZ = (double) th->nreported;
+    for (i = 0; i < th->npruned; i++)
+      if (pli->use_bit_cutoffs || p7_pli_TargetReportable(pli, th->pruned_sc[i], th->pruned_lnP[i])) pli->domZ += 1.0;
+  }
 
 
   /* Second pass is over domains, flagging reportable/includable ones. 
@@ -1499,6 +1836,254 @@ p7_tophits_Alignment(const P7_TOPHITS *th, const ESL_ALPHABET *abc,
  * 3. Tabular (parsable) output of pipeline results.
  *****************************************************************/
 
+/* The tabular writers format their lines by hand into a TBLBUF, and
+ * write it out in large blocks, instead of calling fprintf() with
+ * a long format string for each line. The output is byte-identical
+ * to what the printf() conversions would give: integers and strings
+ * are easy; fixed-point numbers (%.1f, %.2f) are rounded exactly from
+ * the binary double; and %.2g E-values are computed in floating point,
+ * falling back to snprintf() when the value is too close to a
+ * rounding tie to be sure of the last digit.
+ *
+ * Write errors are sticky, as in stdio: check the status of the final
+ * tbl_flush().
+ */
+#define TBLBUFSIZE 65536
+
+typedef struct {
+  FILE *ofp;
+  int   n;                  /* bytes used in buf                 */
+  int   status;             /* eslOK, or eslEWRITE after a failure */
+  char  buf[TBLBUFSIZE];
+} TBLBUF;
+
+static int
+tbl_flush(TBLBUF *b)
+{
+  if (b->n > 0 && b->status == eslOK && fwrite(b->buf, 1, b->n, b->ofp) != (size_t) b->n) b->status = eslEWRITE;
+  b->n = 0;
+  return b->status;
+}
+
+/* make room for <k> more bytes, k <= TBLBUFSIZE */
+static void
+tbl_reserve(TBLBUF *b, int k)
+{
+  if (b->n + k > TBLBUFSIZE) tbl_flush(b);
+}
+
+static void
+tbl_chr(TBLBUF *b, char c)
+{
+  tbl_reserve(b, 1);
+  b->buf[b->n++] = c;
+}
+
+/* tbl_str()
+ * Append string <s>, padded with spaces to width <w>:
+ * on the right if <left> is TRUE (as %-*s), else on the left (%*s).
+ */
+static void
+tbl_str(TBLBUF *b, const char *s, int w, int left)
+{
+  int len = strlen(s);
+  int pad = ESL_MAX(0, w - len);
+
+  if (len + pad > TBLBUFSIZE)	/* something like a huge description: write it straight through */
+    {
+      tbl_flush(b);
+      if (b->status == eslOK && ! left && fprintf(b->ofp, "%*s", pad, "") < 0) b->status = eslEWRITE;
+      if (b->status == eslOK && fwrite(s, 1, len, b->ofp) != (size_t) len)    b->status = eslEWRITE;
+      if (b->status == eslOK &&   left && fprintf(b->ofp, "%*s", pad, "") < 0) b->status = eslEWRITE;
+      return;
+    }
+  tbl_reserve(b, len + pad);
+  if (! left) { memset(b->buf + b->n, ' ', pad); b->n += pad; }
+  memcpy(b->buf + b->n, s, len);  b->n += len;
+  if (  left) { memset(b->buf + b->n, ' ', pad); b->n += pad; }
+}
+
+/* fmt_int()
+ * Format <v> as %ld into <s>; return its length.
+ */
+static int
+fmt_int(char *s, int64_t v)
+{
+  char     tmp[24];
+  uint64_t u = (v < 0 ? -(uint64_t) v : (uint64_t) v);
+  int      n = 0;
+  int      len;
+
+  do { tmp[n++] = '0' + (u % 10); u /= 10; } while (u);
+  len = 0;
+  if (v < 0) s[len++] = '-';
+  while (n) s[len++] = tmp[--n];
+  s[len] = '\0';
+  return len;
+}
+
+/* fmt_fixed()
+ * Format <x> as %.<prec>f into <s>, for <prec> = 1 or 2; return its length.
+ * Rounding is exact: <x> is m * 2^e exactly, with m < 2^53, so
+ * x * 10^prec = (m * 10^prec) * 2^e fits in a uint64_t and can be
+ * rounded half-to-even as printf() does.
+ */
+static int
+fmt_fixed(char *s, double x, int prec)
+{
+  uint64_t bits, m, q, r, half, scale = (prec == 1 ? 10 : 100);
+  int      e, len = 0;
+
+  memcpy(&bits, &x, sizeof(double));
+  e = (int) ((bits >> 52) & 0x7ff);
+  m = bits & 0xfffffffffffffULL;
+  if (e == 0x7ff || e >= 1075) return sprintf(s, "%.*f", prec, x);  /* inf, nan, or |x| >= 2^52: not worth it */
+  if (e == 0) e = 1; else m |= (1ULL << 52);
+  e -= 1075;                                                         /* |x| = m * 2^e, e < 0 */
+
+  m *= scale;
+  if (-e >= 64) q = 0;                                               /* |x| < 2^-11: rounds to zero */
+  else {
+    q    = m >> (-e);
+    r    = m & ((1ULL << (-e)) - 1);
+    half = 1ULL << (-e - 1);
+    if (r > half || (r == half && (q & 1))) q++;
+  }
+
+  if (bits >> 63) s[len++] = '-';                                    /* printf() keeps the sign of a negative zero, too */
+  len += fmt_int(s + len, (int64_t) (q / scale));
+  s[len++] = '.';
+  if (prec == 2) s[len++] = '0' + (q % 100) / 10;
+  s[len++] = '0' + q % 10;
+  s[len] = '\0';
+  return len;
+}
+
+/* fmt_g2()
+ * Format <x> as %.2g into <s>; return its length.
+ */
+static int
+fmt_g2(char *s, double x)
+{
+  double y;
+  int    X, d, len = 0;
+
+  if (x == 0.0 && ! signbit(x))   { strcpy(s, "0"); return 1; }
+  if (! (x >= 1e-300 && x <= 1e300)) return sprintf(s, "%.2g", x);  /* negative, zero, tiny, huge, inf, nan */
+
+  /* scale x to y in [10,100), so x = y * 10^(X-1) */
+  X = (int) floor(log10(x));
+  y = x * pow(10., 1-X);
+  if      (y >= 100.) { X++; y = x * pow(10., 1-X); }
+  else if (y <  10.)  { X--; y = x * pow(10., 1-X); }
+  if (y < 10. || y >= 100. || fabs(y - floor(y) - 0.5) < 1e-9)      /* too close to call: let printf() round it */
+    return sprintf(s, "%.2g", x);
+
+  d = (int) floor(y + 0.5);                                          /* two significant digits, 10..100 */
+  if (d == 100) { d = 10; X++; }
+
+  if (X < -4 || X >= 2)          /* %e style, trailing zero stripped: 1e-05, 1.2e+03 */
+    {
+      s[len++] = '0' + d / 10;
+      if (d % 10) { s[len++] = '.'; s[len++] = '0' + d % 10; }
+      s[len++] = 'e';
+      s[len++] = (X < 0 ? '-' : '+');
+      if (abs(X) < 10) s[len++] = '0';
+      len += fmt_int(s + len, abs(X));
+    }
+  else if (X == 1)               /* 10..99 */
+    len = fmt_int(s, d);
+  else if (X == 0)               /* 1.2, 3 */
+    {
+      s[len++] = '0' + d / 10;
+      if (d % 10) { s[len++] = '.'; s[len++] = '0' + d % 10; }
+    }
+  else                           /* 0.12, 0.00012, 0.1 */
+    {
+      s[len++] = '0';
+      s[len++] = '.';
+      while (++X < 0) s[len++] = '0';
+      s[len++] = '0' + d / 10;
+      if (d % 10) s[len++] = '0' + d % 10;
+    }
+  s[len] = '\0';
+  return len;
+}
+
+static void
+tbl_int(TBLBUF *b, int64_t v, int w)
+{
+  char s[24];
+  fmt_int(s, v);
+  tbl_str(b, s, w, FALSE);
+}
+
+static void
+tbl_fixed(TBLBUF *b, double x, int w, int prec)
+{
+  char s[512];			/* room for %.2f of anything below 2^53, or of DBL_MAX from sprintf() */
+  fmt_fixed(s, x, prec);
+  tbl_str(b, s, w, FALSE);
+}
+
+static void
+tbl_g2(TBLBUF *b, double x, int w)
+{
+  char s[32];
+  fmt_g2(s, x);
+  tbl_str(b, s, w, FALSE);
+}
+
+/* tbl_bytes()
+ * Append <n> raw bytes from <p>, for the binary tables.
+ */
+static void
+tbl_bytes(TBLBUF *b, const void *p, int n)
+{
+  if (n > TBLBUFSIZE)		/* a long alignment string: write it straight through */
+    {
+      tbl_flush(b);
+      if (b->status == eslOK && fwrite(p, 1, n, b->ofp) != (size_t) n) b->status = eslEWRITE;
+      return;
+    }
+  tbl_reserve(b, n);
+  memcpy(b->buf + b->n, p, n);
+  b->n += n;
+}
+
+/* tbl_binstr()
+ * Append string <s> to a binary table: an int32_t length,
+ * -1 for NULL, then the characters without the trailing \0.
+ */
+static void
+tbl_binstr(TBLBUF *b, const char *s)
+{
+  int32_t n = (s == NULL ? -1 : strlen(s));
+
+  tbl_bytes(b, &n, sizeof(int32_t));
+  if (n > 0) tbl_bytes(b, s, n);
+}
+
+/* tabular_name_widths()
+ * Max name and accession lengths in <th>, in one pass;
+ * as p7_tophits_GetMaxNameLength() and p7_tophits_GetMaxAccessionLength().
+ */
+static void
+tabular_name_widths(P7_TOPHITS *th, int *ret_namew, int *ret_accw)
+{
+  uint64_t i;
+  int      namew = 0, accw = 0, n;
+
+  for (i = 0; i < th->N; i++)
+    {
+      if (th->unsrt[i].name != NULL && (n = strlen(th->unsrt[i].name)) > namew) namew = n;
+      if (th->unsrt[i].acc  != NULL && (n = strlen(th->unsrt[i].acc))  > accw)  accw  = n;
+    }
+  *ret_namew = namew;
+  *ret_accw  = accw;
+}
+
+
 /* Function:  p7_tophits_TabularTargets()
  * Synopsis:  Output parsable table of per-sequence hits.
  *
@@ -1519,11 +2104,15 @@ int
 p7_tophits_TabularTargets(FILE *ofp, char *qname, char *qacc, P7_TOPHITS *th, P7_PIPELINE *pli, int show_header)
 {
   int qnamew = ESL_MAX(20, strlen(qname));
-  int tnamew = ESL_MAX(20, p7_tophits_GetMaxNameLength(th));
   int qaccw  = ((qacc != NULL) ? ESL_MAX(10, strlen(qacc)) : 10);
-  int taccw  = ESL_MAX(10, p7_tophits_GetMaxAccessionLength(th));
   int posw   = (pli->long_targets ? ESL_MAX(7, p7_tophits_GetMaxPositionLength(th)) : 0);
+  int tnamew, taccw;
   int h,d;
+  TBLBUF b;
+
+  tabular_name_widths(th, &tnamew, &taccw);
+  tnamew = ESL_MAX(20, tnamew);
+  taccw  = ESL_MAX(10, taccw);
 
   if (show_header)
   {
@@ -1549,56 +2138,58 @@ p7_tophits_TabularTargets(FILE *ofp, char *qname, char *qacc, P7_TOPHITS *th, P7
       }
   }
 
+  b.ofp    = ofp;
+  b.n      = 0;
+  b.status = eslOK;
   for (h = 0; h < th->N; h++)
     if (th->hit[h]->flags & p7_IS_REPORTED)    
     {
         d    = th->hit[h]->best_domain;
+
+        /* "%-*s %-*s %-*s %-*s " */
+        tbl_str(&b, th->hit[h]->name,                                   tnamew, TRUE);  tbl_chr(&b, ' ');
+        tbl_str(&b, th->hit[h]->acc ? th->hit[h]->acc : "-",            taccw,  TRUE);  tbl_chr(&b, ' ');
+        tbl_str(&b, qname,                                              qnamew, TRUE);  tbl_chr(&b, ' ');
+        tbl_str(&b, (qacc != NULL && qacc[0] != '\0') ? qacc : "-",     qaccw,  TRUE);  tbl_chr(&b, ' ');
+
         if (pli->long_targets) 
         {
-            if (fprintf(ofp, "%-*s %-*s %-*s %-*s %7d %7d %*d %*d %*d %*d %*ld %6s %9.2g %6.1f %5.1f  %s\n",
-                tnamew, th->hit[h]->name,
-                taccw,  th->hit[h]->acc ? th->hit[h]->acc : "-",
-                qnamew, qname,
-                qaccw,  ( (qacc != NULL && qacc[0] != '\0') ? qacc : "-"),
-                th->hit[h]->dcl[d].ad->hmmfrom,
-                th->hit[h]->dcl[d].ad->hmmto,
-                posw, th->hit[h]->dcl[d].iali,
-                posw, th->hit[h]->dcl[d].jali,
-                posw, th->hit[h]->dcl[d].ienv,
-                posw, th->hit[h]->dcl[d].jenv,
-                posw, th->hit[h]->dcl[0].ad->L,
-                (th->hit[h]->dcl[d].iali < th->hit[h]->dcl[d].jali ? "   +  "  :  "   -  "),
-                exp(th->hit[h]->lnP),
-                th->hit[h]->score,
-                th->hit[h]->dcl[d].dombias * eslCONST_LOG2R, /* convert NATS to BITS at last moment */
-                th->hit[h]->desc == NULL ? "-" :  th->hit[h]->desc ) < 0)
-                  ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-sequence hit list: write failed");
+            /* "%7d %7d %*d %*d %*d %*d %*ld %6s %9.2g %6.1f %5.1f  %s\n" */
+            tbl_int  (&b, th->hit[h]->dcl[d].ad->hmmfrom, 7);     tbl_chr(&b, ' ');
+            tbl_int  (&b, th->hit[h]->dcl[d].ad->hmmto,   7);     tbl_chr(&b, ' ');
+            tbl_int  (&b, th->hit[h]->dcl[d].iali,     posw);     tbl_chr(&b, ' ');
+            tbl_int  (&b, th->hit[h]->dcl[d].jali,     posw);     tbl_chr(&b, ' ');
+            tbl_int  (&b, th->hit[h]->dcl[d].ienv,     posw);     tbl_chr(&b, ' ');
+            tbl_int  (&b, th->hit[h]->dcl[d].jenv,     posw);     tbl_chr(&b, ' ');
+            tbl_int  (&b, th->hit[h]->dcl[0].ad->L,    posw);     tbl_chr(&b, ' ');
+            tbl_str  (&b, (th->hit[h]->dcl[d].iali < th->hit[h]->dcl[d].jali ? "   +  "  :  "   -  "), 6, FALSE); tbl_chr(&b, ' ');
+            tbl_g2   (&b, exp(th->hit[h]->lnP),                          9);    tbl_chr(&b, ' ');
+            tbl_fixed(&b, th->hit[h]->score,                             6, 1); tbl_chr(&b, ' ');
+            tbl_fixed(&b, th->hit[h]->dcl[d].dombias * eslCONST_LOG2R,   5, 1); /* convert NATS to BITS at last moment */
+            tbl_str  (&b, "  ", 0, FALSE);
         }
         else
         {
-                if (fprintf(ofp, "%-*s %-*s %-*s %-*s %9.2g %6.1f %5.1f %9.2g %6.1f %5.1f %5.1f %3d %3d %3d %3d %3d %3d %3d %s\n",
-                tnamew, th->hit[h]->name,
-                taccw,  th->hit[h]->acc ? th->hit[h]->acc : "-",
-                qnamew, qname,
-                qaccw,  ( (qacc != NULL && qacc[0] != '\0') ? qacc : "-"),
-                exp(th->hit[h]->lnP) * pli->Z,
-                th->hit[h]->score,
-                th->hit[h]->pre_score - th->hit[h]->score, /* bias correction */
-                exp(th->hit[h]->dcl[d].lnP) * pli->Z,
-                th->hit[h]->dcl[d].bitscore,
-                th->hit[h]->dcl[d].dombias * eslCONST_LOG2R, /* convert NATS to BITS at last moment */
-                th->hit[h]->nexpected,
-                th->hit[h]->nregions,
-                th->hit[h]->nclustered,
-                th->hit[h]->noverlaps,
-                th->hit[h]->nenvelopes,
-                th->hit[h]->ndom,
-                th->hit[h]->nreported,
-                th->hit[h]->nincluded,
-                (th->hit[h]->desc == NULL ? "-" : th->hit[h]->desc)) < 0)
-                  ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-sequence hit list: write failed");
+            /* "%9.2g %6.1f %5.1f %9.2g %6.1f %5.1f %5.1f %3d %3d %3d %3d %3d %3d %3d %s\n" */
+            tbl_g2   (&b, exp(th->hit[h]->lnP) * pli->Z,                        9);    tbl_chr(&b, ' ');
+            tbl_fixed(&b, th->hit[h]->score,                                    6, 1); tbl_chr(&b, ' ');
+            tbl_fixed(&b, th->hit[h]->pre_score - th->hit[h]->score,            5, 1); tbl_chr(&b, ' '); /* bias correction */
+            tbl_g2   (&b, exp(th->hit[h]->dcl[d].lnP) * pli->Z,                 9);    tbl_chr(&b, ' ');
+            tbl_fixed(&b, th->hit[h]->dcl[d].bitscore,                          6, 1); tbl_chr(&b, ' ');
+            tbl_fixed(&b, th->hit[h]->dcl[d].dombias * eslCONST_LOG2R,          5, 1); tbl_chr(&b, ' '); /* convert NATS to BITS at last moment */
+            tbl_fixed(&b, th->hit[h]->nexpected,                                5, 1); tbl_chr(&b, ' ');
+            tbl_int  (&b, th->hit[h]->nregions,   3);  tbl_chr(&b, ' ');
+            tbl_int  (&b, th->hit[h]->nclustered, 3);  tbl_chr(&b, ' ');
+            tbl_int  (&b, th->hit[h]->noverlaps,  3);  tbl_chr(&b, ' ');
+            tbl_int  (&b, th->hit[h]->nenvelopes, 3);  tbl_chr(&b, ' ');
+            tbl_int  (&b, th->hit[h]->ndom,       3);  tbl_chr(&b, ' ');
+            tbl_int  (&b, th->hit[h]->nreported,  3);  tbl_chr(&b, ' ');
+            tbl_int  (&b, th->hit[h]->nincluded,  3);  tbl_chr(&b, ' ');
         }
+        tbl_str(&b, (th->hit[h]->desc == NULL ? "-" : th->hit[h]->desc), 0, FALSE);
+        tbl_chr(&b, '\n');
     }
+  if (tbl_flush(&b) != eslOK) ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-sequence hit list: write failed");
   return eslOK;
 }
 
@@ -1624,11 +2215,15 @@ p7_tophits_TabularDomains(FILE *ofp, char *qname, char *qacc, P7_TOPHITS *th, P7
 {
 
   int qnamew = ESL_MAX(20, strlen(qname));
-  int tnamew = ESL_MAX(20, p7_tophits_GetMaxNameLength(th));
   int qaccw  = (qacc ? ESL_MAX(10, strlen(qacc)) : 10);
-  int taccw  = ESL_MAX(10, p7_tophits_GetMaxAccessionLength(th));
+  int tnamew, taccw;
   int tlen, qlen;
   int h,d,nd;
+  TBLBUF b;
+
+  tabular_name_widths(th, &tnamew, &taccw);
+  tnamew = ESL_MAX(20, tnamew);
+  taccw  = ESL_MAX(10, taccw);
 
   if (show_header)
     {
@@ -1642,6 +2237,9 @@ p7_tophits_TabularDomains(FILE *ofp, char *qname, char *qacc, P7_TOPHITS *th, P7
         ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-domain hit list: write failed");
     }
 
+  b.ofp    = ofp;
+  b.n      = 0;
+  b.status = eslOK;
   for (h = 0; h < th->N; h++)
     if (th->hit[h]->flags & p7_IS_REPORTED)
     {
@@ -1659,33 +2257,198 @@ p7_tophits_TabularDomains(FILE *ofp, char *qname, char *qacc, P7_TOPHITS *th, P7
               if (pli->mode == p7_SEARCH_SEQS) { qlen = th->hit[h]->dcl[d].ad->M; tlen = th->hit[h]->dcl[d].ad->L;  }
               else                             { qlen = th->hit[h]->dcl[d].ad->L; tlen = th->hit[h]->dcl[d].ad->M;  }
 
-              if (fprintf(ofp, "%-*s %-*s %5d %-*s %-*s %5d %9.2g %6.1f %5.1f %3d %3d %9.2g %9.2g %6.1f %5.1f %5d %5d %5ld %5ld %5d %5d %4.2f %s\n",
-                tnamew, th->hit[h]->name,
-                taccw,  th->hit[h]->acc ? th->hit[h]->acc : "-",
-                tlen,
-                qnamew, qname,
-                qaccw,  ( (qacc != NULL && qacc[0] != '\0') ? qacc : "-"),
-                qlen,
-                exp(th->hit[h]->lnP) * pli->Z,
-                th->hit[h]->score,
-                th->hit[h]->pre_score - th->hit[h]->score, /* bias correction */
-                nd,
-                th->hit[h]->nreported,
-                exp(th->hit[h]->dcl[d].lnP) * pli->domZ,
-                exp(th->hit[h]->dcl[d].lnP) * pli->Z,
-                th->hit[h]->dcl[d].bitscore,
-                th->hit[h]->dcl[d].dombias * eslCONST_LOG2R, /* NATS to BITS at last moment */
-                th->hit[h]->dcl[d].ad->hmmfrom,
-                th->hit[h]->dcl[d].ad->hmmto,
-                th->hit[h]->dcl[d].ad->sqfrom,
-                th->hit[h]->dcl[d].ad->sqto,
-                th->hit[h]->dcl[d].ienv,
-                th->hit[h]->dcl[d].jenv,
-                (th->hit[h]->dcl[d].oasc / (1.0 + fabs((float) (th->hit[h]->dcl[d].jenv - th->hit[h]->dcl[d].ienv)))),
-                (th->hit[h]->desc ?  th->hit[h]->desc : "-")) < 0)
-                  ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-domain hit list: write failed");
+              /* "%-*s %-*s %5d %-*s %-*s %5d %9.2g %6.1f %5.1f %3d %3d %9.2g %9.2g %6.1f %5.1f %5d %5d %5ld %5ld %5d %5d %4.2f %s\n" */
+              tbl_str  (&b, th->hit[h]->name,                                tnamew, TRUE);  tbl_chr(&b, ' ');
+              tbl_str  (&b, th->hit[h]->acc ? th->hit[h]->acc : "-",         taccw,  TRUE);  tbl_chr(&b, ' ');
+              tbl_int  (&b, tlen,                                            5);             tbl_chr(&b, ' ');
+              tbl_str  (&b, qname,                                           qnamew, TRUE);  tbl_chr(&b, ' ');
+              tbl_str  (&b, (qacc != NULL && qacc[0] != '\0') ? qacc : "-",  qaccw,  TRUE);  tbl_chr(&b, ' ');
+              tbl_int  (&b, qlen,                                            5);             tbl_chr(&b, ' ');
+              tbl_g2   (&b, exp(th->hit[h]->lnP) * pli->Z,                   9);             tbl_chr(&b, ' ');
+              tbl_fixed(&b, th->hit[h]->score,                               6, 1);          tbl_chr(&b, ' ');
+              tbl_fixed(&b, th->hit[h]->pre_score - th->hit[h]->score,       5, 1);          tbl_chr(&b, ' '); /* bias correction */
+              tbl_int  (&b, nd,                                              3);             tbl_chr(&b, ' ');
+              tbl_int  (&b, th->hit[h]->nreported,                           3);             tbl_chr(&b, ' ');
+              tbl_g2   (&b, exp(th->hit[h]->dcl[d].lnP) * pli->domZ,         9);             tbl_chr(&b, ' ');
+              tbl_g2   (&b, exp(th->hit[h]->dcl[d].lnP) * pli->Z,            9);             tbl_chr(&b, ' ');
+              tbl_fixed(&b, th->hit[h]->dcl[d].bitscore,                     6, 1);          tbl_chr(&b, ' ');
+              tbl_fixed(&b, th->hit[h]->dcl[d].dombias * eslCONST_LOG2R,     5, 1);          tbl_chr(&b, ' '); /* NATS to BITS at last moment */
+              tbl_int  (&b, th->hit[h]->dcl[d].ad->hmmfrom,                  5);             tbl_chr(&b, ' ');
+              tbl_int  (&b, th->hit[h]->dcl[d].ad->hmmto,                    5);             tbl_chr(&b, ' ');
+              tbl_int  (&b, th->hit[h]->dcl[d].ad->sqfrom,                   5);             tbl_chr(&b, ' ');
+              tbl_int  (&b, th->hit[h]->dcl[d].ad->sqto,                     5);             tbl_chr(&b, ' ');
+              tbl_int  (&b, th->hit[h]->dcl[d].ienv,                         5);             tbl_chr(&b, ' ');
+              tbl_int  (&b, th->hit[h]->dcl[d].jenv,                         5);             tbl_chr(&b, ' ');
+              tbl_fixed(&b, (th->hit[h]->dcl[d].oasc / (1.0 + fabs((float) (th->hit[h]->dcl[d].jenv - th->hit[h]->dcl[d].ienv)))), 4, 2); tbl_chr(&b, ' ');
+              tbl_str  (&b, (th->hit[h]->desc ?  th->hit[h]->desc : "-"),     0, FALSE);
+              tbl_chr  (&b, '\n');
           }
       }
+  if (tbl_flush(&b) != eslOK) ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-domain hit list: write failed");
+  return eslOK;
+}
+
+
+/* Function:  p7_tophits_BinaryDomains()
+ * Synopsis:  Output a binary table of per-domain hits.
+ *
+ * Purpose:   Output the same reportable per-domain hits as
+ *            <p7_tophits_TabularDomains()>, from sorted tophits list
+ *            <th> with final pipeline accounting in <pli>, as a
+ *            compact binary table on stream <ofp>. Numbers are
+ *            written as they are in memory, without formatting or
+ *            rounding, so a downstream program can load the table
+ *            without parsing it. If <show_ali> is TRUE, each domain
+ *            also carries its alignment strings.
+ *
+ *            Like the ASCII tables, the output is one block per
+ *            query, designed to be concatenated for multiple queries
+ *            and multiple top hits lists.
+ *
+ *            All numbers are in native byte order; a reader that sees
+ *            the magic number byte-swapped knows to swap. A string is
+ *            an int32 length (-1 for none) followed by its characters,
+ *            without a trailing \0. There is no padding. A block is:
+ *
+ *              uint32   magic     <p7_DOMBIN_MAGIC>
+ *              uint32   version   <p7_DOMBIN_VERSION>
+ *              uint32   flags     <p7_DOMBIN_ALI>, <p7_DOMBIN_SCAN>
+ *              uint64   ndom      number of domain records that follow
+ *              double   Z         E-value = exp(lnP) * Z
+ *              double   domZ      conditional E-value = exp(lnP) * domZ
+ *              string   qname
+ *              string   qacc
+ *
+ *            followed by <ndom> domain records, in the order of
+ *            <--domtblout>:
+ *
+ *              string   tname
+ *              string   tacc
+ *              string   tdesc
+ *              int64    tlen
+ *              int64    qlen
+ *              uint32   hitflags  <p7_IS_REPORTED>, <p7_IS_INCLUDED>, ...
+ *              float    score     full sequence bit score
+ *              float    bias      full sequence bias correction (bits)
+ *              double   lnP       full sequence log P-value
+ *              int32    d         domain number, 1..nreported
+ *              int32    nreported reported domains in this target
+ *              int32    included  1 if the domain meets inclusion thresholds
+ *              float    domscore  domain bit score
+ *              float    dombias   domain bias correction (bits)
+ *              double   domlnP    domain log P-value
+ *              int64    hmmfrom, hmmto
+ *              int64    alifrom, alito   (alifrom > alito on a reverse strand)
+ *              int64    envfrom, envto
+ *              float    acc       mean posterior probability of the envelope
+ *
+ *            and, if <p7_DOMBIN_ALI> is set, the strings <model>,
+ *            <mline>, <aseq>, and <ppline> of the domain's alignment
+ *            display.
+ *
+ *            As in <p7_tophits_TabularDomains()>, qlen/tlen are the
+ *            lengths of the query and the target; in hmmscan
+ *            (<p7_DOMBIN_SCAN>) the targets are models.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEWRITE> if a write to <ofp> fails; for example, if
+ *            the disk fills up.
+ */
+int
+p7_tophits_BinaryDomains(FILE *ofp, char *qname, char *qacc, P7_TOPHITS *th, P7_PIPELINE *pli, int show_ali)
+{
+  uint32_t   magic   = p7_DOMBIN_MAGIC;
+  uint32_t   version = p7_DOMBIN_VERSION;
+  uint32_t   flags   = 0;
+  uint64_t   ndom    = 0;
+  P7_HIT    *hit;
+  P7_DOMAIN *dom;
+  int64_t    tlen, qlen;
+  int64_t    coords[6];
+  float      fv[2];
+  int32_t    iv[3];
+  float      acc;
+  int        h,d,nd;
+  TBLBUF     b;
+
+  if (show_ali)                    flags |= p7_DOMBIN_ALI;
+  if (pli->mode == p7_SCAN_MODELS) flags |= p7_DOMBIN_SCAN;
+
+  for (h = 0; h < th->N; h++)
+    if (th->hit[h]->flags & p7_IS_REPORTED)
+      for (d = 0; d < th->hit[h]->ndom; d++)
+        if (th->hit[h]->dcl[d].is_reported) ndom++;
+
+  b.ofp    = ofp;
+  b.n      = 0;
+  b.status = eslOK;
+  tbl_bytes (&b, &magic,     sizeof(uint32_t));
+  tbl_bytes (&b, &version,   sizeof(uint32_t));
+  tbl_bytes (&b, &flags,     sizeof(uint32_t));
+  tbl_bytes (&b, &ndom,      sizeof(uint64_t));
+  tbl_bytes (&b, &pli->Z,    sizeof(double));
+  tbl_bytes (&b, &pli->domZ, sizeof(double));
+  tbl_binstr(&b, qname);
+  tbl_binstr(&b, (qacc != NULL && qacc[0] != '\0') ? qacc : NULL);
+
+  for (h = 0; h < th->N; h++)
+    if (th->hit[h]->flags & p7_IS_REPORTED)
+    {
+        hit = th->hit[h];
+        nd  = 0;
+        for (d = 0; d < hit->ndom; d++)
+          if (hit->dcl[d].is_reported)
+          {
+              dom = hit->dcl + d;
+              nd++;
+
+              if (pli->mode == p7_SEARCH_SEQS) { qlen = dom->ad->M; tlen = dom->ad->L;  }
+              else                             { qlen = dom->ad->L; tlen = dom->ad->M;  }
+
+              tbl_binstr(&b, hit->name);
+              tbl_binstr(&b, hit->acc);
+              tbl_binstr(&b, hit->desc);
+              tbl_bytes (&b, &tlen,       sizeof(int64_t));
+              tbl_bytes (&b, &qlen,       sizeof(int64_t));
+              tbl_bytes (&b, &hit->flags, sizeof(uint32_t));
+
+              fv[0] = hit->score;
+              fv[1] = hit->pre_score - hit->score;
+              tbl_bytes (&b, fv,          sizeof(float) * 2);
+              tbl_bytes (&b, &hit->lnP,   sizeof(double));
+
+              iv[0] = nd;
+              iv[1] = hit->nreported;
+              iv[2] = (dom->is_included ? 1 : 0);
+              tbl_bytes (&b, iv,          sizeof(int32_t) * 3);
+
+              fv[0] = dom->bitscore;
+              fv[1] = dom->dombias * eslCONST_LOG2R; /* NATS to BITS at last moment */
+              tbl_bytes (&b, fv,          sizeof(float) * 2);
+              tbl_bytes (&b, &dom->lnP,   sizeof(double));
+
+              coords[0] = dom->ad->hmmfrom;
+              coords[1] = dom->ad->hmmto;
+              coords[2] = dom->ad->sqfrom;
+              coords[3] = dom->ad->sqto;
+              coords[4] = dom->ienv;
+              coords[5] = dom->jenv;
+              tbl_bytes (&b, coords,      sizeof(int64_t) * 6);
+
+              acc = dom->oasc / (1.0 + fabs((float) (dom->jenv - dom->ienv)));
+              tbl_bytes (&b, &acc,        sizeof(float));
+
+              if (show_ali)
+                {
+                  tbl_binstr(&b, dom->ad->model);
+                  tbl_binstr(&b, dom->ad->mline);
+                  tbl_binstr(&b, dom->ad->aseq);
+                  tbl_binstr(&b, dom->ad->ppline);
+                }
+          }
+      }
+  if (tbl_flush(&b) != eslOK) ESL_EXCEPTION_SYS(eslEWRITE, "binary per-domain hit list: write failed");
   return eslOK;
 }
 
@@ -1983,9 +2746,367 @@ p7_tophits_TabularTail(FILE *ofp, const char *progname, enum p7_pipemodes_e pipe
 
 
 
+/*****************************************************************
+ * 4. Binary save and restore of hit lists
+ *****************************************************************/
+
+/* The binary hit format is meant for saving and restoring hits
+ * within one installation (for example, nhmmer's --checkpoint
+ * files), not for exchange between machines: numbers are written in
+ * native byte order. Each field is written explicitly, at a fixed
+ * width, so the format doesn't depend on how the compiler lays out
+ * P7_HIT, P7_DOMAIN and P7_ALIDISPLAY; a set of hits starts with a
+ * magic number and a format version, and the reader refuses any
+ * other version. A string is an int32_t length (-1 for NULL)
+ * followed by its characters, without the trailing \0.
+ */
+static int
+binary_write_string(FILE *fp, const char *s)
+{
+  int32_t n = (s == NULL ? -1 : strlen(s));
+
+  if (fwrite(&n, sizeof(int32_t), 1, fp) != 1)         return eslEWRITE;
+  if (n > 0 && fwrite(s, sizeof(char), n, fp) != n)    return eslEWRITE;
+  return eslOK;
+}
+
+static int binary_write_int32 (FILE *fp, int32_t  v) { return (fwrite(&v, sizeof(int32_t),  1, fp) == 1 ? eslOK : eslEWRITE); }
+static int binary_write_uint32(FILE *fp, uint32_t v) { return (fwrite(&v, sizeof(uint32_t), 1, fp) == 1 ? eslOK : eslEWRITE); }
+static int binary_write_int64 (FILE *fp, int64_t  v) { return (fwrite(&v, sizeof(int64_t),  1, fp) == 1 ? eslOK : eslEWRITE); }
+static int binary_write_uint64(FILE *fp, uint64_t v) { return (fwrite(&v, sizeof(uint64_t), 1, fp) == 1 ? eslOK : eslEWRITE); }
+static int binary_write_float (FILE *fp, float    v) { return (fwrite(&v, sizeof(float),    1, fp) == 1 ? eslOK : eslEWRITE); }
+static int binary_write_double(FILE *fp, double   v) { return (fwrite(&v, sizeof(double),   1, fp) == 1 ? eslOK : eslEWRITE); }
+
+static int
+binary_read_string(FILE *fp, char **ret_s)
+{
+  int32_t n;
+  char   *s = NULL;
+  int     status;
+
+  *ret_s = NULL;
+  if (fread(&n, sizeof(int32_t), 1, fp) != 1)  return eslEFORMAT;
+  if (n < 0) return eslOK;
+
+  ESL_ALLOC(s, sizeof(char) * (n+1));
+  if (n > 0 && fread(s, sizeof(char), n, fp) != n) { free(s); return eslEFORMAT; }
+  s[n] = '\0';
+
+  *ret_s = s;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* each reads one field of the width given by its name into a variable of the in-memory type */
+static int binary_read_int32 (FILE *fp, int      *ret_v) { int32_t v; if (fread(&v, sizeof(int32_t), 1, fp) != 1) return eslEFORMAT; *ret_v = v; return eslOK; }
+static int binary_read_long  (FILE *fp, long     *ret_v) { int64_t v; if (fread(&v, sizeof(int64_t), 1, fp) != 1) return eslEFORMAT; *ret_v = v; return eslOK; }
+static int binary_read_uint32(FILE *fp, uint32_t *ret_v) { return (fread(ret_v, sizeof(uint32_t), 1, fp) == 1 ? eslOK : eslEFORMAT); }
+static int binary_read_int64 (FILE *fp, int64_t  *ret_v) { return (fread(ret_v, sizeof(int64_t),  1, fp) == 1 ? eslOK : eslEFORMAT); }
+static int binary_read_float (FILE *fp, float    *ret_v) { return (fread(ret_v, sizeof(float),    1, fp) == 1 ? eslOK : eslEFORMAT); }
+static int binary_read_double(FILE *fp, double   *ret_v) { return (fread(ret_v, sizeof(double),   1, fp) == 1 ? eslOK : eslEFORMAT); }
+
+/* Function:  p7_tophits_WriteBinary()
+ * Synopsis:  Save hits to an open binary stream.
+ *
+ * Purpose:   Write the hits <th->unsrt[first..th->N-1]> to the open
+ *            stream <fp> in binary form, with their domains,
+ *            alignment displays, and (if present) per-position
+ *            alignment scores. Hits are written in storage order, not
+ *            sorted order, so a caller can save the hits a search adds
+ *            to <th> a piece at a time by passing the previous <th->N>
+ *            as <first>.
+ *
+ *            A set of hits is:
+ *
+ *              uint32   magic     <p7_HITBIN_MAGIC>
+ *              uint32   version   <p7_HITBIN_VERSION>
+ *              uint64   n         number of hits that follow
+ *
+ *            then for each hit: strings name, acc, desc; int32
+ *            window_length; double sortkey; floats score, pre_score,
+ *            sum_score; doubles lnP, pre_lnP, sum_lnP; float
+ *            nexpected; int32s nregions, nclustered, noverlaps,
+ *            nenvelopes, ndom; uint32 flags; int32s nreported,
+ *            nincluded, best_domain; int64s seqidx, subseq_start,
+ *            offset; and int32 has_dcl. If <has_dcl> is 1, <ndom>
+ *            domains follow, each: int32s ienv, jenv, iali, jali;
+ *            floats envsc, domcorrection, dombias, oasc, bitscore;
+ *            double lnP; int32s is_reported, is_included; int32
+ *            has_ad, and if it is 1 the alignment display (int32 N;
+ *            strings rfline, mmline, csline, model, mline, aseq,
+ *            ppline, hmmname, hmmacc, hmmdesc, sqname, sqacc, sqdesc;
+ *            int32s hmmfrom, hmmto, M; int64s sqfrom, sqto, L); and
+ *            int32 has_scores, and if it is 1, N floats of
+ *            scores_per_pos. Scores are only saved along with an
+ *            alignment display, which gives their number.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEWRITE> on write failure.
+ */
+int
+p7_tophits_WriteBinary(FILE *fp, const P7_TOPHITS *th, uint64_t first)
+{
+  uint64_t       n = (first < th->N ? th->N - first : 0);
+  uint64_t       i;
+  int            d;
+  P7_HIT        *hit;
+  P7_DOMAIN     *dom;
+  P7_ALIDISPLAY *ad;
+  int32_t        has_scores;
+
+  if (binary_write_uint32(fp, p7_HITBIN_MAGIC)   != eslOK ||
+      binary_write_uint32(fp, p7_HITBIN_VERSION) != eslOK ||
+      binary_write_uint64(fp, n)                 != eslOK)
+    ESL_EXCEPTION_SYS(eslEWRITE, "binary hit write failed");
+
+  for (i = first; i < th->N; i++)
+    {
+      hit = th->unsrt + i;
+      if (binary_write_string(fp, hit->name)          != eslOK ||
+          binary_write_string(fp, hit->acc)           != eslOK ||
+          binary_write_string(fp, hit->desc)          != eslOK ||
+          binary_write_int32 (fp, hit->window_length) != eslOK ||
+          binary_write_double(fp, hit->sortkey)       != eslOK ||
+          binary_write_float (fp, hit->score)         != eslOK ||
+          binary_write_float (fp, hit->pre_score)     != eslOK ||
+          binary_write_float (fp, hit->sum_score)     != eslOK ||
+          binary_write_double(fp, hit->lnP)           != eslOK ||
+          binary_write_double(fp, hit->pre_lnP)       != eslOK ||
+          binary_write_double(fp, hit->sum_lnP)       != eslOK ||
+          binary_write_float (fp, hit->nexpected)     != eslOK ||
+          binary_write_int32 (fp, hit->nregions)      != eslOK ||
+          binary_write_int32 (fp, hit->nclustered)    != eslOK ||
+          binary_write_int32 (fp, hit->noverlaps)     != eslOK ||
+          binary_write_int32 (fp, hit->nenvelopes)    != eslOK ||
+          binary_write_int32 (fp, hit->ndom)          != eslOK ||
+          binary_write_uint32(fp, hit->flags)         != eslOK ||
+          binary_write_int32 (fp, hit->nreported)     != eslOK ||
+          binary_write_int32 (fp, hit->nincluded)     != eslOK ||
+          binary_write_int32 (fp, hit->best_domain)   != eslOK ||
+          binary_write_int64 (fp, hit->seqidx)        != eslOK ||
+          binary_write_int64 (fp, hit->subseq_start)  != eslOK ||
+          binary_write_int64 (fp, hit->offset)        != eslOK ||
+          binary_write_int32 (fp, hit->dcl != NULL)   != eslOK)
+        ESL_EXCEPTION_SYS(eslEWRITE, "binary hit write failed");
+      if (hit->dcl == NULL) continue;
+
+      for (d = 0; d < hit->ndom; d++)
+        {
+          dom = hit->dcl + d;
+          ad  = dom->ad;
+          if (binary_write_int32 (fp, dom->ienv)          != eslOK ||
+              binary_write_int32 (fp, dom->jenv)          != eslOK ||
+              binary_write_int32 (fp, dom->iali)          != eslOK ||
+              binary_write_int32 (fp, dom->jali)          != eslOK ||
+              binary_write_float (fp, dom->envsc)         != eslOK ||
+              binary_write_float (fp, dom->domcorrection) != eslOK ||
+              binary_write_float (fp, dom->dombias)       != eslOK ||
+              binary_write_float (fp, dom->oasc)          != eslOK ||
+              binary_write_float (fp, dom->bitscore)      != eslOK ||
+              binary_write_double(fp, dom->lnP)           != eslOK ||
+              binary_write_int32 (fp, dom->is_reported)   != eslOK ||
+              binary_write_int32 (fp, dom->is_included)   != eslOK ||
+              binary_write_int32 (fp, ad != NULL)         != eslOK)
+            ESL_EXCEPTION_SYS(eslEWRITE, "binary hit write failed");
+
+          if (ad != NULL) {
+            if (binary_write_int32 (fp, ad->N)       != eslOK ||
+                binary_write_string(fp, ad->rfline)  != eslOK ||
+                binary_write_string(fp, ad->mmline)  != eslOK ||
+                binary_write_string(fp, ad->csline)  != eslOK ||
+                binary_write_string(fp, ad->model)   != eslOK ||
+                binary_write_string(fp, ad->mline)   != eslOK ||
+                binary_write_string(fp, ad->aseq)    != eslOK ||
+                binary_write_string(fp, ad->ppline)  != eslOK ||
+                binary_write_string(fp, ad->hmmname) != eslOK ||
+                binary_write_string(fp, ad->hmmacc)  != eslOK ||
+                binary_write_string(fp, ad->hmmdesc) != eslOK ||
+                binary_write_string(fp, ad->sqname)  != eslOK ||
+                binary_write_string(fp, ad->sqacc)   != eslOK ||
+                binary_write_string(fp, ad->sqdesc)  != eslOK ||
+                binary_write_int32 (fp, ad->hmmfrom) != eslOK ||
+                binary_write_int32 (fp, ad->hmmto)   != eslOK ||
+                binary_write_int32 (fp, ad->M)       != eslOK ||
+                binary_write_int64 (fp, ad->sqfrom)  != eslOK ||
+                binary_write_int64 (fp, ad->sqto)    != eslOK ||
+                binary_write_int64 (fp, ad->L)       != eslOK)
+              ESL_EXCEPTION_SYS(eslEWRITE, "binary hit write failed");
+          }
+
+          /* scores_per_pos, when present, has one score per alignment column (ad->N) */
+          has_scores = (dom->scores_per_pos != NULL && ad != NULL);
+          if (binary_write_int32(fp, has_scores) != eslOK) ESL_EXCEPTION_SYS(eslEWRITE, "binary hit write failed");
+          if (has_scores && fwrite(dom->scores_per_pos, sizeof(float), ad->N, fp) != ad->N) ESL_EXCEPTION_SYS(eslEWRITE, "binary hit write failed");
+        }
+    }
+  return eslOK;
+}
+
+/* Function:  p7_tophits_ReadBinary()
+ * Synopsis:  Restore hits from an open binary stream.
+ *
+ * Purpose:   Read one set of hits written by <p7_tophits_WriteBinary()>
+ *            from the open stream <fp>, and append them to <th>.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslEOF> if <fp> is at end of file before any data are
+ *            read; <th> is unchanged.
+ *
+ *            <eslEINCOMPAT> if the set was written in a different
+ *            version of the format; <th> is unchanged.
+ *
+ *            <eslEFORMAT> if the data are truncated or otherwise
+ *            unreadable. Hits read completely before the problem
+ *            was found are left in <th>.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_tophits_ReadBinary(FILE *fp, P7_TOPHITS *th)
+{
+  uint32_t       magic, version;
+  uint64_t       n, i;
+  int            d;
+  P7_HIT        *hit = NULL;
+  P7_DOMAIN     *dom;
+  P7_ALIDISPLAY *ad;
+  int            has_dcl, has_ad, has_scores;
+  int            status;
+
+  if (fread(&magic, sizeof(uint32_t), 1, fp) != 1)  return eslEOF;
+  if (magic != p7_HITBIN_MAGIC)                     return eslEFORMAT;
+  if (binary_read_uint32(fp, &version) != eslOK)    return eslEFORMAT;
+  if (version != p7_HITBIN_VERSION)                 return eslEINCOMPAT;
+  if (fread(&n, sizeof(uint64_t), 1, fp) != 1)      return eslEFORMAT;
+
+  for (i = 0; i < n; i++)
+    {
+      hit = NULL;
+      if ((status = p7_tophits_CreateNextHit(th, &hit)) != eslOK) return status;
+      hit->name = hit->acc = hit->desc = NULL;
+      hit->dcl  = NULL;
+      hit->ndom = 0;
+
+      if ((status = binary_read_string(fp, &(hit->name)))          != eslOK) goto FAIL;
+      if ((status = binary_read_string(fp, &(hit->acc)))           != eslOK) goto FAIL;
+      if ((status = binary_read_string(fp, &(hit->desc)))          != eslOK) goto FAIL;
+      if ((status = binary_read_int32 (fp, &(hit->window_length))) != eslOK) goto FAIL;
+      if ((status = binary_read_double(fp, &(hit->sortkey)))       != eslOK) goto FAIL;
+      if ((status = binary_read_float (fp, &(hit->score)))         != eslOK) goto FAIL;
+      if ((status = binary_read_float (fp, &(hit->pre_score)))     != eslOK) goto FAIL;
+      if ((status = binary_read_float (fp, &(hit->sum_score)))     != eslOK) goto FAIL;
+      if ((status = binary_read_double(fp, &(hit->lnP)))           != eslOK) goto FAIL;
+      if ((status = binary_read_double(fp, &(hit->pre_lnP)))       != eslOK) goto FAIL;
+      if ((status = binary_read_double(fp, &(hit->sum_lnP)))       != eslOK) goto FAIL;
+      if ((status = binary_read_float (fp, &(hit->nexpected)))     != eslOK) goto FAIL;
+      if ((status = binary_read_int32 (fp, &(hit->nregions)))      != eslOK) goto FAIL;
+      if ((status = binary_read_int32 (fp, &(hit->nclustered)))    != eslOK) goto FAIL;
+      if ((status = binary_read_int32 (fp, &(hit->noverlaps)))     != eslOK) goto FAIL;
+      if ((status = binary_read_int32 (fp, &(hit->nenvelopes)))    != eslOK) goto FAIL;
+      if ((status = binary_read_int32 (fp, &(hit->ndom)))          != eslOK) goto FAIL;
+      if ((status = binary_read_uint32(fp, &(hit->flags)))         != eslOK) goto FAIL;
+      if ((status = binary_read_int32 (fp, &(hit->nreported)))     != eslOK) goto FAIL;
+      if ((status = binary_read_int32 (fp, &(hit->nincluded)))     != eslOK) goto FAIL;
+      if ((status = binary_read_int32 (fp, &(hit->best_domain)))   != eslOK) goto FAIL;
+      if ((status = binary_read_int64 (fp, &(hit->seqidx)))        != eslOK) goto FAIL;
+      if ((status = binary_read_int64 (fp, &(hit->subseq_start)))  != eslOK) goto FAIL;
+      if ((status = binary_read_int64 (fp, &(hit->offset)))        != eslOK) goto FAIL;
+      if ((status = binary_read_int32 (fp, &has_dcl))              != eslOK) goto FAIL;
+      if (hit->ndom < 0) { status = eslEFORMAT; goto FAIL; }
+      if (! has_dcl || hit->ndom == 0) continue;
+
+      ESL_ALLOC(hit->dcl, sizeof(P7_DOMAIN) * hit->ndom);
+      for (d = 0; d < hit->ndom; d++) { hit->dcl[d].ad = NULL; hit->dcl[d].scores_per_pos = NULL; }
+
+      for (d = 0; d < hit->ndom; d++)
+        {
+          dom = hit->dcl + d;
+          if ((status = binary_read_int32 (fp, &(dom->ienv)))          != eslOK) goto FAIL;
+          if ((status = binary_read_int32 (fp, &(dom->jenv)))          != eslOK) goto FAIL;
+          if ((status = binary_read_int32 (fp, &(dom->iali)))          != eslOK) goto FAIL;
+          if ((status = binary_read_int32 (fp, &(dom->jali)))          != eslOK) goto FAIL;
+          if ((status = binary_read_float (fp, &(dom->envsc)))         != eslOK) goto FAIL;
+          if ((status = binary_read_float (fp, &(dom->domcorrection))) != eslOK) goto FAIL;
+          if ((status = binary_read_float (fp, &(dom->dombias)))       != eslOK) goto FAIL;
+          if ((status = binary_read_float (fp, &(dom->oasc)))          != eslOK) goto FAIL;
+          if ((status = binary_read_float (fp, &(dom->bitscore)))      != eslOK) goto FAIL;
+          if ((status = binary_read_double(fp, &(dom->lnP)))           != eslOK) goto FAIL;
+          if ((status = binary_read_int32 (fp, &(dom->is_reported)))   != eslOK) goto FAIL;
+          if ((status = binary_read_int32 (fp, &(dom->is_included)))   != eslOK) goto FAIL;
+          if ((status = binary_read_int32 (fp, &has_ad))               != eslOK) goto FAIL;
+
+          if (has_ad) {
+            ESL_ALLOC(dom->ad, sizeof(P7_ALIDISPLAY));
+            ad = dom->ad;
+            ad->rfline  = ad->mmline = ad->csline = ad->model = ad->mline = ad->aseq = ad->ppline = NULL;
+            ad->hmmname = ad->hmmacc = ad->hmmdesc = ad->sqname = ad->sqacc = ad->sqdesc = NULL;
+            ad->mem     = NULL;
+            ad->memsize = 0;
+            if ((status = binary_read_int32 (fp, &(ad->N)))       != eslOK) goto FAIL;
+            if ((status = binary_read_string(fp, &(ad->rfline)))  != eslOK) goto FAIL;
+            if ((status = binary_read_string(fp, &(ad->mmline)))  != eslOK) goto FAIL;
+            if ((status = binary_read_string(fp, &(ad->csline)))  != eslOK) goto FAIL;
+            if ((status = binary_read_string(fp, &(ad->model)))   != eslOK) goto FAIL;
+            if ((status = binary_read_string(fp, &(ad->mline)))   != eslOK) goto FAIL;
+            if ((status = binary_read_string(fp, &(ad->aseq)))    != eslOK) goto FAIL;
+            if ((status = binary_read_string(fp, &(ad->ppline)))  != eslOK) goto FAIL;
+            if ((status = binary_read_string(fp, &(ad->hmmname))) != eslOK) goto FAIL;
+            if ((status = binary_read_string(fp, &(ad->hmmacc)))  != eslOK) goto FAIL;
+            if ((status = binary_read_string(fp, &(ad->hmmdesc))) != eslOK) goto FAIL;
+            if ((status = binary_read_string(fp, &(ad->sqname)))  != eslOK) goto FAIL;
+            if ((status = binary_read_string(fp, &(ad->sqacc)))   != eslOK) goto FAIL;
+            if ((status = binary_read_string(fp, &(ad->sqdesc)))  != eslOK) goto FAIL;
+            if ((status = binary_read_int32 (fp, &(ad->hmmfrom))) != eslOK) goto FAIL;
+            if ((status = binary_read_int32 (fp, &(ad->hmmto)))   != eslOK) goto FAIL;
+            if ((status = binary_read_int32 (fp, &(ad->M)))       != eslOK) goto FAIL;
+            if ((status = binary_read_long  (fp, &(ad->sqfrom)))  != eslOK) goto FAIL;
+            if ((status = binary_read_long  (fp, &(ad->sqto)))    != eslOK) goto FAIL;
+            if ((status = binary_read_long  (fp, &(ad->L)))       != eslOK) goto FAIL;
+            if (ad->N < 0) { status = eslEFORMAT; goto FAIL; }
+          }
+
+          /* scores are only written with an alignment display, whose N says how many */
+          if ((status = binary_read_int32(fp, &has_scores)) != eslOK) goto FAIL;
+          if (has_scores) {
+            if (dom->ad == NULL) { status = eslEFORMAT; goto FAIL; }
+            ESL_ALLOC(dom->scores_per_pos, sizeof(float) * ESL_MAX(1, dom->ad->N));
+            if (fread(dom->scores_per_pos, sizeof(float), dom->ad->N, fp) != dom->ad->N) { status = eslEFORMAT; goto FAIL; }
+          }
+        }
+    }
+  return eslOK;
+
+ ERROR:
+ FAIL:
+  /* the partially read hit isn't usable: free what it got, and take it back off the end of <th> */
+  if (hit != NULL) {
+    if (hit->name) free(hit->name);
+    if (hit->acc)  free(hit->acc);
+    if (hit->desc) free(hit->desc);
+    if (hit->dcl) {
+      for (d = 0; d < hit->ndom; d++) {
+        if (hit->dcl[d].ad)             p7_alidisplay_Destroy(hit->dcl[d].ad);
+        if (hit->dcl[d].scores_per_pos) free(hit->dcl[d].scores_per_pos);
+      }
+      free(hit->dcl);
+    }
+    hit->name = hit->acc = hit->desc = NULL;
+    hit->dcl  = NULL;
+    th->N--;
+  }
+  return status;
+}
+/*------------------- end, binary hit lists ---------------------*/
+
+
+
 
 /*****************************************************************
- * 4. Benchmark driver
+ * 5. Benchmark driver
  *****************************************************************/
 #ifdef p7TOPHITS_BENCHMARK
 /* 
@@ -2076,7 +3197,7 @@ main(int argc, char **argv)
 
 
 /*****************************************************************
- * 5. Test driver
+ * 6. Test driver
  *****************************************************************/
 
 #ifdef p7TOPHITS_TESTDRIVE
@@ -2101,6 +3222,41 @@ static ESL_OPTIONS options[] = {
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
 
+/* the hand-rolled number formatting of the tabular writers agrees with printf() */
+static void
+utest_tblformat(ESL_RANDOMNESS *r, int ntrials)
+{
+  char   s1[512], s2[512];
+  double specials[] = { 0.0, -0.0, 0.05, 0.15, 0.25, 0.35, -0.05, -0.04, 0.125, 2.675, 9.95, 9.95e-5, 99.5, 0.000995, 1e-300, 9.5e-301, 1.0, 10.0, 100.0, 1e5, 3.5e10, 1e300, 4503599627370496.0 };
+  double x;
+  int    i, k, prec;
+
+  for (i = 0; i < ntrials + sizeof(specials) / sizeof(double); i++)
+    {
+      if (i < sizeof(specials) / sizeof(double)) x = specials[i];
+      else switch (esl_rnd_Roll(r, 4)) {
+	case 0:  x = (esl_random(r) - 0.5) * 2000.;                             break;  /* scores, biases */
+	case 1:  x = (float) ((esl_random(r) - 0.5) * 200.);                    break;  /* float scores */
+	case 2:  x = exp(-esl_random(r) * 700.) * 100000.;                      break;  /* E-values */
+	default: x = (double) esl_rnd_Roll(r, 20000) / (esl_rnd_Roll(r, 2) ? 200. : 20.); break;  /* exact ties */
+	}
+
+      for (prec = 1; prec <= 2; prec++)
+	{
+	  fmt_fixed(s1, x, prec);
+	  sprintf(s2, "%.*f", prec, x);
+	  if (strcmp(s1, s2) != 0) esl_fatal("tblformat: %.*f of %.17g gives %s, not %s", prec, prec, x, s1, s2);
+	}
+      fmt_g2(s1, x);
+      sprintf(s2, "%.2g", x);
+      if (strcmp(s1, s2) != 0) esl_fatal("tblformat: %%.2g of %.17g gives %s, not %s", x, s1, s2);
+      k = esl_rnd_Roll(r, 2000000000) - 1000000000;
+      fmt_int(s1, k);
+      sprintf(s2, "%d", k);
+      if (strcmp(s1, s2) != 0) esl_fatal("tblformat: %%d of %d gives %s", k, s1);
+    }
+}
+
 static char usage[]  = "[-options]";
 static char banner[] = "test driver for P7_TOPHITS";
 
@@ -2113,11 +3269,29 @@ main(int argc, char **argv)
   P7_TOPHITS     *h1       = NULL;
   P7_TOPHITS     *h2       = NULL;
   P7_TOPHITS     *h3       = NULL;
+  P7_TOPHITS     *h4       = NULL;
+  P7_TOPHITS     *h5       = NULL;
+  P7_TOPHITS     *h6       = NULL;
+  P7_TOPHITS     *av[3], *bv[3];
+  P7_HIT         *hit      = NULL;
+  P7_ALIDISPLAY  *ad       = NULL;
+  FILE           *fp       = NULL;
   char            name[]   = "not_unique_name";
   char            acc[]    = "not_unique_acc";
   char            desc[]   = "Test description for the purposes of making the test driver allocate space";
+  char            buf[32];
+  char           *str      = NULL;
+  P7_PIPELINE     pli;
+  uint32_t        u32[3];
+  uint64_t        u64      = 0;
+  int32_t         i32[3];
+  int64_t         i64[6];
+  float           fv[2];
+  double          dv[2];
   double          key;
-  int             i;
+  int             i, t;
+
+  utest_tblformat(r, 100000);
 
   h1 = p7_tophits_Create();
   h2 = p7_tophits_Create();
@@ -2149,9 +3323,181 @@ main(int argc, char **argv)
   
   if (p7_tophits_GetMaxNameLength(h3) != strlen(name)) esl_fatal("GetMaxNameLength() failed");
 
+  /* binary save/restore round trip, including one hit with a domain and alignment display */
+  p7_tophits_CreateNextHit(h3, &hit);
+  esl_strdup("with_domain", -1, &(hit->name));
+  hit->ndom    = 1;
+  hit->sortkey = 42.0;
+  hit->dcl     = malloc(sizeof(P7_DOMAIN));
+  memset(hit->dcl, 0, sizeof(P7_DOMAIN));
+  hit->dcl[0].iali = 7;
+  hit->dcl[0].ad   = ad = malloc(sizeof(P7_ALIDISPLAY));
+  memset(ad, 0, sizeof(P7_ALIDISPLAY));
+  ad->N = 4;
+  esl_strdup("ACGT", -1, &(ad->model));   esl_strdup("A GT", -1, &(ad->mline)); esl_strdup("ACGT", -1, &(ad->aseq));
+  esl_strdup("hmm",  -1, &(ad->hmmname)); esl_strdup("",     -1, &(ad->hmmacc)); esl_strdup("",    -1, &(ad->hmmdesc));
+  esl_strdup("seq",  -1, &(ad->sqname));  esl_strdup("",     -1, &(ad->sqacc));  esl_strdup("",    -1, &(ad->sqdesc));
+  hit->dcl[0].scores_per_pos = malloc(sizeof(float) * ad->N);
+  for (i = 0; i < ad->N; i++) hit->dcl[0].scores_per_pos[i] = (float) i;
+
+  if ((fp = tmpfile()) == NULL)                   esl_fatal("tmpfile() failed");
+  if (p7_tophits_WriteBinary(fp, h3, 0) != eslOK) esl_fatal("WriteBinary() failed");
+  if (p7_tophits_WriteBinary(fp, h3, 3) != eslOK) esl_fatal("WriteBinary() failed");
+  rewind(fp);
+  h4 = p7_tophits_Create();
+  if (p7_tophits_ReadBinary(fp, h4) != eslOK)     esl_fatal("ReadBinary() failed");
+  if (h4->N != h3->N)                             esl_fatal("ReadBinary() restored %d hits, not %d", (int) h4->N, (int) h3->N);
+  if (p7_tophits_ReadBinary(fp, h4) != eslOK)     esl_fatal("ReadBinary() failed on second set");
+  if (h4->N != 2*h3->N - 3)                       esl_fatal("ReadBinary() appended wrong number of hits");
+  if (p7_tophits_ReadBinary(fp, h4) != eslEOF)    esl_fatal("ReadBinary() didn't detect EOF");
+  for (i = 0; i < h3->N; i++)
+    if (strcmp(h4->unsrt[i].name, h3->unsrt[i].name) != 0 || h4->unsrt[i].sortkey != h3->unsrt[i].sortkey)
+      esl_fatal("ReadBinary() hit %d differs", i);
+  hit = h4->unsrt + h3->N - 1;
+  if (hit->ndom != 1 || hit->dcl[0].iali != 7)    esl_fatal("ReadBinary() domain differs");
+  if (strcmp(hit->dcl[0].ad->mline, "A GT") != 0 || hit->dcl[0].ad->ppline != NULL || strcmp(hit->dcl[0].ad->sqname, "seq") != 0)
+    esl_fatal("ReadBinary() alignment display differs");
+  if (hit->dcl[0].scores_per_pos == NULL || hit->dcl[0].scores_per_pos[3] != 3.0)
+    esl_fatal("ReadBinary() alignment scores differ");
+  fclose(fp);
+
+  /* ReadBinary() refuses another format version, and scores without an alignment display to count them */
+  hit = h3->unsrt + h3->N - 1;
+  u64 = h4->N;
+  if ((fp = tmpfile()) == NULL)                                esl_fatal("tmpfile() failed");
+  if (p7_tophits_WriteBinary(fp, h3, h3->N-1) != eslOK)        esl_fatal("WriteBinary() failed");
+  u32[0] = p7_HITBIN_VERSION + 1;
+  if (fseek(fp, sizeof(uint32_t), SEEK_SET) != 0 || fwrite(u32, sizeof(uint32_t), 1, fp) != 1) esl_fatal("couldn't alter version");
+  rewind(fp);
+  if (p7_tophits_ReadBinary(fp, h4) != eslEINCOMPAT || h4->N != u64) esl_fatal("ReadBinary() accepted another version");
+  fclose(fp);
+
+  hit->dcl[0].ad = NULL;
+  if ((fp = tmpfile()) == NULL)                                esl_fatal("tmpfile() failed");
+  if (p7_tophits_WriteBinary(fp, h3, h3->N-1) != eslOK)        esl_fatal("WriteBinary() failed");
+  hit->dcl[0].ad = ad;
+  i32[0] = 1;                   /* the set ends with the domain's has_scores flag, written as 0 */
+  if (fseek(fp, -((long) sizeof(int32_t)), SEEK_END) != 0 || fwrite(i32, sizeof(int32_t), 1, fp) != 1) esl_fatal("couldn't alter has_scores");
+  rewind(fp);
+  if (p7_tophits_ReadBinary(fp, h4) != eslEFORMAT || h4->N != u64) esl_fatal("ReadBinary() read scores without an alignment display");
+  fclose(fp);
+  u64 = 0;
+
+  /* the binary domain table holds the one reported domain, with its numbers as they are */
+  hit = h3->unsrt + h3->N - 1;
+  hit->flags            |= p7_IS_REPORTED;
+  hit->nreported         = 1;
+  hit->score             = 12.5;
+  hit->lnP               = -3.25;
+  hit->dcl[0].is_reported = TRUE;
+  hit->dcl[0].bitscore   = 11.5;
+  hit->dcl[0].lnP        = -2.75;
+  hit->dcl[0].ienv       = 3;
+  hit->dcl[0].jenv       = 9;
+  ad->hmmfrom = 2;  ad->hmmto = 5;  ad->M = 20;
+  ad->sqfrom  = 4;  ad->sqto  = 7;  ad->L = 30;
+  memset(&pli, 0, sizeof(P7_PIPELINE));
+  pli.mode = p7_SEARCH_SEQS;
+  pli.Z    = 1000.;
+  pli.domZ = 10.;
+  p7_tophits_SortBySortkey(h3);
+
+  if ((fp = tmpfile()) == NULL)                   esl_fatal("tmpfile() failed");
+  if (p7_tophits_BinaryDomains(fp, "query", NULL, h3, &pli, TRUE) != eslOK) esl_fatal("BinaryDomains() failed");
+  rewind(fp);
+  if (fread(u32, sizeof(uint32_t), 3, fp) != 3 || u32[0] != p7_DOMBIN_MAGIC || u32[2] != p7_DOMBIN_ALI) esl_fatal("BinaryDomains() header differs");
+  if (fread(&u64, sizeof(uint64_t), 1, fp) != 1 || u64 != 1)                                            esl_fatal("BinaryDomains() wrote %d domains, not 1", (int) u64);
+  if (fread(dv, sizeof(double), 2, fp) != 2 || dv[0] != pli.Z || dv[1] != pli.domZ)                     esl_fatal("BinaryDomains() Z differs");
+  if (binary_read_string(fp, &str) != eslOK || strcmp(str, "query") != 0) esl_fatal("BinaryDomains() query name differs");
+  free(str);
+  if (binary_read_string(fp, &str) != eslOK || str != NULL)                esl_fatal("BinaryDomains() query accession differs");
+  if (binary_read_string(fp, &str) != eslOK || strcmp(str, "with_domain") != 0) esl_fatal("BinaryDomains() target name differs");
+  free(str);
+  for (i = 0; i < 2; i++)
+    if (binary_read_string(fp, &str) != eslOK || str != NULL)              esl_fatal("BinaryDomains() target acc/desc differs");
+  if (fread(i64, sizeof(int64_t), 2, fp) != 2 || i64[0] != 30 || i64[1] != 20)                          esl_fatal("BinaryDomains() lengths differ");
+  if (fread(u32, sizeof(uint32_t), 1, fp) != 1 || ! (u32[0] & p7_IS_REPORTED))                          esl_fatal("BinaryDomains() flags differ");
+  if (fread(fv, sizeof(float), 2, fp) != 2 || fv[0] != 12.5)                                             esl_fatal("BinaryDomains() score differs");
+  if (fread(dv, sizeof(double), 1, fp) != 1 || dv[0] != -3.25)                                           esl_fatal("BinaryDomains() lnP differs");
+  if (fread(i32, sizeof(int32_t), 3, fp) != 3 || i32[0] != 1 || i32[1] != 1 || i32[2] != 0)             esl_fatal("BinaryDomains() domain numbering differs");
+  if (fread(fv, sizeof(float), 2, fp) != 2 || fv[0] != 11.5)                                             esl_fatal("BinaryDomains() domain score differs");
+  if (fread(dv, sizeof(double), 1, fp) != 1 || dv[0] != -2.75)                                           esl_fatal("BinaryDomains() domain lnP differs");
+  if (fread(i64, sizeof(int64_t), 6, fp) != 6 || i64[0] != 2 || i64[1] != 5 || i64[2] != 4 || i64[3] != 7 || i64[4] != 3 || i64[5] != 9)
+    esl_fatal("BinaryDomains() coords differ");
+  if (fread(fv, sizeof(float), 1, fp) != 1)                                                              esl_fatal("BinaryDomains() acc missing");
+  for (i = 0; i < 3; i++) {
+    if (binary_read_string(fp, &str) != eslOK || str == NULL || strlen(str) != ad->N) esl_fatal("BinaryDomains() alignment differs");
+    free(str);
+  }
+  if (binary_read_string(fp, &str) != eslOK || str != NULL)                esl_fatal("BinaryDomains() ppline differs");
+  if (fgetc(fp) != EOF)                                                    esl_fatal("BinaryDomains() wrote too much");
+  fclose(fp);
+
+  /* a bounded list keeps the same top hits as an unbounded one, and accounts for the rest */
+  h5 = p7_tophits_Create();
+  h6 = p7_tophits_Create();
+  h5->maxhits = 10;
+  for (i = 0; i < 4*N; i++)
+  {
+      key = esl_random(r);
+      snprintf(buf, 32, "hit%d", i);
+      p7_tophits_CreateNextHit(h6, &hit);
+      esl_strdup(buf, -1, &(hit->name));
+      hit->sortkey = hit->score = key;
+      if (! p7_tophits_Admits(h5, key)) { p7_tophits_Prune(h5, key, key); continue; }
+      p7_tophits_CreateNextHit(h5, &hit);
+      esl_strdup(buf, -1, &(hit->name));
+      hit->sortkey = hit->score = key;
+  }
+  p7_tophits_SortBySortkey(h5);
+  p7_tophits_SortBySortkey(h6);
+  if (h5->N != ESL_MIN(10, 4*N))       esl_fatal("bounded list holds %d hits", (int) h5->N);
+  if (h5->N + h5->npruned != h6->N)    esl_fatal("bounded list lost track of pruned hits");
+  for (i = 0; i < h5->N; i++)
+    if (strcmp(h5->hit[i]->name, h6->hit[i]->name) != 0) esl_fatal("bounded list hit %d differs", i);
+
+  /* merging several lists at once gives the same order as merging them one at a time */
+  for (t = 0; t < 3; t++) { av[t] = p7_tophits_Create(); bv[t] = p7_tophits_Create(); }
+  for (i = 0; i < 3*N; i++)
+  {
+      t   = esl_rnd_Roll(r, 3);
+      key = (double) esl_rnd_Roll(r, 10);   /* plenty of tied keys, within and across lists */
+      snprintf(buf, 32, "hit%d", i);
+      p7_tophits_Add(av[t], buf, NULL, NULL, key, (float) key, key, (float) key, key, i, i, N, i, i, N, 1, 1, NULL);
+      p7_tophits_Add(bv[t], buf, NULL, NULL, key, (float) key, key, (float) key, key, i, i, N, i, i, N, 1, 1, NULL);
+  }
+  p7_tophits_SortBySortkey(av[1]);  /* one presorted list, as a worker thread would leave it */
+  if (p7_tophits_MergeAll(av[0], av+1, 2) != eslOK) esl_fatal("MergeAll() failed");
+  p7_tophits_Merge(bv[0], bv[1]);
+  p7_tophits_Merge(bv[0], bv[2]);
+  if (av[0]->N != 3*N || bv[0]->N != 3*N) esl_fatal("merged lists have wrong size");
+  for (i = 0; i < 3*N; i++)
+    if (strcmp(av[0]->hit[i]->name, bv[0]->hit[i]->name) != 0) esl_fatal("MergeAll() hit %d differs from Merge()", i);
+  for (t = 0; t < 3; t++) { p7_tophits_Destroy(av[t]); p7_tophits_Destroy(bv[t]); }
+
+  /* a merged list can still grow and be sorted again */
+  for (t = 0; t < 2; t++) {
+    av[t] = p7_tophits_Create();
+    p7_tophits_Add(av[t], "one", NULL, NULL, (double) t, (float) t, t, (float) t, t, t, t, N, t, t, N, 1, 1, NULL);
+  }
+  if (p7_tophits_MergeAll(av[0], av+1, 1) != eslOK) esl_fatal("MergeAll() failed");
+  for (i = 0; i < 10; i++)
+  {
+      p7_tophits_CreateNextHit(av[0], &hit);
+      snprintf(buf, 32, "added%d", i);
+      esl_strdup(buf, -1, &(hit->name));
+      hit->sortkey = 10.0 + i;
+  }
+  p7_tophits_SortBySortkey(av[0]);
+  if (av[0]->N != 12 || strcmp(av[0]->hit[0]->name, "added9") != 0) esl_fatal("merged list didn't grow correctly");
+  for (t = 0; t < 2; t++) p7_tophits_Destroy(av[t]);
+
   p7_tophits_Destroy(h1);
   p7_tophits_Destroy(h2);
   p7_tophits_Destroy(h3);
+  p7_tophits_Destroy(h4);
+  p7_tophits_Destroy(h5);
+  p7_tophits_Destroy(h6);
   esl_randomness_Destroy(r);
   esl_getopts_Destroy(go);
   return eslOK;
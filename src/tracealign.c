@@ -11,20 +11,59 @@
  */
 #include "p7_config.h"
 
+#include <string.h>
+
 #include "easel.h"
 #include "esl_vectorops.h"
+#ifdef HMMER_THREADS
+#include <pthread.h>
+#include "esl_threads.h"
+#endif /*HMMER_THREADS*/
 
 #include "hmmer.h"
 
+/* Once map_new_msa() has laid out the columns, the rows of the new
+ * alignment are independent of each other. A ROWFILL is a block of
+ * rows <idx0..idx1-1> for make_digital_rows() or make_text_rows() to
+ * fill; with threads, a big alignment is split into one block per
+ * worker.
+ */
+typedef struct {
+  ESL_SQ        **sq;
+  const ESL_MSA  *premsa;
+  P7_TRACE      **tr;
+  const int      *inscount;
+  const int      *matuse;
+  const int      *matmap;
+  int             M;
+  int             alen;
+  int             optflags;
+  const void     *gaprow;	/* all-gap template row: ESL_DSQ [0..alen+1] if digital, char [0..alen] if text */
+  ESL_MSA        *msa;
+  int             idx0;		/* first row of the block */
+  int             idx1;		/* one past the last row  */
+  int             status;	/* RETURN: eslOK, or the error that stopped the block */
+} ROWFILL;
+
+#ifdef HMMER_THREADS
+static int tracealign_ncpus = 0;    /* worker threads for filling rows; set by p7_tracealign_SetThreads() */
+#define TRACEALIGN_MINCELLS (1<<20) /* smaller alignments are filled serially: threads would cost more than they save */
+static void fill_rows_thread(void *arg);
+#endif /*HMMER_THREADS*/
+
 static int     map_new_msa(P7_TRACE **tr, int nseq, int M, int optflags, int **ret_inscount, int **ret_matuse, int **ret_matmap, int *ret_alen);
 static ESL_DSQ get_dsq_z(ESL_SQ **sq, const ESL_MSA *premsa, P7_TRACE **tr, int idx, int z);
-static int     make_digital_msa(ESL_SQ **sq, const ESL_MSA *premsa, P7_TRACE **tr, int nseq, const int *matuse, const int *matmap, int M, int alen, int optflags, ESL_MSA **ret_msa);
-static int     make_text_msa   (ESL_SQ **sq, const ESL_MSA *premsa, P7_TRACE **tr, int nseq, const int *matuse, const int *matmap, int M, int alen, int optflags, ESL_MSA **ret_msa);
+static int     make_digital_msa(ESL_SQ **sq, const ESL_MSA *premsa, P7_TRACE **tr, int nseq, const int *inscount, const int *matuse, const int *matmap, int M, int alen, int optflags, ESL_MSA **ret_msa);
+static int     make_text_msa   (ESL_SQ **sq, const ESL_MSA *premsa, P7_TRACE **tr, int nseq, const int *inscount, const int *matuse, const int *matmap, int M, int alen, int optflags, ESL_MSA **ret_msa);
+static int     fill_rows(const ROWFILL *proto, int nseq);
+static int     make_digital_rows(ROWFILL *rf);
+static int     make_text_rows   (ROWFILL *rf);
+static int     allocate_pp_rows(ESL_MSA *msa, P7_TRACE **tr, int nseq, int alen);
 static int     annotate_rf(ESL_MSA *msa, int M, const int *matuse, const int *matmap);
 static int     annotate_mm(ESL_MSA *msa, P7_HMM *hmm, const int *matuse, const int *matmap);
-static int     annotate_posterior_probability(ESL_MSA *msa, P7_TRACE **tr, const int *matmap, int M, int optflags);
-static int     rejustify_insertions_digital  (                         ESL_MSA *msa, const int *inserts, const int *matmap, const int *matuse, int M);
-static int     rejustify_insertions_text     (const ESL_ALPHABET *abc, ESL_MSA *msa, const int *inserts, const int *matmap, const int *matuse, int M);
+static int     annotate_pp_cons(ESL_MSA *msa, P7_TRACE **tr, const int *matmap);
+static void    rejustify_insert_digital(const ESL_ALPHABET *abc, ESL_DSQ *ax,   char *pp, int lpos, int rpos, int is_nterm);
+static void    rejustify_insert_text   (const ESL_ALPHABET *abc, char    *aseq, char *pp, int lpos, int rpos, int is_nterm);
 
 
 /*****************************************************************
@@ -99,7 +138,6 @@ int
 p7_tracealign_Seqs(ESL_SQ **sq, P7_TRACE **tr, int nseq, int M, int optflags, P7_HMM *hmm, ESL_MSA **ret_msa)
 {
   ESL_MSA      *msa        = NULL;	/* RETURN: new MSA */
-  const ESL_ALPHABET *abc  = sq[0]->abc;
   int          *inscount   = NULL;	/* array of max gaps between aligned columns */
   int          *matmap     = NULL;      /* matmap[k] = apos of match k matmap[1..M] = [1..alen] */
   int          *matuse     = NULL;      /* TRUE if an alignment column is associated with match state k [1..M] */
@@ -109,16 +147,13 @@ p7_tracealign_Seqs(ESL_SQ **sq, P7_TRACE **tr, int nseq, int M, int optflags, P7
 
   if ((status = map_new_msa(tr, nseq, M, optflags, &inscount, &matuse, &matmap, &alen)) != eslOK) return status;
 
-  if (optflags & p7_DIGITIZE) { if ((status = make_digital_msa(sq, NULL, tr, nseq, matuse, matmap, M, alen, optflags, &msa)) != eslOK) goto ERROR; }
-  else                        { if ((status = make_text_msa   (sq, NULL, tr, nseq, matuse, matmap, M, alen, optflags, &msa)) != eslOK) goto ERROR; }
+  if (optflags & p7_DIGITIZE) { if ((status = make_digital_msa(sq, NULL, tr, nseq, inscount, matuse, matmap, M, alen, optflags, &msa)) != eslOK) goto ERROR; }
+  else                        { if ((status = make_text_msa   (sq, NULL, tr, nseq, inscount, matuse, matmap, M, alen, optflags, &msa)) != eslOK) goto ERROR; }
 
   if ((status = annotate_rf(msa, M, matuse, matmap))                               != eslOK) goto ERROR;
   if (hmm)
     if ((status = annotate_mm(msa, hmm,    matuse, matmap))                          != eslOK) goto ERROR;
-  if ((status = annotate_posterior_probability(msa, tr, matmap, M, optflags)) != eslOK) goto ERROR;
-
-  if (optflags & p7_DIGITIZE) rejustify_insertions_digital(     msa, inscount, matmap, matuse, M);
-  else                        rejustify_insertions_text   (abc, msa, inscount, matmap, matuse, M);
+  if ((status = annotate_pp_cons(msa, tr, matmap))                            != eslOK) goto ERROR;
 
   for (idx = 0; idx < nseq; idx++)
     {
@@ -166,7 +201,6 @@ p7_tracealign_Seqs(ESL_SQ **sq, P7_TRACE **tr, int nseq, int M, int optflags, P7
 int
 p7_tracealign_MSA(const ESL_MSA *premsa, P7_TRACE **tr, int M, int optflags, ESL_MSA **ret_postmsa)
 {
-  const ESL_ALPHABET *abc  = premsa->abc;
   ESL_MSA      *msa        = NULL;	/* RETURN: new MSA */
   int          *inscount   = NULL;	/* array of max gaps between aligned columns */
   int          *matmap     = NULL;      /* matmap[k] = apos of match k matmap[1..M] = [1..alen] */
@@ -177,14 +211,11 @@ p7_tracealign_MSA(const ESL_MSA *premsa, P7_TRACE **tr, int M, int optflags, ESL
 
   if ((status = map_new_msa(tr, premsa->nseq, M, optflags, &inscount, &matuse, &matmap, &alen)) != eslOK) return status;
  
-  if (optflags & p7_DIGITIZE) { if ((status = make_digital_msa(NULL, premsa, tr, premsa->nseq, matuse, matmap, M, alen, optflags, &msa)) != eslOK) goto ERROR; }
-  else                        { if ((status = make_text_msa   (NULL, premsa, tr, premsa->nseq, matuse, matmap, M, alen, optflags, &msa)) != eslOK) goto ERROR; }
+  if (optflags & p7_DIGITIZE) { if ((status = make_digital_msa(NULL, premsa, tr, premsa->nseq, inscount, matuse, matmap, M, alen, optflags, &msa)) != eslOK) goto ERROR; }
+  else                        { if ((status = make_text_msa   (NULL, premsa, tr, premsa->nseq, inscount, matuse, matmap, M, alen, optflags, &msa)) != eslOK) goto ERROR; }
 
   if ((status = annotate_rf(msa, M, matuse, matmap))                          != eslOK) goto ERROR;
-  if ((status = annotate_posterior_probability(msa, tr, matmap, M, optflags)) != eslOK) goto ERROR;
-
-  if (optflags & p7_DIGITIZE) rejustify_insertions_digital(     msa, inscount, matmap, matuse, M);
-  else                        rejustify_insertions_text   (abc, msa, inscount, matmap, matuse, M);
+  if ((status = annotate_pp_cons(msa, tr, matmap))                            != eslOK) goto ERROR;
 
 
   /* Transfer information from old MSA to new */
@@ -219,6 +250,33 @@ p7_tracealign_MSA(const ESL_MSA *premsa, P7_TRACE **tr, int M, int optflags, ESL
 }
 
 
+/* Function:  p7_tracealign_SetThreads()
+ * Synopsis:  Set how many threads fill the rows of new alignments.
+ *
+ * Purpose:   Have <p7_tracealign_Seqs()> and <p7_tracealign_MSA()>
+ *            fill the rows of large alignments with up to <ncpus>
+ *            worker threads. <ncpus> of 0 or 1 fills them serially,
+ *            which is the default. The alignment is the same either
+ *            way.
+ *
+ *            This is a setting for the whole program, meant to be
+ *            made once by <main()> from its <--cpu> option, before
+ *            any alignments are made.
+ *
+ *            Without threads (no <HMMER_THREADS>), this does nothing.
+ *
+ * Returns:   <eslOK>.
+ */
+int
+p7_tracealign_SetThreads(int ncpus)
+{
+#ifdef HMMER_THREADS
+  tracealign_ncpus = ncpus;
+#endif
+  return eslOK;
+}
+
+
 
 /* Function: p7_tracealign_computeTraces()
  *
@@ -599,44 +657,117 @@ get_dsq_z(ESL_SQ **sq, const ESL_MSA *premsa, P7_TRACE **tr, int idx, int z)
  * core traces may contain X "states" for fragments.
  * 
  *  matmap[k] = apos of match k, in digital coords:  matmap[1..M] = [1..alen]
+ *
+ * The alignment is built one row at a time, in a single pass: the
+ * row is initialized from a precomputed all-gap template, filled
+ * from its trace (residues and posterior probability annotation
+ * together), and then only the insert regions that this row
+ * actually put residues in are rejustified. Wide alignments are
+ * mostly insert columns that any given row doesn't use, so this
+ * avoids repeatedly sweeping the whole <nseq> x <alen> matrix.
  */
-
 static int
-make_digital_msa(ESL_SQ **sq, const ESL_MSA *premsa, P7_TRACE **tr, int nseq, const int *matuse, const int *matmap, int M, int alen, int optflags, ESL_MSA **ret_msa)
+make_digital_msa(ESL_SQ **sq, const ESL_MSA *premsa, P7_TRACE **tr, int nseq, const int *inscount, const int *matuse, const int *matmap, int M, int alen, int optflags, ESL_MSA **ret_msa)
 {
   const ESL_ALPHABET *abc = (sq == NULL) ? premsa->abc : sq[0]->abc;
-  ESL_MSA      *msa = NULL;
+  ESL_MSA      *msa    = NULL;
+  ESL_DSQ      *gaprow = NULL;	/* template row: sentinels and gaps, [0..alen+1] */
+  ROWFILL       rf;
+  int           apos;
+  int           status;
+
+  if ((msa = esl_msa_CreateDigital(abc, nseq, alen)) == NULL) { status = eslEMEM; goto ERROR;  }
+  if ((status = allocate_pp_rows(msa, tr, nseq, alen)) != eslOK) goto ERROR;
+  ESL_ALLOC(gaprow, sizeof(ESL_DSQ) * (alen+2));
+
+  gaprow[0] = eslDSQ_SENTINEL;
+  for (apos = 1; apos <= alen; apos++) gaprow[apos] = esl_abc_XGetGap(abc);
+  gaprow[alen+1] = eslDSQ_SENTINEL;
+
+  rf.sq       = sq;
+  rf.premsa   = premsa;
+  rf.tr       = tr;
+  rf.inscount = inscount;
+  rf.matuse   = matuse;
+  rf.matmap   = matmap;
+  rf.M        = M;
+  rf.alen     = alen;
+  rf.optflags = optflags;
+  rf.gaprow   = gaprow;
+  rf.msa      = msa;
+  if ((status = fill_rows(&rf, nseq)) != eslOK) goto ERROR;
+
+  msa->nseq = nseq;
+  msa->alen = alen;
+  free(gaprow);
+  *ret_msa = msa;
+  return eslOK;
+
+ ERROR:
+  if (msa)    esl_msa_Destroy(msa);
+  if (gaprow) free(gaprow);
+  *ret_msa = NULL;
+  return status;
+}
+
+
+/* make_digital_rows()
+ * Fill rows <rf->idx0..rf->idx1-1> of a new digital alignment,
+ * for make_digital_msa(). 
+ */
+static int
+make_digital_rows(ROWFILL *rf)
+{
+  ESL_SQ            **sq       = rf->sq;
+  const ESL_MSA      *premsa   = rf->premsa;
+  P7_TRACE          **tr       = rf->tr;
+  const int          *inscount = rf->inscount;
+  const int          *matuse   = rf->matuse;
+  const int          *matmap   = rf->matmap;
+  int                 M        = rf->M;
+  int                 alen     = rf->alen;
+  int                 optflags = rf->optflags;
+  const ESL_ALPHABET *abc      = (sq == NULL) ? premsa->abc : sq[0]->abc;
+  int          *rowins = NULL;	/* rowins[k=0..M]: # of symbols this row put in insert region k */
+  ESL_DSQ      *ax;
+  char         *pp;
   int           idx;
   int           apos;
   int           z;
+  int           k;
   int           status;
 
-  if ((msa = esl_msa_CreateDigital(abc, nseq, alen)) == NULL) { status = eslEMEM; goto ERROR;  }
-  
-  for (idx = 0; idx < nseq; idx++)
+  ESL_ALLOC(rowins, sizeof(int) * (M+1));
+
+  for (idx = rf->idx0; idx < rf->idx1; idx++)
     {
-      msa->ax[idx][0]      = eslDSQ_SENTINEL;
-      for (apos = 1; apos <= alen; apos++) msa->ax[idx][apos] = esl_abc_XGetGap(abc);
-      msa->ax[idx][alen+1] = eslDSQ_SENTINEL;
+      ax = rf->msa->ax[idx];
+      pp = (rf->msa->pp == NULL ? NULL : rf->msa->pp[idx]);
+      memcpy(ax, rf->gaprow, sizeof(ESL_DSQ) * (alen+2));
+      if (pp) { memset(pp, '.', sizeof(char) * alen); pp[alen] = '\0'; }
+      esl_vec_ISet(rowins, M+1, 0);
 
       apos = 1;
       for (z = 0; z < tr[idx]->N; z++)
 	{
 	  switch (tr[idx]->st[z]) {
 	  case p7T_M:
-	    msa->ax[idx][matmap[tr[idx]->k[z]]] = get_dsq_z(sq, premsa, tr, idx, z);
+	    ax[matmap[tr[idx]->k[z]]] = get_dsq_z(sq, premsa, tr, idx, z);
+	    if (pp) pp[matmap[tr[idx]->k[z]]-1] = p7_alidisplay_EncodePostProb(tr[idx]->pp[z]);
 	    apos = matmap[tr[idx]->k[z]] + 1;
 	    break;
 
 	  case p7T_D:
 	    if (matuse[tr[idx]->k[z]]) /* bug h77: if all col is deletes, do nothing; do NOT overwrite a column */
-	      msa->ax[idx][matmap[tr[idx]->k[z]]] = esl_abc_XGetGap(abc); /* overwrites ~ in Dk column on X->Dk */
+	      ax[matmap[tr[idx]->k[z]]] = esl_abc_XGetGap(abc); /* overwrites ~ in Dk column on X->Dk */
 	    apos = matmap[tr[idx]->k[z]] + 1;
 	    break;
 
 	  case p7T_I:
 	    if ( !(optflags & p7_TRIM) || (tr[idx]->k[z] != 0 && tr[idx]->k[z] != M)) {
-	      msa->ax[idx][apos] = get_dsq_z(sq, premsa, tr, idx, z);
+	      ax[apos] = get_dsq_z(sq, premsa, tr, idx, z);
+	      if (pp) pp[apos-1] = p7_alidisplay_EncodePostProb(tr[idx]->pp[z]);
+	      rowins[tr[idx]->k[z]]++;
 	      apos++;
 	    }
 	    break;
@@ -644,7 +775,9 @@ make_digital_msa(ESL_SQ **sq, const ESL_MSA *premsa, P7_TRACE **tr, int nseq, co
 	  case p7T_N:
 	  case p7T_C:
 	    if (! (optflags & p7_TRIM) && tr[idx]->i[z] > 0) {
-	      msa->ax[idx][apos] = get_dsq_z(sq, premsa, tr, idx, z);
+	      ax[apos] = get_dsq_z(sq, premsa, tr, idx, z);
+	      if (pp) pp[apos-1] = p7_alidisplay_EncodePostProb(tr[idx]->pp[z]);
+	      rowins[tr[idx]->st[z] == p7T_N ? 0 : M]++;
 	      apos++;
 	    }
 	    break;
@@ -661,16 +794,16 @@ make_digital_msa(ESL_SQ **sq, const ESL_MSA *premsa, P7_TRACE **tr, int nseq, co
 	      { /* B->X leader. This is a core trace and a fragment. Convert leading gaps to ~ */
 		/* to set apos for an initial Ik: peek at next state for B->X->Ik; superfluous for ->{DM}k: */
 		for (apos = 1; apos <= matmap[tr[idx]->k[z+1]]; apos++)
-		  msa->ax[idx][apos] = esl_abc_XGetMissing(abc);
+		  ax[apos] = esl_abc_XGetMissing(abc);
 		/* tricky! apos is now exactly where it needs to be for X->Ik. all other cases except B->X->Ik set their own apos */
 	      }
 	    else if (tr[idx]->st[z+1] == p7T_E) 
 	      { /* X->E trailer. This is a core trace and a fragment. Convert trailing gaps to ~ */
 		/* don't need to set apos for trailer. There can't be any more residues in a core trace once we hit X->E */
 		for (; apos <= alen; apos++)
-		  msa->ax[idx][apos] = esl_abc_XGetMissing(abc);
+		  ax[apos] = esl_abc_XGetMissing(abc);
 	      }
-	    else ESL_XEXCEPTION(eslECORRUPT, "make_digital_msa(): X state in unexpected position in trace"); 
+	    else ESL_XEXCEPTION(eslECORRUPT, "make_digital_rows(): X state in unexpected position in trace"); 
 	      
 	    break;
 
@@ -678,16 +811,20 @@ make_digital_msa(ESL_SQ **sq, const ESL_MSA *premsa, P7_TRACE **tr, int nseq, co
 	    break;
 	  }
 	}
+
+      /* Rejustify the row's inserts. An insert region that this row left empty is all gaps (or all ~), 
+       * and rejustifying it would be a no-op, so skip it. 
+       */
+      for (k = 0; k < M; k++)
+	if (inscount[k] > 1 && rowins[k] > 0)
+	  rejustify_insert_digital(abc, ax, pp, matmap[k]+1, matmap[k+1]-matuse[k+1], (k == 0));
     }
 
-  msa->nseq = nseq;
-  msa->alen = alen;
-  *ret_msa = msa;
+  free(rowins);
   return eslOK;
 
  ERROR:
-  if (msa) esl_msa_Destroy(msa);
-  *ret_msa = NULL;
+  if (rowins) free(rowins);
   return status;
 }
 
@@ -704,42 +841,107 @@ make_digital_msa(ESL_SQ **sq, const ESL_MSA *premsa, P7_TRACE **tr, int nseq, co
  * Also see comments in make_digital_msa(), above.
  */
 static int
-make_text_msa(ESL_SQ **sq, const ESL_MSA *premsa, P7_TRACE **tr, int nseq, const int *matuse, const int *matmap, int M, int alen, int optflags, ESL_MSA **ret_msa)
+make_text_msa(ESL_SQ **sq, const ESL_MSA *premsa, P7_TRACE **tr, int nseq, const int *inscount, const int *matuse, const int *matmap, int M, int alen, int optflags, ESL_MSA **ret_msa)
 {
-  const ESL_ALPHABET *abc = (sq == NULL) ? premsa->abc : sq[0]->abc;
-  ESL_MSA      *msa = NULL;
+  ESL_MSA      *msa    = NULL;
+  char         *gaprow = NULL;	/* template row: '.' in insert columns, '-' in match columns, [0..alen] */
+  ROWFILL       rf;
+  int           apos;
+  int           k;
+  int           status;
+
+  if ((msa = esl_msa_Create(nseq, alen)) == NULL) { status = eslEMEM; goto ERROR; }
+  if ((status = allocate_pp_rows(msa, tr, nseq, alen)) != eslOK) goto ERROR;
+  ESL_ALLOC(gaprow, sizeof(char) * (alen+1));
+
+  for (apos = 0; apos < alen; apos++) gaprow[apos] = '.';
+  for (k    = 1; k    <= M;   k++)    if (matuse[k]) gaprow[-1+matmap[k]] = '-';
+  gaprow[alen] = '\0';
+
+  rf.sq       = sq;
+  rf.premsa   = premsa;
+  rf.tr       = tr;
+  rf.inscount = inscount;
+  rf.matuse   = matuse;
+  rf.matmap   = matmap;
+  rf.M        = M;
+  rf.alen     = alen;
+  rf.optflags = optflags;
+  rf.gaprow   = gaprow;
+  rf.msa      = msa;
+  if ((status = fill_rows(&rf, nseq)) != eslOK) goto ERROR;
+
+  msa->nseq = nseq;
+  msa->alen = alen;
+  free(gaprow);
+  *ret_msa  = msa;
+  return eslOK;
+
+ ERROR:
+  if (msa    != NULL) esl_msa_Destroy(msa);
+  if (gaprow != NULL) free(gaprow);
+  *ret_msa = NULL;
+  return status;
+}
+
+
+/* make_text_rows()
+ * Fill rows <rf->idx0..rf->idx1-1> of a new text alignment,
+ * for make_text_msa().
+ */
+static int
+make_text_rows(ROWFILL *rf)
+{
+  ESL_SQ            **sq       = rf->sq;
+  const ESL_MSA      *premsa   = rf->premsa;
+  P7_TRACE          **tr       = rf->tr;
+  const int          *inscount = rf->inscount;
+  const int          *matuse   = rf->matuse;
+  const int          *matmap   = rf->matmap;
+  int                 M        = rf->M;
+  int                 alen     = rf->alen;
+  int                 optflags = rf->optflags;
+  const ESL_ALPHABET *abc      = (sq == NULL) ? premsa->abc : sq[0]->abc;
+  int          *rowins = NULL;	/* rowins[k=0..M]: # of symbols this row put in insert region k */
+  char         *aseq;
+  char         *pp;
   int           idx;
   int           apos;
   int           z;
   int           k;
   int           status;
 
-  if ((msa = esl_msa_Create(nseq, alen)) == NULL) { status = eslEMEM; goto ERROR; }
+  ESL_ALLOC(rowins, sizeof(int) * (M+1));
 
-  for (idx = 0; idx < nseq; idx++)
+  for (idx = rf->idx0; idx < rf->idx1; idx++)
     {
-      for (apos = 0; apos < alen; apos++) msa->aseq[idx][apos] = '.';
-      for (k    = 1; k    <= M;   k++)    if (matuse[k]) msa->aseq[idx][-1+matmap[k]] = '-';
-      msa->aseq[idx][apos] = '\0';
+      aseq = rf->msa->aseq[idx];
+      pp   = (rf->msa->pp == NULL ? NULL : rf->msa->pp[idx]);
+      memcpy(aseq, rf->gaprow, sizeof(char) * (alen+1));
+      if (pp) { memset(pp, '.', sizeof(char) * alen); pp[alen] = '\0'; }
+      esl_vec_ISet(rowins, M+1, 0);
 
       apos = 0;
       for (z = 0; z < tr[idx]->N; z++)
 	{
 	  switch (tr[idx]->st[z]) {
 	  case p7T_M:
-	    msa->aseq[idx][-1+matmap[tr[idx]->k[z]]] = toupper(abc->sym[get_dsq_z(sq, premsa, tr, idx, z)]);
+	    aseq[-1+matmap[tr[idx]->k[z]]] = toupper(abc->sym[get_dsq_z(sq, premsa, tr, idx, z)]);
+	    if (pp) pp[-1+matmap[tr[idx]->k[z]]] = p7_alidisplay_EncodePostProb(tr[idx]->pp[z]);
 	    apos = matmap[tr[idx]->k[z]]; /* i.e. one past the match column. remember, text mode is 0..alen-1 */
 	    break;
 
 	  case p7T_D:
 	    if (matuse[tr[idx]->k[z]]) /* bug #h77: if all column is deletes, do nothing; do NOT overwrite a column */
-	      msa->aseq[idx][-1+matmap[tr[idx]->k[z]]] = '-';  /* overwrites ~ in Dk column on X->Dk */
+	      aseq[-1+matmap[tr[idx]->k[z]]] = '-';  /* overwrites ~ in Dk column on X->Dk */
 	    apos = matmap[tr[idx]->k[z]];
 	    break;
 
 	  case p7T_I:
 	    if ( !(optflags & p7_TRIM) || (tr[idx]->k[z] != 0 && tr[idx]->k[z] != M)) {
-	      msa->aseq[idx][apos] = tolower(abc->sym[get_dsq_z(sq, premsa, tr, idx, z)]);
+	      aseq[apos] = tolower(abc->sym[get_dsq_z(sq, premsa, tr, idx, z)]);
+	      if (pp) pp[apos] = p7_alidisplay_EncodePostProb(tr[idx]->pp[z]);
+	      rowins[tr[idx]->k[z]]++;
 	      apos++;
 	    }
 	    break;
@@ -747,7 +949,9 @@ make_text_msa(ESL_SQ **sq, const ESL_MSA *premsa, P7_TRACE **tr, int nseq, const
 	  case p7T_N:
 	  case p7T_C:
 	    if (! (optflags & p7_TRIM) && tr[idx]->i[z] > 0) {
-	      msa->aseq[idx][apos] = tolower(abc->sym[get_dsq_z(sq, premsa, tr, idx, z)]);
+	      aseq[apos] = tolower(abc->sym[get_dsq_z(sq, premsa, tr, idx, z)]);
+	      if (pp) pp[apos] = p7_alidisplay_EncodePostProb(tr[idx]->pp[z]);
+	      rowins[tr[idx]->st[z] == p7T_N ? 0 : M]++;
 	      apos++;
 	    }
 	    break;
@@ -763,15 +967,15 @@ make_text_msa(ESL_SQ **sq, const ESL_MSA *premsa, P7_TRACE **tr, int nseq, const
 	    if (tr[idx]->st[z-1] == p7T_B)
 	      { /* B->X leader. This is a core trace and a fragment. Convert leading gaps to ~ */
 		for (apos = 0; apos < matmap[tr[idx]->k[z+1]]; apos++)
-		  msa->aseq[idx][apos] = '~';
+		  aseq[apos] = '~';
 		/* tricky; apos exactly where it must be for X->Ik; see comments in make_digital_msa() */
 	      }
 	    else if (tr[idx]->st[z+1] == p7T_E) 
 	      { /* X->E trailer. This is a core trace and a fragment. Convert trailing gaps to ~ */
 		for (;  apos < alen; apos++)
-		  msa->aseq[idx][apos] = '~';
+		  aseq[apos] = '~';
 	      }
-	    else ESL_XEXCEPTION(eslECORRUPT, "make_text_msa(): X state in unexpected position in trace"); 
+	    else ESL_XEXCEPTION(eslECORRUPT, "make_text_rows(): X state in unexpected position in trace"); 
 	 
 	    break;
 
@@ -779,18 +983,127 @@ make_text_msa(ESL_SQ **sq, const ESL_MSA *premsa, P7_TRACE **tr, int nseq, const
 	    break;
 	  }
 	}
+
+      for (k = 0; k < M; k++)
+	if (inscount[k] > 1 && rowins[k] > 0)
+	  rejustify_insert_text(abc, aseq, pp, matmap[k], -1+matmap[k+1]-matuse[k+1], (k == 0));
     }
-  msa->nseq = nseq;
-  msa->alen = alen;
-  *ret_msa  = msa;
+
+  free(rowins);
   return eslOK;
 
  ERROR:
-  if (msa != NULL) esl_msa_Destroy(msa);
-  *ret_msa = NULL;
+  if (rowins) free(rowins);
+  return status;
+}
+
+
+/* fill_rows()
+ * Fill all <nseq> rows of a new alignment, using the settings in 
+ * <proto> (all but its row range and status). With threads, a large
+ * alignment is cut into equal blocks of rows, one per worker;
+ * otherwise the rows are filled here, in one block.
+ */
+static int
+fill_rows(const ROWFILL *proto, int nseq)
+{
+  ROWFILL     *blk       = NULL;
+  int          nblk      = 1;
+#ifdef HMMER_THREADS
+  ESL_THREADS *threadObj = NULL;
+#endif
+  int          b;
+  int          status;
+
+#ifdef HMMER_THREADS
+  if (tracealign_ncpus > 1 && (int64_t) nseq * proto->alen >= TRACEALIGN_MINCELLS)
+    nblk = ESL_MIN(tracealign_ncpus, nseq);
+#endif
+  ESL_ALLOC(blk, sizeof(ROWFILL) * nblk);
+  for (b = 0; b < nblk; b++)
+    {
+      blk[b]        = *proto;
+      blk[b].idx0   = (int) ((int64_t) nseq * b     / nblk);
+      blk[b].idx1   = (int) ((int64_t) nseq * (b+1) / nblk);
+      blk[b].status = eslOK;
+    }
+
+  if (nblk == 1) 
+    status = (proto->optflags & p7_DIGITIZE) ? make_digital_rows(blk) : make_text_rows(blk);
+#ifdef HMMER_THREADS
+  else
+    {
+      if ((threadObj = esl_threads_Create(&fill_rows_thread)) == NULL) { status = eslEMEM; goto ERROR; }
+      for (b = 0; b < nblk; b++)
+	if ((status = esl_threads_AddThread(threadObj, &blk[b])) != eslOK) goto ERROR;
+      esl_threads_WaitForStart (threadObj);
+      esl_threads_WaitForFinish(threadObj);
+      esl_threads_Destroy(threadObj);
+      threadObj = NULL;
+
+      status = eslOK;
+      for (b = 0; b < nblk && status == eslOK; b++) status = blk[b].status;
+    }
+#endif
+
+  free(blk);
+  return status;
+
+ ERROR:
+#ifdef HMMER_THREADS
+  if (threadObj) { esl_threads_WaitForStart(threadObj); esl_threads_WaitForFinish(threadObj); esl_threads_Destroy(threadObj); }
+#endif
+  if (blk) free(blk);
   return status;
 }
 
+#ifdef HMMER_THREADS
+/* fill_rows_thread()
+ * Worker for fill_rows(): fill one block of rows.
+ */
+static void
+fill_rows_thread(void *arg)
+{
+  ESL_THREADS *obj = (ESL_THREADS *) arg;
+  ROWFILL     *rf;
+  int          workeridx;
+
+  esl_threads_Started(obj, &workeridx);
+  rf = (ROWFILL *) esl_threads_GetData(obj, workeridx);
+  rf->status = (rf->optflags & p7_DIGITIZE) ? make_digital_rows(rf) : make_text_rows(rf);
+  esl_threads_Finished(obj, workeridx);
+  return;
+}
+#endif /*HMMER_THREADS*/
+
+
+/* allocate_pp_rows()
+ * If any of the traces carry posterior probability annotation,
+ * allocate <msa->pp>, with a row <msa->pp[idx]> of <alen+1> for
+ * each trace that has it, and <NULL> for each one that doesn't.
+ * Otherwise leave <msa->pp> <NULL>. The rows are filled in by
+ * <make_digital_msa()> or <make_text_msa()>.
+ */
+static int
+allocate_pp_rows(ESL_MSA *msa, P7_TRACE **tr, int nseq, int alen)
+{
+  int idx;
+  int status;
+
+  for (idx = 0; idx < nseq; idx++)
+    if (tr[idx]->pp != NULL) break;
+  if (idx == nseq) return eslOK;
+
+  ESL_ALLOC(msa->pp, sizeof(char *) * msa->sqalloc);
+  for (idx = 0; idx < msa->sqalloc; idx++) msa->pp[idx] = NULL; /* nseq==sqalloc; following easel MSA conventions anyway */
+  for (idx = 0; idx < nseq; idx++)
+    if (tr[idx]->pp != NULL) 
+      ESL_ALLOC(msa->pp[idx], sizeof(char) * (alen+1));
+  return eslOK;
+
+ ERROR:
+  return status;   /* caller destroys the MSA, which frees what we allocated */
+}
 
 
 /* annotate_rf()
@@ -880,11 +1193,17 @@ annotate_mm(ESL_MSA *msa, P7_HMM * hmm, const int *matuse, const int *matmap)
   return status;
 }
 
-/* annotate_posterior_probability()
- * Synopsis:  Add posterior probability annotation lines to new MSA.
+/* annotate_pp_cons()
+ * Synopsis:  Add consensus posterior probability annotation line to new MSA.
+ *
+ * Purpose:   The per-sequence posterior probability lines <msa->pp[]>
+ *            were already filled in when the alignment rows were
+ *            made. Here, if there are any, average the posterior
+ *            probabilities of the residues in each match column to
+ *            make <msa->pp_cons>.
  */
 static int
-annotate_posterior_probability(ESL_MSA *msa, P7_TRACE **tr, const int *matmap, int M, int optflags)
+annotate_pp_cons(ESL_MSA *msa, P7_TRACE **tr, const int *matmap)
 {
   double *totp   = NULL;	/* total posterior probability in column <apos>: [0..alen-1] */
   int    *matuse = NULL;	/* #seqs with pp annotation in column <apos>: [0..alen-1] */
@@ -893,60 +1212,21 @@ annotate_posterior_probability(ESL_MSA *msa, P7_TRACE **tr, const int *matmap, i
   int     z;			/* counter over trace positions [0..tr->N-1] */
   int     status;
 
-  /* Determine if any of the traces have posterior probability annotation. */
-  for (idx = 0; idx < msa->nseq; idx++)
-    if (tr[idx]->pp != NULL) break;
-  if (idx == msa->nseq) return eslOK;
+  if (msa->pp == NULL) return eslOK;
 
-  ESL_ALLOC(matuse, sizeof(double) * (msa->alen)); esl_vec_ISet(matuse, msa->alen, 0);
+  ESL_ALLOC(matuse, sizeof(int)    * (msa->alen)); esl_vec_ISet(matuse, msa->alen, 0);
   ESL_ALLOC(totp,   sizeof(double) * (msa->alen)); esl_vec_DSet(totp,   msa->alen, 0.0);
 
-  ESL_ALLOC(msa->pp, sizeof(char *) * msa->sqalloc);
   for (idx = 0; idx < msa->nseq; idx++)
     {
-      if (tr[idx]->pp == NULL) { msa->pp[idx] = NULL; continue; }
-
-      ESL_ALLOC(msa->pp[idx], sizeof(char) * (msa->alen+1));
-      for (apos = 0; apos < msa->alen; apos++) msa->pp[idx][apos] = '.';
-      msa->pp[idx][msa->alen] = '\0';
-
-      apos = 0;
+      if (tr[idx]->pp == NULL) continue;
       for (z = 0; z < tr[idx]->N; z++)
-	{
-	  switch (tr[idx]->st[z]) {
-	  case p7T_M: 
-	    msa->pp[idx][matmap[tr[idx]->k[z]]-1] = p7_alidisplay_EncodePostProb(tr[idx]->pp[z]);  
+	if (tr[idx]->st[z] == p7T_M)
+	  {
 	    totp  [matmap[tr[idx]->k[z]]-1]+= tr[idx]->pp[z];
 	    matuse[matmap[tr[idx]->k[z]]-1]++;
-	  case p7T_D:
-	    apos = matmap[tr[idx]->k[z]]; 
-	    break;
-
-	  case p7T_I:
-	    if ( !(optflags & p7_TRIM) || (tr[idx]->k[z] != 0 && tr[idx]->k[z] != M)) {
-	      msa->pp[idx][apos] = p7_alidisplay_EncodePostProb(tr[idx]->pp[z]);  
-	      apos++;
-	    }
-	    break;
-
-	  case p7T_N:
-	  case p7T_C:
-	    if (! (optflags & p7_TRIM) && tr[idx]->i[z] > 0) {
-	      msa->pp[idx][apos] = p7_alidisplay_EncodePostProb(tr[idx]->pp[z]);
-	      apos++;
-	    }
-	    break;
-
-	  case p7T_E:
-	    apos = matmap[M];	/* set position for C-terminal tail */
-	    break;
-  
-	  default:
-	    break;
 	  }
-	}
     }
-  for (; idx < msa->sqalloc; idx++) msa->pp[idx] = NULL; /* for completeness, following easel MSA conventions, but should be a no-op: nseq==sqalloc */
 
   /* Consensus posterior probability annotation: only on match columns */
   ESL_ALLOC(msa->pp_cons, sizeof(char) * (msa->alen+1));
@@ -962,123 +1242,100 @@ annotate_posterior_probability(ESL_MSA *msa, P7_TRACE **tr, const int *matmap, i
  ERROR:
   if (matuse  != NULL) free(matuse);
   if (totp    != NULL) free(totp);  
-  if (msa->pp != NULL) esl_Free2D((void **) msa->pp, msa->sqalloc);
   return status;
 }
 
 
-/* Function:  rejustify_insertions_digital()
- * Synopsis:  
+/* Function:  rejustify_insert_digital()
+ * Synopsis:  Rejustify one insert region of one row of a digital alignment.
  * Incept:    SRE, Thu Oct 23 13:06:12 2008 [Janelia]
  *
- * Purpose:   
+ * Purpose:   The residues in an insertion are first placed left-justified
+ *            in the insert columns. Rejustify them so half of them stay
+ *            on the left and the other half are moved flush right, as in
+ *            HMMER2 (and so an N-terminal tail is entirely right-justified,
+ *            up against the first consensus column.) The posterior
+ *            probability annotation, if any, moves with the residues.
  *
- * Args:      msa -     alignment to rejustify
- *                      digital mode: ax[0..nseq-1][1..alen] and abc is valid
- *                      text mode:    aseq[0..nseq-1][0..alen-1]			
- *            inserts - # of inserted columns following node k, for k=0.1..M
- *                      inserts[0] is for N state; inserts[M] is for C state
- *            matmap  - index of column associated with node k [k=0.1..M; matmap[0] = 0]
- *                      this is an alignment column index 1..alen, same offset as <ax>
- *                      if applied to text mode aseq or annotation, remember to -1
- *                      if no residues use match state k, matmap[k] is the
- *                      index of the last column used before node k's columns
- *                      start: thus matmap[k]+1 is always the start of 
- *                      node k's insertion (if any).
- *            matuse  - TRUE if an alignment column is associated with node k: [k=0.1..M; matuse[0] = 0]. 
- *                      if matuse[k] == 0, every sequence deleted at node k,
- *                      and we're collapsing the column rather than showing all
- *                      gaps.
+ * Args:      abc      - digital alphabet
+ *            ax       - digital row to rejustify, ax[1..alen]
+ *            pp       - posterior probability annotation for the row, 
+ *                       pp[0..alen-1]; or <NULL> if none
+ *            lpos     - first column of the insert region, 1..alen
+ *            rpos     - last column of the insert region, 1..alen
+ *            is_nterm - TRUE if this is the N-terminal (node 0) insertion
  *                      
  * Note:      The insertion for node k is of length <inserts[k]> columns,
  *            and in 1..alen coords it runs from
- *            matmap[k]+1 .. matmap[k+1]-matuse[k+1].
- *            
- *
- * Returns:   
+ *            matmap[k]+1 .. matmap[k+1]-matuse[k+1], where
+ *            matuse[k+1] is FALSE if every sequence deleted node k+1, 
+ *            and that column was collapsed rather than shown as all
+ *            gaps.
  *
- * Throws:    (no abnormal error conditions)
- *
- * Xref:      
+ * Returns:   (void)
  */
-static int
-rejustify_insertions_digital(ESL_MSA *msa, const int *inserts, const int *matmap, const int *matuse, int M)
+static void
+rejustify_insert_digital(const ESL_ALPHABET *abc, ESL_DSQ *ax, char *pp, int lpos, int rpos, int is_nterm)
 {
-  int idx;
-  int k;
   int apos;
   int nins;
   int npos, opos;
 
-  for (idx = 0; idx < msa->nseq; idx++)
-    {
-      for (k = 0; k < M; k++)
-	if (inserts[k] > 1) 
-	  {
-	    for (nins = 0, apos = matmap[k]+1; apos <= matmap[k+1]-matuse[k+1]; apos++)
-	      if (esl_abc_XIsResidue(msa->abc, msa->ax[idx][apos])) nins++;
+  for (nins = 0, apos = lpos; apos <= rpos; apos++)
+    if (esl_abc_XIsResidue(abc, ax[apos])) nins++;
 
-	    if (k == 0) nins = 0;    /* N-terminus is right justified */
-	    else        nins /= 2;   /* split in half; nins now = # of residues left left-justified  */
+  if (is_nterm) nins = 0;    /* N-terminus is right justified */
+  else          nins /= 2;   /* split in half; nins now = # of residues left left-justified  */
 	    
-	    opos = npos = matmap[k+1]-matuse[k+1];
-	    while (opos >= matmap[k]+1+nins) {
-	      if (esl_abc_XIsGap(msa->abc, msa->ax[idx][opos])) opos--;
-	      else {
-		msa->ax[idx][npos] = msa->ax[idx][opos];
-		if (msa->pp != NULL && msa->pp[idx] != NULL) msa->pp[idx][npos-1] = msa->pp[idx][opos-1];
-		npos--;
-		opos--;
-	      }		
-	    }
-	    while (npos >= matmap[k]+1+nins) {
-	      msa->ax[idx][npos] = esl_abc_XGetGap(msa->abc);
-	      if (msa->pp != NULL && msa->pp[idx] != NULL) msa->pp[idx][npos-1] = '.';
-	      npos--;
-	    }
-	  }
-    }
-  return eslOK;
+  opos = npos = rpos;
+  while (opos >= lpos+nins) {
+    if (esl_abc_XIsGap(abc, ax[opos])) opos--;
+    else {
+      ax[npos] = ax[opos];
+      if (pp != NULL) pp[npos-1] = pp[opos-1];
+      npos--;
+      opos--;
+    }		
+  }
+  while (npos >= lpos+nins) {
+    ax[npos] = esl_abc_XGetGap(abc);
+    if (pp != NULL) pp[npos-1] = '.';
+    npos--;
+  }
 }
 
-static int
-rejustify_insertions_text(const ESL_ALPHABET *abc, ESL_MSA *msa, const int *inserts, const int *matmap, const int *matuse, int M)
+/* rejustify_insert_text()
+ * Same as rejustify_insert_digital(), for a text row aseq[0..alen-1],
+ * with <lpos>, <rpos> in 0..alen-1 coords.
+ */
+static void
+rejustify_insert_text(const ESL_ALPHABET *abc, char *aseq, char *pp, int lpos, int rpos, int is_nterm)
 {
-  int idx;
-  int k;
   int apos;
   int nins;
   int npos, opos;
 
-  for (idx = 0; idx < msa->nseq; idx++)
-    {
-      for (k = 0; k < M; k++)
-	if (inserts[k] > 1) 
-	  {
-	    for (nins = 0, apos = matmap[k]; apos < matmap[k+1]-matuse[k+1]; apos++)
-	      if (esl_abc_CIsResidue(abc, msa->aseq[idx][apos])) nins++;
+  for (nins = 0, apos = lpos; apos <= rpos; apos++)
+    if (esl_abc_CIsResidue(abc, aseq[apos])) nins++;
 
-	    if (k == 0) nins = 0;    /* N-terminus is right justified */
-	    else        nins /= 2;   /* split in half; nins now = # of residues left left-justified  */
+  if (is_nterm) nins = 0;    /* N-terminus is right justified */
+  else          nins /= 2;   /* split in half; nins now = # of residues left left-justified  */
 	    
-	    opos = npos = -1+matmap[k+1]-matuse[k+1];
-	    while (opos >= matmap[k]+nins) {
-	      if (esl_abc_CIsGap(abc, msa->aseq[idx][opos])) opos--;
-	      else {
-		msa->aseq[idx][npos] = msa->aseq[idx][opos];
-		if (msa->pp != NULL && msa->pp[idx] != NULL) msa->pp[idx][npos] = msa->pp[idx][opos];
-		npos--;
-		opos--;
-	      }		
-	    }
-	    while (npos >= matmap[k]+nins) {
-	      msa->aseq[idx][npos] = '.';
-	      if (msa->pp != NULL && msa->pp[idx] != NULL) msa->pp[idx][npos] = '.';
-	      npos--;
-	    }
-	  }
-    }
-  return eslOK;
+  opos = npos = rpos;
+  while (opos >= lpos+nins) {
+    if (esl_abc_CIsGap(abc, aseq[opos])) opos--;
+    else {
+      aseq[npos] = aseq[opos];
+      if (pp != NULL) pp[npos] = pp[opos];
+      npos--;
+      opos--;
+    }		
+  }
+  while (npos >= lpos+nins) {
+    aseq[npos] = '.';
+    if (pp != NULL) pp[npos] = '.';
+    npos--;
+  }
 }
 /*---------------- end, internal functions ----------------------*/
 
@@ -0,0 +1,125 @@
+#! /usr/bin/perl
+
+# Test of nhmmer --checkpoint: a search that is interrupted and then
+# resumed from its checkpoint file must give the same results as one
+# that ran straight through; and a checkpoint must not be resumed
+# with different search options.
+#
+# An interrupted run is simulated by truncating a complete checkpoint
+# file, part way into a record, as a killed process could leave it.
+# Targets are searched in several windows each (--block_length), and
+# a checkpoint records each window, so cuts fall part way through a
+# target. If nhmmer was built with threads, the same is done with
+# --cpu, where workers record windows out of order.
+#
+# Usage:   ./i21-nhmmer-checkpoint.pl <builddir> <srcdir> <tmpfile prefix>
+# Example: ./i21-nhmmer-checkpoint.pl ..         ..       tmpfoo
+
+BEGIN {
+    $builddir  = shift;
+    $srcdir    = shift;
+    $tmppfx    = shift;
+    $verbose   = shift;  # if arg not given, defaults to false (zero)
+}
+
+# The test makes use of the following file:
+#
+# 3box.sto              <msafile>  Single 3box alignment
+
+# It creates the following files:
+# $tmppfx.hmm           <hmm>     1 model, 3box
+# $tmppfx.fa            <seqdb>   13 seqs: 5 random 120Kb DNA seqs, and 8 sampled from $tmppfx.hmm, in two groups
+# $tmppfx.ckpt          <file>    nhmmer checkpoint
+# $tmppfx.out, .tbl     <output>  nhmmer output and tabular output, uninterrupted run
+# $tmppfx.out2, .tbl2   <output>  nhmmer output and tabular output, resumed run
+
+$alignment   = "3box.sto";
+
+@h3progs =  ( "hmmemit", "hmmbuild", "nhmmer");
+@eslprogs =  ("esl-shuffle");
+
+# Verify that we have all the executables and datafiles we need for the test.
+foreach $h3prog  (@h3progs)  { if (! -x "$builddir/src/$h3prog")              { die "FAIL: didn't find $h3prog executable in $builddir/src\n";              } }
+foreach $eslprog (@eslprogs) { if (! -x "$builddir/easel/miniapps/$eslprog")  { die "FAIL: didn't find $eslprog executable in $builddir/easel/miniapps\n";  } }
+
+if (! -r "$srcdir/testsuite/$alignment")  { die "FAIL: can't read msa $alignment in $srcdir/testsuite\n"; }
+
+# Create the test hmm and database; the hits are spread across the
+# database, so they come both from the checkpoint and from the resumed search.
+do_cmd ( "$builddir/src/hmmbuild $tmppfx.hmm $srcdir/testsuite/$alignment" );
+if ($? != 0) { die "FAIL: hmmbuild failed unexpectedly\n"; }
+do_cmd ( "$builddir/easel/miniapps/esl-shuffle --seed 11 --dna -G -N 3 -L 120000 >  $tmppfx.fa" );
+do_cmd ( "$builddir/src/hmmemit -N 4 --seed 4 $tmppfx.hmm                      >> $tmppfx.fa" );
+do_cmd ( "$builddir/easel/miniapps/esl-shuffle --seed 12 --dna -G -N 2 -L 120000 >> $tmppfx.fa" );
+do_cmd ( "$builddir/src/hmmemit -N 4 --seed 5 $tmppfx.hmm                      >> $tmppfx.fa" );
+
+$opts = "--block_length 50000";
+$threaded = (do_cmd("$builddir/src/nhmmer -h") =~ /--cpu/);
+
+# The uninterrupted search
+do_cmd ( "$builddir/src/nhmmer $opts --tblout $tmppfx.tbl $tmppfx.hmm $tmppfx.fa > $tmppfx.out" );
+if ($? != 0) { die "FAIL: nhmmer failed unexpectedly\n"; }
+$expect_out = results("$tmppfx.out");
+$expect_tbl = results("$tmppfx.tbl");
+if ($expect_tbl !~ /\S/) { die "FAIL: nhmmer found no hits to test with\n"; }
+
+# Checkpointed searches, cut short at different points and resumed
+@cpuopts = ("");
+if ($threaded) { @cpuopts = ("--cpu 0", "--cpu 2"); }
+foreach $cpu (@cpuopts)
+{
+    foreach $frac (0.3, 0.6, 0.9)
+    {
+	unlink "$tmppfx.ckpt";
+	do_cmd ( "$builddir/src/nhmmer $opts $cpu --checkpoint $tmppfx.ckpt $tmppfx.hmm $tmppfx.fa > /dev/null" );
+	if ($? != 0) { die "FAIL: nhmmer $cpu --checkpoint failed unexpectedly\n"; }
+	truncate("$tmppfx.ckpt", int((-s "$tmppfx.ckpt") * $frac)) || die "FAIL: couldn't truncate checkpoint file\n";
+
+	do_cmd ( "$builddir/src/nhmmer $opts $cpu --checkpoint $tmppfx.ckpt --tblout $tmppfx.tbl2 $tmppfx.hmm $tmppfx.fa > $tmppfx.out2" );
+	if ($? != 0) { die "FAIL: nhmmer $cpu failed to resume from checkpoint\n"; }
+	if (results("$tmppfx.out2") ne $expect_out) { die "FAIL: resumed nhmmer $cpu output differs (cut at $frac)\n"; }
+	if (results("$tmppfx.tbl2") ne $expect_tbl) { die "FAIL: resumed nhmmer $cpu tabular output differs (cut at $frac)\n"; }
+    }
+}
+
+# A checkpoint can't be resumed with different options
+do_cmd ( "$builddir/src/nhmmer $opts --checkpoint $tmppfx.ckpt -E 1 $tmppfx.hmm $tmppfx.fa 2>&1" );
+if ($? == 0) { die "FAIL: nhmmer resumed a checkpoint with different options\n"; }
+
+# nor can a threaded search resume a serial one's, which cuts targets into different windows
+if ($threaded) {
+    do_cmd ( "$builddir/src/nhmmer $opts --cpu 0 --checkpoint $tmppfx.ckpt $tmppfx.hmm $tmppfx.fa 2>&1" );
+    if ($? == 0) { die "FAIL: nhmmer resumed a threaded checkpoint serially\n"; }
+}
+
+print "ok.\n";
+unlink "$tmppfx.hmm";
+unlink "$tmppfx.fa";
+unlink "$tmppfx.ckpt";
+unlink "$tmppfx.out";
+unlink "$tmppfx.tbl";
+unlink "$tmppfx.out2";
+unlink "$tmppfx.tbl2";
+
+exit 0;
+
+
+sub do_cmd {
+    $cmd = shift;
+    print "$cmd\n" if $verbose;
+    return `$cmd`;
+}
+
+# The parts of an output file that should match between runs:
+# not comments or headers, nor timings.
+sub results {
+    my $file = shift;
+    my $text = "";
+    open(RESULTS, $file) || die "FAIL: couldn't open $file\n";
+    while (<RESULTS>) {
+	next if /^#/ || /CPU time/ || /Elapsed/ || /Mc\/sec/;
+	$text .= $_;
+    }
+    close RESULTS;
+    return $text;
+}
@@ -0,0 +1,83 @@
+#! /usr/bin/perl
+
+# Test of hmmalign --cpu: aligning with worker threads must give
+# exactly the same alignment as aligning serially, whatever the
+# number of workers, and with --trim and --mapali too.
+#
+# --cpu is only offered if hmmalign was built with threads; otherwise
+# there is nothing to compare, and the test passes.
+#
+# Usage:   ./i22-hmmalign-threads.pl <builddir> <srcdir> <tmpfile prefix>
+# Example: ./i22-hmmalign-threads.pl ..         ..       tmpfoo
+
+BEGIN {
+    $builddir  = shift;
+    $srcdir    = shift;
+    $tmppfx    = shift;
+    $verbose   = shift;  # if arg not given, defaults to false (zero)
+}
+
+# The test makes use of the following files:
+#
+# Caudal_act.hmm        <hmm>     Caudal_act model
+# Caudal_act.sto        <msafile> Caudal_act seed alignment, for --mapali
+
+# It creates the following files:
+# $tmppfx.fa            <seqfile> 500 seqs sampled from Caudal_act.hmm, some of them local
+# $tmppfx.sto           <msafile> serial alignment
+# $tmppfx.sto2          <msafile> threaded alignment
+
+@h3progs =  ( "hmmemit", "hmmalign");
+
+# Verify that we have all the executables and datafiles we need for the test.
+foreach $h3prog  (@h3progs)  { if (! -x "$builddir/src/$h3prog")              { die "FAIL: didn't find $h3prog executable in $builddir/src\n";              } }
+
+if (! -r "$srcdir/testsuite/Caudal_act.hmm")  { die "FAIL: can't read Caudal_act.hmm in $srcdir/testsuite\n"; }
+if (! -r "$srcdir/testsuite/Caudal_act.sto")  { die "FAIL: can't read Caudal_act.sto in $srcdir/testsuite\n"; }
+
+if (do_cmd("$builddir/src/hmmalign -h") !~ /--cpu/) { print "ok.\n"; exit 0; }
+
+# Enough sequences that each worker gets several blocks of them.
+do_cmd ( "$builddir/src/hmmemit    -N 300 --seed 7 $srcdir/testsuite/Caudal_act.hmm >  $tmppfx.fa" );
+if ($? != 0) { die "FAIL: hmmemit failed unexpectedly\n"; }
+do_cmd ( "$builddir/src/hmmemit -p -N 200 --seed 8 $srcdir/testsuite/Caudal_act.hmm >> $tmppfx.fa" );
+if ($? != 0) { die "FAIL: hmmemit failed unexpectedly\n"; }
+
+@alignopts = ("", "--trim", "--mapali $srcdir/testsuite/Caudal_act.sto");
+foreach $opts (@alignopts)
+{
+    do_cmd ( "$builddir/src/hmmalign $opts --cpu 0 -o $tmppfx.sto $srcdir/testsuite/Caudal_act.hmm $tmppfx.fa" );
+    if ($? != 0) { die "FAIL: hmmalign $opts --cpu 0 failed unexpectedly\n"; }
+    $expect = slurp("$tmppfx.sto");
+
+    # With no --cpu, HMMER_NCPU (if set) or the number of cores is used.
+    foreach $cpu ("--cpu 1", "--cpu 2", "--cpu 3", "--cpu 8", "")
+    {
+	do_cmd ( "$builddir/src/hmmalign $opts $cpu -o $tmppfx.sto2 $srcdir/testsuite/Caudal_act.hmm $tmppfx.fa" );
+	if ($? != 0) { die "FAIL: hmmalign $opts $cpu failed unexpectedly\n"; }
+	if (slurp("$tmppfx.sto2") ne $expect) { die "FAIL: hmmalign $opts $cpu alignment differs from serial\n"; }
+    }
+}
+
+print "ok.\n";
+unlink "$tmppfx.fa";
+unlink "$tmppfx.sto";
+unlink "$tmppfx.sto2";
+
+exit 0;
+
+
+sub do_cmd {
+    $cmd = shift;
+    print "$cmd\n" if $verbose;
+    return `$cmd`;
+}
+
+sub slurp {
+    my $file = shift;
+    my $text = "";
+    open(SLURP, $file) || die "FAIL: couldn't open $file\n";
+    while (<SLURP>) { $text .= $_; }
+    close SLURP;
+    return $text;
+}